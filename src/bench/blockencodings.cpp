@@ -0,0 +1,54 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const int MEMPOOL_TXS = 50000;
+static const int BLOCK_TXS = 2500;
+
+// Reconstruction of a compact block whose transactions are all among
+// MEMPOOL_TXS in the mempool, as on receipt from a high bandwidth peer.
+static void BlockEncodingsReconstruct(benchmark::State &state) {
+  CTxMemPool pool;
+  CBlock block;
+  CMutableTransaction coinbase;
+  coinbase.vin.resize(1);
+  coinbase.vin[0].prevout.SetNull();
+  coinbase.vout.resize(1);
+  block.vtx.push_back(MakeTransactionRef(coinbase));
+  block.nBits = 0x207fffff;
+
+  LockPoints lp;
+  for (int i = 0; i < MEMPOOL_TXS; i++) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(uint256(), i);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = COIN;
+    CTransactionRef txref = MakeTransactionRef(tx);
+    LOCK(pool.cs);
+    pool.addUnchecked(txref->GetHash(),
+                      CTxMemPoolEntry(txref, 1000, 0, 1, false, 4, lp));
+    if (i % (MEMPOOL_TXS / BLOCK_TXS) == 0)
+      block.vtx.push_back(txref);
+  }
+  CBlockHeaderAndShortTxIDs cmpctblock(block, false);
+  std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+  while (state.KeepRunning()) {
+    PartiallyDownloadedBlock partial(&pool);
+    bool fOk = partial.InitData(cmpctblock, extra_txn) == READ_STATUS_OK &&
+               partial.IsTxAvailable(BLOCK_TXS);
+    assert(fOk);
+  }
+}
+
+BENCHMARK(BlockEncodingsReconstruct, 50);
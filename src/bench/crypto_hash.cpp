@@ -3,6 +3,7 @@
 
 #include <bench/bench.h>
 #include <bloom.h>
+#include <consensus/merkle.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -35,6 +36,24 @@ static void SHA256(benchmark::State &state) {
     CSHA256().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void SHA256D64_1024(benchmark::State &state) {
+  std::vector<uint8_t> in(64 * 1024, 0);
+  while (state.KeepRunning())
+    SHA256D64(in.data(), in.data(), 1024);
+}
+
+static void MerkleRoot(benchmark::State &state) {
+  FastRandomContext rng(true);
+  std::vector<uint256> leaves(9001);
+  for (auto &item : leaves)
+    item = rng.rand256();
+  while (state.KeepRunning()) {
+    bool mutation = false;
+    uint256 hash = ComputeMerkleRoot(leaves, &mutation);
+    leaves[mutation] = hash;
+  }
+}
+
 static void SHA256_32b(benchmark::State &state) {
   std::vector<uint8_t> in(32, 0);
   while (state.KeepRunning()) {
@@ -79,6 +98,8 @@ BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(MerkleRoot, 800);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -0,0 +1,112 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <boost/thread/thread.hpp>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <keystore.h>
+#include <policy/policy.h>
+#include <script/interpreter.h>
+#include <script/sigcache.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <util.h>
+#include <validation.h>
+
+#include <vector>
+
+bool CheckInputs(const CTransaction &tx, CValidationState &state,
+                 const CCoinsViewCache &inputs, bool fScriptChecks,
+                 unsigned int flags, bool cacheSigStore,
+                 bool cacheFullScriptStore, PrecomputedTransactionData &txdata,
+                 std::vector<CScriptCheck> *pvChecks);
+
+static const int MIN_CORES = 2;
+static const unsigned int SPEND_INPUTS = 500;
+
+// Signs a transaction spending SPEND_INPUTS P2PKH outputs held in view.
+static CTransactionRef MakeWideSpend(CCoinsViewCache &view) {
+  static bool fCachesReady = false;
+  if (!fCachesReady) {
+    InitSignatureCache();
+    InitScriptExecutionCache();
+    fCachesReady = true;
+  }
+
+  CBasicKeyStore keystore;
+  CKey key;
+  key.MakeNewKey(true);
+  keystore.AddKey(key);
+  CScript scriptPubKey =
+      GetScriptForDestination(CTxDestination(key.GetPubKey().GetID()));
+
+  CMutableTransaction txFund;
+  txFund.vin.resize(1);
+  txFund.vin[0].prevout.SetNull();
+  txFund.vout.resize(SPEND_INPUTS);
+  for (CTxOut &txout : txFund.vout) {
+    txout.scriptPubKey = scriptPubKey;
+    txout.nValue = COIN;
+  }
+  AddCoins(view, CTransaction(txFund), 1);
+
+  CMutableTransaction txSpend;
+  txSpend.vin.resize(SPEND_INPUTS);
+  for (unsigned int i = 0; i < SPEND_INPUTS; i++) {
+    txSpend.vin[i].prevout = COutPoint(txFund.GetHash(), i);
+  }
+  txSpend.vout.resize(1);
+  txSpend.vout[0].scriptPubKey = scriptPubKey;
+  txSpend.vout[0].nValue = SPEND_INPUTS * COIN - 10000;
+  for (unsigned int i = 0; i < SPEND_INPUTS; i++) {
+    bool fSigned = SignSignature(keystore, CTransaction(txFund), txSpend, i,
+                                 SIGHASH_ALL);
+    assert(fSigned);
+  }
+  return MakeTransactionRef(txSpend);
+}
+
+static void MempoolScriptCheckSerial(benchmark::State &state) {
+  CCoinsView viewDummy;
+  CCoinsViewCache view(&viewDummy);
+  CTransactionRef tx = MakeWideSpend(view);
+
+  LOCK(cs_main);
+  while (state.KeepRunning()) {
+    CValidationState valState;
+    PrecomputedTransactionData txdata(*tx);
+    bool fValid = CheckInputs(*tx, valState, view, true,
+                              STANDARD_SCRIPT_VERIFY_FLAGS, false, false,
+                              txdata, nullptr);
+    assert(fValid);
+  }
+}
+
+static void MempoolScriptCheckParallel(benchmark::State &state) {
+  CCoinsView viewDummy;
+  CCoinsViewCache view(&viewDummy);
+  CTransactionRef tx = MakeWideSpend(view);
+
+  boost::thread_group tg;
+  for (int i = 0; i < std::max(MIN_CORES, GetNumCores()) - 1; i++) {
+    tg.create_thread(&ThreadScriptCheck);
+  }
+
+  {
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+      PrecomputedTransactionData txdata(*tx);
+      bool fValid = CheckInputScriptsParallel(
+          *tx, view, STANDARD_SCRIPT_VERIFY_FLAGS, false, txdata);
+      assert(fValid);
+    }
+  }
+  tg.interrupt_all();
+  tg.join_all();
+}
+
+BENCHMARK(MempoolScriptCheckSerial, 5);
+BENCHMARK(MempoolScriptCheckParallel, 5);
@@ -0,0 +1,115 @@
+// Copyright (c) 2011-2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static void AddTx(const CTransactionRef &tx, const CAmount &nFee,
+                  CTxMemPool &pool) {
+  int64_t nTime = 0;
+  unsigned int nHeight = 1;
+  bool spendsCoinbase = false;
+  unsigned int sigOpCost = 4;
+  LockPoints lp;
+  pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, nFee, nTime, nHeight,
+                                                   spendsCoinbase, sigOpCost,
+                                                   lp));
+}
+
+static CTransactionRef MakeTx(const std::vector<COutPoint> &vPrevouts,
+                              int nOutputs) {
+  CMutableTransaction tx;
+  tx.vin.resize(vPrevouts.size());
+  for (size_t i = 0; i < vPrevouts.size(); i++) {
+    tx.vin[i].prevout = vPrevouts[i];
+    tx.vin[i].scriptSig = CScript() << OP_1;
+  }
+  tx.vout.resize(nOutputs);
+  for (CTxOut &txout : tx.vout) {
+    txout.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txout.nValue = COIN;
+  }
+  return MakeTransactionRef(tx);
+}
+
+static void MempoolAncestorChain(benchmark::State &state) {
+  const int nDepth = 200;
+
+  std::vector<CTransactionRef> vChain;
+  COutPoint prevout(uint256S("01"), 0);
+  for (int i = 0; i < nDepth; i++) {
+    vChain.push_back(MakeTx({prevout}, 1));
+    prevout = COutPoint(vChain.back()->GetHash(), 0);
+  }
+
+  while (state.KeepRunning()) {
+    CTxMemPool pool;
+    for (const CTransactionRef &tx : vChain) {
+      AddTx(tx, 1000LL, pool);
+    }
+    for (const CTransactionRef &tx : vChain) {
+      pool.removeForBlock({tx}, 1);
+    }
+  }
+}
+
+static void MempoolWideFanout(benchmark::State &state) {
+  const int nWidth = 1000;
+
+  CTransactionRef parent = MakeTx({COutPoint(uint256S("02"), 0)}, nWidth);
+  std::vector<CTransactionRef> vChildren;
+  std::vector<COutPoint> vPrevouts;
+  for (int i = 0; i < nWidth; i++) {
+    vChildren.push_back(MakeTx({COutPoint(parent->GetHash(), i)}, 1));
+    vPrevouts.emplace_back(vChildren.back()->GetHash(), 0);
+  }
+  CTransactionRef sweep = MakeTx(vPrevouts, 1);
+
+  while (state.KeepRunning()) {
+    CTxMemPool pool;
+    AddTx(parent, 1000LL, pool);
+    for (const CTransactionRef &tx : vChildren) {
+      AddTx(tx, 1000LL, pool);
+    }
+    AddTx(sweep, 1000LL, pool);
+    pool.PrioritiseTransaction(parent->GetHash(), 1000LL);
+    pool.removeForBlock({parent}, 1);
+    pool.TrimToSize(0);
+  }
+}
+
+static void MempoolMiningOrder(benchmark::State &state) {
+  const int nClusters = 2000;
+
+  CTxMemPool pool;
+  std::vector<CTransactionRef> vParents;
+  for (int i = 0; i < nClusters; i++) {
+    CTransactionRef parent = MakeTx({COutPoint(uint256S("03"), i)}, 2);
+    AddTx(parent, 1000LL + i % 100, pool);
+    AddTx(MakeTx({COutPoint(parent->GetHash(), 0)}, 1), 5000LL, pool);
+    AddTx(MakeTx({COutPoint(parent->GetHash(), 1)}, 1), 100LL, pool);
+    vParents.push_back(parent);
+  }
+
+  LOCK(pool.cs);
+  pool.UpdateMiningOrder();
+  int nPrioritised = 0;
+  while (state.KeepRunning()) {
+    pool.PrioritiseTransaction(vParents[nPrioritised++ % nClusters]->GetHash(),
+                               100LL);
+    pool.UpdateMiningOrder();
+    int64_t nSize = 0;
+    for (const CTxMemPool::MiningChunk *chunk : pool.GetMiningOrder()) {
+      nSize += chunk->nSize;
+    }
+    assert(nSize == (int64_t)pool.GetTotalTxSize());
+  }
+}
+
+BENCHMARK(MempoolAncestorChain, 30);
+BENCHMARK(MempoolWideFanout, 80);
+BENCHMARK(MempoolMiningOrder, 500);
@@ -0,0 +1,68 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <txmempool.h>
+
+#include <deque>
+#include <vector>
+
+static std::vector<CTxMemPoolEntry>
+TrackBatch(CBlockPolicyEstimator &estimator,
+           const std::vector<CTransactionRef> &vBatch, unsigned int nHeight) {
+  std::vector<CTxMemPoolEntry> vEntries;
+  vEntries.reserve(vBatch.size());
+  LockPoints lp;
+  for (size_t i = 0; i < vBatch.size(); i++) {
+    CAmount nFee = 200 + (i * 7919) % 20000;
+    vEntries.emplace_back(vBatch[i], nFee, 0, nHeight, false, 4, lp);
+    estimator.processTransaction(vEntries.back(), true);
+  }
+  return vEntries;
+}
+
+static void PolicyEstimatorProcessBlock(benchmark::State &state) {
+  const int nBatches = 10;
+  const int nBatchSize = 500;
+
+  std::vector<std::vector<CTransactionRef>> vBatches(nBatches);
+  for (int b = 0; b < nBatches; b++) {
+    for (int i = 0; i < nBatchSize; i++) {
+      CMutableTransaction tx;
+      tx.vin.resize(1);
+      tx.vin[0].prevout = COutPoint(uint256S("04"), b * nBatchSize + i);
+      tx.vin[0].scriptSig = CScript() << OP_1;
+      tx.vout.resize(1);
+      tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+      tx.vout[0].nValue = COIN;
+      vBatches[b].push_back(MakeTransactionRef(tx));
+    }
+  }
+
+  CBlockPolicyEstimator estimator;
+  std::vector<const CTxMemPoolEntry *> vNoEntries;
+  unsigned int nHeight = 1;
+  estimator.processBlock(nHeight, vNoEntries);
+
+  std::deque<std::vector<CTxMemPoolEntry>> pending;
+  for (int b = 0; b < nBatches; b++) {
+    pending.push_back(TrackBatch(estimator, vBatches[b], nHeight));
+  }
+
+  int nNext = 0;
+  while (state.KeepRunning()) {
+    std::vector<CTxMemPoolEntry> vMined = std::move(pending.front());
+    pending.pop_front();
+    std::vector<const CTxMemPoolEntry *> vEntries;
+    for (const CTxMemPoolEntry &entry : vMined) {
+      vEntries.push_back(&entry);
+    }
+    estimator.processBlock(++nHeight, vEntries);
+    pending.push_back(
+        TrackBatch(estimator, vBatches[nNext++ % nBatches], nHeight));
+  }
+}
+
+BENCHMARK(PolicyEstimatorProcessBlock, 100);
@@ -0,0 +1,117 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <netbase.h>
+#include <random.h>
+#include <socketevents.h>
+#include <util.h>
+
+#include <vector>
+
+// Peers written to per round, out of all connected ones.
+static const int ACTIVE_PEERS = 20;
+
+struct LoopbackPeers {
+  std::vector<SOCKET> vLocal;
+  std::vector<SOCKET> vRemote;
+
+  explicit LoopbackPeers(int nPeers) {
+    SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bool fListening =
+        bind(hListen, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        getsockname(hListen, (struct sockaddr *)&addr, &len) == 0 &&
+        listen(hListen, SOMAXCONN) == 0;
+    assert(fListening);
+
+    for (int i = 0; i < nPeers; i++) {
+      SOCKET hRemote = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      if (hRemote == INVALID_SOCKET)
+        break;
+      if (connect(hRemote, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        CloseSocket(hRemote);
+        break;
+      }
+      SOCKET hLocal = accept(hListen, nullptr, nullptr);
+      assert(hLocal != INVALID_SOCKET);
+      SetSocketNonBlocking(hLocal, true);
+      vLocal.push_back(hLocal);
+      vRemote.push_back(hRemote);
+    }
+    CloseSocket(hListen);
+  }
+
+  ~LoopbackPeers() {
+    for (SOCKET &hSocket : vLocal)
+      CloseSocket(hSocket);
+    for (SOCKET &hSocket : vRemote)
+      CloseSocket(hSocket);
+  }
+};
+
+// One socket handler round trip per iteration: a few peers send a byte, the
+// backend reports them and they are read until they would block.
+static void SocketEventsRounds(benchmark::State &state,
+                               const std::string &strMode, int nPeers) {
+  RaiseFileDescriptorLimit(2 * nPeers + 64);
+  std::unique_ptr<SocketEvents> events = MakeSocketEvents(strMode);
+  assert(events);
+  LoopbackPeers peers(nPeers);
+  nPeers = peers.vLocal.size();
+  assert(nPeers >= ACTIVE_PEERS);
+  for (SOCKET hSocket : peers.vLocal)
+    assert(events->CanWatch(hSocket));
+
+  FastRandomContext rng(true);
+  while (state.KeepRunning()) {
+    for (int i = 0; i < ACTIVE_PEERS; i++) {
+      char c = 0;
+      send(peers.vRemote[rng.randrange(nPeers)], &c, 1, 0);
+    }
+
+    int nReceived = 0;
+    while (nReceived < ACTIVE_PEERS) {
+      for (int i = 0; i < nPeers; i++) {
+        events->Watch(i, peers.vLocal[i], SOCKET_EVENT_RECV);
+      }
+      SocketEventsReady ready;
+      bool fOk = events->Wait(1000, ready);
+      assert(fOk);
+      for (const auto &it : ready) {
+        char pchBuf[64];
+        int nBytes;
+        while ((nBytes = recv(peers.vLocal[it.first], pchBuf, sizeof(pchBuf),
+                              0)) > 0) {
+          nReceived += nBytes;
+        }
+        events->Drained(it.first, SOCKET_EVENT_RECV);
+      }
+    }
+  }
+}
+
+static void SocketEventsSelect400(benchmark::State &state) {
+  SocketEventsRounds(state, "select", 400);
+}
+
+#ifdef USE_EPOLL
+static void SocketEventsEpoll400(benchmark::State &state) {
+  SocketEventsRounds(state, "epoll", 400);
+}
+
+static void SocketEventsEpoll4000(benchmark::State &state) {
+  SocketEventsRounds(state, "epoll", 4000);
+}
+#endif
+
+BENCHMARK(SocketEventsSelect400, 100);
+#ifdef USE_EPOLL
+BENCHMARK(SocketEventsEpoll400, 100);
+BENCHMARK(SocketEventsEpoll4000, 100);
+#endif
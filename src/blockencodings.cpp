@@ -13,7 +13,73 @@
 #include <util.h>
 #include <validation.h>
 
-#include <unordered_map>
+#include <vector>
+
+// Mempool hashes whose short ids are computed together.
+static const size_t SHORTID_BATCH_SIZE = 64;
+
+// Short ids are 48 bits, so this never is one.
+static const uint64_t SHORTID_EMPTY = ~uint64_t(0);
+
+namespace {
+/** Open addressing map from short ids to block positions. Short ids are
+ * picked by the sender, so slots come from a salted multiply and a long probe
+ * sequence, which only a crafted collision produces, is refused. */
+class ShortIdTable {
+public:
+  static const size_t MAX_PROBE = 64;
+
+  ShortIdTable(size_t nEntries, uint64_t nSalt)
+      : nMultiplier(nSalt | 1), nShift(64) {
+    size_t nSlots = 1;
+    while (nSlots < 2 * nEntries) {
+      nSlots <<= 1;
+      nShift--;
+    }
+    vKeys.assign(nSlots, SHORTID_EMPTY);
+    vIndex.resize(nSlots);
+  }
+
+  /** Fails if shortid is already present or lands too far from its slot. */
+  bool Insert(uint64_t shortid, uint16_t index) {
+    size_t nMask = vKeys.size() - 1;
+    size_t nSlot = Slot(shortid);
+    for (size_t nProbe = 0; nProbe < MAX_PROBE; nProbe++) {
+      uint64_t &key = vKeys[nSlot];
+      if (key == shortid)
+        return false;
+      if (key == SHORTID_EMPTY) {
+        key = shortid;
+        vIndex[nSlot] = index;
+        return true;
+      }
+      nSlot = (nSlot + 1) & nMask;
+    }
+    return false;
+  }
+
+  /** Block position of shortid, or -1. */
+  int32_t Find(uint64_t shortid) const {
+    size_t nMask = vKeys.size() - 1;
+    for (size_t nSlot = Slot(shortid);; nSlot = (nSlot + 1) & nMask) {
+      if (vKeys[nSlot] == shortid)
+        return vIndex[nSlot];
+      if (vKeys[nSlot] == SHORTID_EMPTY)
+        return -1;
+    }
+  }
+
+private:
+  uint64_t nMultiplier;
+  int nShift;
+  std::vector<uint64_t> vKeys;
+  std::vector<uint16_t> vIndex;
+
+  size_t Slot(uint64_t shortid) const {
+    return nShift == 64 ? 0 : (shortid * nMultiplier) >> nShift;
+  }
+};
+} // namespace
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block,
                                                      bool fUseWTXID)
@@ -47,6 +113,13 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256 &txhash) const {
   return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256 *const *txhashes,
+                                            size_t n, uint64_t *out) const {
+  SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, n, out);
+  for (size_t i = 0; i < n; i++)
+    out[i] &= 0xffffffffffffL;
+}
+
 ReadStatus PartiallyDownloadedBlock::InitData(
     const CBlockHeaderAndShortTxIDs &cmpctblock,
     const std::vector<std::pair<uint256, CTransactionRef>> &extra_txn) {
@@ -77,71 +150,73 @@ ReadStatus PartiallyDownloadedBlock::InitData(
   }
   prefilled_count = cmpctblock.prefilledtxn.size();
 
-  std::unordered_map<uint64_t, uint16_t> shorttxids(
-      cmpctblock.shorttxids.size());
+  ShortIdTable shorttxids(cmpctblock.shorttxids.size(),
+                          GetRand(std::numeric_limits<uint64_t>::max()));
   uint16_t index_offset = 0;
   for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
     while (txn_available[i + index_offset])
       index_offset++;
-    shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-
-    if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) >
-        12)
+    if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
       return READ_STATUS_FAILED;
   }
-
-  if (shorttxids.size() != cmpctblock.shorttxids.size())
-    return READ_STATUS_FAILED;
+  const size_t shorttxids_count = cmpctblock.shorttxids.size();
 
   std::vector<bool> have_txn(txn_available.size());
   {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter>> &vTxHashes =
         pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-      uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-      std::unordered_map<uint64_t, uint16_t>::iterator idit =
-          shorttxids.find(shortid);
-      if (idit != shorttxids.end()) {
-        if (!have_txn[idit->second]) {
-          txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-          have_txn[idit->second] = true;
-          mempool_count++;
-        } else {
-          if (txn_available[idit->second]) {
-            txn_available[idit->second].reset();
-            mempool_count--;
+    const uint256 *batch_hashes[SHORTID_BATCH_SIZE];
+    uint64_t batch_shortids[SHORTID_BATCH_SIZE];
+    for (size_t start = 0;
+         start < vTxHashes.size() && mempool_count != shorttxids_count;
+         start += SHORTID_BATCH_SIZE) {
+      size_t count = std::min(SHORTID_BATCH_SIZE, vTxHashes.size() - start);
+      for (size_t j = 0; j < count; j++)
+        batch_hashes[j] = &vTxHashes[start + j].first;
+      cmpctblock.GetShortIDs(batch_hashes, count, batch_shortids);
+
+      for (size_t j = 0; j < count; j++) {
+        int32_t idx = shorttxids.Find(batch_shortids[j]);
+        if (idx >= 0) {
+          if (!have_txn[idx]) {
+            txn_available[idx] = vTxHashes[start + j].second->GetSharedTx();
+            have_txn[idx] = true;
+            mempool_count++;
+          } else {
+            if (txn_available[idx]) {
+              txn_available[idx].reset();
+              mempool_count--;
+            }
           }
         }
-      }
 
-      if (mempool_count == shorttxids.size())
-        break;
+        if (mempool_count == shorttxids_count)
+          break;
+      }
     }
   }
 
   for (size_t i = 0; i < extra_txn.size(); i++) {
-    uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-    std::unordered_map<uint64_t, uint16_t>::iterator idit =
-        shorttxids.find(shortid);
-    if (idit != shorttxids.end()) {
-      if (!have_txn[idit->second]) {
-        txn_available[idit->second] = extra_txn[i].second;
-        have_txn[idit->second] = true;
+    int32_t idx = shorttxids.Find(cmpctblock.GetShortID(extra_txn[i].first));
+    if (idx >= 0) {
+      if (!have_txn[idx]) {
+        txn_available[idx] = extra_txn[i].second;
+        have_txn[idx] = true;
         mempool_count++;
         extra_count++;
       } else {
-        if (txn_available[idit->second] &&
-            txn_available[idit->second]->GetWitnessHash() !=
+        if (txn_available[idx] &&
+            txn_available[idx]->GetWitnessHash() !=
                 extra_txn[i].second->GetWitnessHash()) {
-          txn_available[idit->second].reset();
+          txn_available[idx].reset();
           mempool_count--;
           extra_count--;
         }
       }
     }
 
-    if (mempool_count == shorttxids.size())
+    if (mempool_count == shorttxids_count)
       break;
   }
 
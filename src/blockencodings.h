@@ -150,6 +150,9 @@ public:
 
   uint64_t GetShortID(const uint256 &txhash) const;
 
+  void GetShortIDs(const uint256 *const *txhashes, size_t n,
+                   uint64_t *out) const;
+
   size_t BlockTxCount() const {
     return shorttxids.size() + prefilledtxn.size();
   }
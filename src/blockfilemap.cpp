@@ -0,0 +1,111 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <util.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockFileMapCache g_blockfile_mmap;
+
+CMappedFile::~CMappedFile() { Close(); }
+
+bool CMappedFile::Open(const fs::path &path) {
+  Close();
+#ifdef WIN32
+  return false;
+#else
+  int fd = ::open(path.string().c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void *addr =
+      mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    LogPrintf("Unable to map file %s: %s\n", path.string(), strerror(errno));
+    return false;
+  }
+  pdata = static_cast<unsigned char *>(addr);
+  nLength = (size_t)st.st_size;
+  return true;
+#endif
+}
+
+void CMappedFile::Close() {
+#ifndef WIN32
+  if (pdata)
+    munmap(pdata, nLength);
+#endif
+  pdata = nullptr;
+  nLength = 0;
+}
+
+void CBlockFileMapCache::SetMaxFiles(size_t nMaxFilesIn) {
+  LOCK(cs);
+  nMaxFiles = nMaxFilesIn;
+  while (lru.size() > nMaxFiles)
+    lru.pop_back();
+}
+
+std::shared_ptr<const CMappedFile>
+CBlockFileMapCache::Get(int nFile, const fs::path &path, uint64_t nOffset,
+                        uint64_t nBytes) {
+  LOCK(cs);
+  if (nMaxFiles == 0)
+    return nullptr;
+
+  for (auto it = lru.begin(); it != lru.end(); ++it) {
+    if (it->first != nFile)
+      continue;
+    if (it->second->Contains(nOffset, nBytes)) {
+      lru.splice(lru.begin(), lru, it);
+      return lru.front().second;
+    }
+    lru.erase(it);
+    break;
+  }
+
+  std::shared_ptr<CMappedFile> mapping = std::make_shared<CMappedFile>();
+  if (!mapping->Open(path))
+    return nullptr;
+
+  lru.emplace_front(nFile, mapping);
+  while (lru.size() > nMaxFiles)
+    lru.pop_back();
+
+  if (!mapping->Contains(nOffset, nBytes))
+    return nullptr;
+  return mapping;
+}
+
+void CBlockFileMapCache::Erase(int nFile) {
+  LOCK(cs);
+  for (auto it = lru.begin(); it != lru.end(); ++it) {
+    if (it->first == nFile) {
+      lru.erase(it);
+      return;
+    }
+  }
+}
+
+void CBlockFileMapCache::Clear() {
+  LOCK(cs);
+  lru.clear();
+}
+
+size_t CBlockFileMapCache::Size() const {
+  LOCK(cs);
+  return lru.size();
+}
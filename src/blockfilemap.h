@@ -0,0 +1,72 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+static const int DEFAULT_BLOCKFILE_MMAP = 0;
+
+static const int MAX_BLOCKFILE_MMAP = 64;
+
+class CMappedFile {
+public:
+  CMappedFile() : pdata(nullptr), nLength(0) {}
+  ~CMappedFile();
+
+  CMappedFile(const CMappedFile &) = delete;
+  CMappedFile &operator=(const CMappedFile &) = delete;
+
+  bool Open(const fs::path &path);
+  void Close();
+
+  bool IsNull() const { return pdata == nullptr; }
+  const unsigned char *data() const { return pdata; }
+  size_t size() const { return nLength; }
+
+  bool Contains(uint64_t nOffset, uint64_t nBytes) const {
+    return nOffset <= nLength && nBytes <= nLength - nOffset;
+  }
+
+private:
+  unsigned char *pdata;
+  size_t nLength;
+};
+
+class CBlockFileMapCache {
+public:
+  explicit CBlockFileMapCache(size_t nMaxFilesIn = 0)
+      : nMaxFiles(nMaxFilesIn) {}
+
+  void SetMaxFiles(size_t nMaxFilesIn);
+  size_t GetMaxFiles() const { return nMaxFiles; }
+  bool IsEnabled() const { return nMaxFiles > 0; }
+
+  std::shared_ptr<const CMappedFile> Get(int nFile, const fs::path &path,
+                                         uint64_t nOffset, uint64_t nBytes);
+
+  void Erase(int nFile);
+  void Clear();
+  size_t Size() const;
+
+private:
+  typedef std::pair<int, std::shared_ptr<const CMappedFile>> entry_type;
+
+  mutable CCriticalSection cs;
+  std::atomic<size_t> nMaxFiles;
+  std::list<entry_type> lru;
+};
+
+extern CBlockFileMapCache g_blockfile_mmap;
+
+#endif
@@ -0,0 +1,215 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockimport.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <protocol.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+int nImportThreads = 0;
+
+CBlockImportPipeline::CBlockImportPipeline(const CChainParams &chainparamsIn,
+                                           FILE *fileIn, int nWorkersIn)
+    : chainparams(chainparamsIn),
+      blkdat(fileIn, 2 * MAX_BLOCK_SERIALIZED_SIZE,
+             MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION),
+      nRewind(0), nWorkers(std::max(nWorkersIn, 0)),
+      nMaxInFlight(std::max(nWorkersIn, 1) * IMPORT_BLOCKS_PER_THREAD),
+      nHeightHint(0), fReaderDone(false), nGeneration(0), nRescanPos(0),
+      fStop(false) {
+  nRewind = blkdat.GetPos();
+  if (nWorkers == 0)
+    return;
+
+  threads.emplace_back(&CBlockImportPipeline::ThreadRead, this);
+  for (int i = 0; i < nWorkers; i++)
+    threads.emplace_back(&CBlockImportPipeline::ThreadWork, this);
+}
+
+CBlockImportPipeline::~CBlockImportPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(mut);
+    fStop = true;
+  }
+  condWorker.notify_all();
+  condReader.notify_all();
+  condResult.notify_all();
+  for (std::thread &t : threads)
+    t.join();
+}
+
+bool CBlockImportPipeline::ReadNextFrame(uint64_t &nBlockPos,
+                                         std::vector<unsigned char> &vData) {
+  while (!fStop) {
+    if (!blkdat.SetPos(nRewind) && !blkdat.Seek(nRewind))
+      return false;
+    if (blkdat.eof())
+      return false;
+    nRewind++;
+
+    blkdat.SetLimit();
+
+    unsigned int nSize = 0;
+    try {
+      unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+      blkdat.FindByte(chainparams.MessageStart()[0]);
+      nRewind = blkdat.GetPos() + 1;
+      blkdat >> FLATDATA(buf);
+      if (memcmp(buf, chainparams.MessageStart(),
+                 CMessageHeader::MESSAGE_START_SIZE))
+        continue;
+
+      blkdat >> nSize;
+      if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        continue;
+    } catch (const std::exception &) {
+      return false;
+    }
+    try {
+      nBlockPos = blkdat.GetPos();
+      blkdat.SetLimit(nBlockPos + nSize);
+      blkdat.SetPos(nBlockPos);
+      vData.resize(nSize);
+      for (unsigned int nRead = 0; nRead < nSize;) {
+        unsigned int nChunk = std::min(nSize - nRead, 1U << 16);
+        blkdat.read((char *)vData.data() + nRead, nChunk);
+        nRead += nChunk;
+      }
+      nRewind = blkdat.GetPos();
+      return true;
+    } catch (const std::exception &e) {
+      LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+    }
+  }
+  return false;
+}
+
+// A frame that does not deserialize may have swallowed blocks with its size,
+// so scanning resumes just past its start.
+static uint64_t GetRescanPos(uint64_t nBlockPos) {
+  return nBlockPos - CMessageHeader::MESSAGE_START_SIZE -
+         sizeof(unsigned int) + 1;
+}
+
+void CBlockImportPipeline::ProcessItem(Item &item) const {
+  CImportedBlock &result = item.result;
+  result.nBlockPos = item.nBlockPos;
+
+  std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+  try {
+    CSpanReader(SER_DISK, CLIENT_VERSION, item.vData.data(),
+                item.vData.data() + item.vData.size()) >>
+        *pblock;
+  } catch (const std::exception &e) {
+    result.strError = e.what();
+    return;
+  }
+  item.vData.clear();
+  item.vData.shrink_to_fit();
+
+  CValidationState state;
+  CheckBlockBody(*pblock, state);
+
+  if (!pblock->IsHiveMined(chainparams.GetConsensus()) &&
+      nHeightHint + (int)nMaxInFlight > SKIP_BLOCKHEADER_POW)
+    pblock->hashYespowerCached = pblock->GetHashYespower();
+
+  result.pblock = std::move(pblock);
+}
+
+void CBlockImportPipeline::ThreadRead() {
+  RenameThread("lightningcashr-loadblk-read");
+  int nReadGeneration = 0;
+  while (true) {
+    std::shared_ptr<Item> item = std::make_shared<Item>();
+    bool fHaveFrame = ReadNextFrame(item->nBlockPos, item->vData);
+
+    std::unique_lock<std::mutex> lock(mut);
+    if (!fHaveFrame && nGeneration == nReadGeneration) {
+      fReaderDone = true;
+      condResult.notify_all();
+    }
+    condReader.wait(lock, [&] {
+      return fStop || nGeneration != nReadGeneration ||
+             (fHaveFrame && inFlight.size() < nMaxInFlight);
+    });
+    if (fStop)
+      return;
+    if (nGeneration != nReadGeneration) {
+      nReadGeneration = nGeneration;
+      nRewind = nRescanPos;
+      continue;
+    }
+    inFlight.push_back(item);
+    todo.push_back(item);
+    condWorker.notify_one();
+  }
+}
+
+void CBlockImportPipeline::ThreadWork() {
+  RenameThread("lightningcashr-loadblk-work");
+  while (true) {
+    std::shared_ptr<Item> item;
+    {
+      std::unique_lock<std::mutex> lock(mut);
+      condWorker.wait(lock, [this] { return fStop || !todo.empty(); });
+      if (fStop)
+        return;
+      item = todo.front();
+      todo.pop_front();
+    }
+
+    ProcessItem(*item);
+
+    {
+      std::lock_guard<std::mutex> lock(mut);
+      item->fDone = true;
+    }
+    condResult.notify_all();
+  }
+}
+
+bool CBlockImportPipeline::Next(CImportedBlock &imported) {
+  if (nWorkers == 0) {
+    Item item;
+    if (!ReadNextFrame(item.nBlockPos, item.vData))
+      return false;
+    ProcessItem(item);
+    if (!item.result.pblock)
+      nRewind = GetRescanPos(item.nBlockPos);
+    imported = std::move(item.result);
+    return true;
+  }
+
+  std::shared_ptr<Item> item;
+  {
+    std::unique_lock<std::mutex> lock(mut);
+    condResult.wait(lock, [this] {
+      return fStop || (!inFlight.empty() && inFlight.front()->fDone) ||
+             (inFlight.empty() && fReaderDone);
+    });
+    if (fStop || inFlight.empty())
+      return false;
+    item = inFlight.front();
+    inFlight.pop_front();
+    if (!item->result.pblock) {
+      inFlight.clear();
+      todo.clear();
+      fReaderDone = false;
+      nRescanPos = GetRescanPos(item->nBlockPos);
+      nGeneration++;
+    }
+  }
+  condReader.notify_one();
+
+  imported = std::move(item->result);
+  return true;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include <primitives/block.h>
+#include <streams.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CChainParams;
+
+static const int DEFAULT_IMPORT_THREADS = 0;
+
+static const int MAX_IMPORT_THREADS = 16;
+
+static const int IMPORT_BLOCKS_PER_THREAD = 8;
+
+extern int nImportThreads;
+
+struct CImportedBlock {
+  std::shared_ptr<CBlock> pblock;
+  uint64_t nBlockPos;
+  std::string strError;
+
+  CImportedBlock() : nBlockPos(0) {}
+};
+
+class CBlockImportPipeline {
+public:
+  CBlockImportPipeline(const CChainParams &chainparams, FILE *fileIn,
+                       int nWorkersIn);
+  ~CBlockImportPipeline();
+
+  CBlockImportPipeline(const CBlockImportPipeline &) = delete;
+  CBlockImportPipeline &operator=(const CBlockImportPipeline &) = delete;
+
+  bool Next(CImportedBlock &imported);
+
+  void SetHeightHint(int nHeight) { nHeightHint = nHeight; }
+
+private:
+  struct Item {
+    uint64_t nBlockPos;
+    std::vector<unsigned char> vData;
+    CImportedBlock result;
+    bool fDone;
+
+    Item() : nBlockPos(0), fDone(false) {}
+  };
+
+  const CChainParams &chainparams;
+  CBufferedFile blkdat;
+  uint64_t nRewind;
+
+  const int nWorkers;
+  const size_t nMaxInFlight;
+  std::atomic<int> nHeightHint;
+
+  std::mutex mut;
+  std::condition_variable condWorker;
+  std::condition_variable condReader;
+  std::condition_variable condResult;
+  std::deque<std::shared_ptr<Item>> inFlight;
+  std::deque<std::shared_ptr<Item>> todo;
+  bool fReaderDone;
+  /** Bumped, with nRescanPos set, when what was read ahead is dropped. */
+  int nGeneration;
+  uint64_t nRescanPos;
+  std::atomic<bool> fStop;
+
+  std::vector<std::thread> threads;
+
+  bool ReadNextFrame(uint64_t &nBlockPos, std::vector<unsigned char> &vData);
+  void ProcessItem(Item &item) const;
+  void ThreadRead();
+  void ThreadWork();
+};
+
+#endif
@@ -0,0 +1,105 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprecheck.h>
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+int nPrecheckThreads = 0;
+
+CBlockPrecheckQueue::CBlockPrecheckQueue(const CChainParams &chainparamsIn,
+                                         int nWorkersIn,
+                                         std::function<void()> notifyIn)
+    : chainparams(chainparamsIn), notify(std::move(notifyIn)), nQueued(0),
+      fStop(false) {
+  for (int i = 0; i < std::max(nWorkersIn, 1); i++)
+    threads.emplace_back(&CBlockPrecheckQueue::ThreadWork, this);
+}
+
+CBlockPrecheckQueue::~CBlockPrecheckQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mut);
+    fStop = true;
+  }
+  condWorker.notify_all();
+  for (std::thread &t : threads)
+    t.join();
+}
+
+bool CBlockPrecheckQueue::Push(const std::shared_ptr<CBlock> &pblock,
+                               int nHeight, int64_t nodeid) {
+  Item item;
+  item.block.pblock = pblock;
+  item.block.nodeid = nodeid;
+  item.nHeight = nHeight;
+  {
+    std::lock_guard<std::mutex> lock(mut);
+    size_t &nPeerQueued = mapPeerQueued[nodeid];
+    if (nQueued >= MAX_PRECHECK_BLOCKS ||
+        nPeerQueued >= MAX_PRECHECK_BLOCKS_PER_PEER) {
+      if (nPeerQueued == 0)
+        mapPeerQueued.erase(nodeid);
+      return false;
+    }
+    nQueued++;
+    nPeerQueued++;
+    todo.push_back(std::move(item));
+  }
+  condWorker.notify_one();
+  return true;
+}
+
+void CBlockPrecheckQueue::TakeChecked(
+    std::vector<CPrecheckedBlock> &vChecked) {
+  std::lock_guard<std::mutex> lock(mut);
+  vChecked.swap(vDone);
+  vDone.clear();
+  for (const CPrecheckedBlock &checked : vChecked) {
+    auto it = mapPeerQueued.find(checked.nodeid);
+    if (--it->second == 0)
+      mapPeerQueued.erase(it);
+  }
+  nQueued -= vChecked.size();
+}
+
+void CBlockPrecheckQueue::ProcessItem(Item &item) const {
+  CBlock &block = *item.block.pblock;
+
+  CValidationState state;
+  if (!CheckBlockBody(block, state))
+    return;
+
+  if (item.nHeight > SKIP_BLOCKHEADER_POW && IsYesPower(item.nHeight) &&
+      !block.IsHiveMined(chainparams.GetConsensus()))
+    block.hashYespowerCached = block.GetHashYespower();
+}
+
+void CBlockPrecheckQueue::ThreadWork() {
+  RenameThread("lightningcashr-precheck");
+  while (true) {
+    Item item;
+    {
+      std::unique_lock<std::mutex> lock(mut);
+      condWorker.wait(lock, [this] { return fStop || !todo.empty(); });
+      if (fStop)
+        return;
+      item = std::move(todo.front());
+      todo.pop_front();
+    }
+
+    ProcessItem(item);
+
+    {
+      std::lock_guard<std::mutex> lock(mut);
+      vDone.push_back(std::move(item.block));
+    }
+    if (notify)
+      notify();
+  }
+}
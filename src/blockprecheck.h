@@ -0,0 +1,81 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPRECHECK_H
+#define BITCOIN_BLOCKPRECHECK_H
+
+#include <primitives/block.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CChainParams;
+
+static const int DEFAULT_PRECHECK_THREADS = 0;
+
+static const int MAX_PRECHECK_THREADS = 16;
+
+/** Blocks queued for or done with prechecks and not yet taken, in all and
+ * per peer (as many as a peer may have in flight). Past either, blocks are
+ * processed as they arrive. */
+static const size_t MAX_PRECHECK_BLOCKS = 128;
+static const size_t MAX_PRECHECK_BLOCKS_PER_PEER = 16;
+
+extern int nPrecheckThreads;
+
+struct CPrecheckedBlock {
+  std::shared_ptr<CBlock> pblock;
+  int64_t nodeid;
+
+  CPrecheckedBlock() : nodeid(-1) {}
+};
+
+class CBlockPrecheckQueue {
+public:
+  CBlockPrecheckQueue(const CChainParams &chainparams, int nWorkersIn,
+                      std::function<void()> notifyIn);
+  ~CBlockPrecheckQueue();
+
+  CBlockPrecheckQueue(const CBlockPrecheckQueue &) = delete;
+  CBlockPrecheckQueue &operator=(const CBlockPrecheckQueue &) = delete;
+
+  /** Queue pblock for prechecks. Returns false if the queue, or nodeid's
+   * share of it, is full. */
+  bool Push(const std::shared_ptr<CBlock> &pblock, int nHeight,
+            int64_t nodeid);
+
+  void TakeChecked(std::vector<CPrecheckedBlock> &vChecked);
+
+private:
+  struct Item {
+    CPrecheckedBlock block;
+    int nHeight;
+  };
+
+  const CChainParams &chainparams;
+  const std::function<void()> notify;
+
+  std::mutex mut;
+  std::condition_variable condWorker;
+  std::deque<Item> todo;
+  std::vector<CPrecheckedBlock> vDone;
+  size_t nQueued;
+  std::map<int64_t, size_t> mapPeerQueued;
+  bool fStop;
+
+  std::vector<std::thread> threads;
+
+  void ProcessItem(Item &item) const;
+  void ThreadWork();
+};
+
+#endif
@@ -42,6 +42,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/socket.h>
@@ -87,8 +88,12 @@ typedef int32_t ssize_t;
 size_t strnlen(const char *start, size_t max_len);
 #endif
 
+#ifndef WIN32
+#define USE_POLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET &s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
   return true;
 #else
   return (s < FD_SETSIZE);
@@ -4,105 +4,10 @@
 
 #include <algorithm>
 #include <consensus/merkle.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <utilstrencodings.h>
 
-static void MerkleComputationOptimized(const std::vector<uint256> &leaves,
-                                       uint256 *proot, bool *pmutated,
-                                       uint32_t branchpos,
-                                       std::vector<uint256> *pbranch) {
-  if (pbranch) {
-    pbranch->clear();
-
-    if (leaves.size() > 0) {
-      pbranch->reserve(32);
-    }
-  }
-
-  if (leaves.empty()) {
-    if (pmutated)
-      *pmutated = false;
-    if (proot)
-      *proot = uint256();
-    return;
-  }
-
-  bool mutated = false;
-  uint32_t count = 0;
-  uint256 inner[32];
-  int matchlevel = -1;
-
-  while (count < leaves.size()) {
-    uint256 h = leaves[count];
-    bool matchh = count == branchpos;
-    count++;
-    int level;
-
-    for (level = 0; !(count & (1u << level)); level++) {
-      if (pbranch) {
-        if (matchh) {
-          pbranch->push_back(inner[level]);
-        } else if (matchlevel == level) {
-          pbranch->push_back(h);
-          matchh = true;
-        }
-      }
-
-      mutated |= (inner[level] == h);
-
-      CHash256()
-          .Write(inner[level].begin(), 32)
-          .Write(h.begin(), 32)
-          .Finalize(h.begin());
-    }
-
-    inner[level] = h;
-    if (matchh) {
-      matchlevel = level;
-    }
-  }
-
-  int level = 0;
-  while (!(count & (1u << level))) {
-    level++;
-  }
-
-  uint256 h = inner[level];
-  bool matchh = matchlevel == level;
-
-  while (count != (1u << level)) {
-    if (pbranch && matchh) {
-      pbranch->push_back(h);
-    }
-
-    CHash256().Write(h.begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
-
-    count += (1u << level);
-    level++;
-
-    while (!(count & (1u << level))) {
-      if (pbranch) {
-        if (matchh) {
-          pbranch->push_back(inner[level]);
-        } else if (matchlevel == level) {
-          pbranch->push_back(h);
-          matchh = true;
-        }
-      }
-      CHash256()
-          .Write(inner[level].begin(), 32)
-          .Write(h.begin(), 32)
-          .Finalize(h.begin());
-      level++;
-    }
-  }
-
-  if (pmutated)
-    *pmutated = mutated;
-  if (proot)
-    *proot = h;
-}
-
 static void MerkleComputation(const std::vector<uint256> &leaves,
                               uint256 *proot, bool *pmutated,
                               uint32_t branchpos,
@@ -186,10 +91,26 @@ static void MerkleComputation(const std::vector<uint256> &leaves,
     *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated) {
-  uint256 hash;
-  MerkleComputation(leaves, &hash, mutated, -1, nullptr);
-  return hash;
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated) {
+  bool mutation = false;
+  while (hashes.size() > 1) {
+    if (mutated) {
+      for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+        if (hashes[pos] == hashes[pos + 1])
+          mutation = true;
+      }
+    }
+    if (hashes.size() & 1) {
+      hashes.push_back(hashes.back());
+    }
+    SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+    hashes.resize(hashes.size() / 2);
+  }
+  if (mutated)
+    *mutated = mutation;
+  if (hashes.size() == 0)
+    return uint256();
+  return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves,
@@ -221,7 +142,7 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated) {
   for (const auto &tx : block.vtx) {
     leaves.push_back(tx->GetHash());
   }
-  return ComputeMerkleRoot(leaves, mutated);
+  return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 uint256 BlockWitnessMerkleRoot(const CBlock &block, bool *mutated) {
@@ -234,7 +155,7 @@ uint256 BlockWitnessMerkleRoot(const CBlock &block, bool *mutated) {
   for (size_t s = 1; s < block.vtx.size(); s++) {
     leaves[s] = block.vtx[s]->GetWitnessHash();
   }
-  return ComputeMerkleRoot(leaves, mutated);
+  return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position) {
@@ -249,9 +170,7 @@ std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position) {
 
 uint256 ComputeMerkleRootOptimized(const std::vector<uint256> &leaves,
                                    bool *mutated) {
-  uint256 hash;
-  MerkleComputationOptimized(leaves, &hash, mutated, -1, nullptr);
-  return hash;
+  return ComputeMerkleRoot(leaves, mutated);
 }
 
 uint256
@@ -268,7 +187,7 @@ ComputeMerkleRootFromTransactions(const std::vector<CTransactionRef> &vtx,
   for (const auto &tx : vtx) {
     leaves.push_back(tx->GetHash());
   }
-  return ComputeMerkleRootOptimized(leaves, mutated);
+  return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 bool ValidateMerkleProof(const uint256 &leaf,
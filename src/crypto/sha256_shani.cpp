@@ -0,0 +1,173 @@
+// Copyright (c) 2018-2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Based on https://github.com/noloader/SHA-Intrinsics/blob/master/sha256-x86.c,
+// written and placed in the public domain by Jeffrey Walton, which in turn is
+// based on code from Intel and from Sean Gulley for the miTLS project.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace {
+
+alignas(16) const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Byte swap mask for loading and storing big-endian words. */
+__m128i inline Mask() { return _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL); }
+
+/** Initial state, as the {A,B,E,F} and {C,D,G,H} registers used by SHA-NI. */
+__m128i inline Init0() { return _mm_set_epi64x(0x6a09e667bb67ae85ULL, 0x510e527f9b05688cULL); }
+__m128i inline Init1() { return _mm_set_epi64x(0x3c6ef372a54ff53aULL, 0x1f83d9ab5be0cd19ULL); }
+
+__m128i inline Load(const unsigned char* in) { return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), Mask()); }
+void inline Store(unsigned char* out, __m128i s) { _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, Mask())); }
+
+/** Four rounds on N independent states, extending the message schedule first
+ *  when needed. Called with a constant i so that the indexing folds away.
+ */
+template <int N>
+void inline QuadRound(__m128i (&s0)[N], __m128i (&s1)[N], __m128i (&m)[N][4], int i)
+{
+    const __m128i k = _mm_load_si128((const __m128i*)(K256 + 4 * i));
+    for (int n = 0; n < N; ++n) {
+        if (i >= 4) {
+            __m128i tmp = _mm_sha256msg1_epu32(m[n][i & 3], m[n][(i + 1) & 3]);
+            tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(m[n][(i + 3) & 3], m[n][(i + 2) & 3], 4));
+            m[n][i & 3] = _mm_sha256msg2_epu32(tmp, m[n][(i + 3) & 3]);
+        }
+        __m128i msg = _mm_add_epi32(m[n][i & 3], k);
+        s1[n] = _mm_sha256rnds2_epu32(s1[n], s0[n], msg);
+        s0[n] = _mm_sha256rnds2_epu32(s0[n], s1[n], _mm_shuffle_epi32(msg, 0x0e));
+    }
+}
+
+/** Run one compression over N independent states, interleaving the lanes
+ *  so the sha256rnds2 latency of one is hidden behind the others. The
+ *  message words in m are clobbered.
+ */
+template <int N>
+void inline Compress(__m128i (&s0)[N], __m128i (&s1)[N], __m128i (&m)[N][4])
+{
+    __m128i save0[N], save1[N];
+    for (int n = 0; n < N; ++n) {
+        save0[n] = s0[n];
+        save1[n] = s1[n];
+    }
+    QuadRound<N>(s0, s1, m, 0);
+    QuadRound<N>(s0, s1, m, 1);
+    QuadRound<N>(s0, s1, m, 2);
+    QuadRound<N>(s0, s1, m, 3);
+    QuadRound<N>(s0, s1, m, 4);
+    QuadRound<N>(s0, s1, m, 5);
+    QuadRound<N>(s0, s1, m, 6);
+    QuadRound<N>(s0, s1, m, 7);
+    QuadRound<N>(s0, s1, m, 8);
+    QuadRound<N>(s0, s1, m, 9);
+    QuadRound<N>(s0, s1, m, 10);
+    QuadRound<N>(s0, s1, m, 11);
+    QuadRound<N>(s0, s1, m, 12);
+    QuadRound<N>(s0, s1, m, 13);
+    QuadRound<N>(s0, s1, m, 14);
+    QuadRound<N>(s0, s1, m, 15);
+    for (int n = 0; n < N; ++n) {
+        s0[n] = _mm_add_epi32(s0[n], save0[n]);
+        s1[n] = _mm_add_epi32(s1[n], save1[n]);
+    }
+}
+
+/** Convert {A,B,E,F},{C,D,G,H} into {A,B,C,D},{E,F,G,H} word order (lane 0 first). */
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    __m128i abcd = _mm_shuffle_epi32(_mm_unpackhi_epi64(s0, s1), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_unpacklo_epi64(s0, s1), 0xB1);
+    s0 = abcd;
+    s1 = efgh;
+}
+
+template <int N>
+void inline TransformD64(unsigned char* out, const unsigned char* in)
+{
+    __m128i s0[N], s1[N], m[N][4];
+
+    // Transform 1: the 64 bytes of input.
+    for (int n = 0; n < N; ++n) {
+        s0[n] = Init0();
+        s1[n] = Init1();
+        for (int i = 0; i < 4; ++i) m[n][i] = Load(in + 64 * n + 16 * i);
+    }
+    Compress<N>(s0, s1, m);
+
+    // Transform 2: padding of a 64-byte message.
+    for (int n = 0; n < N; ++n) {
+        m[n][0] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m[n][1] = _mm_setzero_si128();
+        m[n][2] = _mm_setzero_si128();
+        m[n][3] = _mm_set_epi32(0x200, 0, 0, 0);
+    }
+    Compress<N>(s0, s1, m);
+
+    // Transform 3: the 32-byte intermediate hash, padded.
+    for (int n = 0; n < N; ++n) {
+        Unshuffle(s0[n], s1[n]);
+        m[n][0] = s0[n];
+        m[n][1] = s1[n];
+        m[n][2] = _mm_set_epi32(0, 0, 0, 0x80000000);
+        m[n][3] = _mm_set_epi32(0x100, 0, 0, 0);
+        s0[n] = Init0();
+        s1[n] = Init1();
+    }
+    Compress<N>(s0, s1, m);
+
+    for (int n = 0; n < N; ++n) {
+        Unshuffle(s0[n], s1[n]);
+        Store(out + 32 * n, s0[n]);
+        Store(out + 32 * n + 16, s1[n]);
+    }
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i s0[1], s1[1], m[1][4];
+
+    // Convert {A,B,C,D},{E,F,G,H} into the {A,B,E,F},{C,D,G,H} layout.
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0x1B);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1B);
+    s0[0] = _mm_unpackhi_epi64(efgh, abcd);
+    s1[0] = _mm_unpacklo_epi64(efgh, abcd);
+
+    while (blocks--) {
+        for (int i = 0; i < 4; ++i) m[0][i] = Load(chunk + 16 * i);
+        Compress<1>(s0, s1, m);
+        chunk += 64;
+    }
+
+    Unshuffle(s0[0], s1[0]);
+    _mm_storeu_si128((__m128i*)s, s0[0]);
+    _mm_storeu_si128((__m128i*)(s + 4), s1[0]);
+}
+}
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    TransformD64<2>(out, in);
+}
+}
+
+#endif
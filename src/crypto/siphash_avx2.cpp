@@ -0,0 +1,73 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace siphash_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Rot(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+__m256i inline Rot32(__m256i x) { return _mm256_shuffle_epi32(x, 0xB1); }
+
+/** Four SipHash states, one per 64-bit lane. */
+struct State {
+    __m256i v0, v1, v2, v3;
+
+    State(uint64_t k0, uint64_t k1) :
+        v0(K(0x736f6d6570736575ULL ^ k0)), v1(K(0x646f72616e646f6dULL ^ k1)),
+        v2(K(0x6c7967656e657261ULL ^ k0)), v3(K(0x7465646279746573ULL ^ k1)) {}
+
+    void inline Round()
+    {
+        v0 = Add(v0, v1); v1 = Rot(v1, 13); v1 = Xor(v1, v0); v0 = Rot32(v0);
+        v2 = Add(v2, v3); v3 = Rot(v3, 16); v3 = Xor(v3, v2);
+        v0 = Add(v0, v3); v3 = Rot(v3, 21); v3 = Xor(v3, v0);
+        v2 = Add(v2, v1); v1 = Rot(v1, 17); v1 = Xor(v1, v2); v2 = Rot32(v2);
+    }
+};
+
+__m256i inline Read4(const unsigned char* const* in, int word)
+{
+    return _mm256_set_epi64x(ReadLE64(in[3] + 8 * word), ReadLE64(in[2] + 8 * word), ReadLE64(in[1] + 8 * word), ReadLE64(in[0] + 8 * word));
+}
+
+}
+
+/** SipHash-2-4 of eight 32-byte inputs as two interleaved sets of four lanes,
+ * so each round's dependency chain is hidden behind the other set's. */
+void SipHashUint256_8way(uint64_t k0, uint64_t k1, const unsigned char* const* in, uint64_t* out)
+{
+    State a(k0, k1), b(k0, k1);
+    for (int word = 0; word < 4; word++) {
+        __m256i da = Read4(in, word), db = Read4(in + 4, word);
+        a.v3 = Xor(a.v3, da); b.v3 = Xor(b.v3, db);
+        a.Round(); b.Round();
+        a.Round(); b.Round();
+        a.v0 = Xor(a.v0, da); b.v0 = Xor(b.v0, db);
+    }
+    __m256i len = K(((uint64_t)4) << 59);
+    a.v3 = Xor(a.v3, len); b.v3 = Xor(b.v3, len);
+    a.Round(); b.Round();
+    a.Round(); b.Round();
+    a.v0 = Xor(a.v0, len); b.v0 = Xor(b.v0, len);
+    a.v2 = Xor(a.v2, K(0xFF)); b.v2 = Xor(b.v2, K(0xFF));
+    for (int i = 0; i < 4; i++) {
+        a.Round(); b.Round();
+    }
+    _mm256_storeu_si256((__m256i*)out, Xor(Xor(a.v0, a.v1), Xor(a.v2, a.v3)));
+    _mm256_storeu_si256((__m256i*)(out + 4), Xor(Xor(b.v0, b.v1), Xor(b.v2, b.v3)));
+}
+
+}
+
+#endif
@@ -3,6 +3,16 @@
 #include <crypto/hmac_sha512.h>
 #include <hash.h>
 
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL) &&               \
+    (defined(__x86_64__) || defined(__amd64__))
+#include <cpuid.h>
+#define USE_SIPHASH_AVX2
+namespace siphash_avx2 {
+void SipHashUint256_8way(uint64_t k0, uint64_t k1,
+                         const unsigned char *const *in, uint64_t *out);
+}
+#endif
+
 inline uint32_t ROTL32(uint32_t x, int8_t r) {
   return (x << r) | (x >> (32 - r));
 }
@@ -240,3 +250,37 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
   SIPROUND;
   return v0 ^ v1 ^ v2 ^ v3;
 }
+
+#ifdef USE_SIPHASH_AVX2
+static bool HaveAVX2() {
+  uint32_t eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !((ecx >> 27) & 1) ||
+      !((ecx >> 28) & 1))
+    return false;
+  uint32_t a, d;
+  __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+  if ((a & 6) != 6 || __get_cpuid_max(0, nullptr) < 7)
+    return false;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx >> 5) & 1;
+}
+
+static const bool fSipHashAVX2 = HaveAVX2();
+#endif
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         size_t n, uint64_t *out) {
+  size_t i = 0;
+#ifdef USE_SIPHASH_AVX2
+  if (fSipHashAVX2) {
+    for (; i + 8 <= n; i += 8) {
+      const unsigned char *in[8];
+      for (int j = 0; j < 8; j++)
+        in[j] = vals[i + j]->begin();
+      siphash_avx2::SipHashUint256_8way(k0, k1, in, out + i);
+    }
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = SipHashUint256(k0, k1, *vals[i]);
+}
@@ -202,4 +202,9 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256 &val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
                              uint32_t extra);
 
+/** SipHashUint256 of n values, eight at a time with AVX2 where the CPU has
+ * it. */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         size_t n, uint64_t *out);
+
 #endif
@@ -0,0 +1,187 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headersegments.h>
+
+#include <validation.h>
+
+#include <iterator>
+
+HeadersSegmentTracker::HeadersSegmentTracker(
+    const std::map<int, uint256> &mapAnchors) {
+  for (auto it = mapAnchors.begin(); it != mapAnchors.end(); ++it) {
+    Segment segment;
+    segment.nAnchorHeight = it->first;
+    segment.hashAnchor = it->second;
+    segment.hashTip = it->second;
+    auto itNext = std::next(it);
+    if (itNext != mapAnchors.end())
+      segment.hashStop = itNext->second;
+    vSegments.push_back(std::move(segment));
+  }
+}
+
+bool HeadersSegmentTracker::AssignSegment(int64_t peer, int nBestHeight,
+                                          int nPeerHeight, int64_t nNow,
+                                          uint256 &hashFrom,
+                                          uint256 &hashStop) {
+  std::lock_guard<std::mutex> lock(mut);
+  if (mapPeerSegment.count(peer) ||
+      mapPeerSegment.size() >= (size_t)MAX_SEGMENT_PEERS)
+    return false;
+  for (size_t i = 0; i < vSegments.size(); i++) {
+    Segment &segment = vSegments[i];
+    if (segment.fComplete || segment.fTaken || segment.peer != -1 ||
+        segment.nAnchorHeight <= nBestHeight ||
+        segment.nAnchorHeight >= nPeerHeight || segment.setRefused.count(peer))
+      continue;
+    segment.peer = peer;
+    segment.nRequestTime = nNow;
+    mapPeerSegment[peer] = i;
+    hashFrom = segment.hashTip;
+    hashStop = segment.hashStop;
+    return true;
+  }
+  return false;
+}
+
+bool HeadersSegmentTracker::IsSegmentPeer(int64_t peer) const {
+  std::lock_guard<std::mutex> lock(mut);
+  return mapPeerSegment.count(peer);
+}
+
+bool HeadersSegmentTracker::IsContinuation(int64_t peer,
+                                           const uint256 &hashPrev,
+                                           int &nFirstHeight) const {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeerSegment.find(peer);
+  if (it == mapPeerSegment.end())
+    return false;
+  const Segment &segment = vSegments[it->second];
+  if (hashPrev != segment.hashTip)
+    return false;
+  nFirstHeight = segment.nAnchorHeight + 1 + segment.vHeaders.size();
+  return true;
+}
+
+bool HeadersSegmentTracker::AddHeaders(
+    int64_t peer, const std::vector<CBlockHeader> &headers,
+    const std::vector<uint256> &vHashYespower, int64_t nNow, bool &fMore,
+    uint256 &hashFrom, uint256 &hashStop) {
+  fMore = false;
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeerSegment.find(peer);
+  if (it == mapPeerSegment.end())
+    return false;
+  Segment &segment = vSegments[it->second];
+
+  // Anything past the next anchor belongs to the segment after it.
+  uint256 hashLast = segment.hashTip;
+  size_t nCount = 0;
+  bool fReachedStop = false;
+  while (nCount < headers.size() && !fReachedStop) {
+    if (headers[nCount].hashPrevBlock != hashLast)
+      return false;
+    hashLast = headers[nCount++].GetHash();
+    fReachedStop = hashLast == segment.hashStop;
+  }
+
+  if (!vHashYespower.empty() || !segment.vHashYespower.empty()) {
+    segment.vHashYespower.resize(segment.vHeaders.size());
+    if (vHashYespower.empty())
+      segment.vHashYespower.resize(segment.vHeaders.size() + nCount);
+    else
+      segment.vHashYespower.insert(segment.vHashYespower.end(),
+                                   vHashYespower.begin(),
+                                   vHashYespower.begin() + nCount);
+  }
+  segment.sender = peer;
+  segment.vHeaders.insert(segment.vHeaders.end(), headers.begin(),
+                          headers.begin() + nCount);
+  segment.hashTip = hashLast;
+  segment.nRequestTime = nNow;
+
+  if (fReachedStop || segment.vHeaders.size() >= MAX_SEGMENT_HEADERS ||
+      (segment.hashStop.IsNull() && nCount < MAX_HEADERS_RESULTS)) {
+    segment.fComplete = true;
+    Release(segment, false);
+  } else if (nCount < MAX_HEADERS_RESULTS) {
+    // The peer does not have the rest.
+    Release(segment, true);
+  } else {
+    fMore = true;
+    hashFrom = segment.hashTip;
+    hashStop = segment.hashStop;
+  }
+  return true;
+}
+
+void HeadersSegmentTracker::Release(Segment &segment, bool fRefused) {
+  if (segment.peer == -1)
+    return;
+  if (fRefused)
+    segment.setRefused.insert(segment.peer);
+  mapPeerSegment.erase(segment.peer);
+  segment.peer = -1;
+
+  // Nothing buffered is checked against the chain until it reaches the
+  // anchor, and a peer giving up may have been feeding us made up headers,
+  // so the next peer starts over from the anchor.
+  if (!segment.fComplete && !segment.fTaken) {
+    std::vector<CBlockHeader>().swap(segment.vHeaders);
+    std::vector<uint256>().swap(segment.vHashYespower);
+    segment.hashTip = segment.hashAnchor;
+  }
+}
+
+void HeadersSegmentTracker::ReleasePeer(int64_t peer, bool fRefused) {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeerSegment.find(peer);
+  if (it != mapPeerSegment.end())
+    Release(vSegments[it->second], fRefused);
+}
+
+bool HeadersSegmentTracker::HasTimedOut(int64_t peer, int64_t nNow) const {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeerSegment.find(peer);
+  return it != mapPeerSegment.end() &&
+         nNow > vSegments[it->second].nRequestTime + SEGMENT_RESPONSE_TIMEOUT;
+}
+
+std::vector<uint256> HeadersSegmentTracker::GetPendingAnchors() const {
+  std::lock_guard<std::mutex> lock(mut);
+  std::vector<uint256> vAnchors;
+  for (const Segment &segment : vSegments)
+    if (!segment.fTaken && !segment.vHeaders.empty())
+      vAnchors.push_back(segment.hashAnchor);
+  return vAnchors;
+}
+
+bool HeadersSegmentTracker::TakeSegment(const uint256 &hashAnchor,
+                                        std::vector<CBlockHeader> &headers,
+                                        std::vector<uint256> &vHashYespower,
+                                        int64_t &sender) {
+  std::lock_guard<std::mutex> lock(mut);
+  for (Segment &segment : vSegments) {
+    if (segment.fTaken || segment.hashAnchor != hashAnchor)
+      continue;
+    segment.fTaken = true;
+    Release(segment, false);
+    headers = std::move(segment.vHeaders);
+    vHashYespower = std::move(segment.vHashYespower);
+    sender = segment.sender;
+    segment.vHeaders.clear();
+    segment.vHashYespower.clear();
+    return true;
+  }
+  return false;
+}
+
+size_t HeadersSegmentTracker::GetBufferedCount() const {
+  std::lock_guard<std::mutex> lock(mut);
+  size_t nCount = 0;
+  for (const Segment &segment : vSegments)
+    nCount += segment.vHeaders.size();
+  return nCount;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HEADERSEGMENTS_H
+#define BITCOIN_HEADERSEGMENTS_H
+
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+static const bool DEFAULT_PARALLEL_HEADERS = true;
+
+/** Peers downloading segments at once, besides the headers sync peer. */
+static const int MAX_SEGMENT_PEERS = 4;
+
+/** Headers buffered per segment until the chain reaches its anchor, about
+ * 16 MB (22 MB with yespower hashes) each. A peer can only be asked for
+ * headers following one we know, so a segment cannot start anywhere but an
+ * anchor; past this many, the rest of a long gap comes from headers sync. */
+static const size_t MAX_SEGMENT_HEADERS = 200000;
+
+/** Microseconds a peer has to answer each getheaders for its segment. */
+static const int64_t SEGMENT_RESPONSE_TIMEOUT = 60 * 1000000;
+
+/** Download of header chain segments during initial sync.
+ *
+ * Headers sync follows one peer from our best header. Starting at each
+ * anchor (checkpoint) above it, a segment of the chain up to the next anchor
+ * can be fetched from another peer in parallel. Its headers are buffered
+ * here, checked only for continuity, until the anchor itself is in the block
+ * index; they are then taken out and validated like any other headers. Each
+ * segment is downloaded from one peer; if it gives up before the end, the
+ * next peer starts again from the anchor.
+ *
+ * Thread safe. */
+class HeadersSegmentTracker {
+public:
+  explicit HeadersSegmentTracker(const std::map<int, uint256> &mapAnchors);
+
+  /** Give peer the lowest segment above nBestHeight that nobody is
+   * downloading and that it has not refused. Returns false if there is
+   * none, or enough peers are at work. hashFrom and hashStop are what to ask
+   * the peer for. */
+  bool AssignSegment(int64_t peer, int nBestHeight, int nPeerHeight,
+                     int64_t nNow, uint256 &hashFrom, uint256 &hashStop);
+
+  bool IsSegmentPeer(int64_t peer) const;
+
+  /** Whether headers after hashPrev continue the segment of peer, and if so
+   * the height of the first of them. */
+  bool IsContinuation(int64_t peer, const uint256 &hashPrev,
+                      int &nFirstHeight) const;
+
+  /** Buffer the headers peer sent for its segment, with their yespower
+   * hashes if any were computed. Returns false if they do not continue the
+   * segment. fMore is set, with what to ask for next, if the segment still
+   * needs headers from the peer. */
+  bool AddHeaders(int64_t peer, const std::vector<CBlockHeader> &headers,
+                  const std::vector<uint256> &vHashYespower, int64_t nNow,
+                  bool &fMore, uint256 &hashFrom, uint256 &hashStop);
+
+  /** Stop downloading peer's segment. Unless the segment is complete, the
+   * headers it sent are dropped. If fRefused it is not asked for that
+   * segment again. */
+  void ReleasePeer(int64_t peer, bool fRefused = false);
+
+  bool HasTimedOut(int64_t peer, int64_t nNow) const;
+
+  /** Anchors of segments with buffered headers. */
+  std::vector<uint256> GetPendingAnchors() const;
+
+  /** Take the buffered headers of the segment at hashAnchor, which must now
+   * be in the block index, and the peer that sent them. The segment is done;
+   * the rest of it comes from headers sync. */
+  bool TakeSegment(const uint256 &hashAnchor,
+                   std::vector<CBlockHeader> &headers,
+                   std::vector<uint256> &vHashYespower, int64_t &sender);
+
+  size_t GetBufferedCount() const;
+
+private:
+  struct Segment {
+    int nAnchorHeight;
+    uint256 hashAnchor;
+    /** Next anchor, or null for the segment past the last. */
+    uint256 hashStop;
+    std::vector<CBlockHeader> vHeaders;
+    /** Empty, or aligned with vHeaders. */
+    std::vector<uint256> vHashYespower;
+    int64_t sender = -1;
+    uint256 hashTip;
+    bool fComplete = false;
+    bool fTaken = false;
+    int64_t peer = -1;
+    int64_t nRequestTime = 0;
+    std::set<int64_t> setRefused;
+  };
+
+  mutable std::mutex mut;
+  std::vector<Segment> vSegments;
+  std::map<int64_t, size_t> mapPeerSegment;
+
+  void Release(Segment &segment, bool fRefused);
+};
+
+#endif // BITCOIN_HEADERSEGMENTS_H
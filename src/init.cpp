@@ -11,12 +11,16 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <blockfilemap.h>
+#include <blockimport.h>
+#include <blockprecheck.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <fs.h>
+#include <headersegments.h>
 #include <httprpc.h>
 #include <httpserver.h>
 #include <key.h>
@@ -38,6 +42,7 @@
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilmoneystr.h>
@@ -56,6 +61,7 @@
 #endif
 
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/bind.hpp>
@@ -196,6 +202,7 @@ void Shutdown() {
     pcoinsdbview.reset();
     pblocktree.reset();
   }
+  g_blockfile_mmap.Clear();
 #ifdef ENABLE_WALLET
   StopWallets();
 #endif
@@ -291,6 +298,12 @@ std::string HelpMessage(HelpMessageMode mode) {
         "-daemon", _("Run in the background as a daemon and accept commands"));
 #endif
   }
+  strUsage += HelpMessageOpt(
+      "-blockmmap=<n>",
+      strprintf(_("Memory-map up to <n> block files to serve block reads "
+                  "without copying through file buffers (0 to %d, default: "
+                  "%d)"),
+                MAX_BLOCKFILE_MMAP, DEFAULT_BLOCKFILE_MMAP));
   strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
   if (showDebug) {
     strUsage += HelpMessageOpt(
@@ -311,6 +324,22 @@ std::string HelpMessage(HelpMessageMode mode) {
   strUsage += HelpMessageOpt(
       "-loadblock=<file>",
       _("Imports blocks from external blk000??.dat file on startup"));
+  strUsage += HelpMessageOpt(
+      "-importthreads=<n>",
+      strprintf(_("Set the number of threads deserializing and checking "
+                  "blocks during -reindex and -loadblock (%d to %d, 0 = auto, "
+                  "<0 = leave that many cores free, 1 = no pipeline, "
+                  "default: %d)"),
+                -GetNumCores(), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
+  strUsage += HelpMessageOpt(
+      "-precheckthreads=<n>",
+      strprintf(_("Set the number of threads checking blocks received out of "
+                  "order during initial block download before they are "
+                  "connected, and hashing received headers (%d to %d, 0 = "
+                  "auto, <0 = leave that many cores free, 1 = disabled, "
+                  "default: %d)"),
+                -GetNumCores(), MAX_PRECHECK_THREADS,
+                DEFAULT_PRECHECK_THREADS));
   strUsage += HelpMessageOpt(
       "-debuglogfile=<file>",
       strprintf(
@@ -439,6 +468,17 @@ std::string HelpMessage(HelpMessageMode mode) {
       strprintf(
           _("Always query for peer addresses via DNS lookup (default: %u)"),
           DEFAULT_FORCEDNSSEED));
+  strUsage += HelpMessageOpt(
+      "-hiverelay",
+      strprintf(_("Announce hive blocks to high bandwidth peers once their "
+                  "hive proof is checked, before full validation "
+                  "(default: %u)"),
+                DEFAULT_HIVE_FAST_RELAY));
+  strUsage += HelpMessageOpt(
+      "-parallelheaders",
+      strprintf(_("During initial sync, download headers between checkpoints "
+                  "from several peers at once (default: %u)"),
+                DEFAULT_PARALLEL_HEADERS));
   strUsage +=
       HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 "
                                   "if no -proxy or -connect)"));
@@ -499,6 +539,11 @@ std::string HelpMessage(HelpMessageMode mode) {
   strUsage += HelpMessageOpt(
       "-seednode=<ip>",
       _("Connect to a node to retrieve peer addresses, and disconnect"));
+  strUsage += HelpMessageOpt(
+      "-socketevents=<mode>",
+      strprintf(_("Socket events mode, one of: %s (default: %s)"),
+                boost::algorithm::join(GetSocketEventsModes(), ", "),
+                DEFAULT_SOCKET_EVENTS));
   strUsage += HelpMessageOpt(
       "-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds "
                                   "(minimum: 1, default: %d)"),
@@ -510,6 +555,12 @@ std::string HelpMessage(HelpMessageMode mode) {
           DEFAULT_TOR_CONTROL));
   strUsage += HelpMessageOpt("-torpassword=<pass>",
                              _("Tor control port password (default: empty)"));
+  strUsage += HelpMessageOpt(
+      "-txreconciliation",
+      strprintf(_("Reconcile transaction announcements with peers that "
+                  "support it instead of announcing each transaction "
+                  "(default: %u)"),
+                DEFAULT_TXRECONCILIATION));
 #ifdef USE_UPNP
 #if USE_UPNP
   strUsage +=
@@ -1167,6 +1218,7 @@ namespace {
 int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
+std::string strSocketEventsMode;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
 
 } // namespace
@@ -1240,11 +1292,22 @@ bool AppInitParameterInteraction() {
       gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
   nMaxConnections = std::max(nUserMaxConnections, 0);
 
-  nMaxConnections =
-      std::max(std::min(nMaxConnections,
-                        (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
-                              MAX_ADDNODE_CONNECTIONS)),
-               0);
+  strSocketEventsMode = gArgs.GetArg("-socketevents", DEFAULT_SOCKET_EVENTS);
+  const std::vector<std::string> vSocketEventsModes = GetSocketEventsModes();
+  if (std::find(vSocketEventsModes.begin(), vSocketEventsModes.end(),
+                strSocketEventsMode) == vSocketEventsModes.end()) {
+    return InitError(strprintf(_("Invalid -socketevents mode: '%s'"),
+                               strSocketEventsMode));
+  }
+
+  // Only select() is bound by FD_SETSIZE.
+  if (strSocketEventsMode == "select") {
+    nMaxConnections =
+        std::max(std::min(nMaxConnections,
+                          (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
+                                MAX_ADDNODE_CONNECTIONS)),
+                 0);
+  }
   nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS +
                                  MAX_ADDNODE_CONNECTIONS);
   if (nFD < MIN_CORE_FILEDESCRIPTORS)
@@ -1321,6 +1384,7 @@ bool AppInitParameterInteraction() {
                                       chainparams.DefaultConsistencyChecks());
   fCheckpointsEnabled =
       gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+  fHiveFastRelay = gArgs.GetBoolArg("-hiverelay", DEFAULT_HIVE_FAST_RELAY);
 
   hashAssumeValid = uint256S(gArgs.GetArg(
       "-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1374,6 +1438,29 @@ bool AppInitParameterInteraction() {
   else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
     nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+  nImportThreads = gArgs.GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+  if (nImportThreads <= 0)
+    nImportThreads += GetNumCores();
+  if (nImportThreads <= 1)
+    nImportThreads = 0;
+  else if (nImportThreads > MAX_IMPORT_THREADS)
+    nImportThreads = MAX_IMPORT_THREADS;
+
+  nPrecheckThreads = gArgs.GetArg("-precheckthreads", DEFAULT_PRECHECK_THREADS);
+  if (nPrecheckThreads <= 0)
+    nPrecheckThreads += GetNumCores();
+  if (nPrecheckThreads <= 1)
+    nPrecheckThreads = 0;
+  else if (nPrecheckThreads > MAX_PRECHECK_THREADS)
+    nPrecheckThreads = MAX_PRECHECK_THREADS;
+
+  int64_t nBlockFileMmap =
+      gArgs.GetArg("-blockmmap", DEFAULT_BLOCKFILE_MMAP);
+  if (nBlockFileMmap < 0 || nBlockFileMmap > MAX_BLOCKFILE_MMAP)
+    return InitError(strprintf(_("-blockmmap must be between 0 and %d"),
+                               MAX_BLOCKFILE_MMAP));
+  g_blockfile_mmap.SetMaxFiles(nBlockFileMmap);
+
   int64_t nPruneArg = gArgs.GetArg("-prune", 0);
   if (nPruneArg < 0) {
     return InitError(_("Prune cannot be configured with a negative value."));
@@ -1453,6 +1540,10 @@ bool AppInitParameterInteraction() {
   if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
     nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+  if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION) &&
+      !gArgs.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY))
+    nLocalServices = ServiceFlags(nLocalServices | NODE_TXRECON);
+
   if (gArgs.GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
     return InitError("rpcserialversion must be non-negative.");
 
@@ -1600,6 +1691,10 @@ bool AppInitMain() {
     for (int i = 0; i < nScriptCheckThreads - 1; i++)
       threadGroup.create_thread(&ThreadScriptCheck);
   }
+  if (nPrecheckThreads) {
+    for (int i = 0; i < nPrecheckThreads - 1; i++)
+      threadGroup.create_thread(&ThreadHeaderHash);
+  }
 
   CScheduler::Function serviceLoop =
       boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -2042,6 +2137,7 @@ bool AppInitMain() {
   connOptions.nReceiveFloodSize =
       1000 * gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
   connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
+  connOptions.m_socket_events_mode = strSocketEventsMode;
 
   connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
   connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
@@ -6,6 +6,7 @@
 #include <merkleblock.h>
 
 #include <consensus/consensus.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <utilstrencodings.h>
 
@@ -35,21 +36,32 @@ CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter *filter,
   txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+static uint256 HashPair(const uint256 &left, const uint256 &right) {
+  unsigned char buf[64];
+  memcpy(buf, left.begin(), 32);
+  memcpy(buf + 32, right.begin(), 32);
+  uint256 result;
+  SHA256D64(result.begin(), buf, 1);
+  return result;
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos,
                                      const std::vector<uint256> &vTxid) {
   assert(vTxid.size() != 0);
-  if (height == 0) {
+  if (height == 0)
     return vTxid[pos];
-  } else {
-    uint256 left = CalcHash(height - 1, pos * 2, vTxid), right;
-
-    if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-      right = CalcHash(height - 1, pos * 2 + 1, vTxid);
-    else
-      right = left;
 
-    return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+  const uint64_t nBegin = (uint64_t)pos << height;
+  const uint64_t nEnd =
+      std::min<uint64_t>((uint64_t)(pos + 1) << height, vTxid.size());
+  std::vector<uint256> hashes(vTxid.begin() + nBegin, vTxid.begin() + nEnd);
+  for (; height > 0; height--) {
+    if (hashes.size() & 1)
+      hashes.push_back(hashes.back());
+    SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+    hashes.resize(hashes.size() / 2);
   }
+  return hashes[0];
 }
 
 void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos,
@@ -104,7 +116,7 @@ uint256 CPartialMerkleTree::TraverseAndExtract(
       right = left;
     }
 
-    return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    return HashPair(left, right);
   }
 }
 
@@ -54,6 +54,14 @@ CBeeRange solvingRange;
 
 uint32_t solvingBee;
 
+int64_t nSolutionTime;
+
+static CCriticalSection cs_hive_candidate;
+static std::unique_ptr<CBlockTemplate> hiveCandidate;
+// Tip and mempool state the candidate was last built, or tried, for.
+static uint256 hashHiveCandidateTip;
+static unsigned int nHiveCandidateTxUpdated = 0;
+
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockWeight = 0;
 
@@ -77,7 +85,7 @@ BlockAssembler::Options::Options() {
 
 BlockAssembler::BlockAssembler(const CChainParams &params,
                                const Options &options)
-    : chainparams(params) {
+    : fHiveCandidate(false), chainparams(params) {
   blockMinFeeRate = options.blockMinFeeRate;
 
   nBlockMaxWeight = std::max<size_t>(
@@ -113,6 +121,34 @@ void BlockAssembler::resetBlock() {
   nFees = 0;
 }
 
+static CMutableTransaction CreateCoinbase(const CScript &scriptPubKeyIn,
+                                          const CScript *hiveProofScript,
+                                          int nHeight, CAmount nValue) {
+  CMutableTransaction coinbaseTx;
+  coinbaseTx.vin.resize(1);
+  coinbaseTx.vin[0].prevout.SetNull();
+  coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+
+  if (hiveProofScript) {
+    coinbaseTx.vout.resize(2);
+    coinbaseTx.vout[0].scriptPubKey = *hiveProofScript;
+    coinbaseTx.vout[0].nValue = 0;
+
+    coinbaseTx.vout[1].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[1].nValue = nValue;
+  } else {
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nValue;
+  }
+  return coinbaseTx;
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateHiveCandidate() {
+  fHiveCandidate = true;
+  return CreateNewBlock(CScript() << OP_TRUE, true);
+}
+
 std::unique_ptr<CBlockTemplate>
 BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
                                bool fMineWitnessTx,
@@ -136,7 +172,8 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
   CBlockIndex *pindexPrev = chainActive.Tip();
   assert(pindexPrev != nullptr);
 
-  if (hiveProofScript && !IsHiveEnabled(pindexPrev, chainparams.GetConsensus()))
+  if ((hiveProofScript || fHiveCandidate) &&
+      !IsHiveEnabled(pindexPrev, chainparams.GetConsensus()))
     throw std::runtime_error(
         "Error: The Hive is not yet enabled on the network");
 
@@ -159,54 +196,34 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
                     fMineWitnessTx;
 
   int nPackagesSelected = 0;
-  int nDescendantsUpdated = 0;
+  int nRelinearized = 0;
 
-  if (hiveProofScript)
+  if (hiveProofScript || fHiveCandidate)
     fIncludeBCTs = false;
 
-  addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+  addPackageTxs(nPackagesSelected, nRelinearized);
 
   int64_t nTime1 = GetTimeMicros();
 
-  nLastBlockTx = nBlockTx;
-  nLastBlockWeight = nBlockWeight;
-
-  if (hiveProofScript) {
-    CMutableTransaction coinbaseTx;
-
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-
-    coinbaseTx.vout.resize(2);
-    coinbaseTx.vout[0].scriptPubKey = *hiveProofScript;
-    coinbaseTx.vout[0].nValue = 0;
-
-    coinbaseTx.vout[1].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[1].nValue =
-        nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(
-        *pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
-  } else {
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue =
-        nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(
-        *pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+  if (!fHiveCandidate) {
+    nLastBlockTx = nBlockTx;
+    nLastBlockWeight = nBlockWeight;
   }
 
-  LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n",
-            GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+  pblock->vtx[0] = MakeTransactionRef(CreateCoinbase(
+      scriptPubKeyIn, hiveProofScript, nHeight,
+      nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus())));
+  pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(
+      *pblock, pindexPrev, chainparams.GetConsensus());
+  pblocktemplate->vTxFees[0] = -nFees;
+
+  const std::string strStats = strprintf(
+      "CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n",
+      GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+  if (fHiveCandidate)
+    LogPrint(BCLog::HIVE, "%s", strStats);
+  else
+    LogPrintf("%s", strStats);
 
   pblock->hashPrevBlock = pindexPrev->GetBlockHash();
   UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
@@ -233,26 +250,14 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
   int64_t nTime2 = GetTimeMicros();
 
   LogPrint(BCLog::BENCH,
-           "CreateNewBlock() packages: %.2fms (%d packages, %d updated "
-           "descendants), validity: %.2fms (total %.2fms)\n",
-           0.001 * (nTime1 - nTimeStart), nPackagesSelected,
-           nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
+           "CreateNewBlock() packages: %.2fms (%d packages, %d relinearized "
+           "txs), validity: %.2fms (total %.2fms)\n",
+           0.001 * (nTime1 - nTimeStart), nPackagesSelected, nRelinearized, 0.001 * (nTime2 - nTime1),
            0.001 * (nTime2 - nTimeStart));
 
   return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries &testSet) {
-  for (CTxMemPool::setEntries::iterator iit = testSet.begin();
-       iit != testSet.end();) {
-    if (inBlock.count(*iit)) {
-      testSet.erase(iit++);
-    } else {
-      iit++;
-    }
-  }
-}
-
 bool BlockAssembler::TestPackage(uint64_t packageSize,
                                  int64_t packageSigOpsCost) const {
   if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
@@ -263,7 +268,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize,
 }
 
 bool BlockAssembler::TestPackageTransactions(
-    const CTxMemPool::setEntries &package) {
+    const CTxMemPool::vecEntries &package) {
   const Consensus::Params &consensusParams = Params().GetConsensus();
 
   for (const CTxMemPool::txiter it : package) {
@@ -281,6 +286,19 @@ bool BlockAssembler::TestPackageTransactions(
   return true;
 }
 
+bool BlockAssembler::TestPackageParents(
+    const CTxMemPool::vecEntries &package) const {
+  for (auto it = package.begin(); it != package.end(); ++it) {
+    for (const CTxMemPool::txiter parent : mempool.GetMemPoolParents(*it)) {
+      if (!inBlock.count(parent) &&
+          std::find(package.begin(), it, parent) == it) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
   pblock->vtx.emplace_back(iter->GetSharedTx());
   pblocktemplate->vTxFees.push_back(iter->GetFee());
@@ -300,111 +318,65 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
   }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(
-    const CTxMemPool::setEntries &alreadyAdded,
-    indexed_modified_transaction_set &mapModifiedTx) {
-  int nDescendantsUpdated = 0;
-  for (const CTxMemPool::txiter it : alreadyAdded) {
-    CTxMemPool::setEntries descendants;
-    mempool.CalculateDescendants(it, descendants);
-
-    for (CTxMemPool::txiter desc : descendants) {
-      if (alreadyAdded.count(desc))
-        continue;
-      ++nDescendantsUpdated;
-      modtxiter mit = mapModifiedTx.find(desc);
-      if (mit == mapModifiedTx.end()) {
-        CTxMemPoolModifiedEntry modEntry(desc);
-        modEntry.nSizeWithAncestors -= it->GetTxSize();
-        modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-        modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
-        mapModifiedTx.insert(modEntry);
-      } else {
-        mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+bool BlockAssembler::AddPartialChunk(const CTxMemPool::vecEntries &chunk) {
+  // Leaving out what cannot go in the block, and whatever depends on it,
+  // keeps the rest of the chunk in a valid order, and so any prefix of it.
+  CTxMemPool::vecEntries valid;
+  CTxMemPool::setEntries setValid;
+  for (const CTxMemPool::txiter it : chunk) {
+    bool fParents = true;
+    for (const CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+      if (!inBlock.count(parent) && !setValid.count(parent)) {
+        fParents = false;
+        break;
       }
     }
+    if (fParents && TestPackageTransactions(CTxMemPool::vecEntries(1, it))) {
+      valid.push_back(it);
+      setValid.insert(it);
+    }
   }
-  return nDescendantsUpdated;
-}
 
-bool BlockAssembler::SkipMapTxEntry(
-    CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx,
-    CTxMemPool::setEntries &failedTx) {
-  assert(it != mempool.mapTx.end());
-  return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
-}
+  CAmount nPrefixFees = 0;
+  int64_t nPrefixSize = 0;
+  int64_t nPrefixSigOpCost = 0;
+  size_t nTake = 0;
+  for (size_t i = 0; i < valid.size(); i++) {
+    nPrefixSize += valid[i]->GetTxSize();
+    nPrefixSigOpCost += valid[i]->GetSigOpCost();
+    if (!TestPackage(nPrefixSize, nPrefixSigOpCost)) {
+      break;
+    }
+    nPrefixFees += valid[i]->GetModifiedFee();
+    if (nPrefixFees >= blockMinFeeRate.GetFee(nPrefixSize)) {
+      nTake = i + 1;
+    }
+  }
 
-void BlockAssembler::SortForBlock(
-    const CTxMemPool::setEntries &package, CTxMemPool::txiter entry,
-    std::vector<CTxMemPool::txiter> &sortedEntries) {
-  sortedEntries.clear();
-  sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-  std::sort(sortedEntries.begin(), sortedEntries.end(),
-            CompareTxIterByAncestorCount());
+  for (size_t i = 0; i < nTake; i++) {
+    AddToBlock(valid[i]);
+  }
+  return nTake > 0;
 }
 
 void BlockAssembler::addPackageTxs(int &nPackagesSelected,
-                                   int &nDescendantsUpdated) {
-  indexed_modified_transaction_set mapModifiedTx;
-
-  CTxMemPool::setEntries failedTx;
-
-  UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-  CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator
-      mi = mempool.mapTx.get<ancestor_score>().begin();
-  CTxMemPool::txiter iter;
+                                   int &nRelinearized) {
+  nRelinearized = mempool.UpdateMiningOrder();
 
   const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
   int64_t nConsecutiveFailed = 0;
 
-  while (mi != mempool.mapTx.get<ancestor_score>().end() ||
-         !mapModifiedTx.empty()) {
-    if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-        SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-      ++mi;
-      continue;
-    }
-
-    bool fUsingModified = false;
-
-    modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-    if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-      iter = modit->iter;
-      fUsingModified = true;
-    } else {
-      iter = mempool.mapTx.project<0>(mi);
-      if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-          CompareTxMemPoolEntryByAncestorFee()(*modit,
-                                               CTxMemPoolModifiedEntry(iter))) {
-        iter = modit->iter;
-        fUsingModified = true;
-      } else {
-        ++mi;
-      }
-    }
-
-    assert(!inBlock.count(iter));
-
-    uint64_t packageSize = iter->GetSizeWithAncestors();
-    CAmount packageFees = iter->GetModFeesWithAncestors();
-    int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
-    if (fUsingModified) {
-      packageSize = modit->nSizeWithAncestors;
-      packageFees = modit->nModFeesWithAncestors;
-      packageSigOpsCost = modit->nSigOpCostWithAncestors;
-    }
-
-    if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+  for (const CTxMemPool::MiningChunk *chunk : mempool.GetMiningOrder()) {
+    if (chunk->nModFees < blockMinFeeRate.GetFee(chunk->nSize)) {
       return;
     }
 
-    if (!TestPackage(packageSize, packageSigOpsCost)) {
-      if (fUsingModified) {
-        mapModifiedTx.get<ancestor_score>().erase(modit);
-        failedTx.insert(iter);
+    if (!TestPackage(chunk->nSize, chunk->nSigOpCost)) {
+      if (chunk->vTxs.size() > 1 && AddPartialChunk(chunk->vTxs)) {
+        nConsecutiveFailed = 0;
+        ++nPackagesSelected;
+        continue;
       }
-
       ++nConsecutiveFailed;
 
       if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES &&
@@ -414,37 +386,21 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
       continue;
     }
 
-    CTxMemPool::setEntries ancestors;
-    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit,
-                                      nNoLimit, nNoLimit, dummy, false);
-
-    onlyUnconfirmed(ancestors);
-    ancestors.insert(iter);
-
-    if (!TestPackageTransactions(ancestors)) {
-      if (fUsingModified) {
-        mapModifiedTx.get<ancestor_score>().erase(modit);
-        failedTx.insert(iter);
+    if (!TestPackageParents(chunk->vTxs) ||
+        !TestPackageTransactions(chunk->vTxs)) {
+      if (AddPartialChunk(chunk->vTxs)) {
+        ++nPackagesSelected;
       }
       continue;
     }
 
     nConsecutiveFailed = 0;
 
-    std::vector<CTxMemPool::txiter> sortedEntries;
-    SortForBlock(ancestors, iter, sortedEntries);
-
-    for (size_t i = 0; i < sortedEntries.size(); ++i) {
-      AddToBlock(sortedEntries[i]);
-
-      mapModifiedTx.erase(sortedEntries[i]);
+    for (const CTxMemPool::txiter it : chunk->vTxs) {
+      AddToBlock(it);
     }
 
     ++nPackagesSelected;
-
-    nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
   }
 }
 
@@ -473,6 +429,77 @@ void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev,
   pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
+bool UpdateHiveCandidate(const CChainParams &chainparams) {
+  uint256 hashTip;
+  {
+    LOCK(cs_main);
+    hashTip = chainActive.Tip()->GetBlockHash();
+  }
+  const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+  {
+    LOCK(cs_hive_candidate);
+    if (hashHiveCandidateTip == hashTip &&
+        nHiveCandidateTxUpdated == nTransactionsUpdated)
+      return false;
+    hashHiveCandidateTip = hashTip;
+    nHiveCandidateTxUpdated = nTransactionsUpdated;
+  }
+
+  int64_t nStart = GetTimeMicros();
+  std::unique_ptr<CBlockTemplate> candidate;
+  try {
+    candidate = BlockAssembler(chainparams).CreateHiveCandidate();
+  } catch (const std::runtime_error &e) {
+    LogPrint(BCLog::HIVE, "UpdateHiveCandidate: %s\n", e.what());
+    return true;
+  }
+
+  LogPrint(BCLog::HIVE,
+           "UpdateHiveCandidate: %u txs on top of %s prepared in %.2fms\n",
+           candidate->block.vtx.size() - 1,
+           candidate->block.hashPrevBlock.ToString(),
+           0.001 * (GetTimeMicros() - nStart));
+
+  LOCK(cs_hive_candidate);
+  hiveCandidate = std::move(candidate);
+  return true;
+}
+
+static std::unique_ptr<CBlockTemplate>
+TakeHiveCandidate(const CChainParams &chainparams, const CScript &honeyScript,
+                  const CScript &hiveProofScript) {
+  std::unique_ptr<CBlockTemplate> pblocktemplate;
+  {
+    LOCK(cs_hive_candidate);
+    pblocktemplate = std::move(hiveCandidate);
+    hashHiveCandidateTip.SetNull();
+  }
+  if (!pblocktemplate)
+    return nullptr;
+
+  LOCK(cs_main);
+  CBlockIndex *pindexPrev = chainActive.Tip();
+  CBlock *pblock = &pblocktemplate->block;
+  if (pblock->hashPrevBlock != pindexPrev->GetBlockHash())
+    return nullptr;
+
+  const Consensus::Params &consensusParams = chainparams.GetConsensus();
+  const int nHeight = pindexPrev->nHeight + 1;
+  const CAmount nFees = -pblocktemplate->vTxFees[0];
+  pblock->vtx[0] = MakeTransactionRef(
+      CreateCoinbase(honeyScript, &hiveProofScript, nHeight,
+                     nFees + GetBlockSubsidy(nHeight, consensusParams)));
+  pblocktemplate->vchCoinbaseCommitment =
+      GenerateCoinbaseCommitment(*pblock, pindexPrev, consensusParams);
+  pblocktemplate->vTxSigOpsCost[0] =
+      WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+
+  UpdateTime(pblock, consensusParams, pindexPrev);
+  pblock->nBits = GetNextHiveWorkRequired(pindexPrev, consensusParams);
+  pblock->nNonce = consensusParams.hiveNonceMarker;
+  return pblocktemplate;
+}
+
 void BeeKeeper(const CChainParams &chainparams) {
   const Consensus::Params &consensusParams = chainparams.GetConsensus();
 
@@ -557,6 +584,7 @@ void CheckBin(int threadID, std::vector<CBeeRange> bin,
         LOCK(cs_solution_vars);
 
         solutionFound.store(true);
+        nSolutionTime = GetTimeMicros();
         solvingRange = beeRange;
         solvingBee = i;
         return;
@@ -769,8 +797,14 @@ bool BusyBees(const Consensus::Params &consensusParams, int height) {
   if (useEarlyAbortThread)
     earlyAbortThread = new boost::thread(AbortWatchThread, height);
 
-  for (auto &t : binThreads)
-    t.join();
+  UpdateHiveCandidate(Params());
+  for (auto &t : binThreads) {
+    while (!t.try_join_for(
+        boost::chrono::milliseconds(HIVE_CANDIDATE_REFRESH_MS))) {
+      if (!solutionFound.load())
+        UpdateHiveCandidate(Params());
+    }
+  }
 
   checkTime = GetTimeMillis() - checkTime;
 
@@ -861,9 +895,12 @@ bool BusyBees(const Consensus::Params &consensusParams, int height) {
   CScript honeyScript =
       GetScriptForDestination(DecodeDestination(solvingRange.honeyAddress));
 
-  std::unique_ptr<CBlockTemplate> pblocktemplate(
-      BlockAssembler(Params()).CreateNewBlock(honeyScript, true,
-                                              &hiveProofScript));
+  std::unique_ptr<CBlockTemplate> pblocktemplate =
+      TakeHiveCandidate(Params(), honeyScript, hiveProofScript);
+  const bool fWarmTemplate = pblocktemplate != nullptr;
+  if (!fWarmTemplate)
+    pblocktemplate = BlockAssembler(Params()).CreateNewBlock(
+        honeyScript, true, &hiveProofScript);
   if (!pblocktemplate.get()) {
     LogPrintf("BusyBees: Couldn't create block\n");
     return false;
@@ -886,6 +923,15 @@ bool BusyBees(const Consensus::Params &consensusParams, int height) {
 
   std::shared_ptr<const CBlock> shared_pblock =
       std::make_shared<const CBlock>(*pblock);
+  int64_t nSolutionLatency;
+  {
+    LOCK(cs_solution_vars);
+    nSolutionLatency = GetTimeMicros() - nSolutionTime;
+  }
+  LogPrintf("BusyBees: Solution found -> block submitted in %.2fms (%s "
+            "template, %u txs)\n",
+            0.001 * nSolutionLatency, fWarmTemplate ? "warm" : "fresh",
+            pblock->vtx.size() - 1);
   if (!ProcessNewBlock(Params(), shared_pblock, true, nullptr)) {
     LogPrintf("BusyBees: Block wasn't accepted\n");
     return false;
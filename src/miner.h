@@ -9,8 +9,6 @@
 #include <primitives/block.h>
 #include <txmempool.h>
 
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index_container.hpp>
 #include <memory>
 #include <stdint.h>
 
@@ -34,6 +32,7 @@ static const bool DEFAULT_PRINTPRIORITY = false;
 static const int DEFAULT_HIVE_CHECK_DELAY = 1;
 static const int DEFAULT_HIVE_THREADS = -2;
 static const bool DEFAULT_HIVE_EARLY_OUT = true;
+static const int HIVE_CANDIDATE_REFRESH_MS = 1000;
 
 struct CBlockTemplate {
   CBlock block;
@@ -42,79 +41,6 @@ struct CBlockTemplate {
   std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
-struct CTxMemPoolModifiedEntry {
-  explicit CTxMemPoolModifiedEntry(CTxMemPool::txiter entry) {
-    iter = entry;
-    nSizeWithAncestors = entry->GetSizeWithAncestors();
-    nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-    nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
-  }
-
-  int64_t GetModifiedFee() const { return iter->GetModifiedFee(); }
-  uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
-  CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
-  size_t GetTxSize() const { return iter->GetTxSize(); }
-  const CTransaction &GetTx() const { return iter->GetTx(); }
-
-  CTxMemPool::txiter iter;
-  uint64_t nSizeWithAncestors;
-  CAmount nModFeesWithAncestors;
-  int64_t nSigOpCostWithAncestors;
-};
-
-struct CompareCTxMemPoolIter {
-  bool operator()(const CTxMemPool::txiter &a,
-                  const CTxMemPool::txiter &b) const {
-    return &(*a) < &(*b);
-  }
-};
-
-struct modifiedentry_iter {
-  typedef CTxMemPool::txiter result_type;
-  result_type operator()(const CTxMemPoolModifiedEntry &entry) const {
-    return entry.iter;
-  }
-};
-
-struct CompareTxIterByAncestorCount {
-  bool operator()(const CTxMemPool::txiter &a,
-                  const CTxMemPool::txiter &b) const {
-    if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
-      return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-    return CTxMemPool::CompareIteratorByHash()(a, b);
-  }
-};
-
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<modifiedentry_iter,
-                                           CompareCTxMemPoolIter>,
-
-        boost::multi_index::ordered_non_unique<
-
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareTxMemPoolEntryByAncestorFee>>>
-    indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator
-    modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator
-    modtxscoreiter;
-
-struct update_for_parent_inclusion {
-  explicit update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-  void operator()(CTxMemPoolModifiedEntry &e) {
-    e.nModFeesWithAncestors -= iter->GetFee();
-    e.nSizeWithAncestors -= iter->GetTxSize();
-    e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
-  }
-
-  CTxMemPool::txiter iter;
-};
-
 class BlockAssembler {
 private:
   std::unique_ptr<CBlockTemplate> pblocktemplate;
@@ -123,6 +49,7 @@ private:
 
   bool fIncludeWitness;
   bool fIncludeBCTs;
+  bool fHiveCandidate;
 
   unsigned int nBlockMaxWeight;
   CFeeRate blockMinFeeRate;
@@ -151,29 +78,30 @@ public:
   CreateNewBlock(const CScript &scriptPubKeyIn, bool fMineWitnessTx = true,
                  const CScript *hiveProofScript = nullptr);
 
+  /** Select and validate the transactions of a hive block ahead of time.
+   * The result carries a placeholder coinbase and PoW header fields. Unlike
+   * CreateNewBlock, this logs only under -debug=hive and leaves the
+   * getmininginfo block stats alone. */
+  std::unique_ptr<CBlockTemplate> CreateHiveCandidate();
+
 private:
   void resetBlock();
 
   void AddToBlock(CTxMemPool::txiter iter);
 
-  void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+  void addPackageTxs(int &nPackagesSelected, int &nRelinearized);
 
-  void onlyUnconfirmed(CTxMemPool::setEntries &testSet);
+  /** Add what can be of a chunk that cannot be added whole: leaving out
+   * transactions that may not go in the block and those depending on them,
+   * the longest prefix that fits and pays the minimum feerate. Returns false
+   * if nothing was added. */
+  bool AddPartialChunk(const CTxMemPool::vecEntries &chunk);
 
   bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
 
-  bool TestPackageTransactions(const CTxMemPool::setEntries &package);
-
-  bool SkipMapTxEntry(CTxMemPool::txiter it,
-                      indexed_modified_transaction_set &mapModifiedTx,
-                      CTxMemPool::setEntries &failedTx);
+  bool TestPackageTransactions(const CTxMemPool::vecEntries &package);
 
-  void SortForBlock(const CTxMemPool::setEntries &package,
-                    CTxMemPool::txiter entry,
-                    std::vector<CTxMemPool::txiter> &sortedEntries);
-
-  int UpdatePackagesForAdded(const CTxMemPool::setEntries &alreadyAdded,
-                             indexed_modified_transaction_set &mapModifiedTx);
+  bool TestPackageParents(const CTxMemPool::vecEntries &package) const;
 };
 
 void GenerateLNCR(bool fGenerate, int nThreads,
@@ -190,6 +118,10 @@ int64_t UpdateTime(CBlockHeader *pblock,
                    const Consensus::Params &consensusParams,
                    const CBlockIndex *pindexPrev);
 
+/** Rebuild the hive block candidate, unless the tip and mempool are unchanged
+ * since it was last built or tried. Returns false if skipped. */
+bool UpdateHiveCandidate(const CChainParams &chainparams);
+
 void BeeKeeper(const CChainParams &chainparams);
 
 bool BusyBees(const Consensus::Params &consensusParams, int height);
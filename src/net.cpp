@@ -69,6 +69,17 @@ static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
 
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL;
 
+static const int64_t SOCKET_EVENTS_TIMEOUT_MS = 50;
+
+// How often the socket handler sweeps every node for disconnects and timeouts.
+static const int64_t SOCKET_HOUSEKEEPING_INTERVAL_MS = 100;
+
+// Listening sockets are watched under ids no node can have.
+static const uint64_t LISTEN_SOCKET_EVENTS_ID = 1ULL << 63;
+
+// Queued buffers passed to a single sendmsg call.
+static const size_t MAX_SEND_IOVECS = 64;
+
 bool fDiscover = true;
 bool fListen = true;
 bool fRelayTxes = true;
@@ -389,6 +400,12 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
     CloseSocket(hSocket);
     return nullptr;
   }
+  if (socketEvents && !socketEvents->CanWatch(hSocket)) {
+    LogPrintf("Cannot create connection: socket not usable with %s\n",
+              socketEvents->GetName());
+    CloseSocket(hSocket);
+    return nullptr;
+  }
 
   NodeId id = GetNewNodeId();
   uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE)
@@ -639,12 +656,22 @@ void CNode::copyStats(CNodeStats &stats) {
     LOCK(cs_vSend);
     X(mapSendBytesPerMsgCmd);
     X(nSendBytes);
+    X(nSendCalls);
+    X(nSendMsgs);
   }
   {
     LOCK(cs_vRecv);
     X(mapRecvBytesPerMsgCmd);
     X(nRecvBytes);
   }
+  X(nRecvBufferUsage);
+  {
+    LOCK(cs_vProcessMsg);
+    X(mapProcessTimePerMsgCmd);
+    X(nProcessQueueSizeMax);
+    X(nProcessQueueMsgsMax);
+  }
+  X(nProcessCPUMicros);
   X(fWhitelisted);
 
   int64_t nPingUsecWait = 0;
@@ -671,8 +698,8 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes,
   nRecvBytes += nBytes;
   while (nBytes > 0) {
     if (vRecvMsg.empty() || vRecvMsg.back().complete())
-      vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK,
-                                     INIT_PROTO_VERSION));
+      vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK,
+                            INIT_PROTO_VERSION, &nRecvBufferUsage);
 
     CNetMessage &msg = vRecvMsg.back();
 
@@ -729,18 +756,84 @@ int CNode::GetSendVersion() const {
   return nSendVersion;
 }
 
+CRecvBufferPool g_recv_buffer_pool;
+
+CSerializeData CRecvBufferPool::Get(size_t nSize) {
+  CSerializeData vch;
+  if (nSize == 0)
+    return vch;
+
+  int nClass = 0;
+  while (nClass < NUM_CLASSES && ClassSize(nClass) < nSize)
+    nClass++;
+  {
+    LOCK(cs);
+    if (nClass < NUM_CLASSES && !vFree[nClass].empty()) {
+      vch.swap(vFree[nClass].back());
+      vFree[nClass].pop_back();
+      nPooledBytes -= vch.capacity();
+      nHits++;
+      return vch;
+    }
+    nMisses++;
+  }
+  vch.reserve(nClass < NUM_CLASSES ? ClassSize(nClass) : nSize);
+  return vch;
+}
+
+void CRecvBufferPool::Put(CSerializeData &&vch) {
+  int nClass = NUM_CLASSES - 1;
+  while (nClass >= 0 && ClassSize(nClass) > vch.capacity())
+    nClass--;
+  if (nClass < 0)
+    return;
+
+  vch.clear();
+  LOCK(cs);
+  if (vFree[nClass].size() >= MAX_PER_CLASS ||
+      nPooledBytes + vch.capacity() > MAX_POOLED_BYTES)
+    return;
+  nPooledBytes += vch.capacity();
+  vFree[nClass].emplace_back(std::move(vch));
+}
+
+CRecvBufferPool::Stats CRecvBufferPool::GetStats() const {
+  LOCK(cs);
+  Stats stats;
+  stats.nPooledBuffers = 0;
+  for (const std::vector<CSerializeData> &vClass : vFree) {
+    stats.nPooledBuffers += vClass.size();
+  }
+  stats.nPooledBytes = nPooledBytes;
+  stats.nHits = nHits;
+  stats.nMisses = nMisses;
+  return stats;
+}
+
+CNetMessage::~CNetMessage() {
+  if (nBufferCapacity == 0)
+    return;
+  if (pnBufferUsage)
+    *pnBufferUsage -= nBufferCapacity;
+  CSerializeData vch;
+  vRecv.SwapBuffer(vch);
+  g_recv_buffer_pool.Put(std::move(vch));
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes) {
-  unsigned int nRemaining = 24 - nHdrPos;
+  unsigned int nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
   unsigned int nCopy = std::min(nRemaining, nBytes);
 
   memcpy(&hdrbuf[nHdrPos], pch, nCopy);
   nHdrPos += nCopy;
 
-  if (nHdrPos < 24)
+  if (nHdrPos < CMessageHeader::HEADER_SIZE)
     return nCopy;
 
   try {
-    hdrbuf >> hdr;
+    CSpanReader(vRecv.GetType(), vRecv.GetVersion(), hdrbuf,
+                hdrbuf + CMessageHeader::HEADER_SIZE) >>
+        hdr;
   } catch (const std::exception &) {
     return -1;
   }
@@ -757,12 +850,21 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes) {
   unsigned int nRemaining = hdr.nMessageSize - nDataPos;
   unsigned int nCopy = std::min(nRemaining, nBytes);
 
-  if (vRecv.size() < nDataPos + nCopy) {
-    vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+  // Grow with the data received rather than the size announced, which a
+  // peer need not follow with any data.
+  if (nBufferCapacity < nDataPos + nCopy) {
+    CSerializeData vch = g_recv_buffer_pool.Get(nDataPos + nCopy);
+    vch.insert(vch.end(), vRecv.begin(), vRecv.end());
+    if (pnBufferUsage)
+      *pnBufferUsage += vch.capacity() - nBufferCapacity;
+    nBufferCapacity = vch.capacity();
+    vRecv.SwapBuffer(vch);
+    if (vch.capacity() > 0)
+      g_recv_buffer_pool.Put(std::move(vch));
   }
 
   hasher.Write((const unsigned char *)pch, nCopy);
-  memcpy(&vRecv[nDataPos], pch, nCopy);
+  vRecv.write(pch, nCopy);
   nDataPos += nCopy;
 
   return nCopy;
@@ -775,43 +877,75 @@ const uint256 &CNetMessage::GetMessageHash() const {
   return data_hash;
 }
 
-size_t CConnman::SocketSendData(CNode *pnode) const {
+size_t CConnman::SocketSendData(CNode *pnode) {
   auto it = pnode->vSendMsg.begin();
   size_t nSentSize = 0;
+  size_t nSendCalls = 0;
 
   while (it != pnode->vSendMsg.end()) {
-    const auto &data = *it;
-    assert(data.size() > pnode->nSendOffset);
+    assert(it->size() > pnode->nSendOffset);
+    size_t nWanted = 0;
     int nBytes = 0;
     {
       LOCK(pnode->cs_hSocket);
       if (pnode->hSocket == INVALID_SOCKET)
         break;
-      nBytes =
-          send(pnode->hSocket,
-               reinterpret_cast<const char *>(data.data()) + pnode->nSendOffset,
-               data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+      nWanted = it->size() - pnode->nSendOffset;
+      nBytes = send(pnode->hSocket,
+                    reinterpret_cast<const char *>(it->data()) +
+                        pnode->nSendOffset,
+                    nWanted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+      // Hand the kernel as many queued buffers as fit in one call; sendmsg
+      // rather than writev so that MSG_NOSIGNAL applies.
+      struct iovec vIov[MAX_SEND_IOVECS];
+      size_t nIov = 0;
+      size_t nOffset = pnode->nSendOffset;
+      for (auto itIov = it;
+           itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS;
+           ++itIov) {
+        vIov[nIov].iov_base = itIov->data() + nOffset;
+        vIov[nIov].iov_len = itIov->size() - nOffset;
+        nWanted += vIov[nIov].iov_len;
+        nOffset = 0;
+        nIov++;
+      }
+      struct msghdr msg = {};
+      msg.msg_iov = vIov;
+      msg.msg_iovlen = nIov;
+      nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
     }
+    nSendCalls++;
     if (nBytes > 0) {
       pnode->nLastSend = GetSystemTimeInSeconds();
       pnode->nSendBytes += nBytes;
-      pnode->nSendOffset += nBytes;
       nSentSize += nBytes;
-      if (pnode->nSendOffset == data.size()) {
+      size_t nLeft = nBytes;
+      while (nLeft > 0) {
+        size_t nRemaining = it->size() - pnode->nSendOffset;
+        if (nLeft < nRemaining) {
+          pnode->nSendOffset += nLeft;
+          break;
+        }
+        nLeft -= nRemaining;
         pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
-        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+        pnode->nSendSize -= it->size();
         it++;
-      } else {
-        break;
       }
+      pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+      if ((size_t)nBytes < nWanted)
+        break;
     } else {
       if (nBytes < 0) {
         int nErr = WSAGetLastError();
         if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR &&
             nErr != WSAEINPROGRESS) {
-          LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
-          pnode->CloseSocketDisconnect();
+          // The socket handler closes it, being the only one to.
+          if (!pnode->fDisconnect)
+            LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
+          pnode->fDisconnect = true;
         }
       }
 
@@ -824,6 +958,8 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
     assert(pnode->nSendSize == 0);
   }
   pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+  pnode->nSendCalls += nSendCalls;
+  nTotalSendCalls += nSendCalls;
   return nSentSize;
 }
 
@@ -993,9 +1129,9 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
     return;
   }
 
-  if (!IsSelectableSocket(hSocket)) {
-    LogPrintf("connection from %s dropped: non-selectable socket\n",
-              addr.ToString());
+  if (!socketEvents->CanWatch(hSocket)) {
+    LogPrintf("connection from %s dropped: socket not usable with %s\n",
+              addr.ToString(), socketEvents->GetName());
     CloseSocket(hSocket);
     return;
   }
@@ -1038,12 +1174,60 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
     LOCK(cs_vNodes);
     vNodes.push_back(pnode);
   }
+  fSocketNodesAdded = true;
+}
+
+void CConnman::SocketInterestChanged(CNode *pnode) {
+  if (pnode->fSocketInterestChanged.exchange(true))
+    return;
+  LOCK(cs_vSocketInterestChanged);
+  vSocketInterestChanged.push_back(pnode->GetId());
+}
+
+void CConnman::WatchNodeSocket(CNode *pnode) {
+  pnode->fSocketInterestChanged = false;
+  bool select_recv = !pnode->fPauseRecv;
+  bool select_send;
+  {
+    LOCK(pnode->cs_vSend);
+    select_send = !pnode->vSendMsg.empty();
+  }
+
+  uint8_t nInterest = 0;
+  if (select_send)
+    nInterest = SOCKET_EVENT_SEND;
+  else if (select_recv)
+    nInterest = SOCKET_EVENT_RECV;
+  LOCK(pnode->cs_hSocket);
+  if (pnode->hSocket != INVALID_SOCKET)
+    socketEvents->Watch(pnode->GetId(), pnode->hSocket, nInterest);
+}
+
+void CConnman::CloseNodeSocket(CNode *pnode) {
+  socketEvents->Unwatch(pnode->GetId());
+  pnode->CloseSocketDisconnect();
 }
 
 void CConnman::ThreadSocketHandler() {
   unsigned int nPrevNodeCount = 0;
+  // Nodes with watched sockets. Only this thread closes and deletes nodes,
+  // so they stay valid while in here.
+  std::unordered_map<NodeId, CNode *> mapSocketNodes;
+  int64_t nLastHousekeeping = 0;
+
+  for (size_t i = 0; i < vhListenSocket.size(); i++) {
+    socketEvents->Watch(LISTEN_SOCKET_EVENTS_ID + i, vhListenSocket[i].socket,
+                        SOCKET_EVENT_RECV, true);
+  }
+
   while (!interruptNet) {
-    {
+    // Work on every node runs on a timer, or when one was added, so that a
+    // wakeup otherwise only costs as much as the sockets it reports.
+    int64_t nNow = GetTimeMillis();
+    bool fHousekeeping =
+        nNow - nLastHousekeeping >= SOCKET_HOUSEKEEPING_INTERVAL_MS;
+    if (fHousekeeping) {
+      nLastHousekeeping = nNow;
       LOCK(cs_vNodes);
 
       std::vector<CNode *> vNodesCopy = vNodes;
@@ -1054,14 +1238,15 @@ void CConnman::ThreadSocketHandler() {
 
           pnode->grantOutbound.Release();
 
-          pnode->CloseSocketDisconnect();
+          CloseNodeSocket(pnode);
+          mapSocketNodes.erase(pnode->GetId());
 
           pnode->Release();
           vNodesDisconnected.push_back(pnode);
         }
       }
     }
-    {
+    if (fHousekeeping) {
       std::list<CNode *> vNodesDisconnectedCopy = vNodesDisconnected;
       for (CNode *pnode : vNodesDisconnectedCopy) {
         if (pnode->GetRefCount() <= 0) {
@@ -1082,113 +1267,105 @@ void CConnman::ThreadSocketHandler() {
         }
       }
     }
-    size_t vNodesSize;
-    {
-      LOCK(cs_vNodes);
-      vNodesSize = vNodes.size();
-    }
-    if (vNodesSize != nPrevNodeCount) {
-      nPrevNodeCount = vNodesSize;
-      if (clientInterface)
-        clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
-    }
-
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 50000;
-
-    fd_set fdsetRecv;
-    fd_set fdsetSend;
-    fd_set fdsetError;
-    FD_ZERO(&fdsetRecv);
-    FD_ZERO(&fdsetSend);
-    FD_ZERO(&fdsetError);
-    SOCKET hSocketMax = 0;
-    bool have_fds = false;
-
-    for (const ListenSocket &hListenSocket : vhListenSocket) {
-      FD_SET(hListenSocket.socket, &fdsetRecv);
-      hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-      have_fds = true;
-    }
-
-    {
-      LOCK(cs_vNodes);
-      for (CNode *pnode : vNodes) {
-        bool select_recv = !pnode->fPauseRecv;
-        bool select_send;
-        {
-          LOCK(pnode->cs_vSend);
-          select_send = !pnode->vSendMsg.empty();
+    if (fSocketNodesAdded.exchange(false) || fHousekeeping) {
+      std::vector<CNode *> vNodesAdded;
+      size_t vNodesSize;
+      {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+        for (CNode *pnode : vNodes) {
+          if (mapSocketNodes.emplace(pnode->GetId(), pnode).second)
+            vNodesAdded.push_back(pnode);
         }
+      }
+      for (CNode *pnode : vNodesAdded)
+        WatchNodeSocket(pnode);
+      if (vNodesSize != nPrevNodeCount) {
+        nPrevNodeCount = vNodesSize;
+        if (clientInterface)
+          clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+      }
+    }
 
-        LOCK(pnode->cs_hSocket);
-        if (pnode->hSocket == INVALID_SOCKET)
-          continue;
-
-        FD_SET(pnode->hSocket, &fdsetError);
-        hSocketMax = std::max(hSocketMax, pnode->hSocket);
-        have_fds = true;
-
-        if (select_send) {
-          FD_SET(pnode->hSocket, &fdsetSend);
+    if (fHousekeeping) {
+      int64_t nTime = GetSystemTimeInSeconds();
+      for (const auto &entry : mapSocketNodes) {
+        CNode *pnode = entry.second;
+        if (nTime - pnode->nTimeConnected <= 60)
           continue;
-        }
-        if (select_recv) {
-          FD_SET(pnode->hSocket, &fdsetRecv);
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+          LogPrint(BCLog::NET,
+                   "socket no message in first 60 seconds, %d %d from %d\n",
+                   pnode->nLastRecv != 0, pnode->nLastSend != 0,
+                   pnode->GetId());
+          pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+          LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+          pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION
+                                                   ? TIMEOUT_INTERVAL
+                                                   : 90 * 60)) {
+          LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+          pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent &&
+                   pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 <
+                       GetTimeMicros()) {
+          LogPrintf("ping timeout: %fs\n",
+                    0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+          pnode->fDisconnect = true;
+        } else if (!pnode->fSuccessfullyConnected) {
+          LogPrintf("version handshake timeout from %d\n", pnode->GetId());
+          pnode->fDisconnect = true;
         }
       }
     }
 
-    int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend,
-                         &fdsetError, &timeout);
-    if (interruptNet)
-      return;
+    std::vector<NodeId> vInterestChanged;
+    {
+      LOCK(cs_vSocketInterestChanged);
+      vInterestChanged.swap(vSocketInterestChanged);
+    }
+    for (NodeId id : vInterestChanged) {
+      auto it = mapSocketNodes.find(id);
+      if (it != mapSocketNodes.end())
+        WatchNodeSocket(it->second);
+    }
 
-    if (nSelect == SOCKET_ERROR) {
-      if (have_fds) {
-        int nErr = WSAGetLastError();
-        LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-        for (unsigned int i = 0; i <= hSocketMax; i++)
-          FD_SET(i, &fdsetRecv);
-      }
-      FD_ZERO(&fdsetSend);
-      FD_ZERO(&fdsetError);
+    SocketEventsReady ready;
+    if (!socketEvents->Wait(SOCKET_EVENTS_TIMEOUT_MS, ready)) {
+      int nErr = WSAGetLastError();
+      LogPrintf("socket %s error %s\n", socketEvents->GetName(),
+                NetworkErrorString(nErr));
       if (!interruptNet.sleep_for(
-              std::chrono::milliseconds(timeout.tv_usec / 1000)))
+              std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS)))
         return;
     }
+    if (interruptNet)
+      return;
 
-    for (const ListenSocket &hListenSocket : vhListenSocket) {
-      if (hListenSocket.socket != INVALID_SOCKET &&
-          FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-        AcceptConnection(hListenSocket);
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+      if (vhListenSocket[i].socket != INVALID_SOCKET &&
+          ready.count(LISTEN_SOCKET_EVENTS_ID + i)) {
+        AcceptConnection(vhListenSocket[i]);
       }
     }
 
-    std::vector<CNode *> vNodesCopy;
-    {
-      LOCK(cs_vNodes);
-      vNodesCopy = vNodes;
-      for (CNode *pnode : vNodesCopy)
-        pnode->AddRef();
-    }
-    for (CNode *pnode : vNodesCopy) {
+    for (const auto &event : ready) {
       if (interruptNet)
         return;
-
-      bool recvSet = false;
-      bool sendSet = false;
-      bool errorSet = false;
+      if (event.first >= LISTEN_SOCKET_EVENTS_ID)
+        continue;
+      auto itNode = mapSocketNodes.find((NodeId)event.first);
+      if (itNode == mapSocketNodes.end())
+        continue;
+      CNode *pnode = itNode->second;
+      uint8_t nReady = event.second;
       {
         LOCK(pnode->cs_hSocket);
         if (pnode->hSocket == INVALID_SOCKET)
           continue;
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
       }
-      if (recvSet || errorSet) {
+      if (nReady & SOCKET_EVENT_RECV) {
         char pchBuf[0x10000];
         int nBytes = 0;
         {
@@ -1198,9 +1375,11 @@ void CConnman::ThreadSocketHandler() {
           nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
         }
         if (nBytes > 0) {
+          if ((size_t)nBytes < sizeof(pchBuf))
+            socketEvents->Drained(pnode->GetId(), SOCKET_EVENT_RECV);
           bool notify = false;
           if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-            pnode->CloseSocketDisconnect();
+            CloseNodeSocket(pnode);
           RecordBytesRecv(nBytes);
           if (notify) {
             size_t nSizeAdded = 0;
@@ -1216,6 +1395,10 @@ void CConnman::ThreadSocketHandler() {
                                         pnode->vRecvMsg,
                                         pnode->vRecvMsg.begin(), it);
               pnode->nProcessQueueSize += nSizeAdded;
+              pnode->nProcessQueueSizeMax = std::max(
+                  pnode->nProcessQueueSizeMax, pnode->nProcessQueueSize);
+              pnode->nProcessQueueMsgsMax = std::max(
+                  pnode->nProcessQueueMsgsMax, pnode->vProcessMsg.size());
               pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
             }
             WakeMessageHandler();
@@ -1224,58 +1407,31 @@ void CConnman::ThreadSocketHandler() {
           if (!pnode->fDisconnect) {
             LogPrint(BCLog::NET, "socket closed\n");
           }
-          pnode->CloseSocketDisconnect();
+          CloseNodeSocket(pnode);
         } else if (nBytes < 0) {
           int nErr = WSAGetLastError();
-          if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE &&
-              nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+          if (nErr == WSAEWOULDBLOCK) {
+            socketEvents->Drained(pnode->GetId(), SOCKET_EVENT_RECV);
+          } else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR &&
+                     nErr != WSAEINPROGRESS) {
             if (!pnode->fDisconnect)
               LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-            pnode->CloseSocketDisconnect();
+            CloseNodeSocket(pnode);
           }
         }
       }
 
-      if (sendSet) {
+      if (nReady & SOCKET_EVENT_SEND) {
         LOCK(pnode->cs_vSend);
         size_t nBytes = SocketSendData(pnode);
         if (nBytes) {
           RecordBytesSent(nBytes);
         }
+        if (!pnode->vSendMsg.empty())
+          socketEvents->Drained(pnode->GetId(), SOCKET_EVENT_SEND);
       }
 
-      int64_t nTime = GetSystemTimeInSeconds();
-      if (nTime - pnode->nTimeConnected > 60) {
-        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-          LogPrint(BCLog::NET,
-                   "socket no message in first 60 seconds, %d %d from %d\n",
-                   pnode->nLastRecv != 0, pnode->nLastSend != 0,
-                   pnode->GetId());
-          pnode->fDisconnect = true;
-        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-          LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-          pnode->fDisconnect = true;
-        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION
-                                                   ? TIMEOUT_INTERVAL
-                                                   : 90 * 60)) {
-          LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-          pnode->fDisconnect = true;
-        } else if (pnode->nPingNonceSent &&
-                   pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 <
-                       GetTimeMicros()) {
-          LogPrintf("ping timeout: %fs\n",
-                    0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-          pnode->fDisconnect = true;
-        } else if (!pnode->fSuccessfullyConnected) {
-          LogPrintf("version handshake timeout from %d\n", pnode->GetId());
-          pnode->fDisconnect = true;
-        }
-      }
-    }
-    {
-      LOCK(cs_vNodes);
-      for (CNode *pnode : vNodesCopy)
-        pnode->Release();
+      WatchNodeSocket(pnode);
     }
   }
 }
@@ -1283,9 +1439,9 @@ void CConnman::ThreadSocketHandler() {
 void CConnman::WakeMessageHandler() {
   {
     std::lock_guard<std::mutex> lock(mutexMsgProc);
-    fMsgProcWake = true;
+    nMsgProcWakeSeq++;
   }
-  condMsgProc.notify_one();
+  condMsgProc.notify_all();
 }
 
 #ifdef USE_UPNP
@@ -1740,9 +1896,20 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     LOCK(cs_vNodes);
     vNodes.push_back(pnode);
   }
+  fSocketNodesAdded = true;
+}
+
+void CConnman::StartMessageHandlers() {
+  for (int i = 0; i < nMessageHandlerThreads; i++) {
+    threadMessageHandlers.emplace_back(
+        &TraceThread<std::function<void()>>, "msghand",
+        std::function<void()>(
+            std::bind(&CConnman::ThreadMessageHandler, this, i)));
+  }
 }
 
-void CConnman::ThreadMessageHandler() {
+void CConnman::ThreadMessageHandler(int nThread) {
+  uint64_t nWakeSeq = 0;
   while (!flagInterruptMsgProc) {
     std::vector<CNode *> vNodesCopy;
     {
@@ -1755,21 +1922,29 @@ void CConnman::ThreadMessageHandler() {
 
     bool fMoreWork = false;
 
-    for (CNode *pnode : vNodesCopy) {
+    // Threads start at different peers and skip any peer another thread is
+    // serving, so a slow message only holds up its own peer.
+    size_t nStart =
+        vNodesCopy.empty() ? 0 : nThread * vNodesCopy.size() /
+                                     nMessageHandlerThreads;
+    for (size_t i = 0; i < vNodesCopy.size(); i++) {
+      CNode *pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
       if (pnode->fDisconnect)
         continue;
+      if (pnode->fInMessageHandler.exchange(true))
+        continue;
 
+      int64_t nCPUStart = GetThreadCPUTimeMicros();
       bool fMoreNodeWork =
           m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
       fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-      if (flagInterruptMsgProc)
-        return;
-
-      {
+      if (!flagInterruptMsgProc) {
         LOCK(pnode->cs_sendProcessing);
         m_msgproc->SendMessages(pnode, flagInterruptMsgProc);
       }
+      pnode->nProcessCPUMicros += GetThreadCPUTimeMicros() - nCPUStart;
 
+      pnode->fInMessageHandler = false;
       if (flagInterruptMsgProc)
         return;
     }
@@ -1782,12 +1957,12 @@ void CConnman::ThreadMessageHandler() {
 
     std::unique_lock<std::mutex> lock(mutexMsgProc);
     if (!fMoreWork) {
-      condMsgProc.wait_until(lock,
-                             std::chrono::steady_clock::now() +
-                                 std::chrono::milliseconds(100),
-                             [this] { return fMsgProcWake; });
+      condMsgProc.wait_until(
+          lock, std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(100),
+          [&] { return nMsgProcWakeSeq != nWakeSeq || flagInterruptMsgProc; });
     }
-    fMsgProcWake = false;
+    nWakeSeq = nMsgProcWakeSeq;
   }
 }
 
@@ -1934,7 +2109,7 @@ void CConnman::SetNetworkActive(bool active) {
     LOCK(cs_vNodes);
 
     for (CNode *pnode : vNodes) {
-      pnode->CloseSocketDisconnect();
+      pnode->fDisconnect = true;
     }
   }
 
@@ -1944,12 +2119,14 @@ void CConnman::SetNetworkActive(bool active) {
 CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In)
     : nSeed0(nSeed0In), nSeed1(nSeed1In) {
   fNetworkActive = true;
+  fSocketNodesAdded = false;
   setBannedIsDirty = false;
   fAddressesInitialized = false;
   nLastNodeId = 0;
   nSendBufferMaxSize = 0;
   nReceiveFloodSize = 0;
   flagInterruptMsgProc = false;
+  nMsgProcWakeSeq = 0;
   SetTryNewOutboundPeer(false);
 
   Options connOptions;
@@ -2072,6 +2249,14 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     semAddnode = MakeUnique<CSemaphore>(nMaxAddnode);
   }
 
+  socketEvents = MakeSocketEvents(strSocketEventsMode);
+  if (!socketEvents) {
+    LogPrintf("Socket events mode %s unavailable, using select\n",
+              strSocketEventsMode);
+    socketEvents = MakeSocketEvents("select");
+  }
+  LogPrintf("Using %s for socket events\n", socketEvents->GetName());
+
   assert(m_msgproc);
   InterruptSocks5(false);
   interruptNet.reset();
@@ -2079,7 +2264,7 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
 
   {
     std::unique_lock<std::mutex> lock(mutexMsgProc);
-    fMsgProcWake = false;
+    nMsgProcWakeSeq = 0;
   }
 
   threadSocketHandler = std::thread(
@@ -2116,9 +2301,7 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this,
                                         connOptions.m_specified_outgoing)));
 
-  threadMessageHandler = std::thread(
-      &TraceThread<std::function<void()>>, "msghand",
-      std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+  StartMessageHandlers();
 
   scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this),
                           DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2162,8 +2345,11 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::Stop() {
-  if (threadMessageHandler.joinable())
-    threadMessageHandler.join();
+  for (std::thread &thread : threadMessageHandlers) {
+    if (thread.joinable())
+      thread.join();
+  }
+  threadMessageHandlers.clear();
   if (threadOpenConnections.joinable())
     threadOpenConnections.join();
   if (threadOpenAddedConnections.joinable())
@@ -2197,6 +2383,7 @@ void CConnman::Stop() {
   vhListenSocket.clear();
   semOutbound.reset();
   semAddnode.reset();
+  socketEvents.reset();
 }
 
 void CConnman::DeleteNode(CNode *pnode) {
@@ -2388,6 +2575,48 @@ uint64_t CConnman::GetTotalBytesSent() {
   return nTotalBytesSent;
 }
 
+uint64_t CConnman::GetTotalSendCalls() const { return nTotalSendCalls; }
+
+uint64_t CConnman::GetTotalSendMsgs() const { return nTotalSendMsgs; }
+
+void CMsgProcessingTime::Add(int64_t nMicros) {
+  nCount++;
+  nTotalMicros += nMicros;
+  nMaxMicros = std::max(nMaxMicros, nMicros);
+  int nBucket = 0;
+  while (nBucket < NUM_BUCKETS - 1 && nMicros >= BucketLimit(nBucket))
+    nBucket++;
+  vBuckets[nBucket]++;
+}
+
+void CMsgProcessingTime::Merge(const CMsgProcessingTime &other) {
+  nCount += other.nCount;
+  nTotalMicros += other.nTotalMicros;
+  nMaxMicros = std::max(nMaxMicros, other.nMaxMicros);
+  for (int i = 0; i < NUM_BUCKETS; i++)
+    vBuckets[i] += other.vBuckets[i];
+}
+
+void CConnman::RecordMessageProcessed(CNode *pnode,
+                                      const std::string &strCommand,
+                                      int64_t nMicros) {
+  // Same keys as the receive byte counts, so peers cannot grow the map.
+  const std::string &strKey =
+      pnode->mapRecvBytesPerMsgCmd.count(strCommand) ? strCommand
+                                                     : NET_MESSAGE_COMMAND_OTHER;
+  {
+    LOCK(pnode->cs_vProcessMsg);
+    pnode->mapProcessTimePerMsgCmd[strKey].Add(nMicros);
+  }
+  LOCK(cs_processTime);
+  mapProcessTimePerMsgCmd[strKey].Add(nMicros);
+}
+
+mapMsgCmdTime CConnman::GetProcessTimePerMsgCmd() {
+  LOCK(cs_processTime);
+  return mapProcessTimePerMsgCmd;
+}
+
 ServiceFlags CConnman::GetLocalServices() const { return nLocalServices; }
 
 void CConnman::SetBestHeight(int height) {
@@ -2417,6 +2646,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
   nLastSend = 0;
   nLastRecv = 0;
   nSendBytes = 0;
+  nSendCalls = 0;
+  nSendMsgs = 0;
   nRecvBytes = 0;
   nTimeOffset = 0;
   addrName = addrNameIn == "" ? addr.ToStringIPPort() : addrNameIn;
@@ -2457,7 +2688,10 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
   nextSendTimeFeeFilter = 0;
   fPauseRecv = false;
   fPauseSend = false;
+  fSocketInterestChanged = false;
   nProcessQueueSize = 0;
+  nProcessQueueSizeMax = 0;
+  nProcessQueueMsgsMax = 0;
 
   for (const std::string &msg : getAllNetMessageTypes())
     mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2531,6 +2765,8 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
 
     pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
     pnode->nSendSize += nTotalSize;
+    pnode->nSendMsgs++;
+    nTotalSendMsgs++;
 
     if (pnode->nSendSize > nSendBufferMaxSize)
       pnode->fPauseSend = true;
@@ -2538,8 +2774,11 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
     if (nMessageSize)
       pnode->vSendMsg.push_back(std::move(msg.data));
 
-    if (optimisticSend == true)
+    if (optimisticSend == true) {
       nBytesSent = SocketSendData(pnode);
+      if (!pnode->vSendMsg.empty())
+        SocketInterestChanged(pnode);
+    }
   }
   if (nBytesSent)
     RecordBytesSent(nBytesSent);
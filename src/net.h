@@ -17,14 +17,17 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <socketevents.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
 #include <uint256.h>
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <map>
 #include <memory>
 #include <stdint.h>
 #include <thread>
@@ -82,6 +85,8 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
 
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
+
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;
 
 typedef int64_t NodeId;
@@ -108,6 +113,24 @@ struct CSerializedNetMsg {
   std::string command;
 };
 
+/** Processing times of one message type. Bucket i counts messages handled in
+ * under BucketLimit(i) microseconds, the last bucket every slower one. */
+struct CMsgProcessingTime {
+  static const int NUM_BUCKETS = 16;
+
+  uint64_t nCount = 0;
+  int64_t nTotalMicros = 0;
+  int64_t nMaxMicros = 0;
+  std::array<uint64_t, NUM_BUCKETS> vBuckets{};
+
+  static int64_t BucketLimit(int nBucket) { return int64_t(16) << nBucket; }
+
+  void Add(int64_t nMicros);
+  void Merge(const CMsgProcessingTime &other);
+};
+
+typedef std::map<std::string, CMsgProcessingTime> mapMsgCmdTime;
+
 class NetEventsInterface;
 class CConnman {
 public:
@@ -137,6 +160,10 @@ public:
     bool m_use_addrman_outgoing = true;
     std::vector<std::string> m_specified_outgoing;
     std::vector<std::string> m_added_nodes;
+    std::string m_socket_events_mode = DEFAULT_SOCKET_EVENTS;
+    // PeerLogicValidation has not been audited for concurrent handlers and
+    // must run with one.
+    int nMessageHandlerThreads = 1;
   };
 
   void Init(const Options &connOptions) {
@@ -146,6 +173,9 @@ public:
         std::min(connOptions.nMaxOutbound, connOptions.nMaxConnections);
     nMaxAddnode = connOptions.nMaxAddnode;
     nMaxFeeler = connOptions.nMaxFeeler;
+    nMessageHandlerThreads =
+        std::max(1, std::min(connOptions.nMessageHandlerThreads,
+                             MAX_MESSAGE_HANDLER_THREADS));
     nBestHeight = connOptions.nBestHeight;
     clientInterface = connOptions.uiInterface;
     m_msgproc = connOptions.m_msgproc;
@@ -157,6 +187,7 @@ public:
       nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     }
     vWhitelistedRange = connOptions.vWhitelistedRange;
+    strSocketEventsMode = connOptions.m_socket_events_mode;
     {
       LOCK(cs_vAddedNodes);
       vAddedNodes = connOptions.m_added_nodes;
@@ -267,6 +298,12 @@ public:
 
   uint64_t GetTotalBytesRecv();
   uint64_t GetTotalBytesSent();
+  uint64_t GetTotalSendCalls() const;
+  uint64_t GetTotalSendMsgs() const;
+
+  void RecordMessageProcessed(CNode *pnode, const std::string &strCommand,
+                              int64_t nMicros);
+  mapMsgCmdTime GetProcessTimePerMsgCmd();
 
   void SetBestHeight(int height);
   int GetBestHeight() const;
@@ -277,6 +314,10 @@ public:
 
   void WakeMessageHandler();
 
+  /** Have the socket handler look again at which events pnode's socket is
+   * watched for, after its send queue filled or it stopped pausing recv. */
+  void SocketInterestChanged(CNode *pnode);
+
 private:
   struct ListenSocket {
     SOCKET socket;
@@ -295,9 +336,12 @@ private:
   void AddOneShot(const std::string &strDest);
   void ProcessOneShot();
   void ThreadOpenConnections(std::vector<std::string> connect);
-  void ThreadMessageHandler();
+  void StartMessageHandlers();
+  void ThreadMessageHandler(int nThread);
   void AcceptConnection(const ListenSocket &hListenSocket);
   void ThreadSocketHandler();
+  void WatchNodeSocket(CNode *pnode);
+  void CloseNodeSocket(CNode *pnode);
   void ThreadDNSAddressSeed();
 
   uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
@@ -316,7 +360,7 @@ private:
 
   NodeId GetNewNodeId();
 
-  size_t SocketSendData(CNode *pnode) const;
+  size_t SocketSendData(CNode *pnode);
 
   bool BannedSetIsDirty();
 
@@ -342,6 +386,12 @@ private:
   uint64_t nMaxOutboundLimit GUARDED_BY(cs_totalBytesSent);
   uint64_t nMaxOutboundTimeframe GUARDED_BY(cs_totalBytesSent);
 
+  std::atomic<uint64_t> nTotalSendCalls{0};
+  std::atomic<uint64_t> nTotalSendMsgs{0};
+
+  CCriticalSection cs_processTime;
+  mapMsgCmdTime mapProcessTimePerMsgCmd GUARDED_BY(cs_processTime);
+
   std::vector<CSubNet> vWhitelistedRange;
 
   unsigned int nSendBufferMaxSize;
@@ -367,6 +417,11 @@ private:
 
   std::unique_ptr<CSemaphore> semOutbound;
   std::unique_ptr<CSemaphore> semAddnode;
+  std::unique_ptr<SocketEvents> socketEvents;
+  std::string strSocketEventsMode;
+  std::atomic<bool> fSocketNodesAdded;
+  CCriticalSection cs_vSocketInterestChanged;
+  std::vector<NodeId> vSocketInterestChanged;
   int nMaxConnections;
   int nMaxOutbound;
   int nMaxAddnode;
@@ -377,7 +432,9 @@ private:
 
   const uint64_t nSeed0, nSeed1;
 
-  bool fMsgProcWake;
+  int nMessageHandlerThreads;
+  // Bumped on every wake so each handler thread notices it.
+  uint64_t nMsgProcWakeSeq;
 
   std::condition_variable condMsgProc;
   std::mutex mutexMsgProc;
@@ -389,7 +446,7 @@ private:
   std::thread threadSocketHandler;
   std::thread threadOpenAddedConnections;
   std::thread threadOpenConnections;
-  std::thread threadMessageHandler;
+  std::vector<std::thread> threadMessageHandlers;
 
   std::atomic_bool m_try_another_outbound_peer;
 
@@ -486,9 +543,16 @@ public:
   bool m_manual_connection;
   int nStartingHeight;
   uint64_t nSendBytes;
+  uint64_t nSendCalls;
+  uint64_t nSendMsgs;
   mapMsgCmdSize mapSendBytesPerMsgCmd;
   uint64_t nRecvBytes;
   mapMsgCmdSize mapRecvBytesPerMsgCmd;
+  int64_t nRecvBufferUsage;
+  mapMsgCmdTime mapProcessTimePerMsgCmd;
+  size_t nProcessQueueSizeMax;
+  size_t nProcessQueueMsgsMax;
+  int64_t nProcessCPUMicros;
   bool fWhitelisted;
   double dPingTime;
   double dPingWait;
@@ -501,15 +565,52 @@ public:
   CAddress addrBind;
 };
 
+/** Free lists of receive buffers by capacity class (1 KiB to 4 MiB, growing
+ * fourfold). A message moves its payload to a buffer of the next class as
+ * data arrives, so it never holds much more than it received, and returns
+ * the buffers it is done with, so busy peers rarely reach the allocator. */
+class CRecvBufferPool {
+public:
+  struct Stats {
+    size_t nPooledBuffers;
+    size_t nPooledBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+  };
+
+  /** An empty buffer with capacity for at least nSize bytes. */
+  CSerializeData Get(size_t nSize);
+  void Put(CSerializeData &&vch);
+  Stats GetStats() const;
+
+private:
+  static const size_t MIN_CLASS_SIZE = 1024;
+  static const int NUM_CLASSES = 7;
+  static const size_t MAX_PER_CLASS = 64;
+  static const size_t MAX_POOLED_BYTES = 32 * 1024 * 1024;
+
+  mutable CCriticalSection cs;
+  std::vector<CSerializeData> vFree[NUM_CLASSES];
+  size_t nPooledBytes = 0;
+  uint64_t nHits = 0;
+  uint64_t nMisses = 0;
+
+  static size_t ClassSize(int nClass) { return MIN_CLASS_SIZE << (2 * nClass); }
+};
+
+extern CRecvBufferPool g_recv_buffer_pool;
+
 class CNetMessage {
 private:
   mutable CHash256 hasher;
   mutable uint256 data_hash;
+  std::atomic<int64_t> *pnBufferUsage;
+  size_t nBufferCapacity;
 
 public:
   bool in_data;
 
-  CDataStream hdrbuf;
+  unsigned char hdrbuf[CMessageHeader::HEADER_SIZE];
 
   CMessageHeader hdr;
 
@@ -521,16 +622,22 @@ public:
 
   int64_t nTime;
 
+  /** pnBufferUsageIn, if set, is kept up to date with the capacity of the
+   * payload buffer and must outlive the message. */
   CNetMessage(const CMessageHeader::MessageStartChars &pchMessageStartIn,
-              int nTypeIn, int nVersionIn)
-      : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn),
-        vRecv(nTypeIn, nVersionIn) {
-    hdrbuf.resize(24);
+              int nTypeIn, int nVersionIn,
+              std::atomic<int64_t> *pnBufferUsageIn = nullptr)
+      : pnBufferUsage(pnBufferUsageIn), nBufferCapacity(0),
+        hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
     in_data = false;
     nHdrPos = 0;
     nDataPos = 0;
     nTime = 0;
   }
+  ~CNetMessage();
+
+  CNetMessage(const CNetMessage &) = delete;
+  CNetMessage &operator=(const CNetMessage &) = delete;
 
   bool complete() const {
     if (!in_data)
@@ -540,10 +647,7 @@ public:
 
   const uint256 &GetMessageHash() const;
 
-  void SetVersion(int nVersionIn) {
-    hdrbuf.SetVersion(nVersionIn);
-    vRecv.SetVersion(nVersionIn);
-  }
+  void SetVersion(int nVersionIn) { vRecv.SetVersion(nVersionIn); }
 
   int readHeader(const char *pch, unsigned int nBytes);
   int readData(const char *pch, unsigned int nBytes);
@@ -560,17 +664,32 @@ public:
   size_t nSendOffset;
 
   uint64_t nSendBytes;
+  uint64_t nSendCalls;
+  uint64_t nSendMsgs;
   std::deque<std::vector<unsigned char>> vSendMsg;
   CCriticalSection cs_vSend;
   CCriticalSection cs_hSocket;
   CCriticalSection cs_vRecv;
 
+  // Capacity of the payload buffers of received messages not yet destroyed.
+  // Declared ahead of the message queues, whose messages update it until
+  // they are destroyed.
+  std::atomic<int64_t> nRecvBufferUsage{0};
+
   CCriticalSection cs_vProcessMsg;
   std::list<CNetMessage> vProcessMsg;
   size_t nProcessQueueSize;
+  size_t nProcessQueueSizeMax;
+  size_t nProcessQueueMsgsMax;
 
   CCriticalSection cs_sendProcessing;
 
+  // Claimed by the message handler thread currently serving this peer.
+  std::atomic<bool> fInMessageHandler{false};
+
+  // Thread CPU time spent processing this peer's messages and sending to it.
+  std::atomic<int64_t> nProcessCPUMicros{0};
+
   std::deque<CInv> vRecvGetData;
   uint64_t nRecvBytes;
   std::atomic<int> nRecvVersion;
@@ -610,10 +729,12 @@ public:
   const uint64_t nKeyedNetGroup;
   std::atomic_bool fPauseRecv;
   std::atomic_bool fPauseSend;
+  std::atomic_bool fSocketInterestChanged;
 
 protected:
   mapMsgCmdSize mapSendBytesPerMsgCmd;
   mapMsgCmdSize mapRecvBytesPerMsgCmd;
+  mapMsgCmdTime mapProcessTimePerMsgCmd GUARDED_BY(cs_vProcessMsg);
 
 public:
   uint256 hashContinue;
@@ -8,9 +8,11 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockprecheck.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <headersegments.h>
 #include <init.h>
 #include <merkleblock.h>
 #include <netbase.h>
@@ -24,6 +26,8 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txorphanage.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilmoneystr.h>
@@ -36,23 +40,8 @@
 
 std::atomic<int64_t> nTimeBestReceived(0);
 
-struct IteratorComparator {
-  template <typename I> bool operator()(const I &a, const I &b) const {
-    return &(*a) < &(*b);
-  }
-};
-
-struct COrphanTx {
-  CTransactionRef tx;
-  NodeId fromPeer;
-  int64_t nTimeExpire;
-};
 static CCriticalSection g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-std::map<COutPoint,
-         std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>>
-    mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
-void EraseOrphansFor(NodeId peer);
+static TxOrphanage orphanage GUARDED_BY(g_cs_orphans);
 
 static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
 static std::vector<std::pair<uint256, CTransactionRef>>
@@ -93,6 +82,12 @@ int g_outbound_peers_with_protect_from_disconnect = 0;
 
 std::atomic<int64_t> g_last_tip_update(0);
 
+std::unique_ptr<CBlockPrecheckQueue> g_blockprecheck;
+
+std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
+
+std::unique_ptr<HeadersSegmentTracker> g_headersegments;
+
 typedef std::map<uint256, CTransactionRef> MapRelay;
 MapRelay mapRelay;
 
@@ -182,7 +177,6 @@ struct CNodeState {
   int64_t nLastGetHeadersTime;
   int nGetHeadersCount;
   int64_t nLastMempoolReqTime;
-  int nOrphanCount;
 
   // Phase 2 Hardening: Additional rate limiting
   int64_t nLastAddrTime;
@@ -196,6 +190,12 @@ struct CNodeState {
   int nSendCmpctCount;
   int nPongMismatchCount;
 
+  // Hive blocks announced to this peer ahead of validation, and the time from
+  // receiving each one to handing its CMPCTBLOCK to the peer.
+  int nHiveRelayCount;
+  int64_t nHiveRelayLastMicros;
+  int64_t nHiveRelayTotalMicros;
+
   CNodeState(CAddress addrIn, std::string addrNameIn)
       : address(addrIn), name(addrNameIn) {
     fCurrentlyConnected = false;
@@ -234,7 +234,6 @@ struct CNodeState {
     nLastGetHeadersTime = 0;
     nGetHeadersCount = 0;
     nLastMempoolReqTime = 0;
-    nOrphanCount = 0;
     // Initialize Phase 2 rate limiting
     nLastAddrTime = 0;
     nAddrCount = 0;
@@ -246,6 +245,9 @@ struct CNodeState {
     nLastNotFoundTime = 0;
     nSendCmpctCount = 0;
     nPongMismatchCount = 0;
+    nHiveRelayCount = 0;
+    nHiveRelayLastMicros = 0;
+    nHiveRelayTotalMicros = 0;
   }
 };
 
@@ -581,7 +583,14 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid,
   for (const QueuedBlock &entry : state->vBlocksInFlight) {
     mapBlocksInFlight.erase(entry.hash);
   }
-  EraseOrphansFor(nodeid);
+  {
+    LOCK(g_cs_orphans);
+    orphanage.EraseForPeer(nodeid);
+  }
+  if (g_txreconciliation)
+    g_txreconciliation->ForgetPeer(nodeid);
+  if (g_headersegments)
+    g_headersegments->ReleasePeer(nodeid);
   nPreferredDownload -= state->fPreferredDownload;
   nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
   assert(nPeersWithValidatedDownloads >= 0);
@@ -614,6 +623,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     if (queue.pindex)
       stats.vHeightInFlight.push_back(queue.pindex->nHeight);
   }
+  stats.nHiveRelayCount = state->nHiveRelayCount;
+  stats.nHiveRelayLastMicros = state->nHiveRelayLastMicros;
+  stats.nHiveRelayTotalMicros = state->nHiveRelayTotalMicros;
+  stats.fTxReconciliation =
+      g_txreconciliation && g_txreconciliation->IsPeerRegistered(nodeid);
   return true;
 }
 
@@ -630,137 +644,16 @@ void AddToCompactExtraTransactions(const CTransactionRef &tx)
   vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
 }
 
-bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
-    EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-  // Hardening: Limit orphans per peer
-  CNodeState *state = State(peer);
-  if (state && state->nOrphanCount >= 100) {
-    LogPrint(BCLog::MEMPOOL,
-             "ignoring orphan tx from peer=%d (quota exceeded)\n", peer);
-    return false;
-  }
-
-  const uint256 &hash = tx->GetHash();
-  if (mapOrphanTransactions.count(hash))
-    return false;
-
-  unsigned int sz = GetTransactionWeight(*tx);
-  if (sz >= MAX_STANDARD_TX_WEIGHT) {
-    LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n",
-             sz, hash.ToString());
-    return false;
-  }
-
-  auto ret = mapOrphanTransactions.emplace(
-      hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
-  assert(ret.second);
-  for (const CTxIn &txin : tx->vin) {
-    mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-  }
-
-  AddToCompactExtraTransactions(tx);
-
-  LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
-           hash.ToString(), mapOrphanTransactions.size(),
-           mapOrphanTransactionsByPrev.size());
-  if (state)
-    state->nOrphanCount++;
-  return true;
-}
-
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-  std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-  if (it == mapOrphanTransactions.end())
-    return 0;
-
-  // Hardening: Decrement orphan count for the peer
-  NodeId peer = it->second.fromPeer;
-  CNodeState *state = State(peer);
-  if (state && state->nOrphanCount > 0)
-    state->nOrphanCount--;
-
-  for (const CTxIn &txin : it->second.tx->vin) {
-    auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-    if (itPrev == mapOrphanTransactionsByPrev.end())
-      continue;
-    itPrev->second.erase(it);
-    if (itPrev->second.empty())
-      mapOrphanTransactionsByPrev.erase(itPrev);
-  }
-  mapOrphanTransactions.erase(it);
-  return 1;
-}
-
-void EraseOrphansFor(NodeId peer) {
+void GetOrphanStats(TxOrphanageStats &stats) {
   LOCK(g_cs_orphans);
-  int nErased = 0;
-  std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-  while (iter != mapOrphanTransactions.end()) {
-    std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-
-    if (maybeErase->second.fromPeer == peer) {
-      nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-    }
-  }
-  if (nErased > 0)
-    LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased,
-             peer);
+  stats = orphanage.GetStats();
 }
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) {
-  LOCK(g_cs_orphans);
-
-  unsigned int nEvicted = 0;
-  static int64_t nNextSweep;
-  int64_t nNow = GetTime();
-  if (nNextSweep <= nNow) {
-    int nErased = 0;
-    int64_t nMinExpTime =
-        nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-      std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-      if (maybeErase->second.nTimeExpire <= nNow) {
-        nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-      } else {
-        nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-      }
-    }
-
-    nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-    if (nErased > 0)
-      LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
-               nErased);
-  }
-  // Phase 2 Hardening: Evict orphans from misbehaving peers first
-  while (mapOrphanTransactions.size() > nMaxOrphans) {
-    int nHighestMisbehavior = -1;
-    std::map<uint256, COrphanTx>::iterator itToErase =
-        mapOrphanTransactions.end();
-
-    // Find orphan from peer with highest misbehavior score
-    for (auto it = mapOrphanTransactions.begin();
-         it != mapOrphanTransactions.end(); ++it) {
-      CNodeState *peerState = State(it->second.fromPeer);
-      int peerMisbehavior = peerState ? peerState->nMisbehavior : 0;
-      if (peerMisbehavior > nHighestMisbehavior) {
-        nHighestMisbehavior = peerMisbehavior;
-        itToErase = it;
-      }
-    }
-
-    // Fallback to random if no misbehaving peer found
-    if (itToErase == mapOrphanTransactions.end() || nHighestMisbehavior == 0) {
-      uint256 randomhash = GetRandHash();
-      itToErase = mapOrphanTransactions.lower_bound(randomhash);
-      if (itToErase == mapOrphanTransactions.end())
-        itToErase = mapOrphanTransactions.begin();
-    }
-
-    EraseOrphanTx(itToErase->first);
-    ++nEvicted;
-  }
-  return nEvicted;
+bool GetTxReconciliationStats(TxReconciliationStats &stats) {
+  if (!g_txreconciliation)
+    return false;
+  stats = g_txreconciliation->GetStats();
+  return true;
 }
 
 void Misbehaving(NodeId pnode, int howmuch) {
@@ -812,39 +705,32 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn,
       std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this,
                 consensusParams),
       EXTRA_PEER_CHECK_INTERVAL * 1000);
+
+  if (nPrecheckThreads > 0)
+    g_blockprecheck.reset(new CBlockPrecheckQueue(
+        Params(), nPrecheckThreads,
+        [connmanIn] { connmanIn->WakeMessageHandler(); }));
+
+  if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION))
+    g_txreconciliation.reset(new TxReconciliationTracker());
+
+  if (fCheckpointsEnabled &&
+      gArgs.GetBoolArg("-parallelheaders", DEFAULT_PARALLEL_HEADERS))
+    g_headersegments.reset(
+        new HeadersSegmentTracker(Params().Checkpoints().mapCheckpoints));
+}
+
+PeerLogicValidation::~PeerLogicValidation() {
+  g_blockprecheck.reset();
+  g_txreconciliation.reset();
+  g_headersegments.reset();
 }
 
 void PeerLogicValidation::BlockConnected(
     const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex,
     const std::vector<CTransactionRef> &vtxConflicted) {
   LOCK(g_cs_orphans);
-
-  std::vector<uint256> vOrphanErase;
-
-  for (const CTransactionRef &ptx : pblock->vtx) {
-    const CTransaction &tx = *ptx;
-
-    for (const auto &txin : tx.vin) {
-      auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-      if (itByPrev == mapOrphanTransactionsByPrev.end())
-        continue;
-      for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end();
-           ++mi) {
-        const CTransaction &orphanTx = *(*mi)->second.tx;
-        const uint256 &orphanHash = orphanTx.GetHash();
-        vOrphanErase.push_back(orphanHash);
-      }
-    }
-  }
-
-  if (vOrphanErase.size()) {
-    int nErased = 0;
-    for (uint256 &orphanHash : vOrphanErase) {
-      nErased += EraseOrphanTx(orphanHash);
-    }
-    LogPrint(BCLog::MEMPOOL,
-             "Erased %d orphan tx included or conflicted by block\n", nErased);
-  }
+  orphanage.EraseForBlock(*pblock);
 
   g_last_tip_update = GetTime();
 }
@@ -856,12 +742,20 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
 
+// Receipt time of the block this thread is submitting for validation, which
+// NewPoWValidBlock runs under. Zero for blocks that did not come from a peer.
+static thread_local int64_t nBlockReceivedMicros = 0;
+
 void PeerLogicValidation::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
   std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
       std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock, true);
   const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
+  const bool fHive = pblock->IsHiveMined(Params().GetConsensus());
+  const int64_t nTimeStart =
+      nBlockReceivedMicros ? nBlockReceivedMicros : GetTimeMicros();
+
   LOCK(cs_main);
 
   static int nHighestFastAnnounce = 0;
@@ -882,7 +776,7 @@ void PeerLogicValidation::NewPoWValidBlock(
   }
 
   connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled,
-                        &hashBlock](CNode *pnode) {
+                        &hashBlock, fHive, nTimeStart](CNode *pnode) {
     if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
       return;
     ProcessBlockAvailability(pnode->GetId());
@@ -898,6 +792,11 @@ void PeerLogicValidation::NewPoWValidBlock(
       connman->PushMessage(pnode,
                            msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
       state.pindexBestHeaderSent = pindex;
+      if (fHive) {
+        state.nHiveRelayLastMicros = GetTimeMicros() - nTimeStart;
+        state.nHiveRelayTotalMicros += state.nHiveRelayLastMicros;
+        state.nHiveRelayCount++;
+      }
     }
   });
 }
@@ -976,7 +875,7 @@ bool static AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
 
     {
       LOCK(g_cs_orphans);
-      if (mapOrphanTransactions.count(inv.hash))
+      if (orphanage.HaveTx(inv.hash))
         return true;
     }
 
@@ -1036,6 +935,29 @@ static void RelayAddress(const CAddress &addr, bool fReachable,
   connman->ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+// Only the coinbase marker byte is looked at. Consensus rejects witness data
+// in blocks without a witness commitment, and a commitment requires the
+// coinbase to carry the witness reserved value; so a block whose coinbase
+// has no witness has none at all. The coinbase always has one input, so the
+// marker cannot be mistaken for an empty input count.
+static bool RawBlockHasWitness(const std::vector<unsigned char> &vBlockData) {
+  CSpanReader reader(SER_NETWORK, PROTOCOL_VERSION, vBlockData.data(),
+                     vBlockData.data() + vBlockData.size());
+  CBlockHeader header;
+  int32_t nTxVersion;
+  unsigned char nMarker;
+  reader >> header;
+  if (ReadCompactSize(reader) == 0)
+    return false;
+  reader >> nTxVersion >> nMarker;
+  return nMarker == 0;
+}
+
+bool CanServeRawBlock(const std::vector<unsigned char> &vBlockData,
+                      int nInvType) {
+  return nInvType == MSG_WITNESS_BLOCK || !RawBlockHasWitness(vBlockData);
+}
+
 void static ProcessGetBlockData(CNode *pfrom,
                                 const Consensus::Params &consensusParams,
                                 const CInv &inv, CConnman *connman,
@@ -1113,16 +1035,38 @@ void static ProcessGetBlockData(CNode *pfrom,
 
   if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
     std::shared_ptr<const CBlock> pblock;
+    bool fSentRaw = false;
     if (a_recent_block &&
         a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
       pblock = a_recent_block;
+    } else if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+      std::vector<unsigned char> vBlockData;
+      if (!ReadRawBlockFromDisk(vBlockData, (*mi).second->GetBlockPos(),
+                                Params().MessageStart()))
+        assert(!"cannot load block from disk");
+      if (CanServeRawBlock(vBlockData, inv.type)) {
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        msg.data = std::move(vBlockData);
+        connman->PushMessage(pfrom, std::move(msg));
+        fSentRaw = true;
+      } else {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        CSpanReader(SER_NETWORK, PROTOCOL_VERSION, vBlockData.data(),
+                    vBlockData.data() + vBlockData.size()) >>
+            *pblockRead;
+        pblock = pblockRead;
+      }
     } else {
       std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
       if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
         assert(!"cannot load block from disk");
       pblock = pblockRead;
     }
-    if (inv.type == MSG_BLOCK)
+    if (fSentRaw)
+      LogPrint(BCLog::NET, "sent block %s to peer=%d from on-disk bytes\n",
+               inv.hash.ToString(), pfrom->GetId());
+    else if (inv.type == MSG_BLOCK)
       connman->PushMessage(pfrom,
                            msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS,
                                          NetMsgType::BLOCK, *pblock));
@@ -1182,6 +1126,55 @@ void static ProcessGetBlockData(CNode *pfrom,
   }
 }
 
+/** Reconsider a batch of the orphans whose parents peer's transactions
+ * supplied. Returns true if more remain for a later pass. */
+static bool ProcessOrphanTx(CConnman *connman, NodeId peer)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans) {
+  std::list<CTransactionRef> lRemovedTxn;
+  for (unsigned int i = 0; i < MAX_ORPHAN_WORK_PER_PASS; i++) {
+    CTransactionRef porphanTx = orphanage.GetTxToReconsider(peer);
+    if (!porphanTx)
+      break;
+    const CTransaction &orphanTx = *porphanTx;
+    const uint256 &orphanHash = orphanTx.GetHash();
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    if (AcceptToMemoryPool(mempool, state, porphanTx, &fMissingInputs,
+                           &lRemovedTxn, false, 0)) {
+      LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
+               orphanHash.ToString());
+      RelayTransaction(orphanTx, connman);
+      orphanage.AddChildrenToWorkSet(orphanTx);
+      orphanage.ResolveTx(orphanHash, true);
+    } else if (!fMissingInputs) {
+      int nDos = 0;
+      bool fMisbehaving = state.IsInvalid(nDos) && nDos > 0;
+      if (fMisbehaving) {
+        Misbehaving(peer, nDos);
+        LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n",
+                 orphanHash.ToString());
+      }
+
+      LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n",
+               orphanHash.ToString());
+      if (!orphanTx.HasWitness() && !state.CorruptionPossible()) {
+        assert(recentRejects);
+        recentRejects->insert(orphanHash);
+      }
+      orphanage.ResolveTx(orphanHash, false);
+      if (fMisbehaving)
+        break;
+    }
+    mempool.check(pcoinsTip.get());
+  }
+
+  for (const CTransactionRef &removedTx : lRemovedTxn)
+    AddToCompactExtraTransactions(removedTx);
+
+  return orphanage.HaveTxToReconsider(peer);
+}
+
 void static ProcessGetData(CNode *pfrom,
                            const Consensus::Params &consensusParams,
                            CConnman *connman,
@@ -1279,6 +1272,111 @@ inline void static SendBlockTransactions(const CBlock &block,
                        msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/** Validate the headers of segments whose anchor is now in the block index,
+ * punishing whoever sent an invalid one. */
+static void ConnectHeaderSegments(const CChainParams &chainparams) {
+  for (const uint256 &hashAnchor : g_headersegments->GetPendingAnchors()) {
+    {
+      LOCK(cs_main);
+      if (!mapBlockIndex.count(hashAnchor))
+        continue;
+    }
+    std::vector<CBlockHeader> headers;
+    std::vector<uint256> vHashYespower;
+    int64_t sender;
+    if (!g_headersegments->TakeSegment(hashAnchor, headers, vHashYespower,
+                                       sender))
+      continue;
+
+    // A batch at a time, so cs_main is released in between.
+    size_t nConnected = 0;
+    while (nConnected < headers.size()) {
+      const size_t nEnd = std::min<size_t>(nConnected + MAX_HEADERS_RESULTS,
+                                           headers.size());
+      std::vector<CBlockHeader> vBatch(headers.begin() + nConnected,
+                                       headers.begin() + nEnd);
+      std::vector<uint256> vBatchHashYespower;
+      if (!vHashYespower.empty())
+        vBatchHashYespower.assign(vHashYespower.begin() + nConnected,
+                                  vHashYespower.begin() + nEnd);
+      CValidationState state;
+      CBlockHeader first_invalid;
+      if (!ProcessNewBlockHeaders(vBatch, state, chainparams, nullptr,
+                                  &first_invalid, &vBatchHashYespower)) {
+        const uint256 hashInvalid = first_invalid.GetHash();
+        while (nConnected < nEnd &&
+               headers[nConnected].GetHash() != hashInvalid)
+          nConnected++;
+        int nDoS;
+        if (state.IsInvalid(nDoS) && nDoS > 0) {
+          LOCK(cs_main);
+          Misbehaving(sender, nDoS);
+        }
+        LogPrint(BCLog::NET,
+                 "invalid header in segment at %s from peer=%d: %s\n",
+                 hashAnchor.ToString(), sender, FormatStateMessage(state));
+        break;
+      }
+      nConnected = nEnd;
+    }
+    LogPrint(BCLog::NET, "connected %u of %u headers of segment at %s\n",
+             nConnected, headers.size(), hashAnchor.ToString());
+  }
+}
+
+/** Headers continuing the segment pfrom is downloading, starting at
+ * nFirstHeight. Their proof of work is checked now, the rest once the chain
+ * reaches the segment. */
+static bool ProcessSegmentHeaders(CNode *pfrom, CConnman *connman,
+                                  const std::vector<CBlockHeader> &headers,
+                                  int nFirstHeight,
+                                  const CChainParams &chainparams) {
+  const Consensus::Params &consensusParams = chainparams.GetConsensus();
+  for (size_t i = 1; i < headers.size(); i++) {
+    if (headers[i].hashPrevBlock != headers[i - 1].GetHash()) {
+      LOCK(cs_main);
+      Misbehaving(pfrom->GetId(), 20);
+      g_headersegments->ReleasePeer(pfrom->GetId(), true);
+      return error("non-continuous headers sequence");
+    }
+  }
+
+  std::vector<uint256> vHashYespower;
+  HashHeadersYespower(headers, nFirstHeight, consensusParams, vHashYespower);
+  for (size_t i = 0; i < headers.size(); i++) {
+    const uint256 *phashYespower = nullptr;
+    if (!vHashYespower.empty() && !vHashYespower[i].IsNull())
+      phashYespower = &vHashYespower[i];
+    if (!CheckHeaderProofOfWork(headers[i], nFirstHeight + i, consensusParams,
+                                phashYespower)) {
+      LOCK(cs_main);
+      Misbehaving(pfrom->GetId(), 50);
+      g_headersegments->ReleasePeer(pfrom->GetId(), true);
+      return error("header segment proof of work failed at height %d",
+                   nFirstHeight + i);
+    }
+  }
+
+  bool fMore;
+  uint256 hashFrom, hashStop;
+  if (!g_headersegments->AddHeaders(pfrom->GetId(), headers, vHashYespower,
+                                    GetTimeMicros(), fMore, hashFrom,
+                                    hashStop))
+    return true;
+  LogPrint(BCLog::NET, "received %u segment headers (%d) from peer=%d\n",
+           headers.size(), nFirstHeight, pfrom->GetId());
+  if (fMore) {
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman->PushMessage(
+        pfrom, msgMaker.Make(NetMsgType::GETHEADERS,
+                             CBlockLocator(std::vector<uint256>{hashFrom}),
+                             hashStop));
+  }
+
+  ConnectHeaderSegments(chainparams);
+  return true;
+}
+
 bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman,
                                   const std::vector<CBlockHeader> &headers,
                                   const CChainParams &chainparams,
@@ -1287,9 +1385,19 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman,
   size_t nCount = headers.size();
 
   if (nCount == 0) {
+    // Nothing more of the segment we asked for.
+    if (g_headersegments)
+      g_headersegments->ReleasePeer(pfrom->GetId(), true);
     return true;
   }
 
+  int nFirstHeight;
+  if (g_headersegments &&
+      g_headersegments->IsContinuation(pfrom->GetId(),
+                                       headers[0].hashPrevBlock, nFirstHeight))
+    return ProcessSegmentHeaders(pfrom, connman, headers, nFirstHeight,
+                                 chainparams);
+
   bool received_new_header = false;
   const CBlockIndex *pindexLast = nullptr;
   {
@@ -1351,6 +1459,9 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman,
     }
   }
 
+  if (g_headersegments)
+    ConnectHeaderSegments(chainparams);
+
   {
     LOCK(cs_main);
     CNodeState *nodestate = State(pfrom->GetId());
@@ -1407,12 +1518,17 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman,
     }
 
     if (nCount == MAX_HEADERS_RESULTS) {
+      // Skip any segment connected on top of these headers.
+      const CBlockIndex *pindexFrom = pindexLast;
+      if (g_headersegments &&
+          pindexBestHeader->GetAncestor(pindexLast->nHeight) == pindexLast)
+        pindexFrom = pindexBestHeader;
       LogPrint(BCLog::NET,
                "more getheaders (%d) to end to peer=%d (startheight:%d)\n",
-               pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
+               pindexFrom->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
       connman->PushMessage(
           pfrom, msgMaker.Make(NetMsgType::GETHEADERS,
-                               chainActive.GetLocator(pindexLast), uint256()));
+                               chainActive.GetLocator(pindexFrom), uint256()));
     }
 
     bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus());
@@ -1498,6 +1614,68 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman,
   return true;
 }
 
+static void SubmitReceivedBlock(const CChainParams &chainparams,
+                                const std::shared_ptr<CBlock> &pblock,
+                                bool fForceProcessing, bool *fNewBlock,
+                                int64_t nTimeReceived) {
+  nBlockReceivedMicros = nTimeReceived;
+  ProcessNewBlock(chainparams, pblock, fForceProcessing, fNewBlock);
+  nBlockReceivedMicros = 0;
+}
+
+/** Announce transactions a reconciliation found the peer is missing. */
+static void PushTxInventory(CNode *pto, const std::vector<uint256> &vTxids,
+                            CConnman *connman) {
+  const CNetMsgMaker msgMaker(pto->GetSendVersion());
+  std::vector<CInv> vInv;
+  for (const uint256 &txid : vTxids) {
+    vInv.push_back(CInv(MSG_TX, txid));
+    if (vInv.size() == MAX_INV_SZ) {
+      connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+      vInv.clear();
+    }
+  }
+  if (!vInv.empty())
+    connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
+static bool ProcessReceivedBlock(const CChainParams &chainparams,
+                                 const std::shared_ptr<CBlock> &pblock,
+                                 NodeId nodeid, int64_t nTimeReceived = 0) {
+  bool forceProcessing = false;
+  const uint256 hash(pblock->GetHash());
+  {
+    LOCK(cs_main);
+
+    forceProcessing |= MarkBlockAsReceived(hash);
+
+    mapBlockSource.emplace(hash, std::make_pair(nodeid, true));
+  }
+  bool fNewBlock = false;
+  SubmitReceivedBlock(chainparams, pblock, forceProcessing, &fNewBlock,
+                      nTimeReceived);
+  if (!fNewBlock) {
+    LOCK(cs_main);
+    mapBlockSource.erase(hash);
+  }
+  return fNewBlock;
+}
+
+static void ProcessPrecheckedBlocks(const CChainParams &chainparams,
+                                    CConnman *connman) {
+  std::vector<CPrecheckedBlock> vChecked;
+  g_blockprecheck->TakeChecked(vChecked);
+  for (const CPrecheckedBlock &checked : vChecked) {
+    if (!ProcessReceivedBlock(chainparams, checked.pblock, checked.nodeid))
+      continue;
+    CachePrecheckedBlock(checked.pblock);
+    connman->ForNode(checked.nodeid, [](CNode *pnode) {
+      pnode->nLastBlockTime = GetTime();
+      return true;
+    });
+  }
+}
+
 bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
                            CDataStream &vRecv, int64_t nTimeReceived,
                            const CChainParams &chainparams, CConnman *connman,
@@ -1640,6 +1818,14 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
     if (pfrom->fInbound)
       PushNodeVersion(pfrom, connman, GetAdjustedTime());
 
+    if (g_txreconciliation && (pfrom->GetLocalServices() & NODE_TXRECON) &&
+        (nServices & NODE_TXRECON) && fRelay) {
+      uint64_t nSalt = g_txreconciliation->PreRegisterPeer(pfrom->GetId());
+      connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION)
+                                      .Make(NetMsgType::SENDTXRCNCL,
+                                            TXRECONCILIATION_VERSION, nSalt));
+    }
+
     connman->PushMessage(
         pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
 
@@ -1768,6 +1954,18 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
     pfrom->fSuccessfullyConnected = true;
   }
 
+  else if (strCommand == NetMsgType::SENDTXRCNCL) {
+    uint32_t nReconVersion;
+    uint64_t nRemoteSalt;
+    vRecv >> nReconVersion >> nRemoteSalt;
+    // The side that opened the connection requests the reconciliations.
+    if (!pfrom->fSuccessfullyConnected && g_txreconciliation &&
+        g_txreconciliation->RegisterPeer(pfrom->GetId(), !pfrom->fInbound,
+                                         nReconVersion, nRemoteSalt))
+      LogPrint(BCLog::NET, "reconciling transactions with peer=%d\n",
+               pfrom->GetId());
+  }
+
   else if (!pfrom->fSuccessfullyConnected) {
     LOCK(cs_main);
     Misbehaving(pfrom->GetId(), 1);
@@ -2096,8 +2294,6 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
       return true;
     }
 
-    std::deque<COutPoint> vWorkQueue;
-    std::vector<uint256> vEraseQueue;
     CTransactionRef ptx;
     vRecv >> ptx;
     const CTransaction &tx = *ptx;
@@ -2120,9 +2316,7 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
                            false, 0)) {
       mempool.check(pcoinsTip.get());
       RelayTransaction(tx, connman);
-      for (unsigned int i = 0; i < tx.vout.size(); i++) {
-        vWorkQueue.emplace_back(inv.hash, i);
-      }
+      orphanage.AddChildrenToWorkSet(tx);
 
       pfrom->nLastTXTime = GetTime();
 
@@ -2132,56 +2326,7 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
           pfrom->GetId(), tx.GetHash().ToString(), mempool.size(),
           mempool.DynamicMemoryUsage() / 1000);
 
-      std::set<NodeId> setMisbehaving;
-      while (!vWorkQueue.empty()) {
-        auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-        vWorkQueue.pop_front();
-        if (itByPrev == mapOrphanTransactionsByPrev.end())
-          continue;
-        for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end();
-             ++mi) {
-          const CTransactionRef &porphanTx = (*mi)->second.tx;
-          const CTransaction &orphanTx = *porphanTx;
-          const uint256 &orphanHash = orphanTx.GetHash();
-          NodeId fromPeer = (*mi)->second.fromPeer;
-          bool fMissingInputs2 = false;
-
-          CValidationState stateDummy;
-
-          if (setMisbehaving.count(fromPeer))
-            continue;
-          if (AcceptToMemoryPool(mempool, stateDummy, porphanTx,
-                                 &fMissingInputs2, &lRemovedTxn, false, 0)) {
-            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
-                     orphanHash.ToString());
-            RelayTransaction(orphanTx, connman);
-            for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-              vWorkQueue.emplace_back(orphanHash, i);
-            }
-            vEraseQueue.push_back(orphanHash);
-          } else if (!fMissingInputs2) {
-            int nDos = 0;
-            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
-              Misbehaving(fromPeer, nDos);
-              setMisbehaving.insert(fromPeer);
-              LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n",
-                       orphanHash.ToString());
-            }
-
-            LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n",
-                     orphanHash.ToString());
-            vEraseQueue.push_back(orphanHash);
-            if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
-              assert(recentRejects);
-              recentRejects->insert(orphanHash);
-            }
-          }
-          mempool.check(pcoinsTip.get());
-        }
-      }
-
-      for (uint256 hash : vEraseQueue)
-        EraseOrphanTx(hash);
+      ProcessOrphanTx(connman, pfrom->GetId());
     } else if (fMissingInputs) {
       bool fRejectedParents = false;
 
@@ -2199,12 +2344,13 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
           if (!AlreadyHave(_inv))
             pfrom->AskFor(_inv);
         }
-        AddOrphanTx(ptx, pfrom->GetId());
-
         unsigned int nMaxOrphanTx = (unsigned int)std::max(
             (int64_t)0,
             gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-        unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+        if (orphanage.AddTx(ptx, pfrom->GetId(), nMaxOrphanTx))
+          AddToCompactExtraTransactions(ptx);
+
+        unsigned int nEvicted = orphanage.LimitOrphans(nMaxOrphanTx);
         if (nEvicted > 0) {
           LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n",
                    nEvicted);
@@ -2460,7 +2606,7 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
       }
       bool fNewBlock = false;
 
-      ProcessNewBlock(chainparams, pblock, true, &fNewBlock);
+      SubmitReceivedBlock(chainparams, pblock, true, &fNewBlock, nTimeReceived);
       if (fNewBlock) {
         pfrom->nLastBlockTime = GetTime();
       } else {
@@ -2526,7 +2672,7 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
     if (fBlockRead) {
       bool fNewBlock = false;
 
-      ProcessNewBlock(chainparams, pblock, true, &fNewBlock);
+      SubmitReceivedBlock(chainparams, pblock, true, &fNewBlock, nTimeReceived);
       if (fNewBlock) {
         pfrom->nLastBlockTime = GetTime();
       } else {
@@ -2567,23 +2713,21 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
     LogPrint(BCLog::NET, "received block %s peer=%d\n",
              pblock->GetHash().ToString(), pfrom->GetId());
 
-    bool forceProcessing = false;
-    const uint256 hash(pblock->GetHash());
-    {
+    int nPrecheckHeight = -1;
+    if (g_blockprecheck && IsInitialBlockDownload()) {
       LOCK(cs_main);
-
-      forceProcessing |= MarkBlockAsReceived(hash);
-
-      mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
+      BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
+      if (mi != mapBlockIndex.end() && mi->second != chainActive.Tip())
+        nPrecheckHeight = mi->second->nHeight + 1;
     }
-    bool fNewBlock = false;
-    ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
-    if (fNewBlock) {
+
+    // Past the precheck queue limits, blocks are processed as they arrive.
+    bool fQueued =
+        nPrecheckHeight >= 0 &&
+        g_blockprecheck->Push(pblock, nPrecheckHeight, pfrom->GetId());
+    if (!fQueued && ProcessReceivedBlock(chainparams, pblock, pfrom->GetId(),
+                                         nTimeReceived))
       pfrom->nLastBlockTime = GetTime();
-    } else {
-      LOCK(cs_main);
-      mapBlockSource.erase(pblock->GetHash());
-    }
   }
 
   else if (strCommand == NetMsgType::GETADDR) {
@@ -2743,6 +2887,62 @@ bool static ProcessMessage(CNode *pfrom, const std::string &strCommand,
     }
   }
 
+  else if (strCommand == NetMsgType::REQRECON) {
+    uint16_t nSetSize;
+    uint16_t nQ;
+    vRecv >> nSetSize >> nQ;
+    if (g_txreconciliation) {
+      bool fRespond;
+      std::vector<unsigned char> vSketch;
+      if (!g_txreconciliation->HandleReconciliationRequest(
+              pfrom->GetId(), GetTimeMicros(), nSetSize, nQ, fRespond,
+              vSketch)) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 20);
+      } else if (fRespond) {
+        connman->PushMessage(pfrom,
+                             msgMaker.Make(NetMsgType::SKETCH, vSketch));
+      }
+    }
+  }
+
+  else if (strCommand == NetMsgType::SKETCH) {
+    std::vector<unsigned char> vSketch;
+    vRecv >> vSketch;
+    if (g_txreconciliation) {
+      bool fRespond;
+      bool fSuccess;
+      std::vector<uint32_t> vAskShortIds;
+      std::vector<uint256> vAnnounce;
+      if (!g_txreconciliation->HandleSketch(pfrom->GetId(), vSketch, fRespond,
+                                            fSuccess, vAskShortIds,
+                                            vAnnounce)) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 20);
+      } else if (fRespond) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF,
+                                                  fSuccess, vAskShortIds));
+        PushTxInventory(pfrom, vAnnounce, connman);
+      }
+    }
+  }
+
+  else if (strCommand == NetMsgType::RECONCILDIFF) {
+    bool fSuccess;
+    std::vector<uint32_t> vAskShortIds;
+    vRecv >> fSuccess >> vAskShortIds;
+    if (g_txreconciliation) {
+      std::vector<uint256> vAnnounce;
+      if (!g_txreconciliation->HandleReconciliationDifference(
+              pfrom->GetId(), fSuccess, vAskShortIds, vAnnounce)) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 20);
+      } else {
+        PushTxInventory(pfrom, vAnnounce, connman);
+      }
+    }
+  }
+
   else if (strCommand == NetMsgType::NOTFOUND) {
   }
 
@@ -2795,6 +2995,9 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom,
 
   bool fMoreWork = false;
 
+  if (g_blockprecheck)
+    ProcessPrecheckedBlocks(chainparams, connman);
+
   if (!pfrom->vRecvGetData.empty())
     ProcessGetData(pfrom, chainparams.GetConsensus(), connman,
                    interruptMsgProc);
@@ -2805,6 +3008,17 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom,
   if (!pfrom->vRecvGetData.empty())
     return true;
 
+  bool fOrphanWork;
+  {
+    LOCK(g_cs_orphans);
+    fOrphanWork = orphanage.HaveTxToReconsider(pfrom->GetId());
+  }
+  if (fOrphanWork) {
+    LOCK2(cs_main, g_cs_orphans);
+    if (ProcessOrphanTx(connman, pfrom->GetId()))
+      return true;
+  }
+
   if (pfrom->fPauseSend)
     return false;
 
@@ -2817,8 +3031,11 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom,
     msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
     pfrom->nProcessQueueSize -=
         msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+    bool fWasPaused = pfrom->fPauseRecv;
     pfrom->fPauseRecv =
         pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+    if (fWasPaused && !pfrom->fPauseRecv)
+      connman->SocketInterestChanged(pfrom);
     fMoreWork = !pfrom->vProcessMsg.empty();
   }
   CNetMessage &msg(msgs.front());
@@ -2857,6 +3074,7 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom,
   }
 
   bool fRet = false;
+  int64_t nTimeStart = GetTimeMicros();
   try {
     fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams,
                           connman, interruptMsgProc);
@@ -2888,6 +3106,8 @@ bool PeerLogicValidation::ProcessMessages(CNode *pfrom,
   } catch (...) {
     PrintExceptionContinue(nullptr, "ProcessMessages()");
   }
+  connman->RecordMessageProcessed(pfrom, strCommand,
+                                  GetTimeMicros() - nTimeStart);
 
   if (!fRet) {
     LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__,
@@ -3147,6 +3367,29 @@ bool PeerLogicValidation::SendMessages(CNode *pto,
       }
     }
 
+    if (g_headersegments) {
+      uint256 hashFrom, hashStop;
+      if (g_headersegments->HasTimedOut(pto->GetId(), nNow)) {
+        LogPrint(BCLog::NET,
+                 "Timeout downloading headers segment from peer=%d\n",
+                 pto->GetId());
+        g_headersegments->ReleasePeer(pto->GetId(), true);
+      } else if (!state.fSyncStarted && nSyncStarted > 0 && fFetch &&
+                 !pto->fClient && !fImporting && !fReindex &&
+                 pindexBestHeader->GetBlockTime() <=
+                     GetAdjustedTime() - 24 * 60 * 60 &&
+                 g_headersegments->AssignSegment(
+                     pto->GetId(), pindexBestHeader->nHeight,
+                     pto->nStartingHeight, nNow, hashFrom, hashStop)) {
+        LogPrint(BCLog::NET, "getheaders segment after %s to peer=%d\n",
+                 hashFrom.ToString(), pto->GetId());
+        connman->PushMessage(
+            pto, msgMaker.Make(NetMsgType::GETHEADERS,
+                               CBlockLocator(std::vector<uint256>{hashFrom}),
+                               hashStop));
+      }
+    }
+
     if (!fReindex && !fImporting && !IsInitialBlockDownload()) {
       GetMainSignals().Broadcast(nTimeBestReceived, connman);
     }
@@ -3376,7 +3619,9 @@ bool PeerLogicValidation::SendMessages(CNode *pto,
           if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx))
             continue;
 
-          vInv.push_back(CInv(MSG_TX, hash));
+          if (!g_txreconciliation ||
+              !g_txreconciliation->AddToSet(pto->GetId(), hash))
+            vInv.push_back(CInv(MSG_TX, hash));
           nRelayedTransactions++;
           {
             while (!vRelayExpiration.empty() &&
@@ -3403,6 +3648,14 @@ bool PeerLogicValidation::SendMessages(CNode *pto,
     if (!vInv.empty())
       connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+    uint16_t nReconSetSize;
+    uint16_t nReconQ;
+    if (g_txreconciliation &&
+        g_txreconciliation->InitiateReconciliation(pto->GetId(), nNow,
+                                                   nReconSetSize, nReconQ))
+      connman->PushMessage(
+          pto, msgMaker.Make(NetMsgType::REQRECON, nReconSetSize, nReconQ));
+
     nNow = GetTimeMicros();
     if (state.nStallingSince &&
         state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -3543,7 +3796,6 @@ class CNetProcessingCleanup {
 public:
   CNetProcessingCleanup() {}
   ~CNetProcessingCleanup() {
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    orphanage.Clear();
   }
 } instance_of_cnetprocessingcleanup;
@@ -10,11 +10,12 @@
 #include <net.h>
 #include <validationinterface.h>
 
-static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+struct TxOrphanageStats;
+struct TxReconciliationStats;
 
-static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 
-static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+static const unsigned int MAX_ORPHAN_WORK_PER_PASS = 16;
 
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 
@@ -39,6 +40,7 @@ private:
 
 public:
   explicit PeerLogicValidation(CConnman *connman, CScheduler &scheduler);
+  ~PeerLogicValidation();
 
   void
   BlockConnected(const std::shared_ptr<const CBlock> &pblock,
@@ -72,10 +74,25 @@ struct CNodeStateStats {
   int nSyncHeight;
   int nCommonHeight;
   std::vector<int> vHeightInFlight;
+  int nHiveRelayCount;
+  int64_t nHiveRelayLastMicros;
+  int64_t nHiveRelayTotalMicros;
+  bool fTxReconciliation;
 };
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
 void Misbehaving(NodeId nodeid, int howmuch);
 
+void GetOrphanStats(TxOrphanageStats &stats);
+
+/** Whether a block as stored on disk can be sent unchanged in answer to a
+ * getdata of type nInvType, MSG_BLOCK or MSG_WITNESS_BLOCK. If not, it has
+ * witness data the requester did not ask for. */
+bool CanServeRawBlock(const std::vector<unsigned char> &vBlockData,
+                      int nInvType);
+
+/** Returns false if transaction reconciliation is disabled. */
+bool GetTxReconciliationStats(TxReconciliationStats &stats);
+
 #endif
@@ -254,12 +254,19 @@ static IntrRecvError InterruptibleRecv(uint8_t *data, size_t len, int timeout,
         if (!IsSelectableSocket(hSocket)) {
           return IntrRecvError::NetworkError;
         }
+#ifdef USE_POLL
+        struct pollfd pollfd = {};
+        pollfd.fd = hSocket;
+        pollfd.events = POLLIN;
+        int nRet = poll(&pollfd, 1, std::min(endTime - curTime, maxWait));
+#else
         struct timeval tval =
             MillisToTimeval(std::min(endTime - curTime, maxWait));
         fd_set fdset;
         FD_ZERO(&fdset);
         FD_SET(hSocket, &fdset);
         int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+#endif
         if (nRet == SOCKET_ERROR) {
           return IntrRecvError::NetworkError;
         }
@@ -492,11 +499,18 @@ bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
     int nErr = WSAGetLastError();
 
     if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
+#ifdef USE_POLL
+      struct pollfd pollfd = {};
+      pollfd.fd = hSocket;
+      pollfd.events = POLLOUT;
+      int nRet = poll(&pollfd, 1, nTimeout);
+#else
       struct timeval timeout = MillisToTimeval(nTimeout);
       fd_set fdset;
       FD_ZERO(&fdset);
       FD_SET(hSocket, &fdset);
       int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+#endif
       if (nRet == 0) {
         LogPrint(BCLog::NET, "connection to %s timeout\n",
                  addrConnect.ToString());
@@ -11,6 +11,7 @@
 #include <streams.h>
 #include <txmempool.h>
 #include <util.h>
+#include <utiltime.h>
 
 static constexpr double INF_FEERATE = 1e99;
 
@@ -64,17 +65,22 @@ bool FeeModeFromString(const std::string &mode_string,
   return true;
 }
 
+/** Per-bucket counters are kept in flat arrays. The period (or block) is
+ * the row and the bucket the column, so a block's decay pass is one
+ * contiguous sweep over each array. */
 class TxConfirmStats {
 private:
   const std::vector<double> &buckets;
 
-  const std::map<double, unsigned int> &bucketMap;
+  size_t nBuckets;
+
+  size_t nPeriods;
 
   std::vector<double> txCtAvg;
 
-  std::vector<std::vector<double>> confAvg;
+  std::vector<double> confAvg;
 
-  std::vector<std::vector<double>> failAvg;
+  std::vector<double> failAvg;
 
   std::vector<double> avg;
 
@@ -82,15 +88,27 @@ private:
 
   unsigned int scale;
 
-  std::vector<std::vector<int>> unconfTxs;
+  std::vector<int> unconfTxs;
 
   std::vector<int> oldUnconfTxs;
 
   void resizeInMemoryCounters(size_t newbuckets);
 
+  unsigned int BucketIndex(double val) const {
+    return std::lower_bound(buckets.begin(), buckets.end(), val) -
+           buckets.begin();
+  }
+
+  int &UnconfTxs(unsigned int blockIndex, unsigned int bucket) {
+    return unconfTxs[blockIndex * nBuckets + bucket];
+  }
+  int UnconfTxs(unsigned int blockIndex, unsigned int bucket) const {
+    return unconfTxs[blockIndex * nBuckets + bucket];
+  }
+  unsigned int UnconfBlocks() const { return GetMaxConfirms(); }
+
 public:
   TxConfirmStats(const std::vector<double> &defaultBuckets,
-                 const std::map<double, unsigned int> &defaultBucketMap,
                  unsigned int maxPeriods, double decay, unsigned int scale);
 
   void ClearCurrent(unsigned int nBlockHeight);
@@ -109,48 +127,40 @@ public:
                            unsigned int nBlockHeight,
                            EstimationResult *result = nullptr) const;
 
-  unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+  unsigned int GetMaxConfirms() const { return scale * nPeriods; }
 
   void Write(CAutoFile &fileout) const;
 
   void Read(CAutoFile &filein, int nFileVersion, size_t numBuckets);
 };
 
-TxConfirmStats::TxConfirmStats(
-    const std::vector<double> &defaultBuckets,
-    const std::map<double, unsigned int> &defaultBucketMap,
-    unsigned int maxPeriods, double _decay, unsigned int _scale)
-    : buckets(defaultBuckets), bucketMap(defaultBucketMap) {
+TxConfirmStats::TxConfirmStats(const std::vector<double> &defaultBuckets,
+                               unsigned int maxPeriods, double _decay,
+                               unsigned int _scale)
+    : buckets(defaultBuckets), nBuckets(defaultBuckets.size()),
+      nPeriods(maxPeriods) {
   decay = _decay;
   assert(_scale != 0 && "_scale must be non-zero");
   scale = _scale;
-  confAvg.resize(maxPeriods);
-  for (unsigned int i = 0; i < maxPeriods; i++) {
-    confAvg[i].resize(buckets.size());
-  }
-  failAvg.resize(maxPeriods);
-  for (unsigned int i = 0; i < maxPeriods; i++) {
-    failAvg[i].resize(buckets.size());
-  }
+  confAvg.resize(nPeriods * nBuckets);
+  failAvg.resize(nPeriods * nBuckets);
 
-  txCtAvg.resize(buckets.size());
-  avg.resize(buckets.size());
+  txCtAvg.resize(nBuckets);
+  avg.resize(nBuckets);
 
-  resizeInMemoryCounters(buckets.size());
+  resizeInMemoryCounters(nBuckets);
 }
 
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
-  unconfTxs.resize(GetMaxConfirms());
-  for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-    unconfTxs[i].resize(newbuckets);
-  }
-  oldUnconfTxs.resize(newbuckets);
+  unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
+  oldUnconfTxs.assign(newbuckets, 0);
 }
 
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight) {
-  for (unsigned int j = 0; j < buckets.size(); j++) {
-    oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
-    unconfTxs[nBlockHeight % unconfTxs.size()][j] = 0;
+  int *row = &unconfTxs[(nBlockHeight % UnconfBlocks()) * nBuckets];
+  for (size_t j = 0; j < nBuckets; j++) {
+    oldUnconfTxs[j] += row[j];
+    row[j] = 0;
   }
 }
 
@@ -158,23 +168,23 @@ void TxConfirmStats::Record(int blocksToConfirm, double val) {
   if (blocksToConfirm < 1)
     return;
   int periodsToConfirm = (blocksToConfirm + scale - 1) / scale;
-  unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-  for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-    confAvg[i - 1][bucketindex]++;
+  unsigned int bucketindex = BucketIndex(val);
+  for (size_t i = periodsToConfirm; i <= nPeriods; i++) {
+    confAvg[(i - 1) * nBuckets + bucketindex]++;
   }
   txCtAvg[bucketindex]++;
   avg[bucketindex] += val;
 }
 
 void TxConfirmStats::UpdateMovingAverages() {
-  for (unsigned int j = 0; j < buckets.size(); j++) {
-    for (unsigned int i = 0; i < confAvg.size(); i++)
-      confAvg[i][j] = confAvg[i][j] * decay;
-    for (unsigned int i = 0; i < failAvg.size(); i++)
-      failAvg[i][j] = failAvg[i][j] * decay;
-    avg[j] = avg[j] * decay;
-    txCtAvg[j] = txCtAvg[j] * decay;
-  }
+  for (double &v : confAvg)
+    v *= decay;
+  for (double &v : failAvg)
+    v *= decay;
+  for (double &v : avg)
+    v *= decay;
+  for (double &v : txCtAvg)
+    v *= decay;
 }
 
 double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
@@ -203,7 +213,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
   unsigned int bestFarBucket = startbucket;
 
   bool foundAnswer = false;
-  unsigned int bins = unconfTxs.size();
+  unsigned int bins = UnconfBlocks();
   bool newBucketRange = true;
   bool passing = true;
   EstimatorBucket passBucket;
@@ -216,11 +226,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
       newBucketRange = false;
     }
     curFarBucket = bucket;
-    nConf += confAvg[periodTarget - 1][bucket];
+    nConf += confAvg[(periodTarget - 1) * nBuckets + bucket];
     totalNum += txCtAvg[bucket];
-    failNum += failAvg[periodTarget - 1][bucket];
+    failNum += failAvg[(periodTarget - 1) * nBuckets + bucket];
     for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-      extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
+      extraNum += UnconfTxs((nBlockHeight - confct) % bins, bucket);
     extraNum += oldUnconfTxs[bucket];
 
     if (totalNum >= sufficientTxVal / (1 - decay)) {
@@ -323,13 +333,23 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
   return median;
 }
 
+static std::vector<std::vector<double>>
+UnflattenRows(const std::vector<double> &flat, size_t rows) {
+  std::vector<std::vector<double>> nested(rows);
+  const size_t cols = rows ? flat.size() / rows : 0;
+  for (size_t i = 0; i < rows; i++) {
+    nested[i].assign(flat.begin() + i * cols, flat.begin() + (i + 1) * cols);
+  }
+  return nested;
+}
+
 void TxConfirmStats::Write(CAutoFile &fileout) const {
   fileout << decay;
   fileout << scale;
   fileout << avg;
   fileout << txCtAvg;
-  fileout << confAvg;
-  fileout << failAvg;
+  fileout << UnflattenRows(confAvg, nPeriods);
+  fileout << UnflattenRows(failAvg, nPeriods);
 }
 
 void TxConfirmStats::Read(CAutoFile &filein, int nFileVersion,
@@ -356,8 +376,9 @@ void TxConfirmStats::Read(CAutoFile &filein, int nFileVersion,
     throw std::runtime_error(
         "Corrupt estimates file. Mismatch in tx count bucket count");
   }
-  filein >> confAvg;
-  maxPeriods = confAvg.size();
+  std::vector<std::vector<double>> fileConfAvg, fileFailAvg;
+  filein >> fileConfAvg;
+  maxPeriods = fileConfAvg.size();
   maxConfirms = scale * maxPeriods;
 
   if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) {
@@ -365,24 +386,33 @@ void TxConfirmStats::Read(CAutoFile &filein, int nFileVersion,
                              "for between 1 and 1008 (one week) confirms");
   }
   for (unsigned int i = 0; i < maxPeriods; i++) {
-    if (confAvg[i].size() != numBuckets) {
+    if (fileConfAvg[i].size() != numBuckets) {
       throw std::runtime_error("Corrupt estimates file. Mismatch in feerate "
                                "conf average bucket count");
     }
   }
 
-  filein >> failAvg;
-  if (maxPeriods != failAvg.size()) {
+  filein >> fileFailAvg;
+  if (maxPeriods != fileFailAvg.size()) {
     throw std::runtime_error(
         "Corrupt estimates file. Mismatch in confirms tracked for failures");
   }
   for (unsigned int i = 0; i < maxPeriods; i++) {
-    if (failAvg[i].size() != numBuckets) {
+    if (fileFailAvg[i].size() != numBuckets) {
       throw std::runtime_error("Corrupt estimates file. Mismatch in one of "
                                "failure average bucket counts");
     }
   }
 
+  nBuckets = numBuckets;
+  nPeriods = maxPeriods;
+  confAvg.clear();
+  failAvg.clear();
+  for (unsigned int i = 0; i < maxPeriods; i++) {
+    confAvg.insert(confAvg.end(), fileConfAvg[i].begin(), fileConfAvg[i].end());
+    failAvg.insert(failAvg.end(), fileFailAvg[i].begin(), fileFailAvg[i].end());
+  }
+
   resizeInMemoryCounters(numBuckets);
 
   LogPrint(BCLog::ESTIMATEFEE,
@@ -391,9 +421,9 @@ void TxConfirmStats::Read(CAutoFile &filein, int nFileVersion,
 }
 
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val) {
-  unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-  unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-  unconfTxs[blockIndex][bucketindex]++;
+  unsigned int bucketindex = BucketIndex(val);
+  unsigned int blockIndex = nBlockHeight % UnconfBlocks();
+  UnconfTxs(blockIndex, bucketindex)++;
   return bucketindex;
 }
 
@@ -410,7 +440,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight,
     return;
   }
 
-  if (blocksAgo >= (int)unconfTxs.size()) {
+  if (blocksAgo >= (int)UnconfBlocks()) {
     if (oldUnconfTxs[bucketindex] > 0) {
       oldUnconfTxs[bucketindex]--;
     } else {
@@ -420,9 +450,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight,
                bucketindex);
     }
   } else {
-    unsigned int blockIndex = entryHeight % unconfTxs.size();
-    if (unconfTxs[blockIndex][bucketindex] > 0) {
-      unconfTxs[blockIndex][bucketindex]--;
+    unsigned int blockIndex = entryHeight % UnconfBlocks();
+    if (UnconfTxs(blockIndex, bucketindex) > 0) {
+      UnconfTxs(blockIndex, bucketindex)--;
     } else {
       LogPrint(BCLog::ESTIMATEFEE,
                "Blockpolicy error, mempool tx removed from "
@@ -433,8 +463,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight,
   if (!inBlock && (unsigned int)blocksAgo >= scale) {
     assert(scale != 0);
     unsigned int periodsAgo = blocksAgo / scale;
-    for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-      failAvg[i][bucketindex]++;
+    for (size_t i = 0; i < periodsAgo && i < nPeriods; i++) {
+      failAvg[i * nBuckets + bucketindex]++;
     }
   }
 }
@@ -458,25 +488,24 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock) {
 
 CBlockPolicyEstimator::CBlockPolicyEstimator()
     : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0),
-      historicalBest(0), trackedTxs(0), untrackedTxs(0) {
+      historicalBest(0), trackedTxs(0), untrackedTxs(0),
+      nLastBlockUpdateTime(0) {
   static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
   size_t bucketIndex = 0;
   for (double bucketBoundary = MIN_BUCKET_FEERATE;
        bucketBoundary <= MAX_BUCKET_FEERATE;
        bucketBoundary *= FEE_SPACING, bucketIndex++) {
     buckets.push_back(bucketBoundary);
-    bucketMap[bucketBoundary] = bucketIndex;
   }
   buckets.push_back(INF_FEERATE);
-  bucketMap[INF_FEERATE] = bucketIndex;
-  assert(bucketMap.size() == buckets.size());
+  assert(bucketIndex + 1 == buckets.size());
 
   feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(
-      buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+      buckets, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
   shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(
-      buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+      buckets, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
   longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(
-      buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+      buckets, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator() {}
@@ -541,9 +570,11 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight,
 void CBlockPolicyEstimator::processBlock(
     unsigned int nBlockHeight, std::vector<const CTxMemPoolEntry *> &entries) {
   LOCK(cs_feeEstimator);
+  nLastBlockUpdateTime = 0;
   if (nBlockHeight <= nBestSeenHeight) {
     return;
   }
+  int64_t nTimeStart = GetTimeMicros();
 
   nBestSeenHeight = nBlockHeight;
 
@@ -578,6 +609,12 @@ void CBlockPolicyEstimator::processBlock(
 
   trackedTxs = 0;
   untrackedTxs = 0;
+  nLastBlockUpdateTime = GetTimeMicros() - nTimeStart;
+}
+
+int64_t CBlockPolicyEstimator::GetLastBlockUpdateTime() const {
+  LOCK(cs_feeEstimator);
+  return nLastBlockUpdateTime;
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const {
@@ -877,20 +914,16 @@ bool CBlockPolicyEstimator::Read(CAutoFile &filein) {
                                  "and 1000 feerate buckets");
 
       std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(
-          buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+          buckets, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
       std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(
-          buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+          buckets, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
       std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(
-          buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+          buckets, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
       fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
       fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
       fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
 
       buckets = fileBuckets;
-      bucketMap.clear();
-      for (unsigned int i = 0; i < buckets.size(); i++) {
-        bucketMap[buckets[i]] = i;
-      }
 
       feeStats = std::move(fileFeeStats);
       shortStats = std::move(fileShortStats);
@@ -142,6 +142,9 @@ public:
 
   unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
+  /** Time in microseconds spent in the most recent processBlock call. */
+  int64_t GetLastBlockUpdateTime() const;
+
 private:
   unsigned int nBestSeenHeight;
   unsigned int firstRecordedHeight;
@@ -165,7 +168,7 @@ private:
 
   std::vector<double> buckets;
 
-  std::map<double, unsigned int> bucketMap;
+  int64_t nLastBlockUpdateTime;
 
   mutable CCriticalSection cs_feeEstimator;
 
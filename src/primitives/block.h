@@ -62,6 +62,8 @@ public:
   std::vector<CTransactionRef> vtx;
 
   mutable bool fChecked;
+  mutable bool fBodyChecked;
+  mutable uint256 hashYespowerCached;
 
   CBlock() { SetNull(); }
 
@@ -82,6 +84,12 @@ public:
     CBlockHeader::SetNull();
     vtx.clear();
     fChecked = false;
+    fBodyChecked = false;
+    hashYespowerCached.SetNull();
+  }
+
+  const uint256 *GetCachedHashYespower() const {
+    return hashYespowerCached.IsNull() ? nullptr : &hashYespowerCached;
   }
 
   CBlockHeader GetBlockHeader() const {
@@ -39,6 +39,10 @@ const char *SENDCMPCT = "sendcmpct";
 const char *CMPCTBLOCK = "cmpctblock";
 const char *GETBLOCKTXN = "getblocktxn";
 const char *BLOCKTXN = "blocktxn";
+const char *SENDTXRCNCL = "sendtxrcncl";
+const char *REQRECON = "reqrecon";
+const char *SKETCH = "sketch";
+const char *RECONCILDIFF = "reconcildiff";
 } // namespace NetMsgType
 
 const static std::string allNetMessageTypes[] = {
@@ -50,7 +54,8 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::NOTFOUND,    NetMsgType::FILTERLOAD, NetMsgType::FILTERADD,
     NetMsgType::FILTERCLEAR, NetMsgType::REJECT,     NetMsgType::SENDHEADERS,
     NetMsgType::FEEFILTER,   NetMsgType::SENDCMPCT,  NetMsgType::CMPCTBLOCK,
-    NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN,
+    NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN,   NetMsgType::SENDTXRCNCL,
+    NetMsgType::REQRECON,    NetMsgType::SKETCH,     NetMsgType::RECONCILDIFF,
 };
 const static std::vector<std::string>
     allNetMessageTypesVec(allNetMessageTypes,
@@ -107,6 +107,14 @@ extern const char *CMPCTBLOCK;
 extern const char *GETBLOCKTXN;
 
 extern const char *BLOCKTXN;
+
+extern const char *SENDTXRCNCL;
+
+extern const char *REQRECON;
+
+extern const char *SKETCH;
+
+extern const char *RECONCILDIFF;
 }; // namespace NetMsgType
 
 const std::vector<std::string> &getAllNetMessageTypes();
@@ -126,6 +134,8 @@ enum ServiceFlags : uint64_t {
 
   NODE_NETWORK_LIMITED = (1 << 10),
 
+  NODE_TXRECON = (1 << 12),
+
 };
 
 static ServiceFlags GetDesirableServiceFlags(ServiceFlags services) {
@@ -13,6 +13,7 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <net_processing.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
@@ -21,6 +22,7 @@
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txorphanage.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <validation.h>
@@ -440,27 +442,22 @@ std::string EntryDescriptionString() {
          "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) {
-  AssertLockHeld(mempool.cs);
-
-  info.push_back(Pair("size", (int)e.GetTxSize()));
-  info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-  info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-  info.push_back(Pair("time", e.GetTime()));
-  info.push_back(Pair("height", (int)e.GetHeight()));
-  info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-  info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-  info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-  info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
-  info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
-  info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-  info.push_back(
-      Pair("wtxid", mempool.vTxHashes[e.vTxHashesIdx].first.ToString()));
-  const CTransaction &tx = e.GetTx();
+void entryToJSON(UniValue &info, const TxMempoolSnapshotEntry &e) {
+  info.push_back(Pair("size", (int)e.nTxSize));
+  info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+  info.push_back(Pair("modifiedfee", ValueFromAmount(e.nModifiedFee)));
+  info.push_back(Pair("time", e.nTime));
+  info.push_back(Pair("height", (int)e.nHeight));
+  info.push_back(Pair("descendantcount", e.nCountWithDescendants));
+  info.push_back(Pair("descendantsize", e.nSizeWithDescendants));
+  info.push_back(Pair("descendantfees", e.nModFeesWithDescendants));
+  info.push_back(Pair("ancestorcount", e.nCountWithAncestors));
+  info.push_back(Pair("ancestorsize", e.nSizeWithAncestors));
+  info.push_back(Pair("ancestorfees", e.nModFeesWithAncestors));
+  info.push_back(Pair("wtxid", e.wtxid.ToString()));
   std::set<std::string> setDepends;
-  for (const CTxIn &txin : tx.vin) {
-    if (mempool.exists(txin.prevout.hash))
-      setDepends.insert(txin.prevout.hash.ToString());
+  for (const uint256 &hash : e.vDepends) {
+    setDepends.insert(hash.ToString());
   }
 
   UniValue depends(UniValue::VARR);
@@ -472,23 +469,19 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) {
 }
 
 UniValue mempoolToJSON(bool fVerbose) {
+  std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
   if (fVerbose) {
-    LOCK(mempool.cs);
     UniValue o(UniValue::VOBJ);
-    for (const CTxMemPoolEntry &e : mempool.mapTx) {
-      const uint256 &hash = e.GetTx().GetHash();
+    for (const TxMempoolSnapshotEntry &e : snapshot->vEntries) {
       UniValue info(UniValue::VOBJ);
       entryToJSON(info, e);
-      o.push_back(Pair(hash.ToString(), info));
+      o.push_back(Pair(e.txid.ToString(), info));
     }
     return o;
   } else {
-    std::vector<uint256> vtxid;
-    mempool.queryHashes(vtxid);
-
     UniValue a(UniValue::VARR);
-    for (const uint256 &hash : vtxid)
-      a.push_back(hash.ToString());
+    for (const TxMempoolSnapshotEntry &e : snapshot->vEntries)
+      a.push_back(e.txid.ToString());
 
     return a;
   }
@@ -584,10 +577,9 @@ UniValue getmempoolancestors(const JSONRPCRequest &request) {
   } else {
     UniValue o(UniValue::VOBJ);
     for (CTxMemPool::txiter ancestorIt : setAncestors) {
-      const CTxMemPoolEntry &e = *ancestorIt;
-      const uint256 &_hash = e.GetTx().GetHash();
+      const uint256 &_hash = ancestorIt->GetTx().GetHash();
       UniValue info(UniValue::VOBJ);
-      entryToJSON(info, e);
+      entryToJSON(info, mempool.GetSnapshotEntry(ancestorIt));
       o.push_back(Pair(_hash.ToString(), info));
     }
     return o;
@@ -650,10 +642,9 @@ UniValue getmempooldescendants(const JSONRPCRequest &request) {
   } else {
     UniValue o(UniValue::VOBJ);
     for (CTxMemPool::txiter descendantIt : setDescendants) {
-      const CTxMemPoolEntry &e = *descendantIt;
-      const uint256 &_hash = e.GetTx().GetHash();
+      const uint256 &_hash = descendantIt->GetTx().GetHash();
       UniValue info(UniValue::VOBJ);
-      entryToJSON(info, e);
+      entryToJSON(info, mempool.GetSnapshotEntry(descendantIt));
       o.push_back(Pair(_hash.ToString(), info));
     }
     return o;
@@ -678,17 +669,15 @@ UniValue getmempoolentry(const JSONRPCRequest &request) {
 
   uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-  LOCK(mempool.cs);
-
-  CTxMemPool::txiter it = mempool.mapTx.find(hash);
-  if (it == mempool.mapTx.end()) {
+  std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+  const TxMempoolSnapshotEntry *e = snapshot->find(hash);
+  if (!e) {
     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
                        "Transaction not in mempool");
   }
 
-  const CTxMemPoolEntry &e = *it;
   UniValue info(UniValue::VOBJ);
-  entryToJSON(info, e);
+  entryToJSON(info, *e);
   return info;
 }
 
@@ -1493,11 +1482,27 @@ UniValue getchaintips(const JSONRPCRequest &request) {
   return res;
 }
 
+UniValue mempoolMemoryToJSON(const TxMempoolMemoryUsage &usage) {
+  UniValue ret(UniValue::VOBJ);
+  ret.push_back(Pair("entries", (int64_t)usage.nEntries));
+  ret.push_back(Pair("indexes", (int64_t)usage.nIndexes));
+  ret.push_back(Pair("transactions", (int64_t)usage.nTransactions));
+  ret.push_back(Pair("links", (int64_t)usage.nLinks));
+  ret.push_back(Pair("spends", (int64_t)usage.nNextTx));
+  ret.push_back(Pair("deltas", (int64_t)usage.nDeltas));
+  ret.push_back(Pair("txhashes", (int64_t)usage.nTxHashes));
+  ret.push_back(Pair("miningorder", (int64_t)usage.nMiningOrder));
+  ret.push_back(Pair("descendantcache", (int64_t)usage.nDescendantCache));
+  return ret;
+}
+
 UniValue mempoolInfoToJSON() {
+  TxMempoolMemoryUsage memUsage = mempool.GetMemoryUsage();
   UniValue ret(UniValue::VOBJ);
   ret.push_back(Pair("size", (int64_t)mempool.size()));
   ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
-  ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
+  ret.push_back(Pair("usage", (int64_t)memUsage.Total()));
+  ret.push_back(Pair("memory", mempoolMemoryToJSON(memUsage)));
   size_t maxmempool =
       gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
   ret.push_back(Pair("maxmempool", (int64_t)maxmempool));
@@ -1508,6 +1513,25 @@ UniValue mempoolInfoToJSON() {
   ret.push_back(
       Pair("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK())));
 
+  TxOrphanageStats orphanStats;
+  GetOrphanStats(orphanStats);
+  UniValue orphans(UniValue::VOBJ);
+  orphans.push_back(Pair("size", (int64_t)orphanStats.nOrphans));
+  orphans.push_back(Pair("weight", orphanStats.nTotalWeight));
+  orphans.push_back(Pair("outpoints", (int64_t)orphanStats.nOutpoints));
+  orphans.push_back(Pair("peers", (int64_t)orphanStats.nPeers));
+  orphans.push_back(Pair("pending", (int64_t)orphanStats.nWorkSet));
+  orphans.push_back(Pair("added", orphanStats.nAdded));
+  orphans.push_back(Pair("rejected_quota", orphanStats.nRejectedQuota));
+  orphans.push_back(Pair("rejected_weight", orphanStats.nRejectedWeight));
+  orphans.push_back(Pair("resolved", orphanStats.nResolved));
+  orphans.push_back(Pair("invalid", orphanStats.nInvalid));
+  orphans.push_back(Pair("expired", orphanStats.nExpired));
+  orphans.push_back(Pair("evicted", orphanStats.nEvicted));
+  orphans.push_back(Pair("removed_block", orphanStats.nRemovedForBlock));
+  orphans.push_back(Pair("removed_peer", orphanStats.nRemovedForPeer));
+  ret.push_back(Pair("orphans", orphans));
+
   return ret;
 }
 
@@ -1524,14 +1548,46 @@ UniValue getmempoolinfo(const JSONRPCRequest &request) {
         "serialized size because witness data is discounted\n"
         "  \"usage\": xxxxx,              (numeric) Total memory usage for the "
         "mempool\n"
+        "  \"memory\": {                  (json object) Breakdown of usage in "
+        "bytes\n"
+        "    \"entries\": xxxxx,          (numeric) Mempool entries\n"
+        "    \"indexes\": xxxxx,          (numeric) Index nodes over the "
+        "entries\n"
+        "    \"transactions\": xxxxx,     (numeric) Transaction data\n"
+        "    \"links\": xxxxx,            (numeric) Parent and child links\n"
+        "    \"spends\": xxxxx,           (numeric) Spent outpoint map\n"
+        "    \"deltas\": xxxxx,           (numeric) Fee deltas from "
+        "prioritisetransaction\n"
+        "    \"txhashes\": xxxxx,         (numeric) Witness hash list for "
+        "compact blocks\n"
+        "    \"miningorder\": xxxxx,      (numeric) Mining clusters and "
+        "chunks\n"
+        "    \"descendantcache\": xxxxx   (numeric) Cached descendant sets, "
+        "not counted in usage\n"
+        "  },\n"
         "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for "
         "the mempool\n"
         "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " +
         CURRENCY_UNIT +
         "/kB for tx to be accepted. Is the maximum of minrelaytxfee and "
         "minimum mempool fee\n"
-        "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee "
+        "  \"minrelaytxfee\": xxxxx,      (numeric) Current minimum relay fee "
         "for transactions\n"
+        "  \"orphans\": {                 (json object) Orphan transaction "
+        "pool\n"
+        "    \"size\": xxxxx,             (numeric) Orphans held\n"
+        "    \"weight\": xxxxx,           (numeric) Total weight of the "
+        "orphans\n"
+        "    \"outpoints\": xxxxx,        (numeric) Distinct outpoints they "
+        "spend\n"
+        "    \"peers\": xxxxx,            (numeric) Peers holding orphans\n"
+        "    \"pending\": xxxxx,          (numeric) Orphans waiting to be "
+        "reconsidered\n"
+        "    \"added\", \"rejected_quota\", \"rejected_weight\", "
+        "\"resolved\", \"invalid\", \"expired\", \"evicted\", "
+        "\"removed_block\", \"removed_peer\": xxxxx  (numeric) Counters "
+        "since startup\n"
+        "  }\n"
         "}\n"
         "\nExamples:\n" +
         HelpExampleCli("getmempoolinfo", "") +
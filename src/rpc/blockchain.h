@@ -8,6 +8,7 @@
 class CBlock;
 class CBlockIndex;
 class UniValue;
+struct TxMempoolMemoryUsage;
 
 double GetDifficulty(const CBlockIndex *blockindex = nullptr,
                      bool getHiveDifficulty = false);
@@ -19,6 +20,8 @@ UniValue blockToJSON(const CBlock &block, const CBlockIndex *blockindex,
 
 UniValue mempoolInfoToJSON();
 
+UniValue mempoolMemoryToJSON(const TxMempoolMemoryUsage &usage);
+
 UniValue mempoolToJSON(bool fVerbose = false);
 
 UniValue blockheaderToJSON(const CBlockIndex *blockindex);
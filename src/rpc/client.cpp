@@ -117,6 +117,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"signrawtransaction", 1, "prevtxs"},
     {"signrawtransaction", 2, "privkeys"},
     {"sendrawtransaction", 1, "allowhighfees"},
+    {"sendrawtransactions", 0, "hexstrings"},
+    {"sendrawtransactions", 1, "allowhighfees"},
     {"combinerawtransaction", 0, "txs"},
     {"fundrawtransaction", 1, "options"},
     {"fundrawtransaction", 2, "iswitness"},
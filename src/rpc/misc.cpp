@@ -16,6 +16,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <timedata.h>
+#include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <validation.h>
@@ -561,6 +562,10 @@ UniValue getmemoryinfo(const JSONRPCRequest &request) {
         "pages failed at some point and key data could be swapped to disk.\n"
         "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
         "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+        "  },\n"
+        "  \"mempool\": {              (json object) Mempool memory usage by "
+        "component, as in getmempoolinfo\n"
+        "    ...\n"
         "  }\n"
         "}\n"
         "\nResult (mode \"mallocinfo\"):\n"
@@ -574,6 +579,8 @@ UniValue getmemoryinfo(const JSONRPCRequest &request) {
   if (mode == "stats") {
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    obj.push_back(
+        Pair("mempool", mempoolMemoryToJSON(mempool.GetMemoryUsage())));
     return obj;
   } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
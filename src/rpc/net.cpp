@@ -14,6 +14,7 @@
 #include <rpc/protocol.h>
 #include <sync.h>
 #include <timedata.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -62,6 +63,23 @@ UniValue ping(const JSONRPCRequest &request) {
   return NullUniValue;
 }
 
+static UniValue ProcessTimeToJSON(const mapMsgCmdTime &mapTimes) {
+  UniValue ret(UniValue::VOBJ);
+  for (const mapMsgCmdTime::value_type &i : mapTimes) {
+    UniValue histogram(UniValue::VARR);
+    for (uint64_t nBucket : i.second.vBuckets) {
+      histogram.push_back(nBucket);
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", i.second.nCount));
+    obj.push_back(Pair("total_us", i.second.nTotalMicros));
+    obj.push_back(Pair("max_us", i.second.nMaxMicros));
+    obj.push_back(Pair("histogram", histogram));
+    ret.push_back(Pair(i.first, obj));
+  }
+  return ret;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest &request) {
   if (request.fHelp || request.params.size() != 0)
     throw std::runtime_error(
@@ -88,6 +106,17 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
         "epoch (Jan 1 1970 GMT) of the last receive\n"
         "    \"bytessent\": n,            (numeric) The total bytes sent\n"
         "    \"bytesrecv\": n,            (numeric) The total bytes received\n"
+        "    \"sendcalls\": n,            (numeric) Socket send calls made\n"
+        "    \"sendmsgs\": n,             (numeric) Messages queued for "
+        "sending\n"
+        "    \"recvbuffer\": n,           (numeric) Bytes held in buffers of "
+        "received messages not yet processed\n"
+        "    \"cputime\": n,              (numeric) Microseconds of CPU time "
+        "spent processing messages from and sending to the peer\n"
+        "    \"processqueue_max_bytes\": n, (numeric) Largest size of the queue "
+        "of received messages awaiting processing\n"
+        "    \"processqueue_max_msgs\": n, (numeric) Largest number of "
+        "messages in that queue\n"
         "    \"conntime\": ttt,           (numeric) The connection time in "
         "seconds since epoch (Jan 1 1970 GMT)\n"
         "    \"timeoffset\": ttt,         (numeric) The time offset in "
@@ -115,6 +144,14 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
         "we're currently asking from this peer\n"
         "       ...\n"
         "    ],\n"
+        "    \"hiverelay_count\": n,      (numeric) Hive blocks announced to "
+        "the peer before validation finished\n"
+        "    \"hiverelay_last_us\": n,    (numeric) Microseconds from receiving "
+        "the last of them to sending it to the peer\n"
+        "    \"hiverelay_avg_us\": n,     (numeric) The same, averaged over "
+        "all of them\n"
+        "    \"txreconciliation\": true|false, (boolean) Whether transactions "
+        "are reconciled with the peer instead of announced\n"
         "    \"whitelisted\": true|false, (boolean) Whether the peer is "
         "whitelisted\n"
         "    \"bytessent_per_msg\": {\n"
@@ -126,6 +163,13 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
         "       \"addr\": n,              (numeric) The total bytes received "
         "aggregated by message type\n"
         "       ...\n"
+        "    },\n"
+        "    \"processtime_per_msg\": {\n"
+        "       \"addr\": {               (json object) Processing time of "
+        "received messages of this type, as in getnetstats\n"
+        "         ...\n"
+        "       },\n"
+        "       ...\n"
         "    }\n"
         "  }\n"
         "  ,...\n"
@@ -158,6 +202,14 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
     obj.push_back(Pair("lastrecv", stats.nLastRecv));
     obj.push_back(Pair("bytessent", stats.nSendBytes));
     obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+    obj.push_back(Pair("sendcalls", stats.nSendCalls));
+    obj.push_back(Pair("sendmsgs", stats.nSendMsgs));
+    obj.push_back(Pair("recvbuffer", stats.nRecvBufferUsage));
+    obj.push_back(Pair("cputime", stats.nProcessCPUMicros));
+    obj.push_back(
+        Pair("processqueue_max_bytes", (uint64_t)stats.nProcessQueueSizeMax));
+    obj.push_back(
+        Pair("processqueue_max_msgs", (uint64_t)stats.nProcessQueueMsgsMax));
     obj.push_back(Pair("conntime", stats.nTimeConnected));
     obj.push_back(Pair("timeoffset", stats.nTimeOffset));
     if (stats.dPingTime > 0.0)
@@ -182,6 +234,15 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
         heights.push_back(height);
       }
       obj.push_back(Pair("inflight", heights));
+      obj.push_back(Pair("hiverelay_count", statestats.nHiveRelayCount));
+      obj.push_back(
+          Pair("hiverelay_last_us", statestats.nHiveRelayLastMicros));
+      obj.push_back(Pair("hiverelay_avg_us",
+                         statestats.nHiveRelayCount
+                             ? statestats.nHiveRelayTotalMicros /
+                                   statestats.nHiveRelayCount
+                             : 0));
+      obj.push_back(Pair("txreconciliation", statestats.fTxReconciliation));
     }
     obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -198,6 +259,8 @@ UniValue getpeerinfo(const JSONRPCRequest &request) {
         recvPerMsgCmd.push_back(Pair(i.first, i.second));
     }
     obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
+    obj.push_back(Pair("processtime_per_msg",
+                       ProcessTimeToJSON(stats.mapProcessTimePerMsgCmd)));
 
     ret.push_back(obj);
   }
@@ -389,6 +452,8 @@ UniValue getnettotals(const JSONRPCRequest &request) {
         "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
         "  \"timemillis\": t,       (numeric) Current UNIX time in "
         "milliseconds\n"
+        "  \"sendcalls_per_msg\": x.xxx, (numeric) Socket send calls per "
+        "message sent\n"
         "  \"uploadtarget\":\n"
         "  {\n"
         "    \"timeframe\": n,                         (numeric) Length of the "
@@ -403,6 +468,13 @@ UniValue getnettotals(const JSONRPCRequest &request) {
         "current time cycle\n"
         "    \"time_left_in_cycle\": t                 (numeric) Seconds left "
         "in current time cycle\n"
+        "  },\n"
+        "  \"recvbufferpool\":\n"
+        "  {\n"
+        "    \"buffers\": n,   (numeric) Receive buffers kept for reuse\n"
+        "    \"bytes\": n,     (numeric) Their total capacity\n"
+        "    \"hits\": n,      (numeric) Messages given a reused buffer\n"
+        "    \"misses\": n     (numeric) Messages that had to allocate one\n"
         "  }\n"
         "}\n"
         "\nExamples:\n" +
@@ -416,6 +488,11 @@ UniValue getnettotals(const JSONRPCRequest &request) {
   obj.push_back(Pair("totalbytesrecv", g_connman->GetTotalBytesRecv()));
   obj.push_back(Pair("totalbytessent", g_connman->GetTotalBytesSent()));
   obj.push_back(Pair("timemillis", GetTimeMillis()));
+  uint64_t nSendMsgs = g_connman->GetTotalSendMsgs();
+  obj.push_back(Pair("sendcalls_per_msg",
+                     nSendMsgs ? (double)g_connman->GetTotalSendCalls() /
+                                     nSendMsgs
+                               : 0.0));
 
   UniValue outboundLimit(UniValue::VOBJ);
   outboundLimit.push_back(
@@ -430,9 +507,114 @@ UniValue getnettotals(const JSONRPCRequest &request) {
   outboundLimit.push_back(
       Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
   obj.push_back(Pair("uploadtarget", outboundLimit));
+
+  CRecvBufferPool::Stats poolStats = g_recv_buffer_pool.GetStats();
+  UniValue recvPool(UniValue::VOBJ);
+  recvPool.push_back(Pair("buffers", (uint64_t)poolStats.nPooledBuffers));
+  recvPool.push_back(Pair("bytes", (uint64_t)poolStats.nPooledBytes));
+  recvPool.push_back(Pair("hits", poolStats.nHits));
+  recvPool.push_back(Pair("misses", poolStats.nMisses));
+  obj.push_back(Pair("recvbufferpool", recvPool));
   return obj;
 }
 
+UniValue getnetstats(const JSONRPCRequest &request) {
+  if (request.fHelp || request.params.size() > 0)
+    throw std::runtime_error(
+        "getnetstats\n"
+        "\nReturns how long received messages took to process, by message "
+        "type over all peers since startup, and the peers that used the most "
+        "CPU time.\n"
+        "\nResult:\n"
+        "{\n"
+        "  \"bucket_limits_us\": [ n, ... ], (json array) Upper bound in "
+        "microseconds of each histogram bucket but the last, which is "
+        "unbounded\n"
+        "  \"processtime_per_msg\": {\n"
+        "    \"tx\": {\n"
+        "      \"count\": n,           (numeric) Messages processed\n"
+        "      \"total_us\": n,        (numeric) Total processing time in "
+        "microseconds\n"
+        "      \"max_us\": n,          (numeric) Longest processing time\n"
+        "      \"histogram\": [ n, ... ] (json array) Message counts per "
+        "bucket\n"
+        "    },\n"
+        "    ...\n"
+        "  },\n"
+        "  \"peers\": [               (json array) Connected peers, most CPU "
+        "time first\n"
+        "    {\n"
+        "      \"id\": n,              (numeric) Peer index\n"
+        "      \"addr\": \"host:port\", (string) The address of the peer\n"
+        "      \"cputime\": n,         (numeric) As in getpeerinfo\n"
+        "      \"processtime_us\": n,  (numeric) Total message processing "
+        "time\n"
+        "      \"processqueue_max_bytes\": n, (numeric) As in getpeerinfo\n"
+        "      \"processqueue_max_msgs\": n   (numeric) As in getpeerinfo\n"
+        "    },\n"
+        "    ...\n"
+        "  ],\n"
+        "  \"txreconciliation\": {     (json object) Only with "
+        "-txreconciliation\n"
+        "    \"peers\": n,             (numeric) Peers reconciled with\n"
+        "    \"succeeded\": n,         (numeric) Reconciliations we started "
+        "that decoded\n"
+        "    \"failed\": n             (numeric) Those that fell back to "
+        "announcing\n"
+        "  }\n"
+        "}\n"
+        "\nExamples:\n" +
+        HelpExampleCli("getnetstats", "") + HelpExampleRpc("getnetstats", ""));
+  if (!g_connman)
+    throw JSONRPCError(RPC_CLIENT_P2P_DISABLED,
+                       "Error: Peer-to-peer functionality missing or disabled");
+
+  UniValue limits(UniValue::VARR);
+  for (int i = 0; i < CMsgProcessingTime::NUM_BUCKETS - 1; i++) {
+    limits.push_back(CMsgProcessingTime::BucketLimit(i));
+  }
+
+  std::vector<CNodeStats> vstats;
+  g_connman->GetNodeStats(vstats);
+  std::sort(vstats.begin(), vstats.end(),
+            [](const CNodeStats &a, const CNodeStats &b) {
+              return a.nProcessCPUMicros > b.nProcessCPUMicros;
+            });
+  UniValue peers(UniValue::VARR);
+  for (const CNodeStats &stats : vstats) {
+    int64_t nProcessMicros = 0;
+    for (const mapMsgCmdTime::value_type &i : stats.mapProcessTimePerMsgCmd) {
+      nProcessMicros += i.second.nTotalMicros;
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("id", stats.nodeid));
+    obj.push_back(Pair("addr", stats.addrName));
+    obj.push_back(Pair("cputime", stats.nProcessCPUMicros));
+    obj.push_back(Pair("processtime_us", nProcessMicros));
+    obj.push_back(
+        Pair("processqueue_max_bytes", (uint64_t)stats.nProcessQueueSizeMax));
+    obj.push_back(
+        Pair("processqueue_max_msgs", (uint64_t)stats.nProcessQueueMsgsMax));
+    peers.push_back(obj);
+  }
+
+  UniValue ret(UniValue::VOBJ);
+  ret.push_back(Pair("bucket_limits_us", limits));
+  ret.push_back(Pair("processtime_per_msg",
+                     ProcessTimeToJSON(g_connman->GetProcessTimePerMsgCmd())));
+  ret.push_back(Pair("peers", peers));
+
+  TxReconciliationStats reconStats;
+  if (GetTxReconciliationStats(reconStats)) {
+    UniValue recon(UniValue::VOBJ);
+    recon.push_back(Pair("peers", (uint64_t)reconStats.nPeers));
+    recon.push_back(Pair("succeeded", reconStats.nSucceeded));
+    recon.push_back(Pair("failed", reconStats.nFailed));
+    ret.push_back(Pair("txreconciliation", recon));
+  }
+  return ret;
+}
+
 static UniValue GetNetworksInfo() {
   UniValue networks(UniValue::VARR);
   for (int n = 0; n < NET_MAX; ++n) {
@@ -698,6 +880,7 @@ static const CRPCCommand commands[] = {
     {"network", "disconnectnode", &disconnectnode, {"address", "nodeid"}},
     {"network", "getaddednodeinfo", &getaddednodeinfo, {"node"}},
     {"network", "getnettotals", &getnettotals, {}},
+    {"network", "getnetstats", &getnetstats, {}},
     {"network", "getnetworkinfo", &getnetworkinfo, {}},
     {"network",
      "setban",
@@ -1311,6 +1311,127 @@ UniValue sendrawtransaction(const JSONRPCRequest &request) {
   return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest &request) {
+  if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+    throw std::runtime_error(
+        "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+        "\nSubmits a batch of raw transactions (serialized, hex-encoded) to "
+        "local node and network.\n"
+        "\nTransactions are validated in order under a single lock, with "
+        "their scripts checked in parallel. A transaction may spend outputs "
+        "of earlier transactions in the batch.\n"
+        "\nArguments:\n"
+        "1. \"hexstrings\"   (array, required) The hex strings of the raw "
+        "transactions\n"
+        "2. allowhighfees    (boolean, optional, default=false) Allow high "
+        "fees\n"
+        "\nResult:\n"
+        "[                   (array) One object per submitted transaction\n"
+        "  {\n"
+        "    \"txid\" : \"hex\",      (string) The transaction hash in hex, "
+        "absent if it could not be decoded\n"
+        "    \"accepted\" : true|false, (boolean) Whether the transaction is "
+        "in the mempool\n"
+        "    \"error\" : \"msg\"      (string) The reject reason, if not "
+        "accepted\n"
+        "  }\n"
+        "  ,...\n"
+        "]\n"
+        "\nExamples:\n" +
+        HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\"]\"") +
+        HelpExampleRpc("sendrawtransactions", "[\"signedhex\"]"));
+
+  ObserveSafeMode();
+
+  RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+  const UniValue &hexstrings = request.params[0].get_array();
+
+  CAmount nMaxRawTxFee = maxTxFee;
+  if (!request.params[1].isNull() && request.params[1].get_bool())
+    nMaxRawTxFee = 0;
+
+  UniValue result(UniValue::VARR);
+  std::vector<UniValue> vEntries(hexstrings.size(), UniValue(UniValue::VOBJ));
+  std::vector<CTransactionRef> vtx;
+  std::vector<size_t> vIndex;
+  std::vector<uint256> vRelay;
+  for (size_t i = 0; i < hexstrings.size(); i++) {
+    CMutableTransaction mtx;
+    if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str())) {
+      vEntries[i].push_back(Pair("accepted", false));
+      vEntries[i].push_back(Pair("error", "TX decode failed"));
+      continue;
+    }
+    vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    vIndex.push_back(i);
+    vEntries[i].push_back(Pair("txid", vtx.back()->GetHash().GetHex()));
+  }
+
+  std::vector<CTransactionRef> vSubmit;
+  std::vector<size_t> vSubmitIndex;
+  {
+    LOCK(cs_main);
+    CCoinsViewCache &view = *pcoinsTip;
+    for (size_t n = 0; n < vtx.size(); n++) {
+      const uint256 &hashTx = vtx[n]->GetHash();
+      UniValue &entry = vEntries[vIndex[n]];
+      bool fHaveChain = false;
+      for (size_t o = 0; !fHaveChain && o < vtx[n]->vout.size(); o++) {
+        const Coin &existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+        fHaveChain = !existingCoin.IsSpent();
+      }
+      if (fHaveChain) {
+        entry.push_back(Pair("accepted", false));
+        entry.push_back(Pair("error", "transaction already in block chain"));
+      } else if (mempool.exists(hashTx)) {
+        entry.push_back(Pair("accepted", true));
+        vRelay.push_back(hashTx);
+      } else {
+        vSubmit.push_back(vtx[n]);
+        vSubmitIndex.push_back(vIndex[n]);
+      }
+    }
+  }
+
+  // Takes cs_main per chunk, so other callers can get in between.
+  std::vector<MempoolAcceptResult> vResults =
+      AcceptToMemoryPoolBatch(mempool, vSubmit, false, nMaxRawTxFee);
+  for (size_t n = 0; n < vSubmit.size(); n++) {
+    const MempoolAcceptResult &accept = vResults[n];
+    UniValue &entry = vEntries[vSubmitIndex[n]];
+    entry.push_back(Pair("accepted", accept.fAccepted));
+    if (accept.fAccepted) {
+      vRelay.push_back(vSubmit[n]->GetHash());
+    } else if (accept.state.IsInvalid()) {
+      entry.push_back(Pair("error", strprintf("%i: %s",
+                                              accept.state.GetRejectCode(),
+                                              accept.state.GetRejectReason())));
+    } else if (accept.fMissingInputs) {
+      entry.push_back(Pair("error", "Missing inputs"));
+    } else {
+      entry.push_back(Pair("error", accept.state.GetRejectReason()));
+    }
+  }
+
+  std::promise<void> promise;
+  CallFunctionInValidationInterfaceQueue([&promise] { promise.set_value(); });
+  promise.get_future().wait();
+
+  if (!g_connman)
+    throw JSONRPCError(RPC_CLIENT_P2P_DISABLED,
+                       "Error: Peer-to-peer functionality missing or disabled");
+
+  for (const uint256 &hashTx : vRelay) {
+    CInv inv(MSG_TX, hashTx);
+    g_connman->ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+  }
+
+  for (UniValue &entry : vEntries)
+    result.push_back(entry);
+  return result;
+}
+
 static const CRPCCommand commands[] = {
     {"rawtransactions",
      "getrawtransaction",
@@ -1334,6 +1455,10 @@ static const CRPCCommand commands[] = {
      "sendrawtransaction",
      &sendrawtransaction,
      {"hexstring", "allowhighfees"}},
+    {"rawtransactions",
+     "sendrawtransactions",
+     &sendrawtransactions,
+     {"hexstrings", "allowhighfees"}},
     {"rawtransactions",
      "combinerawtransaction",
      &combinerawtransaction,
@@ -0,0 +1,246 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <sketch.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+
+namespace {
+
+typedef std::vector<uint32_t> Poly;
+
+/** Multiply by x^32 mod x^32 + x^7 + x^3 + x^2 + 1. */
+uint64_t MulModulus(uint64_t x) { return x ^ (x << 2) ^ (x << 3) ^ (x << 7); }
+
+uint32_t Reduce(uint64_t x) {
+  uint64_t t = (x & 0xffffffff) ^ MulModulus(x >> 32);
+  return (uint32_t)t ^ (uint32_t)MulModulus(t >> 32);
+}
+
+/** Multiplication by a fixed field element, four bits at a time. */
+class Multiplier {
+public:
+  explicit Multiplier(uint32_t a) {
+    table[0] = 0;
+    for (int i = 1; i < 16; i++)
+      table[i] = (table[i >> 1] << 1) ^ ((i & 1) ? a : 0);
+  }
+
+  uint32_t operator()(uint32_t b) const {
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4)
+      r = (r << 4) ^ table[(b >> i) & 15];
+    return Reduce(r);
+  }
+
+private:
+  uint64_t table[16];
+};
+
+uint32_t Mul(uint32_t a, uint32_t b) { return Multiplier(a)(b); }
+
+uint32_t Sqr(uint32_t a) {
+  uint64_t x = a;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x << 2)) & 0x3333333333333333ULL;
+  x = (x | (x << 1)) & 0x5555555555555555ULL;
+  return Reduce(x);
+}
+
+/** a^(2^32 - 2), the product of a^(2^i) for i = 1 .. 31. */
+uint32_t Inv(uint32_t a) {
+  uint32_t r = 1;
+  for (int i = 1; i < 32; i++) {
+    a = Sqr(a);
+    r = Mul(r, a);
+  }
+  return r;
+}
+
+void Trim(Poly &p) {
+  while (!p.empty() && p.back() == 0)
+    p.pop_back();
+}
+
+void MakeMonic(Poly &p) {
+  Multiplier mul(Inv(p.back()));
+  for (uint32_t &c : p)
+    c = mul(c);
+}
+
+/** Reduce a modulo the monic m, storing the quotient in pq if given. */
+void PolyMod(Poly &a, const Poly &m, Poly *pq = nullptr) {
+  const size_t nDeg = m.size() - 1;
+  if (pq)
+    pq->assign(a.size() > nDeg ? a.size() - nDeg : 0, 0);
+  while (a.size() > nDeg) {
+    const uint32_t c = a.back();
+    const size_t nShift = a.size() - 1 - nDeg;
+    if (c) {
+      Multiplier mul(c);
+      for (size_t i = 0; i < nDeg; i++)
+        a[nShift + i] ^= mul(m[i]);
+      if (pq)
+        (*pq)[nShift] = c;
+    }
+    a.pop_back();
+  }
+  Trim(a);
+}
+
+/** p^2 mod m. Squaring is linear in characteristic 2, so only the
+ * coefficients are squared. */
+Poly SqrMod(const Poly &p, const Poly &m) {
+  Poly r(p.empty() ? 0 : 2 * p.size() - 1, 0);
+  for (size_t i = 0; i < p.size(); i++)
+    r[2 * i] = Sqr(p[i]);
+  PolyMod(r, m);
+  return r;
+}
+
+Poly Gcd(Poly a, Poly b) {
+  while (!b.empty()) {
+    MakeMonic(b);
+    PolyMod(a, b);
+    std::swap(a, b);
+  }
+  if (!a.empty())
+    MakeMonic(a);
+  return a;
+}
+
+/** Roots of the monic f, whose roots must be distinct and in the field.
+ *
+ * gcd(f, Tr(b x)) keeps the roots r with Tr(b r) = 0, and any two distinct
+ * roots differ in that for some b of the polynomial basis. Basis elements
+ * below nBasis already failed to split the roots of f. */
+bool FindRoots(const Poly &f, int nBasis, std::vector<uint32_t> &vRoots) {
+  if (f.size() < 2)
+    return true;
+  if (f.size() == 2) {
+    vRoots.push_back(f[0]);
+    return true;
+  }
+  for (; nBasis < 32; nBasis++) {
+    Poly power{0, (uint32_t)1 << nBasis};
+    Poly trace = power;
+    for (int i = 1; i < 32; i++) {
+      power = SqrMod(power, f);
+      if (trace.size() < power.size())
+        trace.resize(power.size(), 0);
+      for (size_t j = 0; j < power.size(); j++)
+        trace[j] ^= power[j];
+    }
+    Trim(trace);
+
+    Poly g = Gcd(f, trace);
+    if (g.size() > 1 && g.size() < f.size()) {
+      Poly rest = f;
+      Poly q;
+      PolyMod(rest, g, &q);
+      return FindRoots(g, nBasis + 1, vRoots) &&
+             FindRoots(q, nBasis + 1, vRoots);
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+void CSketch::Add(uint32_t nElement) {
+  Multiplier mulSquare(Sqr(nElement));
+  uint32_t nPower = nElement;
+  for (uint32_t &nSyndrome : vSyndromes) {
+    nSyndrome ^= nPower;
+    nPower = mulSquare(nPower);
+  }
+}
+
+void CSketch::Merge(const CSketch &other) {
+  for (size_t i = 0; i < vSyndromes.size() && i < other.vSyndromes.size(); i++)
+    vSyndromes[i] ^= other.vSyndromes[i];
+}
+
+std::vector<unsigned char> CSketch::Serialize() const {
+  std::vector<unsigned char> vData(vSyndromes.size() * 4);
+  for (size_t i = 0; i < vSyndromes.size(); i++)
+    WriteLE32(vData.data() + 4 * i, vSyndromes[i]);
+  return vData;
+}
+
+bool CSketch::Deserialize(const std::vector<unsigned char> &vData) {
+  if (vData.size() % 4)
+    return false;
+  vSyndromes.resize(vData.size() / 4);
+  for (size_t i = 0; i < vSyndromes.size(); i++)
+    vSyndromes[i] = ReadLE32(vData.data() + 4 * i);
+  return true;
+}
+
+bool CSketch::Decode(std::vector<uint32_t> &vElements) const {
+  vElements.clear();
+  const size_t nCapacity = vSyndromes.size();
+
+  // Power sums s_1 .. s_2c; the even ones are squares of earlier ones.
+  std::vector<uint32_t> vSums(2 * nCapacity);
+  for (size_t i = 0; i < vSums.size(); i++)
+    vSums[i] = (i & 1) ? Sqr(vSums[i / 2]) : vSyndromes[i / 2];
+
+  // Berlekamp-Massey for the polynomial whose roots are the inverses of the
+  // elements.
+  Poly c{1};
+  Poly b{1};
+  uint32_t nB = 1;
+  size_t nL = 0;
+  size_t m = 1;
+  for (size_t n = 0; n < vSums.size(); n++) {
+    uint32_t d = vSums[n];
+    for (size_t i = 1; i <= nL && i < c.size(); i++)
+      d ^= Mul(c[i], vSums[n - i]);
+    if (d == 0) {
+      m++;
+      continue;
+    }
+    Multiplier mul(Mul(d, Inv(nB)));
+    Poly t = c;
+    if (c.size() < b.size() + m)
+      c.resize(b.size() + m, 0);
+    for (size_t i = 0; i < b.size(); i++)
+      c[i + m] ^= mul(b[i]);
+    if (2 * nL <= n) {
+      nL = n + 1 - nL;
+      b = std::move(t);
+      nB = d;
+      m = 1;
+    } else {
+      m++;
+    }
+  }
+  Trim(c);
+  if (nL > nCapacity || c.size() != nL + 1)
+    return false;
+  if (nL == 0)
+    return true;
+
+  // Reversed, its roots are the elements themselves. They are all there only
+  // if it divides x^(2^32) - x, the product of x - a over the whole field.
+  Poly f(c.rbegin(), c.rend());
+  Poly x{0, 1};
+  PolyMod(x, f);
+  Poly power = x;
+  for (int i = 0; i < 32; i++)
+    power = SqrMod(power, f);
+  if (power != x)
+    return false;
+
+  if (!FindRoots(f, 0, vElements) || vElements.size() != nL) {
+    vElements.clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SKETCH_H
+#define BITCOIN_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Set sketch of nonzero 32-bit elements (PinSketch over GF(2^32)).
+ *
+ * A sketch of capacity c holds the odd power sums of its elements, c field
+ * elements in all. Adding an element twice removes it again, so merging the
+ * sketches of two sets gives the sketch of their symmetric difference, which
+ * Decode() recovers as long as it has at most c elements. */
+class CSketch {
+public:
+  explicit CSketch(size_t nCapacity = 0) : vSyndromes(nCapacity, 0) {}
+
+  size_t GetCapacity() const { return vSyndromes.size(); }
+
+  void Add(uint32_t nElement);
+
+  /** Turn this into the sketch of the symmetric difference with other, which
+   * must have the same capacity. */
+  void Merge(const CSketch &other);
+
+  std::vector<unsigned char> Serialize() const;
+
+  /** Replace the contents, taking the capacity from the size of vData. */
+  bool Deserialize(const std::vector<unsigned char> &vData);
+
+  /** Recover the elements, or return false if there are more than the
+   * capacity. */
+  bool Decode(std::vector<uint32_t> &vElements) const;
+
+private:
+  std::vector<uint32_t> vSyndromes;
+};
+
+#endif // BITCOIN_SKETCH_H
@@ -0,0 +1,261 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <socketevents.h>
+
+#include <netbase.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <unordered_set>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+namespace {
+
+class SelectSocketEvents final : public SocketEvents {
+public:
+  const char *GetName() const override { return "select"; }
+
+  bool CanWatch(SOCKET hSocket) const override {
+#ifdef WIN32
+    return true;
+#else
+    return hSocket < FD_SETSIZE;
+#endif
+  }
+
+  void Watch(uint64_t nId, SOCKET hSocket, uint8_t nInterest,
+             bool fListen) override {
+    if (CanWatch(hSocket))
+      mapWatched[nId] = Watched{hSocket, nInterest};
+  }
+
+  void Unwatch(uint64_t nId) override { mapWatched.erase(nId); }
+
+  bool Wait(int64_t nTimeoutMs, SocketEventsReady &ready) override {
+    ready.clear();
+    if (mapWatched.empty()) {
+      MilliSleep(nTimeoutMs);
+      return true;
+    }
+
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    for (const auto &entry : mapWatched) {
+      const Watched &w = entry.second;
+      FD_SET(w.hSocket, &fdsetError);
+      if (w.nInterest & SOCKET_EVENT_RECV)
+        FD_SET(w.hSocket, &fdsetRecv);
+      if (w.nInterest & SOCKET_EVENT_SEND)
+        FD_SET(w.hSocket, &fdsetSend);
+      hSocketMax = std::max(hSocketMax, w.hSocket);
+    }
+
+    int nSelect =
+        select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    bool fOk = nSelect != SOCKET_ERROR;
+    for (const auto &entry : mapWatched) {
+      const Watched &w = entry.second;
+      uint8_t nEvents = 0;
+      if (!fOk || FD_ISSET(w.hSocket, &fdsetRecv) ||
+          FD_ISSET(w.hSocket, &fdsetError))
+        nEvents |= SOCKET_EVENT_RECV;
+      if (fOk && FD_ISSET(w.hSocket, &fdsetSend))
+        nEvents |= SOCKET_EVENT_SEND;
+      if (nEvents)
+        ready[entry.first] = nEvents;
+    }
+    return fOk;
+  }
+
+private:
+  struct Watched {
+    SOCKET hSocket;
+    uint8_t nInterest;
+  };
+  std::unordered_map<uint64_t, Watched> mapWatched;
+};
+
+#ifdef USE_EPOLL
+/** Edge triggered epoll. Readiness is remembered until Drained(), so interest
+ * only costs a syscall when it changes, and that only happens when a peer's
+ * send queue fills or empties. Wait() touches only the sockets with events or
+ * still pending ones, not every watched socket. */
+class EpollSocketEvents final : public SocketEvents {
+public:
+  EpollSocketEvents() : vEvents(64) { epollfd = epoll_create1(EPOLL_CLOEXEC); }
+
+  ~EpollSocketEvents() {
+    if (epollfd != -1)
+      close(epollfd);
+  }
+
+  bool IsValid() const { return epollfd != -1; }
+
+  const char *GetName() const override { return "epoll"; }
+
+  void Watch(uint64_t nId, SOCKET hSocket, uint8_t nInterest,
+             bool fListen) override {
+    uint32_t nWant = EPOLLIN;
+    if (!fListen) {
+      nWant |= EPOLLRDHUP | EPOLLET;
+      if (nInterest & SOCKET_EVENT_SEND)
+        nWant |= EPOLLOUT;
+    }
+
+    auto it = mapEntries.find(nId);
+    if (it == mapEntries.end()) {
+      if (!Control(EPOLL_CTL_ADD, nId, hSocket, nWant) &&
+          !(errno == EEXIST && Control(EPOLL_CTL_MOD, nId, hSocket, nWant))) {
+        LogPrintf("epoll_ctl add failed for socket %d: %s\n", hSocket,
+                  NetworkErrorString(errno));
+        return;
+      }
+      it = mapEntries.emplace(nId, Entry{hSocket, nWant, 0, 0, fListen})
+               .first;
+      mapOwners[hSocket] = nId;
+    } else if (it->second.nRegistered != nWant) {
+      if (!Control(EPOLL_CTL_MOD, nId, hSocket, nWant)) {
+        LogPrintf("epoll_ctl mod failed for socket %d: %s\n", hSocket,
+                  NetworkErrorString(errno));
+        return;
+      }
+      it->second.nRegistered = nWant;
+    }
+    it->second.nInterest = nInterest;
+    UpdatePending(*it);
+  }
+
+  void Unwatch(uint64_t nId) override {
+    auto it = mapEntries.find(nId);
+    if (it == mapEntries.end())
+      return;
+    // Leave the descriptor alone if it was closed and is now another's.
+    auto itOwner = mapOwners.find(it->second.hSocket);
+    if (itOwner != mapOwners.end() && itOwner->second == nId) {
+      epoll_event ev = {};
+      epoll_ctl(epollfd, EPOLL_CTL_DEL, it->second.hSocket, &ev);
+      mapOwners.erase(itOwner);
+    }
+    setPending.erase(nId);
+    mapEntries.erase(it);
+  }
+
+  void Drained(uint64_t nId, uint8_t nEvents) override {
+    auto it = mapEntries.find(nId);
+    if (it == mapEntries.end())
+      return;
+    it->second.nReady &= ~nEvents;
+    UpdatePending(*it);
+  }
+
+  bool Wait(int64_t nTimeoutMs, SocketEventsReady &ready) override {
+    ready.clear();
+
+    int nEvents = epoll_wait(epollfd, vEvents.data(), vEvents.size(),
+                             setPending.empty() ? nTimeoutMs : 0);
+    if (nEvents < 0) {
+      if (errno != EINTR) {
+        for (const auto &entry : mapEntries) {
+          ready[entry.first] = SOCKET_EVENT_RECV;
+        }
+        return false;
+      }
+      nEvents = 0;
+    }
+    for (int i = 0; i < nEvents; i++) {
+      auto it = mapEntries.find(vEvents[i].data.u64);
+      if (it == mapEntries.end())
+        continue;
+      uint32_t nFlags = vEvents[i].events;
+      if (nFlags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        it->second.nReady |= SOCKET_EVENT_RECV;
+      if (nFlags & EPOLLOUT)
+        it->second.nReady |= SOCKET_EVENT_SEND;
+      UpdatePending(*it);
+    }
+    if ((size_t)nEvents == vEvents.size())
+      vEvents.resize(vEvents.size() * 2);
+
+    for (auto it = setPending.begin(); it != setPending.end();) {
+      Entry &entry = mapEntries[*it];
+      ready[*it] = entry.nReady & entry.nInterest;
+      if (entry.fListen) {
+        entry.nReady = 0;
+        it = setPending.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    SOCKET hSocket;
+    uint32_t nRegistered;
+    uint8_t nInterest;
+    uint8_t nReady;
+    bool fListen;
+  };
+
+  int epollfd;
+  std::unordered_map<uint64_t, Entry> mapEntries;
+  /** The entry each registered descriptor was last added for. */
+  std::unordered_map<SOCKET, uint64_t> mapOwners;
+  /** Entries ready for an event they are interested in. */
+  std::unordered_set<uint64_t> setPending;
+  std::vector<epoll_event> vEvents;
+
+  bool Control(int op, uint64_t nId, SOCKET hSocket, uint32_t nFlags) {
+    epoll_event ev = {};
+    ev.events = nFlags;
+    ev.data.u64 = nId;
+    return epoll_ctl(epollfd, op, hSocket, &ev) == 0;
+  }
+
+  void UpdatePending(const std::pair<const uint64_t, Entry> &entry) {
+    if (entry.second.nReady & entry.second.nInterest)
+      setPending.insert(entry.first);
+    else
+      setPending.erase(entry.first);
+  }
+};
+#endif
+
+} // namespace
+
+std::vector<std::string> GetSocketEventsModes() {
+  std::vector<std::string> vModes;
+#ifdef USE_EPOLL
+  vModes.push_back("epoll");
+#endif
+  vModes.push_back("select");
+  return vModes;
+}
+
+std::unique_ptr<SocketEvents> MakeSocketEvents(const std::string &strMode) {
+#ifdef USE_EPOLL
+  if (strMode == "epoll") {
+    std::unique_ptr<EpollSocketEvents> events(new EpollSocketEvents());
+    if (!events->IsValid()) {
+      LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(errno));
+      return nullptr;
+    }
+    return std::move(events);
+  }
+#endif
+  if (strMode == "select")
+    return std::unique_ptr<SocketEvents>(new SelectSocketEvents());
+  return nullptr;
+}
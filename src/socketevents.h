@@ -0,0 +1,78 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <compat.h>
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+
+#ifdef USE_EPOLL
+static const char *const DEFAULT_SOCKET_EVENTS = "epoll";
+#else
+static const char *const DEFAULT_SOCKET_EVENTS = "select";
+#endif
+
+enum SocketEventFlags : uint8_t {
+  SOCKET_EVENT_RECV = (1 << 0),
+  SOCKET_EVENT_SEND = (1 << 1),
+};
+
+/** Socket owner id to the events it is ready for. */
+typedef std::unordered_map<uint64_t, uint8_t> SocketEventsReady;
+
+/** Readiness notification for the sockets serviced by the socket handler.
+ *
+ * Watched sockets stay watched until Unwatch(), so the caller only calls
+ * Watch() again when the events it is interested in change. A backend may be
+ * edge triggered, so a reported event keeps being reported until the caller
+ * says with Drained() that the socket would block in that direction.
+ *
+ * Not thread safe, except for CanWatch(). */
+class SocketEvents {
+public:
+  virtual ~SocketEvents() {}
+
+  virtual const char *GetName() const = 0;
+
+  /** Whether hSocket can be serviced by this backend at all. */
+  virtual bool CanWatch(SOCKET hSocket) const { return true; }
+
+  /** Report nInterest events on hSocket under nId, which must identify the
+   * socket for as long as it stays open. Listening sockets are level
+   * triggered and never need Drained(). */
+  virtual void Watch(uint64_t nId, SOCKET hSocket, uint8_t nInterest,
+                     bool fListen = false) = 0;
+
+  /** Stop watching nId. Must be called before its socket is closed, as the
+   * descriptor may be reused for another socket right after. */
+  virtual void Unwatch(uint64_t nId) = 0;
+
+  virtual void Drained(uint64_t nId, uint8_t nEvents) {}
+
+  /** Wait up to nTimeoutMs for a watched socket to be ready, or not at all if
+   * one still is. Returns false on error, in which case every watched socket
+   * is reported readable. */
+  virtual bool Wait(int64_t nTimeoutMs, SocketEventsReady &ready) = 0;
+};
+
+std::vector<std::string> GetSocketEventsModes();
+
+/** Create the backend named strMode, or null if it is not available. */
+std::unique_ptr<SocketEvents> MakeSocketEvents(const std::string &strMode);
+
+#endif // BITCOIN_SOCKETEVENTS_H
@@ -103,6 +103,47 @@ private:
   size_t nPos;
 };
 
+class CSpanReader {
+public:
+  CSpanReader(int nTypeIn, int nVersionIn, const unsigned char *pbeginIn,
+              const unsigned char *pendIn)
+      : nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pcur(pbeginIn),
+        pend(pendIn) {}
+
+  template <typename T> CSpanReader &operator>>(T &obj) {
+    ::Unserialize(*this, obj);
+    return (*this);
+  }
+
+  int GetVersion() const { return nVersion; }
+  int GetType() const { return nType; }
+
+  size_t size() const { return pend - pcur; }
+  bool empty() const { return pcur == pend; }
+  size_t tell() const { return pcur - pbegin; }
+  const unsigned char *data() const { return pcur; }
+
+  void read(char *dst, size_t n) {
+    if (n > size())
+      throw std::ios_base::failure("CSpanReader::read(): end of data");
+    memcpy(dst, pcur, n);
+    pcur += n;
+  }
+
+  void ignore(size_t n) {
+    if (n > size())
+      throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+    pcur += n;
+  }
+
+private:
+  const int nType;
+  const int nVersion;
+  const unsigned char *const pbegin;
+  const unsigned char *pcur;
+  const unsigned char *const pend;
+};
+
 class CDataStream {
 protected:
   typedef CSerializeData vector_type;
@@ -323,6 +364,12 @@ public:
     return (*this);
   }
 
+  /** Exchange the underlying buffer with vchOther and rewind. */
+  void SwapBuffer(vector_type &vchOther) {
+    vch.swap(vchOther);
+    nReadPos = 0;
+  }
+
   void GetAndClear(CSerializeData &d) {
     d.insert(d.end(), begin(), end());
     clear();
@@ -11,6 +11,7 @@
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
+#include <txorphanage.h>
 #include <util.h>
 #include <validation.h>
 
@@ -20,16 +21,6 @@
 
 #include <boost/test/unit_test.hpp>
 
-extern bool AddOrphanTx(const CTransactionRef &tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-  CTransactionRef tx;
-  NodeId fromPeer;
-  int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-
 CService ip(uint32_t i) {
   struct in_addr s;
   s.s_addr = i;
@@ -276,13 +267,13 @@ BOOST_AUTO_TEST_CASE(DoS_bantime) {
   peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
-CTransactionRef RandomOrphan() {
-  std::map<uint256, COrphanTx>::iterator it;
-  LOCK(cs_main);
-  it = mapOrphanTransactions.lower_bound(InsecureRand256());
-  if (it == mapOrphanTransactions.end())
-    it = mapOrphanTransactions.begin();
-  return it->second.tx;
+static CTransactionRef RandomOrphan(const TxOrphanage &orphanage,
+                                    std::vector<CTransactionRef> &vOrphans) {
+  while (true) {
+    size_t i = InsecureRandRange(vOrphans.size());
+    if (orphanage.HaveTx(vOrphans[i]->GetHash()))
+      return vOrphans[i];
+  }
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
@@ -291,6 +282,9 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
   CBasicKeyStore keystore;
   keystore.AddKey(key);
 
+  TxOrphanage orphanage;
+  std::vector<CTransactionRef> vOrphans;
+
   for (int i = 0; i < 50; i++) {
     CMutableTransaction tx;
     tx.vin.resize(1);
@@ -301,11 +295,12 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
     tx.vout[0].nValue = 1 * CENT;
     tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-    AddOrphanTx(MakeTransactionRef(tx), i);
+    vOrphans.push_back(MakeTransactionRef(tx));
+    orphanage.AddTx(vOrphans.back(), i, DEFAULT_MAX_ORPHAN_TRANSACTIONS);
   }
 
   for (int i = 0; i < 50; i++) {
-    CTransactionRef txPrev = RandomOrphan();
+    CTransactionRef txPrev = RandomOrphan(orphanage, vOrphans);
 
     CMutableTransaction tx;
     tx.vin.resize(1);
@@ -316,11 +311,12 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
     tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
     SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
 
-    AddOrphanTx(MakeTransactionRef(tx), i);
+    vOrphans.push_back(MakeTransactionRef(tx));
+    orphanage.AddTx(vOrphans.back(), i, DEFAULT_MAX_ORPHAN_TRANSACTIONS);
   }
 
   for (int i = 0; i < 10; i++) {
-    CTransactionRef txPrev = RandomOrphan();
+    CTransactionRef txPrev = RandomOrphan(orphanage, vOrphans);
 
     CMutableTransaction tx;
     tx.vout.resize(1);
@@ -336,23 +332,122 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
     for (unsigned int j = 1; j < tx.vin.size(); j++)
       tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-    BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+    BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i,
+                                 DEFAULT_MAX_ORPHAN_TRANSACTIONS));
   }
 
-  LOCK(cs_main);
-
   for (NodeId i = 0; i < 3; i++) {
-    size_t sizeBefore = mapOrphanTransactions.size();
-    EraseOrphansFor(i);
-    BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+    size_t sizeBefore = orphanage.Size();
+    orphanage.EraseForPeer(i);
+    BOOST_CHECK(orphanage.Size() < sizeBefore);
+  }
+
+  orphanage.LimitOrphans(40);
+  BOOST_CHECK(orphanage.Size() <= 40);
+  orphanage.LimitOrphans(10);
+  BOOST_CHECK(orphanage.Size() <= 10);
+  orphanage.LimitOrphans(0);
+  BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nOutpoints, 0U);
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nPeers, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanPeerQuota) {
+  BOOST_CHECK_EQUAL(GetOrphanPeerQuota(100), 25U);
+  BOOST_CHECK_EQUAL(GetOrphanPeerQuota(2), 1U);
+  BOOST_CHECK_EQUAL(GetOrphanPeerQuota(0), 1U);
+
+  // A peer flooding orphans only fills its share, the other still gets in.
+  const unsigned int nMax = DEFAULT_MAX_ORPHAN_TRANSACTIONS;
+  const unsigned int nQuota = GetOrphanPeerQuota(nMax);
+  TxOrphanage orphanage;
+  for (NodeId peer = 1; peer <= 2; peer++) {
+    unsigned int nAdded = 0;
+    for (unsigned int n = 0; n < nMax; n++) {
+      CMutableTransaction tx;
+      tx.vin.resize(1);
+      tx.vin[0].prevout.hash = InsecureRand256();
+      tx.vout.resize(1);
+      if (orphanage.AddTx(MakeTransactionRef(tx), peer, nMax))
+        nAdded++;
+      BOOST_CHECK_EQUAL(orphanage.LimitOrphans(nMax), 0U);
+    }
+    BOOST_CHECK_EQUAL(nAdded, nQuota);
   }
+  BOOST_CHECK_EQUAL(orphanage.Size(), 2 * nQuota);
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nRejectedQuota, 2 * (nMax - nQuota));
+}
 
-  LimitOrphanTxSize(40);
-  BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-  LimitOrphanTxSize(10);
-  BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-  LimitOrphanTxSize(0);
-  BOOST_CHECK(mapOrphanTransactions.empty());
+BOOST_AUTO_TEST_CASE(DoS_orphanWorkSet) {
+  TxOrphanage orphanage;
+  const unsigned int nMax = DEFAULT_MAX_ORPHAN_TRANSACTIONS;
+  const unsigned int nQuota = GetOrphanPeerQuota(nMax);
+
+  CMutableTransaction parent;
+  parent.vin.resize(1);
+  parent.vin[0].prevout.hash = InsecureRand256();
+  parent.vout.resize(2);
+  for (CTxOut &txout : parent.vout) {
+    txout.nValue = 1 * CENT;
+    txout.scriptPubKey = CScript() << OP_TRUE;
+  }
+
+  // One child per peer, plus a flood from peer 2 that hits its quota.
+  std::vector<CTransactionRef> vChildren;
+  for (unsigned int n = 0; n < 2; n++) {
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(parent.GetHash(), n);
+    child.vout.resize(1);
+    child.vout[0].nValue = 1 * CENT;
+    vChildren.push_back(MakeTransactionRef(child));
+  }
+  BOOST_CHECK(orphanage.AddTx(vChildren[0], 1, nMax));
+  for (unsigned int n = 1; n <= nQuota + 1; n++) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vout.resize(1);
+    BOOST_CHECK_EQUAL(orphanage.AddTx(MakeTransactionRef(tx), 2, nMax),
+                      n <= nQuota);
+  }
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nRejectedQuota, 1U);
+
+  // Eviction takes from the peer holding the most orphans, which leaves
+  // peer 2 room for its child.
+  BOOST_CHECK_EQUAL(orphanage.LimitOrphans(nQuota), 1U);
+  BOOST_CHECK(orphanage.HaveTx(vChildren[0]->GetHash()));
+  BOOST_CHECK(orphanage.AddTx(vChildren[1], 2, nMax));
+
+  // Each child is reconsidered by the peer that sent it.
+  orphanage.AddChildrenToWorkSet(CTransaction(parent));
+  BOOST_CHECK(orphanage.HaveTxToReconsider(1));
+  BOOST_CHECK(orphanage.GetTxToReconsider(1) == vChildren[0]);
+  BOOST_CHECK(!orphanage.GetTxToReconsider(1));
+  orphanage.ResolveTx(vChildren[0]->GetHash(), true);
+  BOOST_CHECK(!orphanage.HaveTx(vChildren[0]->GetHash()));
+
+  BOOST_CHECK(orphanage.HaveTxToReconsider(2));
+  BOOST_CHECK(orphanage.GetTxToReconsider(2) == vChildren[1]);
+  BOOST_CHECK(!orphanage.GetTxToReconsider(2));
+
+  // A block spending the same outpoint removes the conflicting orphan.
+  CMutableTransaction orphan;
+  orphan.vin.resize(1);
+  orphan.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+  orphan.vout.resize(1);
+  BOOST_CHECK(orphanage.AddTx(MakeTransactionRef(orphan), 3, nMax));
+  CMutableTransaction conflict = orphan;
+  conflict.vout.resize(2);
+  CBlock block;
+  block.vtx.push_back(MakeTransactionRef(conflict));
+  orphanage.EraseForBlock(block);
+  BOOST_CHECK(!orphanage.HaveTx(orphan.GetHash()));
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nRemovedForBlock, 1U);
+
+  orphanage.EraseForPeer(2);
+  BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+  BOOST_CHECK_EQUAL(orphanage.GetStats().nPeers, 0U);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -339,6 +339,41 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(ManyShortIdsTest) {
+  CTxMemPool pool;
+  TestMemPoolEntryHelper entry;
+  CBlock block(BuildBlockTestCase());
+  block.vtx.resize(1);
+
+  // More mempool transactions than one short id batch, most in the block.
+  for (int i = 0; i < 200; i++) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    CTransactionRef txref = MakeTransactionRef(tx);
+    pool.addUnchecked(txref->GetHash(), entry.FromTx(*txref));
+    if (i % 4 != 0)
+      block.vtx.push_back(txref);
+  }
+
+  {
+    CBlockHeaderAndShortTxIDs shortIDs(block, true);
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+      BOOST_CHECK(partialBlock.IsTxAvailable(i));
+    }
+  }
+
+  // Repeated short ids cannot be resolved.
+  block.vtx.push_back(block.vtx[1]);
+  CBlockHeaderAndShortTxIDs shortIDs(block, true);
+  PartiallyDownloadedBlock partialBlock(&pool);
+  BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn) == READ_STATUS_FAILED);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
   BlockTransactionsRequest req1;
   req1.blockhash = InsecureRand256();
@@ -0,0 +1,93 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <streams.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+static CDiskBlockPos AppendBlock(const CBlock &block, int nFile) {
+  CDiskBlockPos pos(nFile, 0);
+  fs::path path = GetBlockPosFilename(pos, "blk");
+  fs::create_directories(path.parent_path());
+  CAutoFile file(fsbridge::fopen(path, "ab"), SER_DISK, CLIENT_VERSION);
+  BOOST_REQUIRE(!file.IsNull());
+  fseek(file.Get(), 0, SEEK_END);
+  unsigned int nSize = GetSerializeSize(file, block);
+  file << FLATDATA(Params().MessageStart()) << nSize;
+  pos.nPos = ftell(file.Get());
+  file << block;
+  return pos;
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(span_reader) {
+  std::vector<unsigned char> data{1, 0, 0, 0, 2, 3};
+  CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, data.data(),
+                     data.data() + data.size());
+  uint32_t a;
+  uint8_t b;
+  reader >> a;
+  BOOST_CHECK_EQUAL(a, 1U);
+  BOOST_CHECK_EQUAL(reader.size(), 2U);
+  reader.ignore(1);
+  reader >> b;
+  BOOST_CHECK_EQUAL(b, 3);
+  BOOST_CHECK(reader.empty());
+  BOOST_CHECK_EQUAL(reader.tell(), data.size());
+  BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+  BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_block_reads) {
+  const CBlock &genesis = Params().GenesisBlock();
+  CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+  ssBlock << genesis;
+  std::vector<unsigned char> serialized(ssBlock.begin(), ssBlock.end());
+
+  CDiskBlockPos pos1 = AppendBlock(genesis, 99);
+
+  for (int nMaxFiles : {0, 2}) {
+    g_blockfile_mmap.SetMaxFiles(nMaxFiles);
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pos1, Params().GetConsensus()));
+    BOOST_CHECK(block.GetHash() == genesis.GetHash());
+
+    std::vector<unsigned char> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, pos1, Params().MessageStart()));
+    BOOST_CHECK(raw == serialized);
+  }
+  BOOST_CHECK_EQUAL(g_blockfile_mmap.Size(), 1U);
+
+  CDiskBlockPos pos2 = AppendBlock(genesis, 99);
+  CBlock block;
+  BOOST_CHECK(ReadBlockFromDisk(block, pos2, Params().GetConsensus()));
+  BOOST_CHECK(block.GetHash() == genesis.GetHash());
+  BOOST_CHECK_EQUAL(g_blockfile_mmap.Size(), 1U);
+
+  CMessageHeader::MessageStartChars badStart = {0, 0, 0, 0};
+  std::vector<unsigned char> raw;
+  BOOST_CHECK(!ReadRawBlockFromDisk(raw, pos2, badStart));
+
+  AppendBlock(genesis, 100);
+  AppendBlock(genesis, 101);
+  BOOST_CHECK(ReadBlockFromDisk(block, CDiskBlockPos(100, pos1.nPos),
+                                Params().GetConsensus()));
+  BOOST_CHECK(ReadBlockFromDisk(block, CDiskBlockPos(101, pos1.nPos),
+                                Params().GetConsensus()));
+  BOOST_CHECK_EQUAL(g_blockfile_mmap.Size(), 2U);
+
+  g_blockfile_mmap.Erase(101);
+  BOOST_CHECK_EQUAL(g_blockfile_mmap.Size(), 1U);
+  g_blockfile_mmap.SetMaxFiles(0);
+  BOOST_CHECK_EQUAL(g_blockfile_mmap.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockimport.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <streams.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestingSetup)
+
+/** Blocks between garbage, and a frame that does not deserialize but whose
+ * size covers another block. vHashes has the hash of the block at each of
+ * vPos, or null for the bad frame. */
+static fs::path WriteImportFile(std::vector<uint64_t> &vPos,
+                                std::vector<uint256> &vHashes) {
+  const CBlock &genesis = Params().GenesisBlock();
+  CBlock other = genesis;
+  other.nTime++;
+
+  fs::path path = GetDataDir() / "import.dat";
+  CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+  std::vector<unsigned char> garbage(37, 0x5a);
+  std::vector<unsigned char> bad(100, 0xff);
+
+  file.write((const char *)garbage.data(), garbage.size());
+  for (int i = 0; i < 20; i++) {
+    const CBlock &block = i % 2 ? other : genesis;
+    unsigned int nSize = GetSerializeSize(file, block);
+    file << FLATDATA(Params().MessageStart()) << nSize;
+    vPos.push_back(ftell(file.Get()));
+    vHashes.push_back(block.GetHash());
+    file << block;
+    if (i == 10) {
+      unsigned int nBadSize = bad.size() + 8 + nSize + 5;
+      file << FLATDATA(Params().MessageStart()) << nBadSize;
+      vPos.push_back(ftell(file.Get()));
+      vHashes.push_back(uint256());
+      file.write((const char *)bad.data(), bad.size());
+      file << FLATDATA(Params().MessageStart()) << nSize;
+      vPos.push_back(ftell(file.Get()));
+      vHashes.push_back(block.GetHash());
+      file << block;
+      file.write((const char *)garbage.data(), 5);
+    }
+    file.write((const char *)garbage.data(), i);
+  }
+  return path;
+}
+
+BOOST_AUTO_TEST_CASE(import_pipeline_order) {
+  std::vector<uint64_t> vPos;
+  std::vector<uint256> vHashes;
+  fs::path path = WriteImportFile(vPos, vHashes);
+
+  for (int nWorkers : {0, 1, 3}) {
+    CBlockImportPipeline pipeline(Params(), fsbridge::fopen(path, "rb"),
+                                  nWorkers);
+    CImportedBlock imported;
+    size_t n = 0;
+    while (pipeline.Next(imported)) {
+      BOOST_REQUIRE(n < vPos.size());
+      BOOST_CHECK_EQUAL(imported.nBlockPos, vPos[n]);
+      if (vHashes[n].IsNull()) {
+        BOOST_CHECK(!imported.pblock);
+        BOOST_CHECK(!imported.strError.empty());
+      } else {
+        BOOST_REQUIRE(imported.pblock);
+        BOOST_CHECK(imported.pblock->GetHash() == vHashes[n]);
+        BOOST_CHECK_EQUAL(imported.pblock->fBodyChecked, true);
+      }
+      n++;
+    }
+    BOOST_CHECK_EQUAL(n, vPos.size());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(import_pipeline_early_stop) {
+  std::vector<uint64_t> vPos;
+  std::vector<uint256> vHashes;
+  fs::path path = WriteImportFile(vPos, vHashes);
+
+  CBlockImportPipeline pipeline(Params(), fsbridge::fopen(path, "rb"), 4);
+  CImportedBlock imported;
+  BOOST_CHECK(pipeline.Next(imported));
+  BOOST_CHECK_EQUAL(imported.nBlockPos, vPos[0]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockprecheck.h>
+#include <chainparams.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprecheck_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(precheck_queue) {
+  std::atomic<int> nNotified(0);
+  CBlockPrecheckQueue queue(Params(), 3, [&nNotified] { nNotified++; });
+
+  std::vector<std::shared_ptr<CBlock>> vBlocks;
+  for (int i = 0; i < 10; i++) {
+    std::shared_ptr<CBlock> pblock =
+        std::make_shared<CBlock>(Params().GenesisBlock());
+    if (i % 3 == 0)
+      pblock->hashMerkleRoot.SetNull();
+    vBlocks.push_back(pblock);
+    BOOST_CHECK(queue.Push(pblock, 1, i));
+  }
+
+  std::vector<CPrecheckedBlock> vChecked;
+  while (vChecked.size() < vBlocks.size()) {
+    std::vector<CPrecheckedBlock> vTaken;
+    queue.TakeChecked(vTaken);
+    vChecked.insert(vChecked.end(), vTaken.begin(), vTaken.end());
+    if (vTaken.empty())
+      MilliSleep(1);
+  }
+  // Workers notify after handing a block over, so the last notifications
+  // may still be on their way.
+  while (nNotified < 10)
+    MilliSleep(1);
+
+  for (const CPrecheckedBlock &checked : vChecked) {
+    BOOST_REQUIRE(checked.nodeid >= 0 && checked.nodeid < 10);
+    BOOST_CHECK(checked.pblock == vBlocks[checked.nodeid]);
+    BOOST_CHECK_EQUAL(checked.pblock->fBodyChecked, checked.nodeid % 3 != 0);
+    BOOST_CHECK(checked.pblock->hashYespowerCached.IsNull());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(precheck_queue_limits) {
+  CBlockPrecheckQueue queue(Params(), 1, nullptr);
+  std::shared_ptr<CBlock> pblock =
+      std::make_shared<CBlock>(Params().GenesisBlock());
+
+  // Checked blocks count until taken.
+  for (size_t i = 0; i < MAX_PRECHECK_BLOCKS_PER_PEER; i++)
+    BOOST_CHECK(queue.Push(pblock, 1, 0));
+  BOOST_CHECK(!queue.Push(pblock, 1, 0));
+  for (size_t i = MAX_PRECHECK_BLOCKS_PER_PEER; i < MAX_PRECHECK_BLOCKS; i++)
+    BOOST_CHECK(queue.Push(pblock, 1, i / MAX_PRECHECK_BLOCKS_PER_PEER));
+  BOOST_CHECK(!queue.Push(pblock, 1, MAX_PRECHECK_BLOCKS));
+
+  size_t nTaken = 0;
+  while (nTaken < MAX_PRECHECK_BLOCKS) {
+    std::vector<CPrecheckedBlock> vTaken;
+    queue.TakeChecked(vTaken);
+    nTaken += vTaken.size();
+    if (vTaken.empty())
+      MilliSleep(1);
+  }
+  BOOST_CHECK(queue.Push(pblock, 1, 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
+#include <hash.h>
 #include <random.h>
 #include <test/test_bitcoin.h>
 #include <utilstrencodings.h>
@@ -635,6 +636,64 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector) {
       "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64) {
+  for (int i = 0; i <= 32; ++i) {
+    unsigned char in[64 * 32];
+    unsigned char out1[32 * 32], out2[32 * 32];
+    for (int j = 0; j < 64 * i; ++j) {
+      in[j] = InsecureRandBits(8);
+    }
+    for (int j = 0; j < i; ++j) {
+      CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+    }
+    SHA256D64(out2, in, i);
+    BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+
+    SHA256D64(in, in, i);
+    BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+  std::vector<unsigned char> data(64 * 40 + 7);
+  for (auto &c : data)
+    c = InsecureRandBits(8);
+
+  SHA256AutoDetect(sha256_implementation::STANDARD);
+  std::vector<uint256> vExpected;
+  for (size_t len = 0; len <= data.size(); len += 13) {
+    uint256 hash;
+    CSHA256().Write(data.data(), len).Finalize(hash.begin());
+    vExpected.push_back(hash);
+  }
+  std::vector<unsigned char> expectedD64(32 * 40);
+  SHA256D64(expectedD64.data(), data.data(), 40);
+
+  for (auto impl :
+       {sha256_implementation::USE_SSE4,
+        sha256_implementation::USE_SSE4_AND_AVX2,
+        sha256_implementation::USE_SHANI, sha256_implementation::USE_ALL}) {
+    std::string name = SHA256AutoDetect(impl);
+    BOOST_TEST_MESSAGE("Testing SHA256 implementation " << name);
+    size_t i = 0;
+    for (size_t len = 0; len <= data.size(); len += 13) {
+      uint256 hash;
+      CSHA256().Write(data.data(), len).Finalize(hash.begin());
+      BOOST_CHECK_MESSAGE(hash == vExpected[i++], name << " len=" << len);
+    }
+    TestSHA256(
+        "abc",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    TestSHA256(
+        std::string(1000000, 'a'),
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    std::vector<unsigned char> outD64(32 * 40);
+    SHA256D64(outD64.data(), data.data(), 40);
+    BOOST_CHECK_MESSAGE(outD64 == expectedD64, name);
+  }
+  SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests) {
   FastRandomContext ctx;
   for (int i = 0; i <= 64; ++i) {
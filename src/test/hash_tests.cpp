@@ -127,6 +127,21 @@ BOOST_AUTO_TEST_CASE(siphash) {
     BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
     BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
   }
+
+  // Batches of every length up to several vector widths plus a tail.
+  std::vector<uint256> vHashes(37);
+  std::vector<const uint256 *> vPtrs;
+  for (uint256 &hash : vHashes) {
+    hash = InsecureRand256();
+    vPtrs.push_back(&hash);
+  }
+  for (size_t n = 0; n <= vHashes.size(); n++) {
+    std::vector<uint64_t> vOut(n);
+    SipHashUint256Batch(1, 2, vPtrs.data(), n, vOut.data());
+    for (size_t i = 0; i < n; i++) {
+      BOOST_CHECK_EQUAL(vOut[i], SipHashUint256(1, 2, vHashes[i]));
+    }
+  }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
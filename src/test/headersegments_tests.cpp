@@ -0,0 +1,200 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <headersegments.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+/** A chain of headers, hashes[h] being the hash of headers[h]. */
+struct HeaderChain {
+  std::vector<CBlockHeader> headers;
+  std::vector<uint256> hashes;
+
+  explicit HeaderChain(int nLength) {
+    for (int h = 0; h < nLength; h++) {
+      CBlockHeader header;
+      header.nVersion = 4;
+      header.hashPrevBlock = h ? hashes.back() : uint256();
+      header.nTime = 1500000000 + h;
+      header.nNonce = h;
+      headers.push_back(header);
+      hashes.push_back(header.GetHash());
+    }
+  }
+
+  std::vector<CBlockHeader> Range(int nFrom, int nCount) const {
+    return std::vector<CBlockHeader>(headers.begin() + nFrom,
+                                     headers.begin() + nFrom + nCount);
+  }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(headersegments_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(segment_download) {
+  const HeaderChain chain(7000);
+  HeadersSegmentTracker tracker(
+      {{0, chain.hashes[0]}, {3000, chain.hashes[3000]},
+       {6500, chain.hashes[6500]}});
+  const std::vector<uint256> vNoHashes;
+  uint256 hashFrom, hashStop;
+  bool fMore;
+  int nFirstHeight;
+
+  // Segments start above our best header, and below the peer's height.
+  BOOST_CHECK(!tracker.AssignSegment(1, 100, 3000, 0, hashFrom, hashStop));
+  BOOST_CHECK(tracker.AssignSegment(1, 100, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(hashFrom == chain.hashes[3000]);
+  BOOST_CHECK(hashStop == chain.hashes[6500]);
+  BOOST_CHECK(!tracker.AssignSegment(1, 100, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(tracker.AssignSegment(2, 100, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(hashFrom == chain.hashes[6500]);
+  BOOST_CHECK(hashStop.IsNull());
+  BOOST_CHECK(!tracker.AssignSegment(3, 100, 7000, 0, hashFrom, hashStop));
+
+  BOOST_CHECK(!tracker.IsContinuation(1, chain.hashes[3001], nFirstHeight));
+  BOOST_CHECK(tracker.IsContinuation(1, chain.hashes[3000], nFirstHeight));
+  BOOST_CHECK_EQUAL(nFirstHeight, 3001);
+  BOOST_CHECK(!tracker.AddHeaders(1, chain.Range(3002, 2000), vNoHashes, 0,
+                                  fMore, hashFrom, hashStop));
+
+  BOOST_CHECK(tracker.AddHeaders(1, chain.Range(3001, 2000), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(fMore);
+  BOOST_CHECK(hashFrom == chain.hashes[5000]);
+
+  // Headers past the next anchor are dropped and the segment is done.
+  BOOST_CHECK(tracker.AddHeaders(1, chain.Range(5001, 1999), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(!fMore);
+  BOOST_CHECK(!tracker.IsSegmentPeer(1));
+
+  // The last segment ends with a short batch.
+  BOOST_CHECK(tracker.AddHeaders(2, chain.Range(6501, 499), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(!fMore);
+  BOOST_CHECK(!tracker.IsSegmentPeer(2));
+  BOOST_CHECK_EQUAL(tracker.GetBufferedCount(), 3500U + 499U);
+
+  std::vector<uint256> vAnchors = tracker.GetPendingAnchors();
+  BOOST_CHECK_EQUAL(vAnchors.size(), 2U);
+  std::vector<CBlockHeader> headers;
+  std::vector<uint256> vHashYespower;
+  int64_t sender;
+  BOOST_CHECK(tracker.TakeSegment(chain.hashes[3000], headers, vHashYespower,
+                                  sender));
+  BOOST_CHECK_EQUAL(headers.size(), 3500U);
+  BOOST_CHECK(headers.back().GetHash() == chain.hashes[6500]);
+  BOOST_CHECK(vHashYespower.empty());
+  BOOST_CHECK_EQUAL(sender, 1);
+  BOOST_CHECK(!tracker.TakeSegment(chain.hashes[3000], headers, vHashYespower,
+                                   sender));
+  BOOST_CHECK_EQUAL(tracker.GetPendingAnchors().size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(segment_handover) {
+  const HeaderChain chain(7000);
+  HeadersSegmentTracker tracker(
+      {{0, chain.hashes[0]}, {3000, chain.hashes[3000]}});
+  const std::vector<uint256> vNoHashes;
+  uint256 hashFrom, hashStop;
+  bool fMore;
+
+  BOOST_CHECK(tracker.AssignSegment(1, 0, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(tracker.AddHeaders(1, chain.Range(3001, 2000), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(!tracker.HasTimedOut(1, SEGMENT_RESPONSE_TIMEOUT));
+  BOOST_CHECK(tracker.HasTimedOut(1, SEGMENT_RESPONSE_TIMEOUT + 1));
+
+  // A peer that gave up is not asked again, and what it sent is not trusted:
+  // the next starts over from the anchor.
+  tracker.ReleasePeer(1, true);
+  BOOST_CHECK_EQUAL(tracker.GetBufferedCount(), 0U);
+  BOOST_CHECK(tracker.GetPendingAnchors().empty());
+  BOOST_CHECK(!tracker.AssignSegment(1, 0, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(tracker.AssignSegment(2, 0, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(hashFrom == chain.hashes[3000]);
+  BOOST_CHECK(!tracker.AddHeaders(2, chain.Range(5001, 1999), vNoHashes, 0,
+                                  fMore, hashFrom, hashStop));
+
+  BOOST_CHECK(tracker.AddHeaders(2, chain.Range(3001, 2000), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(fMore);
+  std::vector<uint256> vHashes(1999);
+  vHashes[5] = chain.hashes[5];
+  BOOST_CHECK(tracker.AddHeaders(2, chain.Range(5001, 1999), vHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  BOOST_CHECK(!fMore);
+  BOOST_CHECK(!tracker.IsSegmentPeer(2));
+
+  // A complete segment is kept when its peer goes away.
+  tracker.ReleasePeer(2);
+  std::vector<CBlockHeader> headers;
+  std::vector<uint256> vHashYespower;
+  int64_t sender;
+  BOOST_CHECK(tracker.TakeSegment(chain.hashes[3000], headers, vHashYespower,
+                                  sender));
+  BOOST_CHECK_EQUAL(headers.size(), 3999U);
+  BOOST_CHECK_EQUAL(vHashYespower.size(), 3999U);
+  BOOST_CHECK(vHashYespower[2005] == chain.hashes[5]);
+  BOOST_CHECK_EQUAL(sender, 2);
+}
+
+BOOST_AUTO_TEST_CASE(segment_taken_while_downloading) {
+  const HeaderChain chain(7000);
+  HeadersSegmentTracker tracker(
+      {{0, chain.hashes[0]}, {3000, chain.hashes[3000]}});
+  const std::vector<uint256> vNoHashes;
+  uint256 hashFrom, hashStop;
+  bool fMore;
+
+  // Once the chain reaches the anchor, what was buffered is validated.
+  BOOST_CHECK(tracker.AssignSegment(1, 0, 7000, 0, hashFrom, hashStop));
+  BOOST_CHECK(tracker.AddHeaders(1, chain.Range(3001, 2000), vNoHashes, 0,
+                                 fMore, hashFrom, hashStop));
+  std::vector<CBlockHeader> headers;
+  std::vector<uint256> vHashYespower;
+  int64_t sender;
+  BOOST_CHECK(tracker.TakeSegment(chain.hashes[3000], headers, vHashYespower,
+                                  sender));
+  BOOST_CHECK_EQUAL(headers.size(), 2000U);
+  BOOST_CHECK_EQUAL(sender, 1);
+  BOOST_CHECK(!tracker.IsSegmentPeer(1));
+}
+
+BOOST_AUTO_TEST_CASE(header_hashes_parallel) {
+  const HeaderChain chain(64);
+  const Consensus::Params &params = Params().GetConsensus();
+  std::vector<CBlockHeader> headers = chain.headers;
+  headers[20].nNonce = params.hiveNonceMarker;
+
+  std::vector<uint256> vHashYespower;
+  HashHeadersYespower(headers, 1, params, vHashYespower);
+  BOOST_CHECK(vHashYespower.empty());
+
+  boost::thread_group threadGroup;
+  for (int i = 0; i < 3; i++)
+    threadGroup.create_thread(&ThreadHeaderHash);
+  HashHeadersYespower(headers, SKIP_BLOCKHEADER_POW - 9, params,
+                      vHashYespower);
+  threadGroup.interrupt_all();
+  threadGroup.join_all();
+  BOOST_CHECK_EQUAL(vHashYespower.size(), headers.size());
+  for (size_t i = 0; i < headers.size(); i++) {
+    if (i < 10 || i == 20)
+      BOOST_CHECK(vHashYespower[i].IsNull());
+    else
+      BOOST_CHECK(vHashYespower[i] == headers[i].GetHashYespower());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/merkle.h>
 #include <net.h>
 #include <validation.h>
 
@@ -11,6 +12,9 @@
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
+void MarkHiveProofChecked(const uint256 &hashBlock,
+                          const CBlockIndex *pindexTip);
+
 BOOST_FIXTURE_TEST_SUITE(main_tests, TestingSetup)
 
 static void TestBlockSubsidyHalvings(const Consensus::Params &consensusParams) {
@@ -88,4 +92,44 @@ BOOST_AUTO_TEST_CASE(test_combiner_all) {
   Test.disconnect(&ReturnTrue);
   BOOST_CHECK(Test());
 }
+BOOST_AUTO_TEST_CASE(hive_early_relay) {
+  const Consensus::Params &params = Params().GetConsensus();
+  CBlockIndex *pindexGenesis = chainActive.Genesis();
+  // The genesis block, at a height where hive blocks are relayed early.
+  CBlockIndex tip(*pindexGenesis);
+  tip.nHeight = SKIP_BLOCKHEADER_POW;
+
+  CMutableTransaction coinbase;
+  coinbase.vin.resize(1);
+  coinbase.vout.resize(1);
+  CBlock block;
+  block.hashPrevBlock = tip.GetBlockHash();
+  block.nNonce = params.hiveNonceMarker;
+  block.vtx.push_back(MakeTransactionRef(coinbase));
+  block.hashMerkleRoot = BlockMerkleRoot(block);
+
+  BOOST_CHECK(!CanRelayHiveBlockEarly(block, &tip, true, params));
+  BOOST_CHECK(!CanRelayHiveBlockEarly(block, pindexGenesis, false, params));
+  CBlock orphan(block);
+  orphan.hashPrevBlock = uint256S("01");
+  BOOST_CHECK(!CanRelayHiveBlockEarly(orphan, &tip, false, params));
+
+  // The coinbase carries no hive proof.
+  BOOST_CHECK(!CanRelayHiveBlockEarly(block, &tip, false, params));
+  CValidationState state;
+  BOOST_CHECK(!CheckBlockHiveProof(block, state, params, &tip));
+  BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-hive-proof");
+
+  // A proof found good is only trusted on top of the same tip.
+  MarkHiveProofChecked(block.GetHash(), &tip);
+  BOOST_CHECK(CanRelayHiveBlockEarly(block, &tip, false, params));
+  CBlockIndex other(tip);
+  const uint256 hashOther = uint256S("02");
+  other.phashBlock = &hashOther;
+  BOOST_CHECK(!CheckBlockHiveProof(block, state, params, &other));
+
+  block.hashMerkleRoot = uint256();
+  BOOST_CHECK(!CanRelayHiveBlockEarly(block, &tip, false, params));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -541,4 +541,236 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest) {
   SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest) {
+  TestMemPoolEntryHelper entry;
+  CTxMemPool pool;
+
+  CMutableTransaction tx1 = CMutableTransaction();
+  tx1.vin.resize(1);
+  tx1.vin[0].scriptSig = CScript() << OP_1;
+  tx1.vout.resize(2);
+  tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+  tx1.vout[0].nValue = 10 * COIN;
+  tx1.vout[1].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+  tx1.vout[1].nValue = 10 * COIN;
+  pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+
+  std::shared_ptr<const CTxMemPoolSnapshot> snapshot1 = pool.GetSnapshot();
+  BOOST_CHECK_EQUAL(snapshot1->size(), 1U);
+  BOOST_CHECK(pool.GetSnapshot() == snapshot1);
+
+  CMutableTransaction tx2 = CMutableTransaction();
+  tx2.vin.resize(2);
+  tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+  tx2.vin[0].scriptSig = CScript() << OP_2;
+  tx2.vin[1].prevout = COutPoint(tx1.GetHash(), 1);
+  tx2.vin[1].scriptSig = CScript() << OP_2;
+  tx2.vout.resize(1);
+  tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+  tx2.vout[0].nValue = 10 * COIN;
+  pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).FromTx(tx2));
+
+  std::shared_ptr<const CTxMemPoolSnapshot> snapshot2 = pool.GetSnapshot();
+  BOOST_CHECK(snapshot2 != snapshot1);
+  BOOST_CHECK_EQUAL(snapshot1->size(), 1U);
+  BOOST_CHECK_EQUAL(snapshot2->size(), 2U);
+  BOOST_CHECK_EQUAL(snapshot2->nTotalTxSize, pool.GetTotalTxSize());
+
+  std::vector<uint256> vtxid;
+  pool.queryHashes(vtxid);
+  BOOST_REQUIRE_EQUAL(vtxid.size(), snapshot2->vEntries.size());
+  for (size_t i = 0; i < vtxid.size(); i++) {
+    BOOST_CHECK(vtxid[i] == snapshot2->vEntries[i].txid);
+  }
+
+  const TxMempoolSnapshotEntry *e = snapshot2->find(tx2.GetHash());
+  BOOST_REQUIRE(e);
+  BOOST_CHECK_EQUAL(e->nFee, 20000LL);
+  BOOST_CHECK_EQUAL(e->nCountWithAncestors, 2U);
+  BOOST_REQUIRE_EQUAL(e->vDepends.size(), 1U);
+  BOOST_CHECK(e->vDepends[0] == tx1.GetHash());
+  BOOST_CHECK(!snapshot2->find(uint256()));
+
+  pool.removeRecursive(tx1);
+
+  // Taken again only once the mempool changes.
+  std::shared_ptr<const CTxMemPoolSnapshot> snapshot3 = pool.GetSnapshot();
+  BOOST_CHECK_EQUAL(snapshot3->size(), 0U);
+  BOOST_CHECK_EQUAL(snapshot2->size(), 2U);
+  BOOST_CHECK(pool.GetSnapshot() == snapshot3);
+  pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+  BOOST_CHECK_EQUAL(pool.GetSnapshot()->size(), 1U);
+}
+
+static std::vector<std::vector<uint256>> MiningOrderHashes(CTxMemPool &pool) {
+  std::vector<std::vector<uint256>> vOrder;
+  for (const CTxMemPool::MiningChunk *chunk : pool.GetMiningOrder()) {
+    vOrder.emplace_back();
+    for (const CTxMemPool::txiter it : chunk->vTxs) {
+      vOrder.back().push_back(it->GetTx().GetHash());
+    }
+  }
+  return vOrder;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMiningOrderTest) {
+  TestMemPoolEntryHelper entry;
+  CTxMemPool pool;
+  LOCK(pool.cs);
+
+  CMutableTransaction txParent = CMutableTransaction();
+  txParent.vin.resize(1);
+  txParent.vin[0].scriptSig = CScript() << OP_1;
+  txParent.vout.resize(2);
+  for (CTxOut &txout : txParent.vout) {
+    txout.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txout.nValue = 10 * COIN;
+  }
+  pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+  CMutableTransaction txHigh = CMutableTransaction();
+  txHigh.vin.resize(1);
+  txHigh.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+  txHigh.vin[0].scriptSig = CScript() << OP_2;
+  txHigh.vout.resize(1);
+  txHigh.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+  txHigh.vout[0].nValue = 10 * COIN;
+  pool.addUnchecked(txHigh.GetHash(), entry.Fee(20000LL).FromTx(txHigh));
+
+  CMutableTransaction txLow = txHigh;
+  txLow.vin[0].prevout = COutPoint(txParent.GetHash(), 1);
+  pool.addUnchecked(txLow.GetHash(), entry.Fee(1000LL).FromTx(txLow));
+
+  CMutableTransaction txOther = txHigh;
+  txOther.vin[0].prevout = COutPoint(uint256S("01"), 0);
+  pool.addUnchecked(txOther.GetHash(), entry.Fee(5000LL).FromTx(txOther));
+
+  // The child pays for its parent, so both are mined as one chunk ahead of
+  // the unrelated transaction; the low fee sibling is left on its own.
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), 4);
+  std::vector<std::vector<uint256>> vOrder = MiningOrderHashes(pool);
+  BOOST_REQUIRE_EQUAL(vOrder.size(), 3U);
+  BOOST_REQUIRE_EQUAL(vOrder[0].size(), 2U);
+  BOOST_CHECK(vOrder[0][0] == txParent.GetHash());
+  BOOST_CHECK(vOrder[0][1] == txHigh.GetHash());
+  BOOST_CHECK(vOrder[1] == std::vector<uint256>{txOther.GetHash()});
+  BOOST_CHECK(vOrder[2] == std::vector<uint256>{txLow.GetHash()});
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), 0);
+
+  // Only the touched cluster is relinearized.
+  pool.PrioritiseTransaction(txOther.GetHash(), 50000LL);
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), 1);
+  vOrder = MiningOrderHashes(pool);
+  BOOST_REQUIRE_EQUAL(vOrder.size(), 3U);
+  BOOST_CHECK(vOrder[0] == std::vector<uint256>{txOther.GetHash()});
+
+  // Mining the parent splits its cluster in two.
+  pool.removeForBlock({MakeTransactionRef(txParent)}, 1);
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), 2);
+  vOrder = MiningOrderHashes(pool);
+  BOOST_REQUIRE_EQUAL(vOrder.size(), 3U);
+  BOOST_CHECK(vOrder[1] == std::vector<uint256>{txHigh.GetHash()});
+  BOOST_CHECK(vOrder[2] == std::vector<uint256>{txLow.GetHash()});
+
+  pool.clear();
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), 0);
+  BOOST_CHECK(pool.GetMiningOrder().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolLargeClusterOrderTest) {
+  TestMemPoolEntryHelper entry;
+  CTxMemPool pool;
+  LOCK(pool.cs);
+
+  const size_t nChildren = MAX_LINEARIZE_CLUSTER_SIZE;
+  CMutableTransaction txParent = CMutableTransaction();
+  txParent.vin.resize(1);
+  txParent.vin[0].scriptSig = CScript() << OP_1;
+  txParent.vout.resize(nChildren);
+  for (CTxOut &txout : txParent.vout) {
+    txout.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    txout.nValue = COIN;
+  }
+  pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+  std::vector<uint256> vChildren;
+  for (size_t i = 0; i < nChildren; i++) {
+    CMutableTransaction tx = CMutableTransaction();
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txParent.GetHash(), i);
+    tx.vin[0].scriptSig = CScript() << OP_2;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx.vout[0].nValue = COIN;
+    pool.addUnchecked(tx.GetHash(),
+                      entry.Fee(1000LL + 10 * ((i * 37) % nChildren))
+                          .FromTx(tx));
+    vChildren.push_back(tx.GetHash());
+  }
+
+  // Too large to relinearize: the parent comes first, then its children by
+  // decreasing feerate.
+  BOOST_CHECK_EQUAL(pool.UpdateMiningOrder(), (int)nChildren + 1);
+  std::vector<uint256> vOrder;
+  for (const std::vector<uint256> &vChunk : MiningOrderHashes(pool)) {
+    vOrder.insert(vOrder.end(), vChunk.begin(), vChunk.end());
+  }
+  BOOST_REQUIRE_EQUAL(vOrder.size(), nChildren + 1);
+  BOOST_CHECK(vOrder[0] == txParent.GetHash());
+  for (size_t i = 1; i < vOrder.size(); i++) {
+    const size_t nChild =
+        std::find(vChildren.begin(), vChildren.end(), vOrder[i]) -
+        vChildren.begin();
+    BOOST_REQUIRE(nChild < nChildren);
+    BOOST_CHECK_EQUAL((nChild * 37) % nChildren, nChildren - i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMemoryUsageTest) {
+  TestMemPoolEntryHelper entry;
+  CTxMemPool pool;
+  LOCK(pool.cs);
+
+  CMutableTransaction txParent = CMutableTransaction();
+  txParent.vin.resize(1);
+  txParent.vin[0].scriptSig = CScript() << OP_1;
+  txParent.vout.resize(1);
+  txParent.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+  txParent.vout[0].nValue = 10 * COIN;
+  pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+
+  CMutableTransaction txChild = txParent;
+  txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+  pool.addUnchecked(txChild.GetHash(), entry.Fee(1000LL).FromTx(txChild));
+  pool.UpdateMiningOrder();
+
+  TxMempoolMemoryUsage usage = pool.GetMemoryUsage();
+  BOOST_CHECK_EQUAL(usage.Total(), pool.DynamicMemoryUsage());
+  BOOST_CHECK_EQUAL(usage.nEntries, 2 * sizeof(CTxMemPoolEntry));
+  BOOST_CHECK(usage.nIndexes > 0);
+  BOOST_CHECK(usage.nTransactions > 0);
+  BOOST_CHECK(usage.nLinks > 0);
+  BOOST_CHECK(usage.nNextTx > 0);
+  BOOST_CHECK(usage.nTxHashes > 0);
+  BOOST_CHECK(usage.nMiningOrder > 0);
+  BOOST_CHECK_EQUAL(usage.nDeltas, 0U);
+  BOOST_CHECK_EQUAL(usage.nDescendantCache, 0U);
+
+  CTxMemPool::setEntries setDescendants;
+  pool.CalculateDescendantsCached(pool.mapTx.find(txParent.GetHash()),
+                                  setDescendants);
+  BOOST_CHECK_EQUAL(setDescendants.size(), 2U);
+  BOOST_CHECK(pool.GetMemoryUsage().nDescendantCache > 0);
+  BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), usage.Total());
+
+  pool.removeRecursive(txParent);
+  usage = pool.GetMemoryUsage();
+  BOOST_CHECK_EQUAL(usage.Total(), pool.DynamicMemoryUsage());
+  BOOST_CHECK_EQUAL(usage.nEntries, 0U);
+  BOOST_CHECK_EQUAL(usage.nTransactions, 0U);
+  BOOST_CHECK_EQUAL(usage.nLinks, 0U);
+  BOOST_CHECK_EQUAL(usage.nNextTx, 0U);
+  BOOST_CHECK_EQUAL(usage.nDescendantCache, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
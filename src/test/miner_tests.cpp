@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <base58.h>
 #include <chainparams.h>
 #include <coins.h>
 #include <consensus/consensus.h>
@@ -192,6 +193,100 @@ void TestPackageSelection(const CChainParams &chainparams, CScript scriptPubKey,
   BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+void TestChunkPrefix(const CChainParams &chainparams, CScript scriptPubKey,
+                     std::vector<CTransactionRef> &txFirst) {
+  TestMemPoolEntryHelper entry;
+
+  CMutableTransaction tx;
+  tx.vin.resize(1);
+  tx.vin[0].scriptSig = CScript() << OP_1;
+  tx.vin[0].prevout.hash = txFirst[3]->GetHash();
+  tx.vin[0].prevout.n = 0;
+  tx.vout.resize(1);
+  size_t parentSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+  CAmount parentFee = blockMinFeeRate.GetFee(parentSize);
+  tx.vout[0].nValue = 5000000000LL - parentFee;
+
+  uint256 hashParentTx = tx.GetHash();
+  mempool.addUnchecked(
+      hashParentTx,
+      entry.Fee(parentFee).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+
+  tx.vin[0].prevout.hash = hashParentTx;
+  tx.vout.resize(20);
+  for (CTxOut &txout : tx.vout) {
+    txout.nValue = (5000000000LL - parentFee - 100000) / 20;
+  }
+  size_t childSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+  mempool.addUnchecked(
+      tx.GetHash(),
+      entry.Fee(100000).Time(GetTime()).SpendsCoinbase(false).FromTx(tx));
+
+  // The child pays for its parent, but only the parent fits.
+  BlockAssembler::Options options;
+  options.nBlockMaxWeight =
+      4000 + WITNESS_SCALE_FACTOR * (parentSize + childSize);
+  options.blockMinFeeRate = blockMinFeeRate;
+  std::unique_ptr<CBlockTemplate> pblocktemplate =
+      BlockAssembler(chainparams, options).CreateNewBlock(scriptPubKey);
+  BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+  BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
+}
+
+void TestHiveBlockBCT(const CChainParams &chainparams,
+                      std::vector<CTransactionRef> &txFirst) {
+  TestMemPoolEntryHelper entry;
+
+  CMutableTransaction tx;
+  tx.vin.resize(1);
+  tx.vin[0].scriptSig = CScript() << OP_1;
+  tx.vin[0].prevout.hash = txFirst[3]->GetHash();
+  tx.vin[0].prevout.n = 0;
+  tx.vout.resize(2);
+  tx.vout[0].nValue = 2500000000LL;
+  tx.vout[1].nValue = 2500000000LL - 10000;
+
+  uint256 hashParentTx = tx.GetHash();
+  mempool.addUnchecked(
+      hashParentTx,
+      entry.Fee(10000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+
+  CScript scriptBCT = GetScriptForDestination(
+      DecodeDestination(chainparams.GetConsensus().beeCreationAddress));
+  scriptBCT << OP_RETURN << OP_BEE;
+  CScript scriptHoney = CScript() << OP_DUP << OP_HASH160
+                                  << std::vector<unsigned char>(20)
+                                  << OP_EQUALVERIFY << OP_CHECKSIG;
+  scriptBCT.insert(scriptBCT.end(), scriptHoney.begin(), scriptHoney.end());
+
+  CMutableTransaction bct;
+  bct.vin.resize(1);
+  bct.vin[0].scriptSig = CScript() << OP_1;
+  bct.vin[0].prevout = COutPoint(hashParentTx, 0);
+  bct.vout.resize(1);
+  bct.vout[0].scriptPubKey = scriptBCT;
+  bct.vout[0].nValue = 2500000000LL - 1000000;
+  BOOST_CHECK(CTransaction(bct).IsBCT(
+      chainparams.GetConsensus(),
+      GetScriptForDestination(
+          DecodeDestination(chainparams.GetConsensus().beeCreationAddress))));
+  mempool.addUnchecked(bct.GetHash(), entry.Fee(1000000).FromTx(bct));
+
+  tx.vin[0].prevout = COutPoint(hashParentTx, 1);
+  tx.vout.resize(1);
+  tx.vout[0].nValue = 2500000000LL - 20000;
+  uint256 hashSiblingTx = tx.GetHash();
+  mempool.addUnchecked(hashSiblingTx, entry.Fee(10000).FromTx(tx));
+
+  // The BCT pays for its parent, but cannot go in a hive block; the parent
+  // and its other child still do.
+  std::unique_ptr<CBlockTemplate> pblocktemplate =
+      AssemblerForTest(chainparams).CreateHiveCandidate();
+  BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+  BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
+  BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashSiblingTx);
+}
+
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity) {
   const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
   const CChainParams &chainparams = *chainParams;
@@ -555,6 +650,37 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity) {
 
   TestPackageSelection(chainparams, scriptPubKey, txFirst);
 
+  mempool.clear();
+  TestChunkPrefix(chainparams, scriptPubKey, txFirst);
+
+  mempool.clear();
+  TestHiveBlockBCT(chainparams, txFirst);
+
+  fCheckpointsEnabled = true;
+}
+
+BOOST_AUTO_TEST_CASE(hive_candidate) {
+  const CChainParams &chainparams = Params();
+  fCheckpointsEnabled = false;
+  nLastBlockTx = 1234;
+  nLastBlockWeight = 5678;
+
+  // Background templates leave the getmininginfo stats alone.
+  std::unique_ptr<CBlockTemplate> pblocktemplate;
+  BOOST_CHECK(pblocktemplate =
+                  BlockAssembler(chainparams).CreateHiveCandidate());
+  BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+  BOOST_CHECK_EQUAL(nLastBlockTx, 1234U);
+  BOOST_CHECK_EQUAL(nLastBlockWeight, 5678U);
+
+  // Rebuilt only when the tip or the mempool changes.
+  mempool.AddTransactionsUpdated(1);
+  BOOST_CHECK(UpdateHiveCandidate(chainparams));
+  BOOST_CHECK(!UpdateHiveCandidate(chainparams));
+  mempool.AddTransactionsUpdated(1);
+  BOOST_CHECK(UpdateHiveCandidate(chainparams));
+  BOOST_CHECK(!UpdateHiveCandidate(chainparams));
+
   fCheckpointsEnabled = true;
 }
 
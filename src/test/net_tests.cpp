@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <hash.h>
 #include <net.h>
+#include <net_processing.h>
 #include <netbase.h>
 #include <serialize.h>
 #include <streams.h>
@@ -168,4 +169,336 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test) {
   BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool) {
+  CRecvBufferPool pool;
+  BOOST_CHECK(pool.Get(0).capacity() == 0);
+
+  CSerializeData vch = pool.Get(300);
+  BOOST_CHECK_EQUAL(vch.capacity(), 1024U);
+  vch.assign(300, 'x');
+  const char *pchBuffer = vch.data();
+  pool.Put(std::move(vch));
+  BOOST_CHECK_EQUAL(pool.GetStats().nPooledBuffers, 1U);
+
+  // A request in the same class is served by the returned buffer, cleared.
+  CSerializeData vchReused = pool.Get(1000);
+  BOOST_CHECK(vchReused.data() == pchBuffer);
+  BOOST_CHECK(vchReused.empty());
+  BOOST_CHECK_EQUAL(pool.Get(1025).capacity(), 4096U);
+  BOOST_CHECK_EQUAL(pool.Get(MAX_PROTOCOL_MESSAGE_LENGTH).capacity(),
+                    4U * 1024 * 1024);
+
+  CRecvBufferPool::Stats stats = pool.GetStats();
+  BOOST_CHECK_EQUAL(stats.nHits, 1U);
+  BOOST_CHECK_EQUAL(stats.nMisses, 3U);
+  BOOST_CHECK_EQUAL(stats.nPooledBuffers, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_receive) {
+  std::vector<unsigned char> vPayload(5000, 0x42);
+  CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+  CMessageHeader hdr(Params().MessageStart(), "block", vPayload.size());
+  uint256 hash = Hash(vPayload.begin(), vPayload.end());
+  memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+  ssMsg << hdr;
+  ssMsg.write((const char *)vPayload.data(), vPayload.size());
+
+  std::atomic<int64_t> nUsage{0};
+  {
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION,
+                    &nUsage);
+    const char *pch = &ssMsg[0];
+    unsigned int nLeft = ssMsg.size();
+    // Feed the header and payload in small pieces, as a slow socket would.
+    while (nLeft > 0) {
+      unsigned int nChunk = std::min(nLeft, 7U);
+      int nRead = msg.in_data ? msg.readData(pch, nChunk)
+                              : msg.readHeader(pch, nChunk);
+      BOOST_REQUIRE(nRead > 0);
+      pch += nRead;
+      nLeft -= nRead;
+      BOOST_CHECK(nUsage >= msg.nDataPos);
+      BOOST_CHECK(nUsage <= 4 * std::max(msg.nDataPos, 1024U));
+    }
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), "block");
+    BOOST_CHECK(std::equal(msg.vRecv.begin(), msg.vRecv.end(),
+                           vPayload.begin()));
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK_EQUAL(nUsage, 16 * 1024);
+  }
+  BOOST_CHECK_EQUAL(nUsage, 0);
+
+  // Announcing a large message does not reserve room for it.
+  CDataStream ssLarge(SER_NETWORK, PROTOCOL_VERSION);
+  ssLarge << CMessageHeader(Params().MessageStart(), "block", 3000000);
+  ssLarge.write((const char *)vPayload.data(), 100);
+  CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION,
+                  &nUsage);
+  BOOST_CHECK(msg.readHeader(&ssLarge[0], ssLarge.size()) ==
+              CMessageHeader::HEADER_SIZE);
+  BOOST_CHECK_EQUAL(
+      msg.readData(&ssLarge[CMessageHeader::HEADER_SIZE], 100), 100);
+  BOOST_CHECK_EQUAL(nUsage, 1024);
+}
+
+BOOST_AUTO_TEST_CASE(message_processing_time) {
+  CMsgProcessingTime time;
+  time.Add(0);
+  time.Add(15);
+  time.Add(16);
+  time.Add(1000);
+  time.Add(int64_t(1) << 40);
+  BOOST_CHECK_EQUAL(time.nCount, 5U);
+  BOOST_CHECK_EQUAL(time.nMaxMicros, int64_t(1) << 40);
+  BOOST_CHECK_EQUAL(time.vBuckets[0], 2U);
+  BOOST_CHECK_EQUAL(time.vBuckets[1], 1U);
+  // 1000us falls under the 1024us limit of bucket 6.
+  BOOST_CHECK_EQUAL(time.vBuckets[6], 1U);
+  BOOST_CHECK_EQUAL(time.vBuckets[CMsgProcessingTime::NUM_BUCKETS - 1], 1U);
+
+  CConnman connman(0x1337, 0x1337);
+  CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(),
+             "", true);
+  connman.RecordMessageProcessed(&node, NetMsgType::TX, 100);
+  connman.RecordMessageProcessed(&node, NetMsgType::TX, 300);
+  connman.RecordMessageProcessed(&node, "nonsense", 50);
+
+  CNodeStats stats;
+  node.copyStats(stats);
+  BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd.size(), 2U);
+  BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::TX].nCount, 2U);
+  BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd[NetMsgType::TX].nTotalMicros,
+                    400);
+  BOOST_CHECK_EQUAL(stats.mapProcessTimePerMsgCmd["*other*"].nCount, 1U);
+  BOOST_CHECK_EQUAL(
+      connman.GetProcessTimePerMsgCmd()[NetMsgType::TX].nMaxMicros, 300);
+}
+
+#ifndef WIN32
+namespace {
+// Reassembles the messages written to the other end of a socket pair.
+struct MessageReader {
+  std::vector<std::pair<std::string, std::vector<unsigned char>>> vMsgs;
+  std::unique_ptr<CNetMessage> msg;
+
+  void ReadOnce(SOCKET hSocket) {
+    char pchBuf[0x10000];
+    ssize_t nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), 0);
+    BOOST_REQUIRE(nBytes > 0);
+    const char *pch = pchBuf;
+    while (nBytes > 0) {
+      if (!msg)
+        msg.reset(new CNetMessage(Params().MessageStart(), SER_NETWORK,
+                                  INIT_PROTO_VERSION));
+      int nRead = msg->in_data ? msg->readData(pch, nBytes)
+                               : msg->readHeader(pch, nBytes);
+      BOOST_REQUIRE(nRead > 0);
+      pch += nRead;
+      nBytes -= nRead;
+      if (msg->complete()) {
+        BOOST_CHECK(memcmp(msg->GetMessageHash().begin(),
+                           msg->hdr.pchChecksum,
+                           CMessageHeader::CHECKSUM_SIZE) == 0);
+        vMsgs.emplace_back(
+            msg->hdr.GetCommand(),
+            std::vector<unsigned char>(msg->vRecv.begin(), msg->vRecv.end()));
+        msg.reset();
+      }
+    }
+  }
+};
+} // namespace
+
+BOOST_AUTO_TEST_CASE(batched_send) {
+  int fds[2];
+  BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  SetSocketNonBlocking(fds[0], true);
+  CConnman connman(0x1337, 0x1337);
+  CNode node(0, NODE_NETWORK, 0, fds[0], CAddress(), 0, 0, CAddress(), "",
+             false);
+
+  // Large messages fill the socket buffer and are written partially; the
+  // small ones queued behind them then go out several per call.
+  const size_t nLarge = 8;
+  const size_t nSmall = 200;
+  for (size_t i = 0; i < nLarge; i++) {
+    CSerializedNetMsg msg;
+    msg.command = "block";
+    msg.data.assign(300000, (unsigned char)i);
+    connman.PushMessage(&node, std::move(msg));
+  }
+  BOOST_CHECK(!node.vSendMsg.empty());
+  for (size_t i = 0; i < nSmall; i++) {
+    CSerializedNetMsg msg;
+    msg.command = i % 2 ? "inv" : "ping";
+    msg.data.assign(i, (unsigned char)i);
+    connman.PushMessage(&node, std::move(msg));
+  }
+  BOOST_CHECK_EQUAL(node.nSendCalls, 1U);
+
+  MessageReader reader;
+  while (reader.vMsgs.size() < nLarge + nSmall) {
+    CConnmanTest::SocketSendData(connman, node);
+    reader.ReadOnce(fds[1]);
+  }
+  BOOST_CHECK(node.vSendMsg.empty());
+  BOOST_CHECK_EQUAL(node.nSendSize, 0U);
+  BOOST_CHECK_EQUAL(node.nSendMsgs, nLarge + nSmall);
+  BOOST_CHECK(node.nSendCalls < nSmall);
+
+  const auto &vMsgs = reader.vMsgs;
+  for (size_t i = 0; i < nLarge; i++) {
+    BOOST_CHECK_EQUAL(vMsgs[i].first, "block");
+    BOOST_CHECK(vMsgs[i].second ==
+                std::vector<unsigned char>(300000, (unsigned char)i));
+  }
+  for (size_t i = 0; i < nSmall; i++) {
+    BOOST_CHECK_EQUAL(vMsgs[nLarge + i].first, i % 2 ? "inv" : "ping");
+    BOOST_CHECK(vMsgs[nLarge + i].second ==
+                std::vector<unsigned char>(i, (unsigned char)i));
+  }
+  close(fds[1]);
+}
+#endif
+
+namespace {
+// Records whether any peer was ever served by two handler threads at once.
+class HandlerProbe : public NetEventsInterface {
+public:
+  static const int ROUNDS = 20;
+
+  explicit HandlerProbe(int nPeers) : vInPeer(nPeers), vRounds(nPeers) {}
+
+  bool ProcessMessages(CNode *pnode, std::atomic<bool> &interrupt) override {
+    Enter(pnode);
+    MilliSleep(2);
+    bool fMoreWork = ++vRounds[pnode->GetId()] < ROUNDS;
+    Leave(pnode);
+    return fMoreWork;
+  }
+
+  bool SendMessages(CNode *pnode, std::atomic<bool> &interrupt) override {
+    Enter(pnode);
+    Leave(pnode);
+    return true;
+  }
+
+  void InitializeNode(CNode *pnode) override {}
+  void FinalizeNode(NodeId id, bool &update_connection_time) override {}
+
+  bool Done() const {
+    for (const std::atomic<int> &nRounds : vRounds) {
+      if (nRounds < ROUNDS)
+        return false;
+    }
+    return true;
+  }
+
+  std::atomic<bool> fOverlap{false};
+  std::atomic<int> nMaxActive{0};
+
+private:
+  std::vector<std::atomic<int>> vInPeer;
+  std::vector<std::atomic<int>> vRounds;
+  std::atomic<int> nActive{0};
+
+  void Enter(CNode *pnode) {
+    if (vInPeer[pnode->GetId()]++ != 0)
+      fOverlap = true;
+    int nNow = ++nActive;
+    int nMax = nMaxActive;
+    while (nNow > nMax && !nMaxActive.compare_exchange_weak(nMax, nNow)) {
+    }
+  }
+
+  void Leave(CNode *pnode) {
+    nActive--;
+    vInPeer[pnode->GetId()]--;
+  }
+};
+} // namespace
+
+BOOST_AUTO_TEST_CASE(message_handler_threads) {
+  const int nPeers = 8;
+  HandlerProbe probe(nPeers);
+  CConnman connman(0x1337, 0x1337);
+  CConnman::Options options;
+  options.m_msgproc = &probe;
+  options.nMessageHandlerThreads = 4;
+  connman.Init(options);
+
+  for (NodeId id = 0; id < nPeers; id++) {
+    CNode *pnode = new CNode(id, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(),
+                             0, 0, CAddress(), "", true);
+    pnode->fSuccessfullyConnected = true;
+    CConnmanTest::AddNode(connman, *pnode);
+  }
+  CConnmanTest::StartMessageHandlers(connman);
+
+  int64_t nDeadline = GetTimeMillis() + 10000;
+  while (!probe.Done() && GetTimeMillis() < nDeadline) {
+    MilliSleep(10);
+  }
+  connman.Interrupt();
+  connman.Stop();
+  InterruptSocks5(false);
+
+  BOOST_CHECK(probe.Done());
+  BOOST_CHECK(!probe.fOverlap);
+  BOOST_CHECK(probe.nMaxActive > 1);
+}
+
+static std::vector<unsigned char> SerializeBlock(const CBlock &block,
+                                                 int nVersionFlags) {
+  CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | nVersionFlags);
+  ss << block;
+  return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(raw_block_serving) {
+  CMutableTransaction coinbase;
+  coinbase.vin.resize(1);
+  coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+  coinbase.vout.resize(1);
+  coinbase.vout[0].nValue = 50 * COIN;
+
+  CMutableTransaction spend;
+  spend.vin.resize(1);
+  spend.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+  spend.vout.resize(1);
+  spend.vout[0].nValue = 49 * COIN;
+
+  CBlock plain;
+  plain.vtx.push_back(MakeTransactionRef(coinbase));
+  plain.vtx.push_back(MakeTransactionRef(spend));
+
+  // A witness anywhere in a valid block means one in the coinbase, even
+  // when it is the only one.
+  coinbase.vin[0].scriptWitness.stack.assign(
+      1, std::vector<unsigned char>(32, 0));
+  CBlock coinbaseOnly;
+  coinbaseOnly.vtx.push_back(MakeTransactionRef(coinbase));
+  coinbaseOnly.vtx.push_back(MakeTransactionRef(spend));
+  spend.vin[0].scriptWitness.stack.assign(1, std::vector<unsigned char>(72));
+  CBlock witness;
+  witness.vtx.push_back(MakeTransactionRef(coinbase));
+  witness.vtx.push_back(MakeTransactionRef(spend));
+
+  // Blocks are stored with their witnesses.
+  const std::vector<unsigned char> vPlain = SerializeBlock(plain, 0);
+  BOOST_CHECK(CanServeRawBlock(vPlain, MSG_BLOCK));
+  BOOST_CHECK(CanServeRawBlock(vPlain, MSG_WITNESS_BLOCK));
+  BOOST_CHECK(vPlain ==
+              SerializeBlock(plain, SERIALIZE_TRANSACTION_NO_WITNESS));
+
+  for (const CBlock *pblock : {&coinbaseOnly, &witness}) {
+    const std::vector<unsigned char> vStored = SerializeBlock(*pblock, 0);
+    BOOST_CHECK(!CanServeRawBlock(vStored, MSG_BLOCK));
+    BOOST_CHECK(CanServeRawBlock(vStored, MSG_WITNESS_BLOCK));
+    BOOST_CHECK(vStored !=
+                SerializeBlock(*pblock, SERIALIZE_TRANSACTION_NO_WITNESS));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
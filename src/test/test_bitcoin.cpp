@@ -19,9 +19,11 @@
 
 #include <memory>
 
-void CConnmanTest::AddNode(CNode &node) {
-  LOCK(g_connman->cs_vNodes);
-  g_connman->vNodes.push_back(&node);
+void CConnmanTest::AddNode(CNode &node) { AddNode(*g_connman, node); }
+
+void CConnmanTest::AddNode(CConnman &connman, CNode &node) {
+  LOCK(connman.cs_vNodes);
+  connman.vNodes.push_back(&node);
 }
 
 void CConnmanTest::ClearNodes() {
@@ -29,6 +31,15 @@ void CConnmanTest::ClearNodes() {
   g_connman->vNodes.clear();
 }
 
+void CConnmanTest::StartMessageHandlers(CConnman &connman) {
+  connman.StartMessageHandlers();
+}
+
+size_t CConnmanTest::SocketSendData(CConnman &connman, CNode &node) {
+  LOCK(node.cs_vSend);
+  return connman.SocketSendData(&node);
+}
+
 uint256 insecure_rand_seed = GetRandHash();
 FastRandomContext insecure_rand_ctx(insecure_rand_seed);
 
@@ -50,7 +50,10 @@ class CConnman;
 class CNode;
 struct CConnmanTest {
   static void AddNode(CNode &node);
+  static void AddNode(CConnman &connman, CNode &node);
   static void ClearNodes();
+  static void StartMessageHandlers(CConnman &connman);
+  static size_t SocketSendData(CConnman &connman, CNode &node);
 };
 
 class PeerLogicValidation;
@@ -0,0 +1,273 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <sketch.h>
+#include <txreconciliation.h>
+#include <utilstrencodings.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode) {
+  SeedInsecureRand(true);
+  for (size_t nCapacity : {1, 2, 4, 16, 64}) {
+    for (size_t nDiff = 0; nDiff <= nCapacity; nDiff++) {
+      CSketch a(nCapacity), b(nCapacity);
+      for (int i = 0; i < 50; i++) {
+        uint32_t nShared = InsecureRand32() | 1;
+        a.Add(nShared);
+        b.Add(nShared);
+      }
+      std::set<uint32_t> setDiff;
+      while (setDiff.size() < nDiff) {
+        uint32_t nElement = InsecureRand32() & ~1U;
+        if (nElement == 0 || !setDiff.insert(nElement).second)
+          continue;
+        (InsecureRandBool() ? a : b).Add(nElement);
+      }
+
+      CSketch received;
+      BOOST_CHECK(received.Deserialize(a.Serialize()));
+      BOOST_CHECK_EQUAL(received.GetCapacity(), nCapacity);
+      received.Merge(b);
+      std::vector<uint32_t> vDecoded;
+      BOOST_CHECK(received.Decode(vDecoded));
+      BOOST_CHECK(std::set<uint32_t>(vDecoded.begin(), vDecoded.end()) ==
+                  setDiff);
+    }
+  }
+
+  CSketch full(16);
+  for (int i = 0; i < 21; i++)
+    full.Add(InsecureRand32() | 1);
+  std::vector<uint32_t> vDecoded;
+  BOOST_CHECK(!full.Decode(vDecoded));
+  BOOST_CHECK(vDecoded.empty());
+
+  CSketch truncated;
+  BOOST_CHECK(!truncated.Deserialize(std::vector<unsigned char>(6)));
+}
+
+namespace {
+
+/** Two nodes, a having opened the connection to b, exchanging messages in
+ * their wire encoding. */
+struct ReconLink {
+  TxReconciliationTracker a, b;
+  std::set<uint256> setKnownA, setKnownB;
+  uint64_t nBytes = 0;
+
+  template <typename... Args>
+  CDataStream Send(const char *pszCommand, Args &&... args) {
+    CSerializedNetMsg msg = CNetMsgMaker(PROTOCOL_VERSION)
+                                .Make(pszCommand, std::forward<Args>(args)...);
+    nBytes += CMessageHeader::HEADER_SIZE + msg.data.size();
+    return CDataStream(msg.data, SER_NETWORK, PROTOCOL_VERSION);
+  }
+
+  void Announce(const std::vector<uint256> &vTxids, std::set<uint256> &to) {
+    if (vTxids.empty())
+      return;
+    std::vector<CInv> vInv;
+    for (const uint256 &txid : vTxids)
+      vInv.push_back(CInv(MSG_TX, txid));
+    CDataStream stream = Send(NetMsgType::INV, vInv);
+    stream >> vInv;
+    for (const CInv &inv : vInv)
+      to.insert(inv.hash);
+  }
+};
+
+/** Relay nRounds batches of nTxs transactions reaching both nodes from other
+ * peers, except nOnlyPercent that reach only one of them, and return the
+ * bytes sent between the two per transaction. */
+double RelayBytesPerTx(bool fReconcile, int nRounds, int nTxs,
+                       int nOnlyPercent, TxReconciliationStats &stats) {
+  ReconLink link;
+  if (fReconcile) {
+    // Peer ids as seen from each side: a knows b as 1, b knows a as 0.
+    CDataStream toB = link.Send(NetMsgType::SENDTXRCNCL,
+                                TXRECONCILIATION_VERSION,
+                                link.a.PreRegisterPeer(1));
+    CDataStream toA = link.Send(NetMsgType::SENDTXRCNCL,
+                                TXRECONCILIATION_VERSION,
+                                link.b.PreRegisterPeer(0));
+    uint32_t nVersion;
+    uint64_t nSalt;
+    toB >> nVersion >> nSalt;
+    BOOST_CHECK(link.b.RegisterPeer(0, false, nVersion, nSalt));
+    toA >> nVersion >> nSalt;
+    BOOST_CHECK(link.a.RegisterPeer(1, true, nVersion, nSalt));
+  }
+
+  std::set<uint256> setAll;
+  int64_t nNow = 0;
+  for (int nRound = 0; nRound < nRounds; nRound++) {
+    std::vector<uint256> vNewA, vNewB;
+    for (int i = 0; i < nTxs; i++) {
+      uint256 txid = InsecureRand256();
+      setAll.insert(txid);
+      int nWhere = InsecureRandRange(100);
+      if (nWhere >= nOnlyPercent / 2)
+        vNewB.push_back(txid);
+      if (nWhere < nOnlyPercent / 2 || nWhere >= nOnlyPercent)
+        vNewA.push_back(txid);
+    }
+    link.setKnownA.insert(vNewA.begin(), vNewA.end());
+    link.setKnownB.insert(vNewB.begin(), vNewB.end());
+
+    if (!fReconcile) {
+      link.Announce(vNewA, link.setKnownB);
+      link.Announce(vNewB, link.setKnownA);
+      continue;
+    }
+
+    for (const uint256 &txid : vNewA)
+      BOOST_CHECK(link.a.AddToSet(1, txid));
+    for (const uint256 &txid : vNewB)
+      BOOST_CHECK(link.b.AddToSet(0, txid));
+    nNow += RECON_REQUEST_INTERVAL + RECON_REQUEST_MARGIN;
+
+    uint16_t nSetSize, nQ;
+    BOOST_REQUIRE(link.a.InitiateReconciliation(1, nNow, nSetSize, nQ));
+    CDataStream request = link.Send(NetMsgType::REQRECON, nSetSize, nQ);
+    request >> nSetSize >> nQ;
+
+    bool fRespond;
+    std::vector<unsigned char> vSketch;
+    BOOST_REQUIRE(link.b.HandleReconciliationRequest(0, nNow, nSetSize, nQ,
+                                                     fRespond, vSketch));
+    BOOST_REQUIRE(fRespond);
+    CDataStream sketch = link.Send(NetMsgType::SKETCH, vSketch);
+    sketch >> vSketch;
+
+    bool fSuccess;
+    std::vector<uint32_t> vAskShortIds;
+    std::vector<uint256> vAnnounce;
+    BOOST_REQUIRE(link.a.HandleSketch(1, vSketch, fRespond, fSuccess,
+                                      vAskShortIds, vAnnounce));
+    BOOST_REQUIRE(fRespond);
+    CDataStream diff =
+        link.Send(NetMsgType::RECONCILDIFF, fSuccess, vAskShortIds);
+    link.Announce(vAnnounce, link.setKnownB);
+    diff >> fSuccess >> vAskShortIds;
+
+    BOOST_REQUIRE(link.b.HandleReconciliationDifference(
+        0, fSuccess, vAskShortIds, vAnnounce));
+    link.Announce(vAnnounce, link.setKnownA);
+  }
+
+  BOOST_CHECK(link.setKnownA == setAll);
+  BOOST_CHECK(link.setKnownB == setAll);
+  stats = link.a.GetStats();
+  return (double)link.nBytes / setAll.size();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(reconciliation_bytes_per_tx) {
+  SeedInsecureRand(true);
+  TxReconciliationStats stats;
+  double nFlooding = RelayBytesPerTx(false, 50, 20, 20, stats);
+  double nReconciling = RelayBytesPerTx(true, 50, 20, 20, stats);
+  BOOST_TEST_MESSAGE(strprintf("bytes per tx: flooding %.1f, "
+                               "reconciliation %.1f (%u failed rounds)",
+                               nFlooding, nReconciling, stats.nFailed));
+  BOOST_CHECK_EQUAL(stats.nSucceeded + stats.nFailed, 50U);
+  BOOST_CHECK(stats.nSucceeded >= 45);
+  BOOST_CHECK(nReconciling * 2 < nFlooding);
+
+  // Differences beyond any sketch fall back to announcing everything.
+  RelayBytesPerTx(true, 3, 200, 100, stats);
+  BOOST_CHECK_EQUAL(stats.nSucceeded, 0U);
+  BOOST_CHECK_EQUAL(stats.nFailed, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_negotiation) {
+  TxReconciliationTracker tracker;
+  uint256 txid = InsecureRand256();
+  BOOST_CHECK(!tracker.RegisterPeer(0, true, TXRECONCILIATION_VERSION, 1));
+  BOOST_CHECK(!tracker.AddToSet(0, txid));
+
+  tracker.PreRegisterPeer(0);
+  BOOST_CHECK(!tracker.RegisterPeer(0, true, 0, 1));
+  tracker.PreRegisterPeer(0);
+  BOOST_CHECK(tracker.RegisterPeer(0, true, TXRECONCILIATION_VERSION, 1));
+  BOOST_CHECK(!tracker.RegisterPeer(0, true, TXRECONCILIATION_VERSION, 1));
+  BOOST_CHECK(tracker.IsPeerRegistered(0));
+  BOOST_CHECK(tracker.AddToSet(0, txid));
+
+  // A sketch nobody asked for is ignored, a malformed one and a request to
+  // the initiator are violations.
+  bool fRespond;
+  bool fSuccess;
+  std::vector<uint32_t> vAskShortIds;
+  std::vector<uint256> vAnnounce;
+  const std::vector<unsigned char> vEmptySketch(4);
+  BOOST_CHECK(tracker.HandleSketch(0, vEmptySketch, fRespond, fSuccess,
+                                   vAskShortIds, vAnnounce));
+  BOOST_CHECK(!fRespond);
+  BOOST_CHECK(!tracker.HandleSketch(0, std::vector<unsigned char>(3),
+                                    fRespond, fSuccess, vAskShortIds,
+                                    vAnnounce));
+  std::vector<unsigned char> vSketch;
+  BOOST_CHECK(!tracker.HandleReconciliationRequest(0, 0, 1, DEFAULT_RECON_Q,
+                                                   fRespond, vSketch));
+
+  // An unanswered request is given up on, its transactions kept for later.
+  uint16_t nSetSize, nQ;
+  BOOST_CHECK(tracker.InitiateReconciliation(0, 0, nSetSize, nQ));
+  BOOST_CHECK_EQUAL(nSetSize, 1);
+  BOOST_CHECK(!tracker.InitiateReconciliation(0, RECON_REQUEST_INTERVAL,
+                                              nSetSize, nQ));
+  BOOST_CHECK(tracker.InitiateReconciliation(0, RECON_RESPONSE_TIMEOUT,
+                                             nSetSize, nQ));
+  BOOST_CHECK_EQUAL(nSetSize, 1);
+
+  // The late answer to the first request is dropped, the next one ends the
+  // current round.
+  BOOST_CHECK(tracker.HandleSketch(0, vEmptySketch, fRespond, fSuccess,
+                                   vAskShortIds, vAnnounce));
+  BOOST_CHECK(!fRespond);
+  BOOST_CHECK(vAnnounce.empty());
+  BOOST_CHECK(tracker.HandleSketch(0, vEmptySketch, fRespond, fSuccess,
+                                   vAskShortIds, vAnnounce));
+  BOOST_CHECK(fRespond);
+  BOOST_CHECK(!fSuccess);
+  BOOST_CHECK(vAnnounce == std::vector<uint256>(1, txid));
+
+  // Requests closer together than RECON_REQUEST_INTERVAL are ignored.
+  TxReconciliationTracker responder;
+  responder.PreRegisterPeer(0);
+  BOOST_CHECK(responder.RegisterPeer(0, false, TXRECONCILIATION_VERSION, 1));
+  BOOST_CHECK(responder.AddToSet(0, txid));
+  const int64_t nStart = RECON_RESPONSE_TIMEOUT;
+  BOOST_CHECK(responder.HandleReconciliationRequest(
+      0, nStart, 1, DEFAULT_RECON_Q, fRespond, vSketch));
+  BOOST_CHECK(fRespond);
+  BOOST_CHECK(!vSketch.empty());
+  BOOST_CHECK(responder.HandleReconciliationRequest(
+      0, nStart + RECON_REQUEST_INTERVAL - 1, 1, DEFAULT_RECON_Q, fRespond,
+      vSketch));
+  BOOST_CHECK(!fRespond);
+  BOOST_CHECK(vSketch.empty());
+  BOOST_CHECK(responder.HandleReconciliationRequest(
+      0, nStart + RECON_REQUEST_INTERVAL, 1, DEFAULT_RECON_Q, fRespond,
+      vSketch));
+  BOOST_CHECK(fRespond);
+  BOOST_CHECK(!vSketch.empty());
+
+  tracker.ForgetPeer(0);
+  BOOST_CHECK(!tracker.IsPeerRegistered(0));
+  BOOST_CHECK_EQUAL(tracker.GetStats().nPeers, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
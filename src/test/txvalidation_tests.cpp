@@ -5,6 +5,7 @@
 #include <amount.h>
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/test_bitcoin.h>
 #include <txmempool.h>
@@ -48,4 +49,108 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup) {
   BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+static CMutableTransaction SignedSpend(const COutPoint &prevout,
+                                       const CScript &scriptPubKey,
+                                       const CKey &key, CAmount nValue) {
+  CMutableTransaction tx;
+  tx.nVersion = 1;
+  tx.vin.resize(1);
+  tx.vin[0].prevout = prevout;
+  tx.vout.resize(1);
+  tx.vout[0].nValue = nValue;
+  tx.vout[0].scriptPubKey = scriptPubKey;
+
+  std::vector<unsigned char> vchSig;
+  uint256 hash =
+      SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+  BOOST_CHECK(key.Sign(hash, vchSig));
+  vchSig.push_back((unsigned char)SIGHASH_ALL);
+  tx.vin[0].scriptSig << vchSig;
+  return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain100Setup) {
+  CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                   << OP_CHECKSIG;
+
+  CMutableTransaction parent = SignedSpend(
+      COutPoint(coinbaseTxns[0].GetHash(), 0), scriptPubKey, coinbaseKey,
+      11 * CENT);
+  CMutableTransaction child = SignedSpend(COutPoint(parent.GetHash(), 0),
+                                          scriptPubKey, coinbaseKey, 10 * CENT);
+  CMutableTransaction doubleSpend = SignedSpend(
+      COutPoint(coinbaseTxns[0].GetHash(), 0), scriptPubKey, coinbaseKey,
+      12 * CENT);
+  CMutableTransaction badSig = SignedSpend(
+      COutPoint(coinbaseTxns[1].GetHash(), 0), scriptPubKey, coinbaseKey,
+      11 * CENT);
+  badSig.vin[0].scriptSig = CScript() << std::vector<unsigned char>(71, 0x30);
+  CMutableTransaction orphan = SignedSpend(COutPoint(InsecureRand256(), 0),
+                                           scriptPubKey, coinbaseKey,
+                                           10 * CENT);
+
+  std::vector<CTransactionRef> vtx = {
+      MakeTransactionRef(parent), MakeTransactionRef(child),
+      MakeTransactionRef(doubleSpend), MakeTransactionRef(badSig),
+      MakeTransactionRef(orphan)};
+  std::vector<MempoolAcceptResult> vResults =
+      AcceptToMemoryPoolBatch(mempool, vtx, true, 0);
+
+  BOOST_REQUIRE_EQUAL(vResults.size(), vtx.size());
+  BOOST_CHECK(vResults[0].fAccepted);
+  BOOST_CHECK(vResults[1].fAccepted);
+  BOOST_CHECK(!vResults[2].fAccepted);
+  BOOST_CHECK_EQUAL(vResults[2].state.GetRejectReason(),
+                    "txn-mempool-conflict");
+  BOOST_CHECK(!vResults[3].fAccepted);
+  BOOST_CHECK(vResults[3].state.IsInvalid());
+  BOOST_CHECK(!vResults[4].fAccepted);
+  BOOST_CHECK(vResults[4].fMissingInputs);
+
+  BOOST_CHECK_EQUAL(mempool.size(), 2U);
+  BOOST_CHECK(mempool.exists(parent.GetHash()));
+  BOOST_CHECK(mempool.exists(child.GetHash()));
+  mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_dump_load, TestChain100Setup) {
+  CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                   << OP_CHECKSIG;
+
+  std::vector<CTransactionRef> vtx;
+  for (int i = 0; i < 3; i++) {
+    CMutableTransaction parent = SignedSpend(
+        COutPoint(coinbaseTxns[i].GetHash(), 0), scriptPubKey, coinbaseKey,
+        11 * CENT);
+    CMutableTransaction child = SignedSpend(
+        COutPoint(parent.GetHash(), 0), scriptPubKey, coinbaseKey, 10 * CENT);
+    vtx.push_back(MakeTransactionRef(parent));
+    vtx.push_back(MakeTransactionRef(child));
+  }
+  for (const MempoolAcceptResult &result :
+       AcceptToMemoryPoolBatch(mempool, vtx, true, 0)) {
+    BOOST_CHECK(result.fAccepted);
+  }
+  mempool.PrioritiseTransaction(vtx[1]->GetHash(), 1000);
+  mempool.PrioritiseTransaction(InsecureRand256(), 2000);
+
+  BOOST_REQUIRE(DumpMempool());
+  mempool.clear();
+  {
+    LOCK(mempool.cs);
+    mempool.mapDeltas.clear();
+  }
+  BOOST_REQUIRE(LoadMempool());
+
+  BOOST_CHECK_EQUAL(mempool.size(), vtx.size());
+  for (const CTransactionRef &tx : vtx) {
+    BOOST_CHECK(mempool.exists(tx->GetHash()));
+  }
+  CAmount nFeeDelta = 0;
+  mempool.ApplyDelta(vtx[1]->GetHash(), nFeeDelta);
+  BOOST_CHECK_EQUAL(nFeeDelta, 1000);
+  BOOST_CHECK_EQUAL(mempool.mapDeltas.size(), 2U);
+  mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -57,22 +57,29 @@ size_t CTxMemPoolEntry::GetTxSize() const {
 void CTxMemPool::UpdateForDescendants(txiter updateIt,
                                       cacheMap &cachedDescendants,
                                       const std::set<uint256> &setExclude) {
-  setEntries stageEntries, setAllDescendants;
-  stageEntries = GetMemPoolChildren(updateIt);
+  const EpochGuard epoch(*this);
+  vecEntries stageEntries, vAllDescendants;
+  visited(updateIt);
+  for (const txiter childEntry : GetMemPoolChildren(updateIt)) {
+    if (!visited(childEntry)) {
+      stageEntries.push_back(childEntry);
+    }
+  }
 
   while (!stageEntries.empty()) {
-    const txiter cit = *stageEntries.begin();
-    setAllDescendants.insert(cit);
-    stageEntries.erase(cit);
-    const setEntries &setChildren = GetMemPoolChildren(cit);
-    for (const txiter childEntry : setChildren) {
+    const txiter cit = stageEntries.back();
+    stageEntries.pop_back();
+    vAllDescendants.push_back(cit);
+    for (const txiter childEntry : GetMemPoolChildren(cit)) {
       cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
       if (cacheIt != cachedDescendants.end()) {
         for (const txiter cacheEntry : cacheIt->second) {
-          setAllDescendants.insert(cacheEntry);
+          if (!visited(cacheEntry)) {
+            vAllDescendants.push_back(cacheEntry);
+          }
         }
-      } else if (!setAllDescendants.count(childEntry)) {
-        stageEntries.insert(childEntry);
+      } else if (!visited(childEntry)) {
+        stageEntries.push_back(childEntry);
       }
     }
   }
@@ -80,12 +87,12 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt,
   int64_t modifySize = 0;
   CAmount modifyFee = 0;
   int64_t modifyCount = 0;
-  for (txiter cit : setAllDescendants) {
+  for (txiter cit : vAllDescendants) {
     if (!setExclude.count(cit->GetTx().GetHash())) {
       modifySize += cit->GetTxSize();
       modifyFee += cit->GetModifiedFee();
       modifyCount++;
-      cachedDescendants[updateIt].insert(cit);
+      cachedDescendants[updateIt].push_back(cit);
 
       mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(),
                                               updateIt->GetModifiedFee(), 1,
@@ -106,26 +113,27 @@ void CTxMemPool::UpdateTransactionsFromBlock(
                                        vHashesToUpdate.end());
 
   for (const uint256 &hash : reverse_iterate(vHashesToUpdate)) {
-    setEntries setChildren;
-
     txiter it = mapTx.find(hash);
     if (it == mapTx.end()) {
       continue;
     }
-    auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
-
-    for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
-      const uint256 &childHash = iter->second->GetHash();
-      txiter childIter = mapTx.find(childHash);
-      assert(childIter != mapTx.end());
-
-      if (setChildren.insert(childIter).second &&
-          !setAlreadyIncluded.count(childHash)) {
-        UpdateChild(it, childIter, true);
-        UpdateParent(childIter, it, true);
+    {
+      const EpochGuard epoch(*this);
+      auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
+
+      for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
+        const uint256 &childHash = iter->second->GetHash();
+        txiter childIter = mapTx.find(childHash);
+        assert(childIter != mapTx.end());
+
+        if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
+          UpdateChild(it, childIter, true);
+          UpdateParent(childIter, it, true);
+        }
       }
     }
     UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
+    setMiningDirty.insert(it);
   }
 }
 
@@ -137,20 +145,24 @@ bool CTxMemPool::CalculateMemPoolAncestors(
   LOCK(cs);
   setAncestors.clear();
 
-  std::vector<txiter> vToProcess;
+  const EpochGuard epoch(*this);
+  vecEntries vToProcess;
   const CTransaction &tx = entry.GetTx();
 
   if (fSearchForParents) {
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
       txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-      if (piter != mapTx.end()) {
+      if (piter != mapTx.end() && !visited(piter)) {
         vToProcess.push_back(piter);
       }
     }
   } else {
     txiter it = mapTx.iterator_to(entry);
-    const setEntries &parents = GetMemPoolParents(it);
-    vToProcess.insert(vToProcess.end(), parents.begin(), parents.end());
+    for (const txiter piter : GetMemPoolParents(it)) {
+      if (!visited(piter)) {
+        vToProcess.push_back(piter);
+      }
+    }
   }
 
   uint64_t totalSizeWithAncestors = entry.GetTxSize();
@@ -159,10 +171,6 @@ bool CTxMemPool::CalculateMemPoolAncestors(
     txiter stageit = vToProcess.back();
     vToProcess.pop_back();
 
-    if (setAncestors.count(stageit)) {
-      continue;
-    }
-
     if (setAncestors.size() + 1 > limitAncestorCount) {
       errString = strprintf("too many unconfirmed ancestors [limit: %u]",
                             limitAncestorCount);
@@ -192,18 +200,55 @@ bool CTxMemPool::CalculateMemPoolAncestors(
 
     setAncestors.insert(stageit);
 
-    const setEntries &parents = GetMemPoolParents(stageit);
-    vToProcess.insert(vToProcess.end(), parents.begin(), parents.end());
+    for (const txiter piter : GetMemPoolParents(stageit)) {
+      if (!visited(piter)) {
+        vToProcess.push_back(piter);
+      }
+    }
   }
 
   return true;
 }
 
+void CTxMemPool::CalculateAncestorsOf(txiter it,
+                                      vecEntries &vAncestors) const {
+  const EpochGuard epoch(*this);
+  vAncestors.clear();
+  for (const txiter piter : GetMemPoolParents(it)) {
+    if (!visited(piter)) {
+      vAncestors.push_back(piter);
+    }
+  }
+  for (size_t i = 0; i < vAncestors.size(); i++) {
+    for (const txiter piter : GetMemPoolParents(vAncestors[i])) {
+      if (!visited(piter)) {
+        vAncestors.push_back(piter);
+      }
+    }
+  }
+}
+
+void CTxMemPool::CalculateDescendantsOf(txiter it,
+                                        vecEntries &vDescendants) const {
+  const EpochGuard epoch(*this);
+  vDescendants.clear();
+  for (const txiter childiter : GetMemPoolChildren(it)) {
+    if (!visited(childiter)) {
+      vDescendants.push_back(childiter);
+    }
+  }
+  for (size_t i = 0; i < vDescendants.size(); i++) {
+    for (const txiter childiter : GetMemPoolChildren(vDescendants[i])) {
+      if (!visited(childiter)) {
+        vDescendants.push_back(childiter);
+      }
+    }
+  }
+}
+
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it,
                                    setEntries &setAncestors) {
-  setEntries parentIters = GetMemPoolParents(it);
-
-  for (txiter piter : parentIters) {
+  for (txiter piter : GetMemPoolParents(it)) {
     UpdateChild(piter, it, add);
   }
   const int64_t updateCount = (add ? 1 : -1);
@@ -231,39 +276,39 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it,
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it) {
-  const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-  for (txiter updateIt : setMemPoolChildren) {
+  for (txiter updateIt : GetMemPoolChildren(it)) {
     UpdateParent(updateIt, it, false);
   }
 }
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove,
                                             bool updateDescendants) {
-  const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+  vecEntries vRelatives;
   if (updateDescendants) {
     for (txiter removeIt : entriesToRemove) {
-      setEntries setDescendants;
-      CalculateDescendants(removeIt, setDescendants);
-      setDescendants.erase(removeIt);
+      CalculateDescendantsOf(removeIt, vRelatives);
 
       int64_t modifySize = -((int64_t)removeIt->GetTxSize());
       CAmount modifyFee = -removeIt->GetModifiedFee();
       int modifySigOps = -removeIt->GetSigOpCost();
-      for (txiter dit : setDescendants) {
+      for (txiter dit : vRelatives) {
         mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1,
                                                 modifySigOps));
       }
     }
   }
   for (txiter removeIt : entriesToRemove) {
-    setEntries setAncestors;
-    const CTxMemPoolEntry &entry = *removeIt;
-    std::string dummy;
-
-    CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit,
-                              nNoLimit, dummy, false);
+    CalculateAncestorsOf(removeIt, vRelatives);
 
-    UpdateAncestorsOf(false, removeIt, setAncestors);
+    for (txiter piter : GetMemPoolParents(removeIt)) {
+      UpdateChild(piter, removeIt, false);
+    }
+    const int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+    const CAmount modifyFee = -removeIt->GetModifiedFee();
+    for (txiter ancestorIt : vRelatives) {
+      mapTx.modify(ancestorIt,
+                   update_descendant_state(modifySize, modifyFee, -1));
+    }
   }
 
   for (txiter removeIt : entriesToRemove) {
@@ -294,7 +339,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator *estimator)
-    : nTransactionsUpdated(0), minerPolicyEstimator(estimator) {
+    : nTransactionsUpdated(0), minerPolicyEstimator(estimator), nEpoch(0),
+      fHasEpochGuard(false), nNextMiningCluster(0) {
   _clear();
 
   nCheckFrequency = 0;
@@ -349,6 +395,7 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
   }
   UpdateAncestorsOf(true, newit, setAncestors);
   UpdateEntryForAncestors(newit, setAncestors);
+  setMiningDirty.insert(newit);
 
   nTransactionsUpdated++;
   totalTxSize += entry.GetTxSize();
@@ -364,7 +411,13 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
   metrics.recordRemove();
-  descendantCache.erase(it);
+  auto cacheIt = descendantCache.find(it);
+  if (cacheIt != descendantCache.end()) {
+    cachedDescendantCacheUsage -= DescendantCacheUsage(cacheIt->second);
+    descendantCache.erase(cacheIt);
+  }
+  EraseMiningCluster(it->nMiningCluster, true);
+  setMiningDirty.erase(it);
   NotifyEntryRemoved(it->GetSharedTx(), reason);
   const uint256 hash = it->GetTx().GetHash();
   for (const CTxIn &txin : it->GetTx().vin)
@@ -381,7 +434,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
 
   totalTxSize -= it->GetTxSize();
   cachedInnerUsage -= it->DynamicMemoryUsage();
-  cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
+  cachedLinksUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
                       memusage::DynamicUsage(mapLinks[it].children);
   mapLinks.erase(it);
   mapTx.erase(it);
@@ -393,23 +446,13 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
 
 void CTxMemPool::CalculateDescendants(txiter entryit,
                                       setEntries &setDescendants) {
-  setEntries stage;
-  if (setDescendants.count(entryit) == 0) {
-    stage.insert(entryit);
+  if (!setDescendants.insert(entryit).second) {
+    return;
   }
 
-  while (!stage.empty()) {
-    txiter it = *stage.begin();
-    setDescendants.insert(it);
-    stage.erase(it);
-
-    const setEntries &setChildren = GetMemPoolChildren(it);
-    for (const txiter &childiter : setChildren) {
-      if (!setDescendants.count(childiter)) {
-        stage.insert(childiter);
-      }
-    }
-  }
+  vecEntries vDescendants;
+  CalculateDescendantsOf(entryit, vDescendants);
+  setDescendants.insert(vDescendants.begin(), vDescendants.end());
 }
 
 void CTxMemPool::CalculateDescendantsCached(txiter entryit,
@@ -424,7 +467,18 @@ void CTxMemPool::CalculateDescendantsCached(txiter entryit,
 
   // Use original calculation but cache result
   CalculateDescendants(entryit, setDescendants);
-  descendantCache[entryit] = {setDescendants, GetTime()};
+  DescendantCacheEntry &cached = descendantCache[entryit];
+  if (cacheIt != descendantCache.end()) {
+    cachedDescendantCacheUsage -= DescendantCacheUsage(cached);
+  }
+  cached = {setDescendants, GetTime()};
+  cachedDescendantCacheUsage += DescendantCacheUsage(cached);
+}
+
+size_t
+CTxMemPool::DescendantCacheUsage(const DescendantCacheEntry &cached) const {
+  return memusage::IncrementalDynamicUsage(descendantCache) +
+         memusage::DynamicUsage(cached.descendants);
 }
 
 void CTxMemPool::removeRecursive(const CTransaction &origTx,
@@ -543,10 +597,17 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
 
 void CTxMemPool::_clear() {
   mapLinks.clear();
+  mapMiningClusters.clear();
+  miningOrder.clear();
+  setMiningDirty.clear();
+  cachedMiningUsage = 0;
   mapTx.clear();
   mapNextTx.clear();
   totalTxSize = 0;
   cachedInnerUsage = 0;
+  cachedLinksUsage = 0;
+  descendantCache.clear();
+  cachedDescendantCacheUsage = 0;
   lastRollingFeeUpdate = GetTime();
   blockSinceLastRollingFeeBump = false;
   rollingMinimumFeeRate = 0;
@@ -583,6 +644,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
 
   uint64_t checkTotal = 0;
   uint64_t innerUsage = 0;
+  uint64_t linksUsage = 0;
 
   CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache *>(pcoins));
   const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -598,8 +660,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
     txlinksMap::const_iterator linksiter = mapLinks.find(it);
     assert(linksiter != mapLinks.end());
     const TxLinks &links = linksiter->second;
-    innerUsage += memusage::DynamicUsage(links.parents) +
+    linksUsage += memusage::DynamicUsage(links.parents) +
                   memusage::DynamicUsage(links.children);
+    assert(setEntries(links.parents.begin(), links.parents.end()).size() ==
+           links.parents.size());
+    assert(setEntries(links.children.begin(), links.children.end()).size() ==
+           links.children.size());
     bool fDependsWait = false;
     setEntries setParentCheck;
     int64_t parentSizes = 0;
@@ -626,7 +692,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
       assert(it3->second == &tx);
       i++;
     }
-    assert(setParentCheck == GetMemPoolParents(it));
+    assert(setParentCheck == setEntries(links.parents.begin(),
+                                        links.parents.end()));
 
     setEntries setAncestors;
     uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -662,10 +729,14 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
         childSizes += childit->GetTxSize();
       }
     }
-    assert(setChildrenCheck == GetMemPoolChildren(it));
+    assert(setChildrenCheck == setEntries(links.children.begin(),
+                                          links.children.end()));
 
     assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
 
+    assert(setMiningDirty.count(it) ||
+           mapMiningClusters.count(it->nMiningCluster));
+
     if (fDependsWait)
       waitingOnDependants.push_back(&(*it));
     else {
@@ -696,6 +767,28 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
 
   assert(totalTxSize == checkTotal);
   assert(innerUsage == cachedInnerUsage);
+  assert(linksUsage == cachedLinksUsage);
+
+  uint64_t descendantCacheUsage = 0;
+  for (const auto &cached : descendantCache) {
+    descendantCacheUsage += DescendantCacheUsage(cached.second);
+  }
+  assert(descendantCacheUsage == cachedDescendantCacheUsage);
+
+  size_t nMiningChunks = 0;
+  uint64_t miningUsage = 0;
+  for (const auto &cluster : mapMiningClusters) {
+    miningUsage += cluster.second.nUsage;
+    for (const MiningChunk &chunk : cluster.second.vChunks) {
+      assert(miningOrder.count(&chunk));
+      for (const txiter chunkit : chunk.vTxs) {
+        assert(chunkit->nMiningCluster == cluster.first);
+      }
+      nMiningChunks++;
+    }
+  }
+  assert(miningOrder.size() == nMiningChunks);
+  assert(miningUsage == cachedMiningUsage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256 &hasha,
@@ -812,21 +905,17 @@ void CTxMemPool::PrioritiseTransaction(const uint256 &hash,
     if (it != mapTx.end()) {
       mapTx.modify(it, update_fee_delta(delta));
 
-      setEntries setAncestors;
-      uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-      std::string dummy;
-      CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit,
-                                nNoLimit, dummy, false);
-      for (txiter ancestorIt : setAncestors) {
+      vecEntries vRelatives;
+      CalculateAncestorsOf(it, vRelatives);
+      for (txiter ancestorIt : vRelatives) {
         mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
       }
 
-      setEntries setDescendants;
-      CalculateDescendants(it, setDescendants);
-      setDescendants.erase(it);
-      for (txiter descendantIt : setDescendants) {
+      CalculateDescendantsOf(it, vRelatives);
+      for (txiter descendantIt : vRelatives) {
         mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
       }
+      setMiningDirty.insert(it);
       ++nTransactionsUpdated;
     }
   }
@@ -873,13 +962,320 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 }
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
+  return GetMemoryUsage().Total();
+}
+
+TxMempoolMemoryUsage CTxMemPool::GetMemoryUsage() const {
   LOCK(cs);
 
-  return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void *)) *
-             mapTx.size() +
-         memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) +
-         memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) +
-         cachedInnerUsage;
+  TxMempoolMemoryUsage usage;
+  usage.nEntries = sizeof(CTxMemPoolEntry) * mapTx.size();
+  usage.nIndexes =
+      memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void *)) *
+          mapTx.size() -
+      usage.nEntries;
+  usage.nTransactions = cachedInnerUsage;
+  usage.nLinks = memusage::DynamicUsage(mapLinks) + cachedLinksUsage;
+  usage.nNextTx = memusage::DynamicUsage(mapNextTx);
+  usage.nDeltas = memusage::DynamicUsage(mapDeltas);
+  usage.nTxHashes = memusage::DynamicUsage(vTxHashes);
+  usage.nMiningOrder = memusage::DynamicUsage(mapMiningClusters) +
+                       memusage::DynamicUsage(miningOrder) +
+                       memusage::DynamicUsage(setMiningDirty) +
+                       cachedMiningUsage;
+  usage.nDescendantCache = cachedDescendantCacheUsage;
+  return usage;
+}
+
+TxMempoolSnapshotEntry CTxMemPool::GetSnapshotEntry(txiter it) const {
+  AssertLockHeld(cs);
+  TxMempoolSnapshotEntry entry;
+  entry.txid = it->GetTx().GetHash();
+  entry.wtxid = vTxHashes[it->vTxHashesIdx].first;
+  entry.nTxSize = it->GetTxSize();
+  entry.nFee = it->GetFee();
+  entry.nModifiedFee = it->GetModifiedFee();
+  entry.nTime = it->GetTime();
+  entry.nHeight = it->GetHeight();
+  entry.nCountWithDescendants = it->GetCountWithDescendants();
+  entry.nSizeWithDescendants = it->GetSizeWithDescendants();
+  entry.nModFeesWithDescendants = it->GetModFeesWithDescendants();
+  entry.nCountWithAncestors = it->GetCountWithAncestors();
+  entry.nSizeWithAncestors = it->GetSizeWithAncestors();
+  entry.nModFeesWithAncestors = it->GetModFeesWithAncestors();
+  const vecEntries &parents = GetMemPoolParents(it);
+  entry.vDepends.reserve(parents.size());
+  for (txiter piter : parents) {
+    entry.vDepends.push_back(piter->GetTx().GetHash());
+  }
+  return entry;
+}
+
+namespace {
+bool SnapshotDepthAndScore(const TxMempoolSnapshotEntry &a,
+                           const TxMempoolSnapshotEntry &b) {
+  if (a.nCountWithAncestors != b.nCountWithAncestors)
+    return a.nCountWithAncestors < b.nCountWithAncestors;
+  double f1 = (double)a.nModifiedFee * b.nTxSize;
+  double f2 = (double)b.nModifiedFee * a.nTxSize;
+  if (f1 == f2)
+    return b.txid < a.txid;
+  return f1 > f2;
+}
+
+bool IsSnapshotSince(const std::shared_ptr<const CTxMemPoolSnapshot> &current,
+                     unsigned int nTransactionsUpdated) {
+  return current &&
+         (int)(current->nTransactionsUpdated - nTransactionsUpdated) >= 0;
+}
+} // namespace
+
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::TakeSnapshot() const {
+  int64_t nStart = GetTimeMicros();
+  std::shared_ptr<CTxMemPoolSnapshot> next =
+      std::make_shared<CTxMemPoolSnapshot>();
+  {
+    LOCK(cs);
+    next->nTransactionsUpdated = nTransactionsUpdated;
+    next->nTotalTxSize = totalTxSize;
+    next->vEntries.reserve(mapTx.size());
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it)
+      next->vEntries.push_back(GetSnapshotEntry(it));
+  }
+  int64_t nCopied = GetTimeMicros();
+
+  // Ordering is left until after the mempool lock is released.
+  std::sort(next->vEntries.begin(), next->vEntries.end(),
+            SnapshotDepthAndScore);
+  next->mapIndex.reserve(next->vEntries.size());
+  for (size_t i = 0; i < next->vEntries.size(); i++)
+    next->mapIndex.emplace(next->vEntries[i].txid, i);
+
+  LogPrint(BCLog::MEMPOOL,
+           "Took mempool snapshot of %u txn in %.2fms (%.2fms locked)\n",
+           next->size(), (GetTimeMicros() - nStart) * 0.001,
+           (nCopied - nStart) * 0.001);
+  return next;
+}
+
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::GetSnapshot() const {
+  const unsigned int nUpdated = nTransactionsUpdated;
+  std::shared_ptr<const CTxMemPoolSnapshot> current =
+      std::atomic_load(&snapshot);
+  if (IsSnapshotSince(current, nUpdated))
+    return current;
+
+  boost::unique_lock<boost::mutex> lock(mutexSnapshot);
+  current = std::atomic_load(&snapshot);
+  if (!IsSnapshotSince(current, nUpdated)) {
+    current = TakeSnapshot();
+    std::atomic_store(&snapshot, current);
+  }
+  return current;
+}
+
+void CTxMemPool::EraseMiningCluster(uint64_t nCluster, bool fMarkDirty) {
+  auto clusterIt = mapMiningClusters.find(nCluster);
+  if (clusterIt == mapMiningClusters.end()) {
+    return;
+  }
+  for (const MiningChunk &chunk : clusterIt->second.vChunks) {
+    miningOrder.erase(&chunk);
+    if (fMarkDirty) {
+      setMiningDirty.insert(chunk.vTxs.begin(), chunk.vTxs.end());
+    }
+  }
+  cachedMiningUsage -= clusterIt->second.nUsage;
+  mapMiningClusters.erase(clusterIt);
+}
+
+void CTxMemPool::LinearizeMiningCluster(const vecEntries &vCluster) {
+  vecEntries vLinearized;
+  if (vCluster.size() == 1) {
+    vLinearized = vCluster;
+  } else {
+    const size_t nCount = vCluster.size();
+    std::unordered_map<const CTxMemPoolEntry *, size_t> mapPos;
+    std::vector<CAmount> vFees(nCount);
+    std::vector<int64_t> vSizes(nCount);
+    for (size_t i = 0; i < nCount; i++) {
+      mapPos.emplace(&*vCluster[i], i);
+      vFees[i] = vCluster[i]->GetModFeesWithAncestors();
+      vSizes[i] = vCluster[i]->GetSizeWithAncestors();
+    }
+
+    auto better = [&](size_t a, size_t b) {
+      double f1 = (double)vFees[a] * vSizes[b];
+      double f2 = (double)vFees[b] * vSizes[a];
+      if (f1 == f2) {
+        return vCluster[a]->GetTx().GetHash() < vCluster[b]->GetTx().GetHash();
+      }
+      return f1 > f2;
+    };
+    std::set<size_t, decltype(better)> candidates(better);
+    vLinearized.reserve(nCount);
+
+    if (nCount > MAX_LINEARIZE_CLUSTER_SIZE) {
+      std::vector<size_t> vMissingParents(nCount);
+      for (size_t i = 0; i < nCount; i++) {
+        vMissingParents[i] = GetMemPoolParents(vCluster[i]).size();
+        if (vMissingParents[i] == 0) {
+          candidates.insert(i);
+        }
+      }
+      while (!candidates.empty()) {
+        const size_t pos = *candidates.begin();
+        candidates.erase(candidates.begin());
+        vLinearized.push_back(vCluster[pos]);
+        for (const txiter citer : GetMemPoolChildren(vCluster[pos])) {
+          const size_t cpos = mapPos.at(&*citer);
+          if (--vMissingParents[cpos] == 0) {
+            candidates.insert(cpos);
+          }
+        }
+      }
+    } else {
+      // Greedily pick the best remaining ancestor package within the cluster,
+      // as block assembly used to do over the whole mempool.
+      std::vector<bool> vPicked(nCount, false);
+      std::vector<uint64_t> vSeen(nCount, 0);
+      uint64_t nSeen = 0;
+      for (size_t i = 0; i < nCount; i++) {
+        candidates.insert(i);
+      }
+
+      std::vector<size_t> vPackage, vDescendants;
+      while (!candidates.empty()) {
+        ++nSeen;
+        vPackage.assign(1, *candidates.begin());
+        vSeen[vPackage[0]] = nSeen;
+        for (size_t i = 0; i < vPackage.size(); i++) {
+          for (const txiter piter : GetMemPoolParents(vCluster[vPackage[i]])) {
+            size_t pos = mapPos.at(&*piter);
+            if (!vPicked[pos] && vSeen[pos] != nSeen) {
+              vSeen[pos] = nSeen;
+              vPackage.push_back(pos);
+            }
+          }
+        }
+        std::sort(vPackage.begin(), vPackage.end(), [&](size_t a, size_t b) {
+          if (vCluster[a]->GetCountWithAncestors() !=
+              vCluster[b]->GetCountWithAncestors()) {
+            return vCluster[a]->GetCountWithAncestors() <
+                   vCluster[b]->GetCountWithAncestors();
+          }
+          return vCluster[a]->GetTx().GetHash() <
+                 vCluster[b]->GetTx().GetHash();
+        });
+        for (size_t pos : vPackage) {
+          candidates.erase(pos);
+          vPicked[pos] = true;
+          vLinearized.push_back(vCluster[pos]);
+        }
+
+        auto stageChildren = [&](size_t pos) {
+          for (const txiter citer : GetMemPoolChildren(vCluster[pos])) {
+            size_t cpos = mapPos.at(&*citer);
+            if (!vPicked[cpos] && vSeen[cpos] != nSeen) {
+              vSeen[cpos] = nSeen;
+              vDescendants.push_back(cpos);
+            }
+          }
+        };
+        for (size_t pos : vPackage) {
+          ++nSeen;
+          vDescendants.clear();
+          stageChildren(pos);
+          for (size_t i = 0; i < vDescendants.size(); i++) {
+            stageChildren(vDescendants[i]);
+          }
+          for (size_t dpos : vDescendants) {
+            candidates.erase(dpos);
+            vFees[dpos] -= vCluster[pos]->GetModifiedFee();
+            vSizes[dpos] -= vCluster[pos]->GetTxSize();
+            candidates.insert(dpos);
+          }
+        }
+      }
+    }
+  }
+
+  const uint64_t nCluster = ++nNextMiningCluster;
+  MiningCluster cluster;
+  for (const txiter it : vLinearized) {
+    it->nMiningCluster = nCluster;
+    MiningChunk chunk;
+    chunk.vTxs.push_back(it);
+    chunk.nModFees = it->GetModifiedFee();
+    chunk.nSize = it->GetTxSize();
+    chunk.nSigOpCost = it->GetSigOpCost();
+    while (!cluster.vChunks.empty()) {
+      MiningChunk &prev = cluster.vChunks.back();
+      if ((double)chunk.nModFees * prev.nSize <=
+          (double)prev.nModFees * chunk.nSize) {
+        break;
+      }
+      prev.vTxs.insert(prev.vTxs.end(), chunk.vTxs.begin(), chunk.vTxs.end());
+      prev.nModFees += chunk.nModFees;
+      prev.nSize += chunk.nSize;
+      prev.nSigOpCost += chunk.nSigOpCost;
+      chunk = std::move(prev);
+      cluster.vChunks.pop_back();
+    }
+    cluster.vChunks.push_back(std::move(chunk));
+  }
+
+  cluster.nUsage = memusage::DynamicUsage(cluster.vChunks);
+  for (size_t i = 0; i < cluster.vChunks.size(); i++) {
+    cluster.vChunks[i].nCluster = nCluster;
+    cluster.vChunks[i].nIndex = i;
+    cluster.nUsage += memusage::DynamicUsage(cluster.vChunks[i].vTxs);
+  }
+  cachedMiningUsage += cluster.nUsage;
+
+  const MiningCluster &inserted =
+      mapMiningClusters.emplace(nCluster, std::move(cluster)).first->second;
+  for (const MiningChunk &chunk : inserted.vChunks) {
+    miningOrder.insert(&chunk);
+  }
+}
+
+int CTxMemPool::UpdateMiningOrder() {
+  AssertLockHeld(cs);
+  std::vector<vecEntries> vClusters;
+  {
+    const EpochGuard epoch(*this);
+    for (const txiter it : setMiningDirty) {
+      if (visited(it)) {
+        continue;
+      }
+      vecEntries vCluster(1, it);
+      for (size_t i = 0; i < vCluster.size(); i++) {
+        for (const txiter piter : GetMemPoolParents(vCluster[i])) {
+          if (!visited(piter)) {
+            vCluster.push_back(piter);
+          }
+        }
+        for (const txiter citer : GetMemPoolChildren(vCluster[i])) {
+          if (!visited(citer)) {
+            vCluster.push_back(citer);
+          }
+        }
+      }
+      vClusters.push_back(std::move(vCluster));
+    }
+  }
+  setMiningDirty.clear();
+
+  int nRelinearized = 0;
+  for (const vecEntries &vCluster : vClusters) {
+    for (const txiter it : vCluster) {
+      EraseMiningCluster(it->nMiningCluster, false);
+    }
+    LinearizeMiningCluster(vCluster);
+    nRelinearized += vCluster.size();
+  }
+  return nRelinearized;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants,
@@ -919,25 +1315,39 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
   return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
-  setEntries s;
-  if (add && mapLinks[entry].children.insert(child).second) {
-    cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-  } else if (!add && mapLinks[entry].children.erase(child)) {
-    cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+static size_t UpdateLink(CTxMemPool::vecEntries &links, CTxMemPool::txiter it,
+                         bool add) {
+  const size_t nUsageBefore = memusage::DynamicUsage(links);
+  auto pos = std::find(links.begin(), links.end(), it);
+  if (add && pos == links.end()) {
+    links.push_back(it);
+  } else if (!add && pos != links.end()) {
+    *pos = links.back();
+    links.pop_back();
   }
+  return memusage::DynamicUsage(links) - nUsageBefore;
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
+  cachedLinksUsage += UpdateLink(mapLinks[entry].children, child, add);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add) {
-  setEntries s;
-  if (add && mapLinks[entry].parents.insert(parent).second) {
-    cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-  } else if (!add && mapLinks[entry].parents.erase(parent)) {
-    cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-  }
+  cachedLinksUsage += UpdateLink(mapLinks[entry].parents, parent, add);
+}
+
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool &in) : pool(in) {
+  assert(!pool.fHasEpochGuard);
+  ++pool.nEpoch;
+  pool.fHasEpochGuard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard() {
+  ++pool.nEpoch;
+  pool.fHasEpochGuard = false;
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::vecEntries &
 CTxMemPool::GetMemPoolParents(txiter entry) const {
   assert(entry != mapTx.end());
   txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -945,7 +1355,7 @@ CTxMemPool::GetMemPoolParents(txiter entry) const {
   return it->second.parents;
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::vecEntries &
 CTxMemPool::GetMemPoolChildren(txiter entry) const {
   assert(entry != mapTx.end());
   txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -6,10 +6,12 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -27,8 +29,8 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
-#include <boost/optional.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/thread/mutex.hpp>
 
 struct MempoolMetrics {
   std::atomic<uint64_t> totalAdds{0};
@@ -65,9 +67,9 @@ private:
   CTransactionRef tx;
   CAmount nFee;
 
-  size_t nTxWeight;
+  uint32_t nTxWeight;
 
-  size_t nUsageSize;
+  uint32_t nUsageSize;
 
   int64_t nTime;
 
@@ -132,30 +134,8 @@ public:
 
   mutable size_t vTxHashesIdx;
 
-private:
-  mutable boost::optional<CFeeRate> cachedFeeRate;
-  mutable boost::optional<CFeeRate> cachedAncestorFeeRate;
-
-public:
-  CFeeRate GetFeeRate() const {
-    if (!cachedFeeRate) {
-      cachedFeeRate = CFeeRate(nFee, GetTxSize());
-    }
-    return *cachedFeeRate;
-  }
-
-  CFeeRate GetAncestorFeeRate() const {
-    if (!cachedAncestorFeeRate) {
-      cachedAncestorFeeRate =
-          CFeeRate(nModFeesWithAncestors, nSizeWithAncestors);
-    }
-    return *cachedAncestorFeeRate;
-  }
-
-  void invalidateCache() {
-    cachedFeeRate = boost::none;
-    cachedAncestorFeeRate = boost::none;
-  }
+  mutable uint64_t nEpoch = 0;
+  mutable uint64_t nMiningCluster = 0;
 };
 
 struct update_descendant_state {
@@ -348,11 +328,72 @@ public:
   }
 };
 
+/** Clusters with more transactions than this are not greedily relinearized,
+ * which costs quadratic time in their size; each transaction is instead
+ * taken by its own ancestor feerate once its parents are in. */
+static const size_t MAX_LINEARIZE_CLUSTER_SIZE = 100;
+
+struct TxMempoolSnapshotEntry {
+  uint256 txid;
+  uint256 wtxid;
+  size_t nTxSize;
+  CAmount nFee;
+  CAmount nModifiedFee;
+  int64_t nTime;
+  unsigned int nHeight;
+  uint64_t nCountWithDescendants;
+  uint64_t nSizeWithDescendants;
+  CAmount nModFeesWithDescendants;
+  uint64_t nCountWithAncestors;
+  uint64_t nSizeWithAncestors;
+  CAmount nModFeesWithAncestors;
+  std::vector<uint256> vDepends;
+};
+
+/** Breakdown of CTxMemPool::DynamicMemoryUsage by component. */
+struct TxMempoolMemoryUsage {
+  size_t nEntries = 0;
+  size_t nIndexes = 0;
+  size_t nTransactions = 0;
+  size_t nLinks = 0;
+  size_t nNextTx = 0;
+  size_t nDeltas = 0;
+  size_t nTxHashes = 0;
+  size_t nMiningOrder = 0;
+  /** Not part of Total(), which TrimToSize evicts against: lookups fill this
+   * cache, and they should not push transactions out. */
+  size_t nDescendantCache = 0;
+
+  size_t Total() const {
+    return nEntries + nIndexes + nTransactions + nLinks + nNextTx + nDeltas +
+           nTxHashes + nMiningOrder;
+  }
+};
+
+/** Immutable copy of the mempool for read-only consumers. Once obtained it
+ * can be iterated without cs_main or the mempool lock. */
+class CTxMemPoolSnapshot {
+public:
+  unsigned int nTransactionsUpdated;
+  uint64_t nTotalTxSize;
+
+  /** Entries sorted by ancestor count and score, as queryHashes returns. */
+  std::vector<TxMempoolSnapshotEntry> vEntries;
+  std::unordered_map<uint256, size_t, SaltedTxidHasher> mapIndex;
+
+  size_t size() const { return vEntries.size(); }
+
+  const TxMempoolSnapshotEntry *find(const uint256 &txid) const {
+    auto it = mapIndex.find(txid);
+    return it == mapIndex.end() ? nullptr : &vEntries[it->second];
+  }
+};
+
 class CTxMemPool {
 private:
   uint32_t nCheckFrequency;
 
-  unsigned int nTransactionsUpdated;
+  std::atomic<unsigned int> nTransactionsUpdated;
 
   CBlockPolicyEstimator *minerPolicyEstimator;
 
@@ -360,6 +401,8 @@ private:
 
   uint64_t cachedInnerUsage;
 
+  uint64_t cachedLinksUsage;
+
   mutable int64_t lastRollingFeeUpdate;
   mutable bool blockSinceLastRollingFeeBump;
   mutable double rollingMinimumFeeRate;
@@ -403,6 +446,34 @@ public:
     }
   };
   typedef std::set<txiter, CompareIteratorByHash> setEntries;
+  typedef std::vector<txiter> vecEntries;
+
+  /** A run of a cluster's linearization that is mined as a unit. Chunks of
+   * one cluster never increase in feerate, so walking all chunks by
+   * decreasing feerate yields a topologically valid block order. */
+  struct MiningChunk {
+    vecEntries vTxs;
+    CAmount nModFees;
+    int64_t nSize;
+    int64_t nSigOpCost;
+    uint64_t nCluster;
+    size_t nIndex;
+  };
+
+  struct CompareMiningChunk {
+    bool operator()(const MiningChunk *a, const MiningChunk *b) const {
+      double f1 = (double)a->nModFees * b->nSize;
+      double f2 = (double)b->nModFees * a->nSize;
+      if (f1 != f2) {
+        return f1 > f2;
+      }
+      if (a->nCluster != b->nCluster) {
+        return a->nCluster < b->nCluster;
+      }
+      return a->nIndex < b->nIndex;
+    }
+  };
+  typedef std::set<const MiningChunk *, CompareMiningChunk> MiningOrder;
 
   struct DescendantCacheEntry {
     setEntries descendants;
@@ -411,16 +482,19 @@ public:
   mutable std::map<txiter, DescendantCacheEntry, CompareIteratorByHash>
       descendantCache;
   int64_t lastCacheInvalidation = 0;
+  uint64_t cachedDescendantCacheUsage = 0;
 
-  const setEntries &GetMemPoolParents(txiter entry) const;
-  const setEntries &GetMemPoolChildren(txiter entry) const;
+  const vecEntries &GetMemPoolParents(txiter entry) const;
+  const vecEntries &GetMemPoolChildren(txiter entry) const;
 
 private:
-  typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+  typedef std::map<txiter, vecEntries, CompareIteratorByHash> cacheMap;
+
+  size_t DescendantCacheUsage(const DescendantCacheEntry &cached) const;
 
   struct TxLinks {
-    setEntries parents;
-    setEntries children;
+    vecEntries parents;
+    vecEntries children;
   };
 
   typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
@@ -429,6 +503,46 @@ private:
   void UpdateParent(txiter entry, txiter parent, bool add);
   void UpdateChild(txiter entry, txiter child, bool add);
 
+  /** Traversals mark entries with the current epoch instead of collecting
+   * them in a set; an EpochGuard opens a new epoch and must not nest. */
+  mutable uint64_t nEpoch;
+  mutable bool fHasEpochGuard;
+
+  class EpochGuard {
+  public:
+    explicit EpochGuard(const CTxMemPool &in);
+    ~EpochGuard();
+
+  private:
+    const CTxMemPool &pool;
+  };
+
+  bool visited(txiter it) const {
+    assert(fHasEpochGuard);
+    bool ret = it->nEpoch >= nEpoch;
+    it->nEpoch = std::max(it->nEpoch, nEpoch);
+    return ret;
+  }
+
+  void CalculateAncestorsOf(txiter it, vecEntries &vAncestors) const;
+  void CalculateDescendantsOf(txiter it, vecEntries &vDescendants) const;
+
+  /** Connected components of the mempool graph, each linearized and split
+   * into chunks. Entries added, removed or reprioritised only mark their
+   * cluster dirty; it is relinearized on the next UpdateMiningOrder(). */
+  struct MiningCluster {
+    std::vector<MiningChunk> vChunks;
+    size_t nUsage;
+  };
+  std::map<uint64_t, MiningCluster> mapMiningClusters;
+  MiningOrder miningOrder;
+  setEntries setMiningDirty;
+  uint64_t nNextMiningCluster;
+  uint64_t cachedMiningUsage;
+
+  void EraseMiningCluster(uint64_t nCluster, bool fMarkDirty);
+  void LinearizeMiningCluster(const vecEntries &vCluster);
+
   std::vector<indexed_transaction_set::const_iterator>
   GetSortedDepthAndScore() const;
 
@@ -494,6 +608,17 @@ public:
     LOCK(cs);
     lastCacheInvalidation = GetTime();
     descendantCache.clear();
+    cachedDescendantCacheUsage = 0;
+  }
+
+  /** Relinearize the clusters touched since the last call and return the
+   * number of entries that were reordered. */
+  int UpdateMiningOrder();
+
+  /** All chunks by decreasing feerate; call UpdateMiningOrder() first. */
+  const MiningOrder &GetMiningOrder() const {
+    AssertLockHeld(cs);
+    return miningOrder;
   }
 
   CFeeRate GetMinFee(size_t sizelimit) const;
@@ -526,6 +651,14 @@ public:
   std::vector<TxMempoolInfo> infoAll() const;
 
   size_t DynamicMemoryUsage() const;
+  TxMempoolMemoryUsage GetMemoryUsage() const;
+
+  TxMempoolSnapshotEntry GetSnapshotEntry(txiter it) const;
+
+  /** Return a snapshot taken no earlier than the call. The last one is
+   * reused until the mempool changes; the first caller after a change takes
+   * a new one, and callers arriving meanwhile wait for it. */
+  std::shared_ptr<const CTxMemPoolSnapshot> GetSnapshot() const;
 
   boost::signals2::signal<void(CTransactionRef)> NotifyEntryAdded;
   boost::signals2::signal<void(CTransactionRef, MemPoolRemovalReason)>
@@ -534,6 +667,12 @@ public:
 private:
   mutable MempoolMetrics metrics;
 
+  mutable std::shared_ptr<const CTxMemPoolSnapshot> snapshot;
+  /** Held while taking a snapshot, before cs. */
+  mutable boost::mutex mutexSnapshot;
+
+  std::shared_ptr<const CTxMemPoolSnapshot> TakeSnapshot() const;
+
 public:
   const MempoolMetrics &getMetrics() const { return metrics; }
 
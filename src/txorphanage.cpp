@@ -0,0 +1,242 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <consensus/validation.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <util.h>
+#include <utiltime.h>
+
+bool TxOrphanage::AddTx(const CTransactionRef &tx, int64_t peer,
+                        unsigned int nMaxOrphans) {
+  const uint256 &hash = tx->GetHash();
+  if (mapOrphans.count(hash))
+    return false;
+
+  auto itPeer = mapPeers.find(peer);
+  if (itPeer != mapPeers.end() &&
+      itPeer->second.vOrphans.size() >= GetOrphanPeerQuota(nMaxOrphans)) {
+    stats.nRejectedQuota++;
+    LogPrint(BCLog::MEMPOOL,
+             "ignoring orphan tx from peer=%d (quota exceeded)\n", peer);
+    return false;
+  }
+
+  unsigned int sz = GetTransactionWeight(*tx);
+  if (sz >= MAX_STANDARD_TX_WEIGHT) {
+    stats.nRejectedWeight++;
+    LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n",
+             sz, hash.ToString());
+    return false;
+  }
+
+  PeerOrphans &peerOrphans = mapPeers[peer];
+  auto ret = mapOrphans.emplace(
+      hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME,
+                     peerOrphans.vOrphans.size()});
+  assert(ret.second);
+  peerOrphans.vOrphans.push_back(ret.first);
+  for (const CTxIn &txin : tx->vin) {
+    mapByPrev[txin.prevout].insert(ret.first);
+  }
+  nTotalWeight += sz;
+  stats.nAdded++;
+
+  LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
+           hash.ToString(), mapOrphans.size(), mapByPrev.size());
+  return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256 &txid) const {
+  return mapOrphans.count(txid);
+}
+
+void TxOrphanage::EraseIt(OrphanMap::iterator it) {
+  for (const CTxIn &txin : it->second.tx->vin) {
+    auto itPrev = mapByPrev.find(txin.prevout);
+    if (itPrev == mapByPrev.end())
+      continue;
+    itPrev->second.erase(it);
+    if (itPrev->second.empty())
+      mapByPrev.erase(itPrev);
+  }
+
+  auto itPeer = mapPeers.find(it->second.fromPeer);
+  assert(itPeer != mapPeers.end());
+  std::vector<OrphanMap::iterator> &vOrphans = itPeer->second.vOrphans;
+  size_t nIndex = it->second.nPeerIndex;
+  vOrphans[nIndex] = vOrphans.back();
+  vOrphans[nIndex]->second.nPeerIndex = nIndex;
+  vOrphans.pop_back();
+  if (vOrphans.empty() && itPeer->second.setWork.empty())
+    mapPeers.erase(itPeer);
+
+  nTotalWeight -= GetTransactionWeight(*it->second.tx);
+  mapOrphans.erase(it);
+}
+
+int TxOrphanage::EraseTx(const uint256 &txid) {
+  auto it = mapOrphans.find(txid);
+  if (it == mapOrphans.end())
+    return 0;
+  EraseIt(it);
+  return 1;
+}
+
+void TxOrphanage::ResolveTx(const uint256 &txid, bool fValid) {
+  if (EraseTx(txid)) {
+    if (fValid)
+      stats.nResolved++;
+    else
+      stats.nInvalid++;
+  }
+}
+
+void TxOrphanage::EraseForPeer(int64_t peer) {
+  auto itPeer = mapPeers.find(peer);
+  if (itPeer == mapPeers.end())
+    return;
+
+  // The peer's entry goes away with its last orphan once its work set is
+  // empty.
+  itPeer->second.setWork.clear();
+  int nErased = 0;
+  while (itPeer != mapPeers.end() && !itPeer->second.vOrphans.empty()) {
+    EraseIt(itPeer->second.vOrphans.back());
+    nErased++;
+    itPeer = mapPeers.find(peer);
+  }
+  if (itPeer != mapPeers.end())
+    mapPeers.erase(itPeer);
+
+  stats.nRemovedForPeer += nErased;
+  if (nErased > 0)
+    LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased,
+             peer);
+}
+
+void TxOrphanage::EraseForBlock(const CBlock &block) {
+  std::vector<uint256> vOrphanErase;
+  for (const CTransactionRef &ptx : block.vtx) {
+    for (const CTxIn &txin : ptx->vin) {
+      auto itByPrev = mapByPrev.find(txin.prevout);
+      if (itByPrev == mapByPrev.end())
+        continue;
+      for (OrphanMap::iterator it : itByPrev->second) {
+        vOrphanErase.push_back(it->first);
+      }
+    }
+  }
+  if (vOrphanErase.empty())
+    return;
+
+  int nErased = 0;
+  for (const uint256 &orphanHash : vOrphanErase) {
+    nErased += EraseTx(orphanHash);
+  }
+  stats.nRemovedForBlock += nErased;
+  LogPrint(BCLog::MEMPOOL,
+           "Erased %d orphan tx included or conflicted by block\n", nErased);
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int nMaxOrphans) {
+  int64_t nNow = GetTime();
+  if (nNextSweep <= nNow) {
+    int nErased = 0;
+    int64_t nMinExpTime =
+        nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+    auto iter = mapOrphans.begin();
+    while (iter != mapOrphans.end()) {
+      auto maybeErase = iter++;
+      if (maybeErase->second.nTimeExpire <= nNow) {
+        EraseIt(maybeErase);
+        nErased++;
+      } else {
+        nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+      }
+    }
+
+    nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+    stats.nExpired += nErased;
+    if (nErased > 0)
+      LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
+               nErased);
+  }
+
+  unsigned int nEvicted = 0;
+  FastRandomContext rng;
+  while (mapOrphans.size() > nMaxOrphans) {
+    auto itLargest = mapPeers.end();
+    for (auto itPeer = mapPeers.begin(); itPeer != mapPeers.end(); ++itPeer) {
+      if (itLargest == mapPeers.end() || itPeer->second.vOrphans.size() >
+                                             itLargest->second.vOrphans.size())
+        itLargest = itPeer;
+    }
+    assert(itLargest != mapPeers.end() &&
+           !itLargest->second.vOrphans.empty());
+    const std::vector<OrphanMap::iterator> &vOrphans =
+        itLargest->second.vOrphans;
+    EraseIt(vOrphans[rng.randrange(vOrphans.size())]);
+    ++nEvicted;
+  }
+  stats.nEvicted += nEvicted;
+  return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction &tx) {
+  const uint256 &hash = tx.GetHash();
+  for (unsigned int i = 0; i < tx.vout.size(); i++) {
+    auto itByPrev = mapByPrev.find(COutPoint(hash, i));
+    if (itByPrev == mapByPrev.end())
+      continue;
+    for (OrphanMap::iterator it : itByPrev->second) {
+      mapPeers[it->second.fromPeer].setWork.insert(it->first);
+    }
+  }
+}
+
+CTransactionRef TxOrphanage::GetTxToReconsider(int64_t peer) {
+  auto itPeer = mapPeers.find(peer);
+  if (itPeer == mapPeers.end())
+    return nullptr;
+
+  std::set<uint256> &setWork = itPeer->second.setWork;
+  CTransactionRef tx;
+  while (!tx && !setWork.empty()) {
+    auto itOrphan = mapOrphans.find(*setWork.begin());
+    setWork.erase(setWork.begin());
+    if (itOrphan != mapOrphans.end())
+      tx = itOrphan->second.tx;
+  }
+  if (itPeer->second.vOrphans.empty() && setWork.empty())
+    mapPeers.erase(itPeer);
+  return tx;
+}
+
+bool TxOrphanage::HaveTxToReconsider(int64_t peer) const {
+  auto itPeer = mapPeers.find(peer);
+  return itPeer != mapPeers.end() && !itPeer->second.setWork.empty();
+}
+
+TxOrphanageStats TxOrphanage::GetStats() const {
+  TxOrphanageStats ret = stats;
+  ret.nOrphans = mapOrphans.size();
+  ret.nOutpoints = mapByPrev.size();
+  ret.nPeers = mapPeers.size();
+  ret.nWorkSet = 0;
+  for (const auto &peer : mapPeers) {
+    ret.nWorkSet += peer.second.setWork.size();
+  }
+  ret.nTotalWeight = nTotalWeight;
+  return ret;
+}
+
+void TxOrphanage::Clear() {
+  mapOrphans.clear();
+  mapByPrev.clear();
+  mapPeers.clear();
+  nTotalWeight = 0;
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include <coins.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/** Each peer may hold this fraction of the orphan pool. */
+static const unsigned int ORPHAN_PEER_SHARE = 4;
+
+/** Orphans one peer may hold in a pool of at most nMaxOrphans. */
+inline unsigned int GetOrphanPeerQuota(unsigned int nMaxOrphans) {
+  return std::max(1U, nMaxOrphans / ORPHAN_PEER_SHARE);
+}
+
+struct TxOrphanageStats {
+  size_t nOrphans = 0;
+  size_t nOutpoints = 0;
+  size_t nPeers = 0;
+  size_t nWorkSet = 0;
+  uint64_t nTotalWeight = 0;
+
+  uint64_t nAdded = 0;
+  uint64_t nRejectedQuota = 0;
+  uint64_t nRejectedWeight = 0;
+  uint64_t nResolved = 0;
+  uint64_t nInvalid = 0;
+  uint64_t nExpired = 0;
+  uint64_t nEvicted = 0;
+  uint64_t nRemovedForBlock = 0;
+  uint64_t nRemovedForPeer = 0;
+};
+
+/** Transactions whose inputs are not yet known. Orphans are indexed by the
+ * outpoints they spend, so a new parent or block finds its dependants without
+ * scanning, and each peer's share of the pool is bounded.
+ *
+ * Not thread safe; net_processing guards it with g_cs_orphans. */
+class TxOrphanage {
+public:
+  /** Store an orphan from peer. Fails if it is already present, too large or
+   * the peer holds its quota of a pool of at most nMaxOrphans. */
+  bool AddTx(const CTransactionRef &tx, int64_t peer,
+             unsigned int nMaxOrphans);
+
+  bool HaveTx(const uint256 &txid) const;
+
+  /** Erase an orphan, returning the number removed (0 or 1). */
+  int EraseTx(const uint256 &txid);
+
+  /** Erase an orphan after it was accepted or found invalid. */
+  void ResolveTx(const uint256 &txid, bool fValid);
+
+  void EraseForPeer(int64_t peer);
+
+  /** Erase orphans included in or conflicting with block. */
+  void EraseForBlock(const CBlock &block);
+
+  /** Expire old orphans, then evict down to nMaxOrphans, taking from the
+   * peer holding the most. Returns the number evicted for size. */
+  unsigned int LimitOrphans(unsigned int nMaxOrphans);
+
+  /** Queue the orphans spending tx's outputs for reconsideration by the peer
+   * that supplied each of them. */
+  void AddChildrenToWorkSet(const CTransaction &tx);
+
+  /** Pop the next orphan peer should reconsider, or null if it has none. */
+  CTransactionRef GetTxToReconsider(int64_t peer);
+
+  bool HaveTxToReconsider(int64_t peer) const;
+
+  size_t Size() const { return mapOrphans.size(); }
+
+  TxOrphanageStats GetStats() const;
+
+  void Clear();
+
+private:
+  struct OrphanTx {
+    CTransactionRef tx;
+    int64_t fromPeer;
+    int64_t nTimeExpire;
+    size_t nPeerIndex;
+  };
+  typedef std::map<uint256, OrphanTx> OrphanMap;
+
+  struct IteratorComparator {
+    bool operator()(const OrphanMap::iterator &a,
+                    const OrphanMap::iterator &b) const {
+      return &(*a) < &(*b);
+    }
+  };
+
+  struct PeerOrphans {
+    std::vector<OrphanMap::iterator> vOrphans;
+    std::set<uint256> setWork;
+  };
+
+  OrphanMap mapOrphans;
+  std::unordered_map<COutPoint,
+                     std::set<OrphanMap::iterator, IteratorComparator>,
+                     SaltedOutpointHasher>
+      mapByPrev;
+  std::map<int64_t, PeerOrphans> mapPeers;
+  uint64_t nTotalWeight = 0;
+  int64_t nNextSweep = 0;
+  TxOrphanageStats stats;
+
+  void EraseIt(OrphanMap::iterator it);
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
@@ -0,0 +1,251 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <hash.h>
+#include <random.h>
+#include <sketch.h>
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+size_t EstimateSketchCapacity(size_t nLocal, size_t nRemote, uint16_t nQ) {
+  size_t nMin = std::min(nLocal, nRemote);
+  size_t nMax = std::max(nLocal, nRemote);
+  return nMax - nMin + nMin * nQ / RECON_Q_PRECISION + 1;
+}
+
+uint32_t TxReconciliationTracker::PeerState::ShortId(
+    const uint256 &txid) const {
+  return 1 + (uint32_t)(SipHashUint256(k0, k1, txid) % 0xffffffff);
+}
+
+void TxReconciliationTracker::PeerState::RestoreRound() {
+  setQueued.insert(vRound.begin(), vRound.end());
+  vRound.clear();
+  fInRound = false;
+}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(int64_t peer) {
+  uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+  std::lock_guard<std::mutex> lock(mut);
+  mapPreRegistered[peer] = nSalt;
+  return nSalt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(int64_t peer, bool fInitiator,
+                                           uint32_t nVersion,
+                                           uint64_t nRemoteSalt) {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPreRegistered.find(peer);
+  if (it == mapPreRegistered.end() || nVersion < 1)
+    return false;
+  uint64_t nLocalSalt = it->second;
+  mapPreRegistered.erase(it);
+
+  // Both sides derive the same short id keys from the pair of salts.
+  CHashWriter hasher(SER_GETHASH, 0);
+  hasher << std::string("txrecon") << std::min(nLocalSalt, nRemoteSalt)
+         << std::max(nLocalSalt, nRemoteSalt);
+  uint256 hashKey = hasher.GetHash();
+  PeerState &state = mapPeers[peer];
+  state.k0 = hashKey.GetUint64(0);
+  state.k1 = hashKey.GetUint64(1);
+  state.fInitiator = fInitiator;
+  return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(int64_t peer) {
+  std::lock_guard<std::mutex> lock(mut);
+  mapPreRegistered.erase(peer);
+  mapPeers.erase(peer);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(int64_t peer) const {
+  std::lock_guard<std::mutex> lock(mut);
+  return mapPeers.count(peer);
+}
+
+bool TxReconciliationTracker::AddToSet(int64_t peer, const uint256 &txid) {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeers.find(peer);
+  if (it == mapPeers.end() ||
+      it->second.setQueued.size() >= MAX_RECON_SET_SIZE)
+    return false;
+  it->second.setQueued.insert(txid);
+  return true;
+}
+
+bool TxReconciliationTracker::InitiateReconciliation(int64_t peer,
+                                                     int64_t nNow,
+                                                     uint16_t &nSetSize,
+                                                     uint16_t &nQ) {
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeers.find(peer);
+  if (it == mapPeers.end() || !it->second.fInitiator)
+    return false;
+  PeerState &state = it->second;
+  if (state.fInRound) {
+    if (nNow < state.nRequestTime + RECON_RESPONSE_TIMEOUT)
+      return false;
+    state.RestoreRound();
+    state.nStaleSketches++;
+  }
+  if (nNow < state.nNextRequest)
+    return false;
+
+  state.vRound.assign(state.setQueued.begin(), state.setQueued.end());
+  state.setQueued.clear();
+  state.fInRound = true;
+  state.nRequestTime = nNow;
+  state.nNextRequest = nNow + RECON_REQUEST_INTERVAL + RECON_REQUEST_MARGIN;
+  nSetSize = state.vRound.size();
+  nQ = DEFAULT_RECON_Q;
+  return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(
+    int64_t peer, int64_t nNow, uint16_t nRemoteSetSize, uint16_t nQ,
+    bool &fRespond, std::vector<unsigned char> &vSketch) {
+  fRespond = false;
+  vSketch.clear();
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeers.find(peer);
+  if (it == mapPeers.end() || it->second.fInitiator)
+    return false;
+  PeerState &state = it->second;
+  // Each request costs a sketch of up to MAX_RECON_SET_SIZE entries.
+  if (state.nRequestTime && nNow < state.nRequestTime + RECON_REQUEST_INTERVAL)
+    return true;
+  fRespond = true;
+  state.nRequestTime = nNow;
+  // The previous round was abandoned by the peer.
+  if (state.fInRound)
+    state.RestoreRound();
+
+  state.vRound.assign(state.setQueued.begin(), state.setQueued.end());
+  state.setQueued.clear();
+  state.fInRound = true;
+
+  size_t nCapacity =
+      EstimateSketchCapacity(state.vRound.size(), nRemoteSetSize, nQ);
+  if (nCapacity > MAX_SKETCH_CAPACITY)
+    return true;
+  CSketch sketch(nCapacity);
+  for (const uint256 &txid : state.vRound)
+    sketch.Add(state.ShortId(txid));
+  vSketch = sketch.Serialize();
+  return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(
+    int64_t peer, const std::vector<unsigned char> &vSketch, bool &fRespond,
+    bool &fSuccess, std::vector<uint32_t> &vAskShortIds,
+    std::vector<uint256> &vAnnounce) {
+  fRespond = false;
+  fSuccess = false;
+  vAskShortIds.clear();
+  vAnnounce.clear();
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeers.find(peer);
+  if (it == mapPeers.end() || !it->second.fInitiator)
+    return false;
+  CSketch sketch;
+  if (vSketch.size() > MAX_SKETCH_CAPACITY * 4 ||
+      !sketch.Deserialize(vSketch))
+    return false;
+  PeerState &state = it->second;
+  // The peer answers in order, so late sketches come before the current one.
+  if (state.nStaleSketches) {
+    state.nStaleSketches--;
+    return true;
+  }
+  if (!state.fInRound)
+    return true;
+  fRespond = true;
+
+  std::vector<uint32_t> vDiff;
+  if (sketch.GetCapacity() > 0) {
+    CSketch local(sketch.GetCapacity());
+    for (const uint256 &txid : state.vRound)
+      local.Add(state.ShortId(txid));
+    sketch.Merge(local);
+    fSuccess = sketch.Decode(vDiff) && vDiff.size() < sketch.GetCapacity();
+  }
+
+  if (fSuccess) {
+    std::unordered_map<uint32_t, const uint256 *> mapRound;
+    for (const uint256 &txid : state.vRound)
+      mapRound.emplace(state.ShortId(txid), &txid);
+    std::unordered_map<uint32_t, std::set<uint256>::iterator> mapQueued;
+    for (auto itQueued = state.setQueued.begin();
+         itQueued != state.setQueued.end(); ++itQueued)
+      mapQueued.emplace(state.ShortId(*itQueued), itQueued);
+
+    for (uint32_t nShortId : vDiff) {
+      auto itRound = mapRound.find(nShortId);
+      if (itRound != mapRound.end()) {
+        vAnnounce.push_back(*itRound->second);
+        continue;
+      }
+      // Queued since the round began, and the peer has it already.
+      auto itQueued = mapQueued.find(nShortId);
+      if (itQueued != mapQueued.end()) {
+        state.setQueued.erase(itQueued->second);
+        mapQueued.erase(itQueued);
+        continue;
+      }
+      vAskShortIds.push_back(nShortId);
+    }
+    nSucceeded++;
+  } else {
+    vAnnounce = std::move(state.vRound);
+    nFailed++;
+  }
+  state.vRound.clear();
+  state.fInRound = false;
+  return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(
+    int64_t peer, bool fSuccess, const std::vector<uint32_t> &vAskShortIds,
+    std::vector<uint256> &vAnnounce) {
+  vAnnounce.clear();
+  std::lock_guard<std::mutex> lock(mut);
+  auto it = mapPeers.find(peer);
+  if (it == mapPeers.end() || it->second.fInitiator || !it->second.fInRound)
+    return false;
+  PeerState &state = it->second;
+
+  if (fSuccess) {
+    std::unordered_map<uint32_t, const uint256 *> mapRound;
+    for (const uint256 &txid : state.vRound)
+      mapRound.emplace(state.ShortId(txid), &txid);
+    for (uint32_t nShortId : vAskShortIds) {
+      auto itRound = mapRound.find(nShortId);
+      if (itRound == mapRound.end()) {
+        // Decoded into something we never sketched; trust none of it.
+        fSuccess = false;
+        break;
+      }
+      vAnnounce.push_back(*itRound->second);
+    }
+  }
+  if (!fSuccess)
+    vAnnounce = std::move(state.vRound);
+  state.vRound.clear();
+  state.fInRound = false;
+  return true;
+}
+
+TxReconciliationStats TxReconciliationTracker::GetStats() const {
+  std::lock_guard<std::mutex> lock(mut);
+  TxReconciliationStats stats;
+  stats.nPeers = mapPeers.size();
+  stats.nSucceeded = nSucceeded;
+  stats.nFailed = nFailed;
+  return stats;
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2025 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <uint256.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+static const bool DEFAULT_TXRECONCILIATION = false;
+
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+
+/** Microseconds a peer must leave between its reconciliation requests;
+ * those sent sooner are not answered. */
+static const int64_t RECON_REQUEST_INTERVAL = 2 * 1000000;
+
+/** Added to RECON_REQUEST_INTERVAL between the requests we send, so delays
+ * on the way do not bring two closer together than the peer allows. */
+static const int64_t RECON_REQUEST_MARGIN = 500000;
+
+/** Microseconds to wait for a requested sketch. */
+static const int64_t RECON_RESPONSE_TIMEOUT = 30 * 1000000;
+
+/** Transactions queued for a peer past this are announced directly. */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+
+/** Differences needing a larger sketch fall back to announcing. */
+static const size_t MAX_SKETCH_CAPACITY = 64;
+
+/** Expected share of the smaller set missing from the larger, in units of
+ * 1 / RECON_Q_PRECISION (BIP 330). */
+static const uint16_t RECON_Q_PRECISION = 32767;
+static const uint16_t DEFAULT_RECON_Q = RECON_Q_PRECISION / 4;
+
+struct TxReconciliationStats {
+  size_t nPeers = 0;
+  uint64_t nSucceeded = 0;
+  uint64_t nFailed = 0;
+};
+
+/** Sketch capacity for the difference of two sets of the given sizes. One
+ * more than the expected difference, which Decode() results must stay below,
+ * so a difference that does not fit is almost never mistaken for one that
+ * does. */
+size_t EstimateSketchCapacity(size_t nLocal, size_t nRemote, uint16_t nQ);
+
+/** Set reconciliation of transaction announcements, after Erlay (BIP 330).
+ *
+ * Transactions for a registered peer are queued here instead of announced.
+ * Periodically the side that opened the connection asks for a sketch of the
+ * other's queue, merges a sketch of its own and decodes what only one side
+ * has. It announces its share and asks the peer to announce the rest, so
+ * transactions both sides queued cost neither an announcement. If the
+ * difference does not fit the sketch both sides announce their whole queue.
+ *
+ * Thread safe. */
+class TxReconciliationTracker {
+public:
+  /** Offer reconciliation to peer, returning the salt to send it. */
+  uint64_t PreRegisterPeer(int64_t peer);
+
+  /** Complete negotiation with the peer's salt. Fails if we did not offer
+   * reconciliation or already completed it. */
+  bool RegisterPeer(int64_t peer, bool fInitiator, uint32_t nVersion,
+                    uint64_t nRemoteSalt);
+
+  void ForgetPeer(int64_t peer);
+
+  bool IsPeerRegistered(int64_t peer) const;
+
+  /** Queue txid for the next reconciliation with peer. Returns false if it
+   * should be announced instead: peer is not registered or its queue is
+   * full. */
+  bool AddToSet(int64_t peer, const uint256 &txid);
+
+  /** As initiator, whether a request is due, and what it carries. */
+  bool InitiateReconciliation(int64_t peer, int64_t nNow, uint16_t &nSetSize,
+                              uint16_t &nQ);
+
+  /** As responder, sketch our queue for the peer. vSketch is left empty if
+   * it would be too large. fRespond is false if the request came sooner than
+   * RECON_REQUEST_INTERVAL after the last one answered, and is ignored.
+   * Returns false on a protocol violation. */
+  bool HandleReconciliationRequest(int64_t peer, int64_t nNow,
+                                   uint16_t nRemoteSetSize, uint16_t nQ,
+                                   bool &fRespond,
+                                   std::vector<unsigned char> &vSketch);
+
+  /** As initiator, decode the difference with the peer's sketch into the
+   * transactions to announce and, if fSuccess, the short ids to ask for.
+   * fRespond is false if the sketch answers no open request, such as one
+   * given up on after RECON_RESPONSE_TIMEOUT, and is ignored. Returns false
+   * on a protocol violation. */
+  bool HandleSketch(int64_t peer, const std::vector<unsigned char> &vSketch,
+                    bool &fRespond, bool &fSuccess,
+                    std::vector<uint32_t> &vAskShortIds,
+                    std::vector<uint256> &vAnnounce);
+
+  /** As responder, finish the round with the transactions the peer asked
+   * for, or all of ours if it could not decode. Returns false on a protocol
+   * violation. */
+  bool HandleReconciliationDifference(
+      int64_t peer, bool fSuccess, const std::vector<uint32_t> &vAskShortIds,
+      std::vector<uint256> &vAnnounce);
+
+  TxReconciliationStats GetStats() const;
+
+private:
+  struct PeerState {
+    uint64_t k0;
+    uint64_t k1;
+    bool fInitiator;
+    std::set<uint256> setQueued;
+    /** Queue at the start of the current round. */
+    std::vector<uint256> vRound;
+    bool fInRound = false;
+    /** When the last request was sent, or as responder answered. */
+    int64_t nRequestTime = 0;
+    int64_t nNextRequest = 0;
+    /** Requests given up on whose sketches may still arrive, ahead of the
+     * current round's. */
+    uint32_t nStaleSketches = 0;
+
+    uint32_t ShortId(const uint256 &txid) const;
+    void RestoreRound();
+  };
+
+  mutable std::mutex mut;
+  std::map<int64_t, uint64_t> mapPreRegistered;
+  std::map<int64_t, PeerState> mapPeers;
+  uint64_t nSucceeded = 0;
+  uint64_t nFailed = 0;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -10,6 +10,7 @@
 #include <utiltime.h>
 
 #include <atomic>
+#include <time.h>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread.hpp>
@@ -50,6 +51,15 @@ int64_t GetTimeMicros() {
 
 int64_t GetSystemTimeInSeconds() { return GetTimeMicros() / 1000000; }
 
+int64_t GetThreadCPUTimeMicros() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+  return GetTimeMicros();
+}
+
 void MilliSleep(int64_t n) {
 #if defined(HAVE_WORKING_BOOST_SLEEP_FOR)
   boost::this_thread::sleep_for(boost::chrono::milliseconds(n));
@@ -14,6 +14,10 @@ int64_t GetTimeMillis();
 int64_t GetTimeMicros();
 int64_t GetSystemTimeInSeconds();
 
+/** CPU time used by the calling thread, or wall clock time where the platform
+ * cannot measure it. Only differences between calls are meaningful. */
+int64_t GetThreadCPUTimeMicros();
+
 void SetMockTime(int64_t nMockTimeIn);
 int64_t GetMockTime();
 void MilliSleep(int64_t n);
@@ -6,6 +6,8 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfilemap.h>
+#include <blockimport.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,6 +16,7 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <hash.h>
 #include <init.h>
@@ -40,6 +43,7 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
 #include <future>
 #include <sstream>
 
@@ -122,7 +126,8 @@ public:
 
   bool AcceptBlockHeader(const CBlockHeader &block, CValidationState &state,
                          const CChainParams &chainparams,
-                         CBlockIndex **ppindex);
+                         CBlockIndex **ppindex,
+                         const uint256 *phashYespower = nullptr);
   bool AcceptBlock(const std::shared_ptr<const CBlock> &pblock,
                    CValidationState &state, const CChainParams &chainparams,
                    CBlockIndex **ppindex, bool fRequested,
@@ -197,6 +202,7 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fHiveFastRelay = DEFAULT_HIVE_FAST_RELAY;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -232,6 +238,14 @@ CBlockIndex *&pindexBestInvalid = g_chainstate.pindexBestInvalid;
 std::multimap<CBlockIndex *, CBlockIndex *> &mapBlocksUnlinked =
     g_chainstate.mapBlocksUnlinked;
 
+std::map<uint256, std::pair<int, std::shared_ptr<const CBlock>>>
+    mapPrecheckedBlocks;
+
+// Blocks whose hive proof passed on top of hashHiveCheckedTip, the only tip a
+// pass holds at. Guarded by cs_main.
+uint256 hashHiveCheckedTip;
+std::set<uint256> setHiveCheckedBlocks;
+
 CCriticalSection cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
@@ -730,7 +744,14 @@ static bool AcceptToMemoryPoolWorker(
     }
 
     PrecomputedTransactionData txdata(tx);
-    if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false,
+    // Large transactions are verified on the script check threads first; only
+    // a failure goes through the serial path below for its reject reason.
+    bool fScriptsChecked =
+        nScriptCheckThreads &&
+        tx.vin.size() >= MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS &&
+        CheckInputScriptsParallel(tx, view, scriptVerifyFlags, true, txdata);
+    if (!fScriptsChecked &&
+        !CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false,
                      txdata)) {
       CValidationState stateDummy;
 
@@ -832,6 +853,38 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state,
                                     bypass_limits, nAbsurdFee);
 }
 
+static std::shared_ptr<const CMappedFile>
+MapBlockAtPos(const CDiskBlockPos &pos,
+              const CMessageHeader::MessageStartChars &messageStart,
+              const unsigned char *&pblock, unsigned int &nSize) {
+  if (!g_blockfile_mmap.IsEnabled() || pos.IsNull() ||
+      pos.nPos < BLOCK_DISK_HEADER_SIZE)
+    return nullptr;
+
+  fs::path path = GetBlockPosFilename(pos, "blk");
+  std::shared_ptr<const CMappedFile> mapping = g_blockfile_mmap.Get(
+      pos.nFile, path, pos.nPos - BLOCK_DISK_HEADER_SIZE,
+      BLOCK_DISK_HEADER_SIZE);
+  if (!mapping)
+    return nullptr;
+
+  const unsigned char *phdr =
+      mapping->data() + pos.nPos - BLOCK_DISK_HEADER_SIZE;
+  if (memcmp(phdr, messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+    return nullptr;
+  nSize = ReadLE32(phdr + CMessageHeader::MESSAGE_START_SIZE);
+  if (nSize > MAX_SIZE)
+    return nullptr;
+
+  if (!mapping->Contains(pos.nPos, nSize)) {
+    mapping = g_blockfile_mmap.Get(pos.nFile, path, pos.nPos, nSize);
+    if (!mapping)
+      return nullptr;
+  }
+  pblock = mapping->data() + pos.nPos;
+  return mapping;
+}
+
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut,
                     const Consensus::Params &consensusParams,
                     uint256 &hashBlock, bool fAllowSlow,
@@ -850,6 +903,28 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut,
     if (fTxIndex) {
       CDiskTxPos postx;
       if (pblocktree->ReadTxIndex(hash, postx)) {
+        const unsigned char *pblock = nullptr;
+        unsigned int nSize = 0;
+        std::shared_ptr<const CMappedFile> mapping = MapBlockAtPos(
+            postx, Params().MessageStart(), pblock, nSize);
+        if (mapping) {
+          CBlockHeader header;
+          try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pblock,
+                               pblock + nSize);
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> txOut;
+          } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s", __func__,
+                         e.what());
+          }
+          hashBlock = header.GetHash();
+          if (txOut->GetHash() != hash)
+            return error("%s: txid mismatch", __func__);
+          return true;
+        }
+
         CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
         if (file.IsNull())
           return error("%s: OpenBlockFile failed", __func__);
@@ -916,6 +991,21 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Consensus::Params &consensusParams) {
   block.SetNull();
 
+  const unsigned char *pblock = nullptr;
+  unsigned int nSize = 0;
+  std::shared_ptr<const CMappedFile> mapping =
+      MapBlockAtPos(pos, Params().MessageStart(), pblock, nSize);
+  if (mapping) {
+    try {
+      CSpanReader reader(SER_DISK, CLIENT_VERSION, pblock, pblock + nSize);
+      reader >> block;
+    } catch (const std::exception &e) {
+      return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                   pos.ToString());
+    }
+    return true;
+  }
+
   CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
   if (filein.IsNull())
     return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
@@ -948,6 +1038,52 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
   return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char> &block,
+                          const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageStartChars &messageStart) {
+  const unsigned char *pblock = nullptr;
+  unsigned int nSize = 0;
+  std::shared_ptr<const CMappedFile> mapping =
+      MapBlockAtPos(pos, messageStart, pblock, nSize);
+  if (mapping) {
+    block.assign(pblock, pblock + nSize);
+    return true;
+  }
+
+  if (pos.IsNull() || pos.nPos < BLOCK_DISK_HEADER_SIZE)
+    return error("%s: invalid block position %s", __func__, pos.ToString());
+
+  CDiskBlockPos hpos = pos;
+  hpos.nPos -= BLOCK_DISK_HEADER_SIZE;
+  CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+  if (filein.IsNull())
+    return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+  try {
+    CMessageHeader::MessageStartChars blkStart;
+    unsigned int blkSize;
+    filein >> FLATDATA(blkStart) >> blkSize;
+    if (memcmp(blkStart, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+      return error("%s: Block magic mismatch for %s: %s versus expected %s",
+                   __func__, pos.ToString(),
+                   HexStr(blkStart,
+                          blkStart + CMessageHeader::MESSAGE_START_SIZE),
+                   HexStr(messageStart,
+                          messageStart + CMessageHeader::MESSAGE_START_SIZE));
+    if (blkSize > MAX_SIZE)
+      return error("%s: Block data is larger than maximum deserialization "
+                   "size for %s: %s versus %s",
+                   __func__, pos.ToString(), blkSize, MAX_SIZE);
+    block.resize(blkSize);
+    filein.read((char *)block.data(), blkSize);
+  } catch (const std::exception &e) {
+    return error("%s: Read from block file failed: %s for %s", __func__,
+                 e.what(), pos.ToString());
+  }
+
+  return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams) {
   int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
 
@@ -1452,8 +1588,10 @@ void static FlushBlockFile(bool fFinalize = false) {
 
   FILE *fileOld = OpenBlockFile(posOld);
   if (fileOld) {
-    if (fFinalize)
+    if (fFinalize) {
+      g_blockfile_mmap.Erase(nLastBlockFile);
       TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+    }
     FileCommit(fileOld);
     fclose(fileOld);
   }
@@ -1519,6 +1657,132 @@ void ThreadScriptCheck() {
   scriptcheckqueue.Thread();
 }
 
+bool CheckInputScriptsParallel(const CTransaction &tx,
+                               const CCoinsViewCache &inputs,
+                               unsigned int flags, bool cacheSigStore,
+                               PrecomputedTransactionData &txdata) {
+  std::vector<CScriptCheck> vChecks;
+  CValidationState stateDummy;
+  if (!CheckInputs(tx, stateDummy, inputs, true, flags, cacheSigStore, false,
+                   txdata, &vChecks)) {
+    return false;
+  }
+  if (vChecks.empty())
+    return true;
+
+  CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+  control.Add(vChecks);
+  return control.Wait();
+}
+
+static void AcceptToMemoryPoolBatchChunk(
+    const CChainParams &chainparams, CTxMemPool &pool,
+    const std::vector<CTransactionRef> &vtx,
+    const std::vector<int64_t> &vAcceptTime, size_t nBegin, size_t nEnd,
+    bool bypass_limits, const CAmount nAbsurdFee,
+    std::vector<MempoolAcceptResult> &vResults) {
+  std::vector<std::vector<COutPoint>> vCoinsToUncache(vtx.size());
+  int64_t nTimeStart = GetTimeMicros();
+  size_t nChecks = 0;
+
+  LOCK(cs_main);
+
+  if (nScriptCheckThreads && nEnd - nBegin > 1) {
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+      scriptVerifyFlags =
+          gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+
+    std::deque<PrecomputedTransactionData> txdata;
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    {
+      LOCK(pool.cs);
+      CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+      CCoinsViewCache view(&viewMemPool);
+      for (size_t i = nBegin; i < nEnd; i++) {
+        const CTransaction &tx = *vtx[i];
+        if (tx.IsCoinBase())
+          continue;
+        for (const CTxIn &txin : tx.vin) {
+          if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+            vCoinsToUncache[i].push_back(txin.prevout);
+        }
+        if (!view.HaveInputs(tx))
+          continue;
+
+        txdata.emplace_back(tx);
+        std::vector<CScriptCheck> vChecks;
+        CValidationState stateDummy;
+        CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags, true, false,
+                    txdata.back(), &vChecks);
+        nChecks += vChecks.size();
+        control.Add(vChecks);
+        AddCoins(view, tx, MEMPOOL_HEIGHT, true);
+      }
+    }
+    // The queue stops running checks once one fails; the rest are then
+    // only done during acceptance.
+    if (!control.Wait())
+      LogPrint(BCLog::MEMPOOL, "Batch script check failed, signature cache "
+                               "warming stopped early\n");
+  }
+  int64_t nTimeScripts = GetTimeMicros();
+
+  size_t nAccepted = 0;
+  for (size_t i = nBegin; i < nEnd; i++) {
+    MempoolAcceptResult &result = vResults[i];
+    std::vector<COutPoint> coins_to_uncache;
+    result.fAccepted = AcceptToMemoryPoolWorker(
+        chainparams, pool, result.state, vtx[i], &result.fMissingInputs,
+        vAcceptTime[i], nullptr, bypass_limits, nAbsurdFee, coins_to_uncache);
+    if (result.fAccepted) {
+      nAccepted++;
+    } else {
+      for (const COutPoint &outpoint : coins_to_uncache)
+        pcoinsTip->Uncache(outpoint);
+      for (const COutPoint &outpoint : vCoinsToUncache[i])
+        pcoinsTip->Uncache(outpoint);
+    }
+  }
+
+  CValidationState stateDummy;
+  FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+
+  int64_t nTimeEnd = GetTimeMicros();
+  LogPrint(BCLog::MEMPOOL,
+           "Batch accepted %u of %u txn (%u script checks %.2fms, accept "
+           "%.2fms)\n",
+           nAccepted, nEnd - nBegin, nChecks,
+           (nTimeScripts - nTimeStart) * 0.001,
+           (nTimeEnd - nTimeScripts) * 0.001);
+}
+
+static std::vector<MempoolAcceptResult> AcceptToMemoryPoolBatchWithTime(
+    const CChainParams &chainparams, CTxMemPool &pool,
+    const std::vector<CTransactionRef> &vtx,
+    const std::vector<int64_t> &vAcceptTime, bool bypass_limits,
+    const CAmount nAbsurdFee) {
+  assert(vAcceptTime.size() == vtx.size());
+  std::vector<MempoolAcceptResult> vResults(vtx.size());
+  for (size_t nBegin = 0; nBegin < vtx.size();
+       nBegin += MAX_MEMPOOL_BATCH_SIZE) {
+    size_t nEnd = std::min(vtx.size(), nBegin + MAX_MEMPOOL_BATCH_SIZE);
+    AcceptToMemoryPoolBatchChunk(chainparams, pool, vtx, vAcceptTime, nBegin,
+                                 nEnd, bypass_limits, nAbsurdFee, vResults);
+  }
+  return vResults;
+}
+
+std::vector<MempoolAcceptResult>
+AcceptToMemoryPoolBatch(CTxMemPool &pool,
+                        const std::vector<CTransactionRef> &vtx,
+                        bool bypass_limits, const CAmount nAbsurdFee) {
+  return AcceptToMemoryPoolBatchWithTime(
+      Params(), pool, vtx, std::vector<int64_t>(vtx.size(), GetTime()),
+      bypass_limits, nAbsurdFee);
+}
+
 VersionBitsCache versionbitscache;
 
 int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev,
@@ -2110,6 +2374,7 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nTimeFeeEstimator = 0;
 
 struct PerBlockConnectTrace {
   CBlockIndex *pindex = nullptr;
@@ -2161,6 +2426,52 @@ public:
   }
 };
 
+void CachePrecheckedBlock(const std::shared_ptr<const CBlock> &pblock) {
+  LOCK(cs_main);
+  BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+  if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA) ||
+      mi->second->nHeight <= chainActive.Height())
+    return;
+  const int nHeight = mi->second->nHeight;
+
+  for (auto it = mapPrecheckedBlocks.begin();
+       it != mapPrecheckedBlocks.end();) {
+    if (it->second.first <= chainActive.Height())
+      it = mapPrecheckedBlocks.erase(it);
+    else
+      it++;
+  }
+
+  if (mapPrecheckedBlocks.size() >= MAX_PRECHECKED_BLOCKS) {
+    auto itEvict = std::max_element(
+        mapPrecheckedBlocks.begin(), mapPrecheckedBlocks.end(),
+        [](const decltype(mapPrecheckedBlocks)::value_type &a,
+           const decltype(mapPrecheckedBlocks)::value_type &b) {
+          return a.second.first < b.second.first;
+        });
+    if (itEvict->second.first <= nHeight)
+      return;
+    mapPrecheckedBlocks.erase(itEvict);
+  }
+  mapPrecheckedBlocks.emplace(pblock->GetHash(),
+                              std::make_pair(nHeight, pblock));
+}
+
+static std::shared_ptr<const CBlock> TakePrecheckedBlock(const uint256 &hash) {
+  AssertLockHeld(cs_main);
+  auto it = mapPrecheckedBlocks.find(hash);
+  if (it == mapPrecheckedBlocks.end())
+    return nullptr;
+  // The hive proof must be checked again at the new tip, and other holders
+  // may be reading the cached block, so clear fChecked on a copy. Only the
+  // transaction pointers are copied.
+  std::shared_ptr<CBlock> pblock =
+      std::make_shared<CBlock>(*it->second.second);
+  mapPrecheckedBlocks.erase(it);
+  pblock->fChecked = false;
+  return pblock;
+}
+
 bool CChainState::ConnectTip(CValidationState &state,
                              const CChainParams &chainparams,
                              CBlockIndex *pindexNew,
@@ -2170,14 +2481,15 @@ bool CChainState::ConnectTip(CValidationState &state,
   assert(pindexNew->pprev == chainActive.Tip());
 
   int64_t nTime1 = GetTimeMicros();
-  std::shared_ptr<const CBlock> pthisBlock;
-  if (!pblock) {
+  std::shared_ptr<const CBlock> pthisBlock =
+      TakePrecheckedBlock(pindexNew->GetBlockHash());
+  if (pblock) {
+    pthisBlock = pblock;
+  } else if (!pthisBlock) {
     std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
     if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
       return AbortNode(state, "Failed to read block");
     pthisBlock = pblockNew;
-  } else {
-    pthisBlock = pblock;
   }
   const CBlock &blockConnecting = *pthisBlock;
 
@@ -2222,6 +2534,12 @@ bool CChainState::ConnectTip(CValidationState &state,
 
   mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
   disconnectpool.removeForBlock(blockConnecting.vtx);
+  int64_t nTimeFees = feeEstimator.GetLastBlockUpdateTime();
+  nTimeFeeEstimator += nTimeFees;
+  LogPrint(BCLog::BENCH,
+           "  - Fee estimator update: %.2fms [%.2fs (%.2fms/blk)]\n",
+           nTimeFees * MILLI, nTimeFeeEstimator * MICRO,
+           nTimeFeeEstimator * MILLI / nBlocksTotal);
 
   chainActive.SetTip(pindexNew);
   UpdateTip(pindexNew, chainparams);
@@ -2835,38 +3153,162 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
   return true;
 }
 
+static uint256 GetHeaderPoWHash(const CBlockHeader &block, int nHeight,
+                                const uint256 *phashYespower) {
+  if (!IsYesPower(nHeight))
+    return block.GetPoWHash();
+  return phashYespower ? *phashYespower : block.GetHashYespower();
+}
+
+bool CheckHeaderProofOfWork(const CBlockHeader &block, int nHeight,
+                            const Consensus::Params &consensusParams,
+                            const uint256 *phashYespower) {
+  if (nHeight <= SKIP_BLOCKHEADER_POW || block.IsHiveMined(consensusParams))
+    return true;
+
+  const uint256 hash = GetHeaderPoWHash(block, nHeight, phashYespower);
+  if (nHeight >= nSpeedFork)
+    return CheckProofOfWork2(hash, block.nBits, consensusParams);
+  return CheckProofOfWork(hash, block.nBits, consensusParams);
+}
+
+namespace {
+
+class CHeaderHashCheck {
+private:
+  const CBlockHeader *pheader;
+  uint256 *phash;
+
+public:
+  CHeaderHashCheck() : pheader(nullptr), phash(nullptr) {}
+  CHeaderHashCheck(const CBlockHeader &header, uint256 &hash)
+      : pheader(&header), phash(&hash) {}
+
+  bool operator()() {
+    *phash = pheader->GetHashYespower();
+    return true;
+  }
+
+  void swap(CHeaderHashCheck &check) {
+    std::swap(pheader, check.pheader);
+    std::swap(phash, check.phash);
+  }
+};
+
+} // namespace
+
+static CCheckQueue<CHeaderHashCheck> headerhashqueue(16);
+
+void ThreadHeaderHash() {
+  RenameThread("lightningcashr-hdrhash");
+  headerhashqueue.Thread();
+}
+
+void HashHeadersYespower(const std::vector<CBlockHeader> &headers,
+                         int nFirstHeight,
+                         const Consensus::Params &consensusParams,
+                         std::vector<uint256> &vHashYespower) {
+  std::vector<size_t> vTodo;
+  for (size_t i = 0; i < headers.size(); i++) {
+    const int nHeight = nFirstHeight + i;
+    if (nHeight > SKIP_BLOCKHEADER_POW && IsYesPower(nHeight) &&
+        !headers[i].IsHiveMined(consensusParams))
+      vTodo.push_back(i);
+  }
+  vHashYespower.clear();
+  if (vTodo.empty())
+    return;
+  vHashYespower.resize(headers.size());
+
+  std::vector<CHeaderHashCheck> vChecks;
+  vChecks.reserve(vTodo.size());
+  for (size_t i : vTodo)
+    vChecks.emplace_back(headers[i], vHashYespower[i]);
+  CCheckQueueControl<CHeaderHashCheck> control(&headerhashqueue);
+  control.Add(vChecks);
+  control.Wait();
+}
+
 static bool CheckBlockHeader(const CBlockHeader &block, CValidationState &state,
                              const Consensus::Params &consensusParams,
-                             bool fCheckPOW = true) {
-  CBlockIndex *pindexPrev = NULL;
+                             bool fCheckPOW = true,
+                             const uint256 *phashYespower = nullptr) {
   int nHeight = 0;
   BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
-  if (mi != mapBlockIndex.end()) {
-    pindexPrev = mi->second;
-    nHeight = pindexPrev->nHeight + 1;
+  if (mi != mapBlockIndex.end())
+    nHeight = mi->second->nHeight + 1;
+
+  if (fCheckPOW && !CheckHeaderProofOfWork(block, nHeight, consensusParams,
+                                           phashYespower))
+    return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
+                     "proof of work failed");
+
+  return true;
+}
+
+static bool IsHiveProofChecked(const uint256 &hashBlock,
+                               const CBlockIndex *pindexTip) {
+  LOCK(cs_main);
+  return hashHiveCheckedTip == pindexTip->GetBlockHash() &&
+         setHiveCheckedBlocks.count(hashBlock);
+}
+
+void MarkHiveProofChecked(const uint256 &hashBlock,
+                          const CBlockIndex *pindexTip) {
+  LOCK(cs_main);
+  if (hashHiveCheckedTip != pindexTip->GetBlockHash()) {
+    hashHiveCheckedTip = pindexTip->GetBlockHash();
+    setHiveCheckedBlocks.clear();
   }
+  setHiveCheckedBlocks.insert(hashBlock);
+}
 
-  if (nHeight <= SKIP_BLOCKHEADER_POW)
+bool CheckBlockHiveProof(const CBlock &block, CValidationState &state,
+                         const Consensus::Params &consensusParams,
+                         const CBlockIndex *pindexTip) {
+  // The proof depends on the coins at the tip, so a pass only holds there.
+  const uint256 hashBlock = block.GetHash();
+  if (IsHiveProofChecked(hashBlock, pindexTip))
     return true;
+  const int nTipHeight = pindexTip->nHeight;
 
-  if (nHeight >= nSpeedFork) {
-    if (fCheckPOW && !block.IsHiveMined(consensusParams)) {
-      if (!CheckProofOfWork2(IsYesPower(nHeight) ? block.GetHashYespower()
-                                                 : block.GetPoWHash(),
-                             block.nBits, consensusParams))
-        return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
-                         "proof of work failed");
-    }
-  } else {
-    if (fCheckPOW && !block.IsHiveMined(consensusParams)) {
-      if (!CheckProofOfWork(IsYesPower(nHeight) ? block.GetHashYespower()
-                                                : block.GetPoWHash(),
-                            block.nBits, consensusParams))
-        return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
-                         "proof of work failed");
-    }
+  if (nTipHeight >= nAdjustFork) {
+    if (!CheckHiveProof3(&block, consensusParams))
+      return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
+                       "proof of hive failed");
+  }
+
+  if ((nTipHeight >= nSpeedFork) && (nTipHeight < nAdjustFork)) {
+    if (!CheckHiveProof(&block, consensusParams))
+      return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
+                       "proof of hive failed");
   }
 
+  if ((consensusParams.variableBeecost) &&
+      ((nTipHeight - 1) >= (consensusParams.variableForkBlock)) &&
+      ((nTipHeight - 1) >= (consensusParams.remvariableForkBlock)) &&
+      (nTipHeight < nSpeedFork)) {
+    if (!CheckHiveProof3(&block, consensusParams))
+      return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
+                       "proof of hive failed");
+  }
+  if ((consensusParams.variableBeecost) &&
+      ((nTipHeight - 1) >= (consensusParams.variableForkBlock)) &&
+      ((nTipHeight - 1) < (consensusParams.remvariableForkBlock)) &&
+      (nTipHeight < nSpeedFork)) {
+    if (!CheckHiveProof2(&block, consensusParams))
+      return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
+                       "proof of hive failed");
+  }
+  if ((consensusParams.variableBeecost) &&
+      ((nTipHeight - 1) < (consensusParams.variableForkBlock)) &&
+      (nTipHeight < nSpeedFork)) {
+    if (!CheckHiveProof(&block, consensusParams))
+      return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
+                       "proof of hive failed");
+  }
+
+  MarkHiveProofChecked(hashBlock, pindexTip);
   return true;
 }
 
@@ -2876,56 +3318,34 @@ bool CheckBlock(const CBlock &block, CValidationState &state,
   if (block.fChecked)
     return true;
 
-  if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
+  if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW,
+                        block.GetCachedHashYespower()))
     return false;
 
   if (block.IsHiveMined(consensusParams)) {
-    if ((chainActive.Tip()->nHeight) < SKIP_BLOCKHEADER_POW)
+    const CBlockIndex *pindexTip;
+    {
+      LOCK(cs_main);
+      pindexTip = chainActive.Tip();
+    }
+    if (pindexTip->nHeight < SKIP_BLOCKHEADER_POW)
       return true;
 
-    if ((chainActive.Tip()->nHeight) >= nAdjustFork) {
-      if (!CheckHiveProof3(&block, consensusParams))
-        return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
-                         "proof of hive failed");
-    }
-
-    if (((chainActive.Tip()->nHeight) >= nSpeedFork) &&
-        ((chainActive.Tip()->nHeight) < nAdjustFork)) {
-      if (!CheckHiveProof(&block, consensusParams))
-        return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
-                         "proof of hive failed");
-    }
-
-    if ((consensusParams.variableBeecost) &&
-        (((chainActive.Tip()->nHeight) - 1) >=
-         (consensusParams.variableForkBlock)) &&
-        (((chainActive.Tip()->nHeight) - 1) >=
-         (consensusParams.remvariableForkBlock)) &&
-        ((chainActive.Tip()->nHeight) < nSpeedFork)) {
-      if (!CheckHiveProof3(&block, consensusParams))
-        return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
-                         "proof of hive failed");
-    }
-    if ((consensusParams.variableBeecost) &&
-        (((chainActive.Tip()->nHeight) - 1) >=
-         (consensusParams.variableForkBlock)) &&
-        (((chainActive.Tip()->nHeight) - 1) <
-         (consensusParams.remvariableForkBlock)) &&
-        ((chainActive.Tip()->nHeight) < nSpeedFork)) {
-      if (!CheckHiveProof2(&block, consensusParams))
-        return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
-                         "proof of hive failed");
-    }
-    if ((consensusParams.variableBeecost) &&
-        (((chainActive.Tip()->nHeight) - 1) <
-         (consensusParams.variableForkBlock)) &&
-        ((chainActive.Tip()->nHeight) < nSpeedFork)) {
-      if (!CheckHiveProof(&block, consensusParams))
-        return state.DoS(100, false, REJECT_INVALID, "bad-hive-proof", false,
-                         "proof of hive failed");
-    }
+    if (!CheckBlockHiveProof(block, state, consensusParams, pindexTip))
+      return false;
   }
 
+  if (!block.fBodyChecked && !CheckBlockBody(block, state, fCheckMerkleRoot))
+    return false;
+
+  if (fCheckPOW && fCheckMerkleRoot)
+    block.fChecked = true;
+
+  return true;
+}
+
+bool CheckBlockBody(const CBlock &block, CValidationState &state,
+                    bool fCheckMerkleRoot) {
   if (fCheckMerkleRoot) {
     bool mutated;
     uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
@@ -2971,8 +3391,8 @@ bool CheckBlock(const CBlock &block, CValidationState &state,
     return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false,
                      "out-of-bounds SigOpCount");
 
-  if (fCheckPOW && fCheckMerkleRoot)
-    block.fChecked = true;
+  if (fCheckMerkleRoot)
+    block.fBodyChecked = true;
 
   return true;
 }
@@ -3267,7 +3687,8 @@ static bool ContextualCheckBlock(const CBlock &block, CValidationState &state,
 bool CChainState::AcceptBlockHeader(const CBlockHeader &block,
                                     CValidationState &state,
                                     const CChainParams &chainparams,
-                                    CBlockIndex **ppindex) {
+                                    CBlockIndex **ppindex,
+                                    const uint256 *phashYespower) {
   AssertLockHeld(cs_main);
 
   uint256 hash = block.GetHash();
@@ -3285,7 +3706,8 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader &block,
       return true;
     }
 
-    if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+    if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), true,
+                          phashYespower))
       return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__,
                    hash.ToString(), FormatStateMessage(state));
 
@@ -3334,16 +3756,41 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader> &headers,
                             CValidationState &state,
                             const CChainParams &chainparams,
                             const CBlockIndex **ppindex,
-                            CBlockHeader *first_invalid) {
+                            CBlockHeader *first_invalid,
+                            const std::vector<uint256> *pvHashYespower) {
   if (first_invalid != nullptr)
     first_invalid->SetNull();
+
+  // Proof of work hashes of new headers are computed on the header hash
+  // threads before cs_main is taken.
+  std::vector<uint256> vHashYespower;
+  if (!pvHashYespower && !headers.empty()) {
+    int nFirstHeight = -1;
+    {
+      LOCK(cs_main);
+      BlockMap::iterator mi = mapBlockIndex.find(headers[0].hashPrevBlock);
+      if (mi != mapBlockIndex.end() &&
+          !mapBlockIndex.count(headers.back().GetHash()))
+        nFirstHeight = mi->second->nHeight + 1;
+    }
+    if (nFirstHeight >= 0)
+      HashHeadersYespower(headers, nFirstHeight, chainparams.GetConsensus(),
+                          vHashYespower);
+    pvHashYespower = &vHashYespower;
+  }
+
   {
     LOCK(cs_main);
-    for (const CBlockHeader &header : headers) {
+    for (size_t i = 0; i < headers.size(); i++) {
+      const CBlockHeader &header = headers[i];
       CBlockIndex *pindex = nullptr;
+      const uint256 *phashYespower = nullptr;
+      if (pvHashYespower && i < pvHashYespower->size() &&
+          !(*pvHashYespower)[i].IsNull())
+        phashYespower = &(*pvHashYespower)[i];
 
-      if (!g_chainstate.AcceptBlockHeader(header, state, chainparams,
-                                          &pindex)) {
+      if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex,
+                                          phashYespower)) {
         if (first_invalid)
           *first_invalid = header;
         return false;
@@ -3392,7 +3839,8 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock> &pblock,
   CBlockIndex *pindexDummy = nullptr;
   CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-  if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+  if (!AcceptBlockHeader(block, state, chainparams, &pindex,
+                         block.GetCachedHashYespower()))
     return false;
 
   bool fAlreadyHave = pindex->nStatus & BLOCK_HAVE_DATA;
@@ -3457,11 +3905,56 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock> &pblock,
   return true;
 }
 
+bool CanRelayHiveBlockEarly(const CBlock &block, const CBlockIndex *pindexTip,
+                            bool fInitialDownload,
+                            const Consensus::Params &consensusParams) {
+  if (fInitialDownload || !pindexTip ||
+      pindexTip->GetBlockHash() != block.hashPrevBlock ||
+      pindexTip->nHeight < SKIP_BLOCKHEADER_POW)
+    return false;
+
+  CValidationState state;
+  if (!CheckBlockHiveProof(block, state, consensusParams, pindexTip))
+    return false;
+  bool mutated;
+  return BlockMerkleRoot(block, &mutated) == block.hashMerkleRoot && !mutated;
+}
+
+/** A hive block only wins if it reaches the network before the next PoW block,
+ * so announce it to high bandwidth peers as soon as its header and hive proof
+ * are known good, ahead of the body checks and connecting it. */
+static void RelayHiveBlockEarly(const std::shared_ptr<const CBlock> &pblock,
+                                const CChainParams &chainparams) {
+  const CBlock &block = *pblock;
+  const CBlockIndex *pindexTip;
+  bool fInitialDownload;
+  {
+    LOCK(cs_main);
+    pindexTip = chainActive.Tip();
+    fInitialDownload = IsInitialBlockDownload();
+  }
+  if (!CanRelayHiveBlockEarly(block, pindexTip, fInitialDownload,
+                              chainparams.GetConsensus()))
+    return;
+
+  LOCK(cs_main);
+  CValidationState state;
+  CBlockIndex *pindex = nullptr;
+  if (!g_chainstate.AcceptBlockHeader(block, state, chainparams, &pindex,
+                                      block.GetCachedHashYespower()) ||
+      (pindex->nStatus & BLOCK_HAVE_DATA) || chainActive.Tip() != pindex->pprev)
+    return;
+  GetMainSignals().NewPoWValidBlock(pindex, pblock);
+}
+
 bool ProcessNewBlock(const CChainParams &chainparams,
                      const std::shared_ptr<const CBlock> pblock,
                      bool fForceProcessing, bool *fNewBlock) {
   AssertLockNotHeld(cs_main);
 
+  if (fHiveFastRelay && pblock->IsHiveMined(chainparams.GetConsensus()))
+    RelayHiveBlockEarly(pblock, chainparams);
+
   {
     CBlockIndex *pindex = nullptr;
     if (fNewBlock)
@@ -3567,6 +4060,7 @@ void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
   for (std::set<int>::iterator it = setFilesToPrune.begin();
        it != setFilesToPrune.end(); ++it) {
     CDiskBlockPos pos(*it, 0);
+    g_blockfile_mmap.Erase(*it);
     fs::remove(GetBlockPosFilename(pos, "blk"));
     fs::remove(GetBlockPosFilename(pos, "rev"));
     LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4174,6 +4668,9 @@ void UnloadBlockIndex() {
   pindexBestHeader = nullptr;
   mempool.clear();
   mapBlocksUnlinked.clear();
+  mapPrecheckedBlocks.clear();
+  hashHiveCheckedTip.SetNull();
+  setHiveCheckedBlocks.clear();
   vinfoBlockFile.clear();
   nLastBlockFile = 0;
   setDirtyBlockIndex.clear();
@@ -4244,44 +4741,21 @@ bool LoadExternalBlockFile(const CChainParams &chainparams, FILE *fileIn,
 
   int nLoaded = 0;
   try {
-    CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SERIALIZED_SIZE,
-                         MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK,
-                         CLIENT_VERSION);
-    uint64_t nRewind = blkdat.GetPos();
-    while (!blkdat.eof()) {
+    CBlockImportPipeline pipeline(chainparams, fileIn, nImportThreads);
+    CImportedBlock imported;
+    while (pipeline.Next(imported)) {
       boost::this_thread::interruption_point();
 
-      blkdat.SetPos(nRewind);
-      nRewind++;
-
-      blkdat.SetLimit();
-
-      unsigned int nSize = 0;
-      try {
-        unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-        blkdat.FindByte(chainparams.MessageStart()[0]);
-        nRewind = blkdat.GetPos() + 1;
-        blkdat >> FLATDATA(buf);
-        if (memcmp(buf, chainparams.MessageStart(),
-                   CMessageHeader::MESSAGE_START_SIZE))
-          continue;
-
-        blkdat >> nSize;
-        if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-          continue;
-      } catch (const std::exception &) {
-        break;
+      if (dbp)
+        dbp->nPos = imported.nBlockPos;
+      if (!imported.pblock) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                  imported.strError);
+        continue;
       }
       try {
-        uint64_t nBlockPos = blkdat.GetPos();
-        if (dbp)
-          dbp->nPos = nBlockPos;
-        blkdat.SetLimit(nBlockPos + nSize);
-        blkdat.SetPos(nBlockPos);
-        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        std::shared_ptr<CBlock> pblock = std::move(imported.pblock);
         CBlock &block = *pblock;
-        blkdat >> block;
-        nRewind = blkdat.GetPos();
 
         uint256 hash = block.GetHash();
         if (hash != chainparams.GetConsensus().hashGenesisBlock &&
@@ -4299,9 +4773,12 @@ bool LoadExternalBlockFile(const CChainParams &chainparams, FILE *fileIn,
             (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
           LOCK(cs_main);
           CValidationState state;
-          if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr,
+          CBlockIndex *pindex = nullptr;
+          if (g_chainstate.AcceptBlock(pblock, state, chainparams, &pindex,
                                        true, dbp, nullptr))
             nLoaded++;
+          if (pindex)
+            pipeline.SetHeightHint(pindex->nHeight);
           if (state.IsError())
             break;
         } else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
@@ -4603,7 +5080,12 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params &params,
                                      versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHUNKS = 1;
+// Older nodes only read version 1 and start with an empty mempool when they
+// find a version 2 file.
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+static const uint32_t MEMPOOL_DUMP_CHUNK_SIZE = 1000;
 
 bool LoadMempool(void) {
   const CChainParams &chainparams = Params();
@@ -4621,43 +5103,68 @@ bool LoadMempool(void) {
   int64_t failed = 0;
   int64_t already_there = 0;
   int64_t nNow = GetTime();
+  int64_t nTimeStart = GetTimeMicros();
+  int64_t nTimeAccept = 0;
 
   try {
     uint64_t version;
     file >> version;
-    if (version != MEMPOOL_DUMP_VERSION) {
+    if (version != MEMPOOL_DUMP_VERSION &&
+        version != MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
       return false;
     }
-    uint64_t num;
-    file >> num;
-    while (num--) {
-      CTransactionRef tx;
-      int64_t nTime;
-      int64_t nFeeDelta;
-      file >> tx;
-      file >> nTime;
-      file >> nFeeDelta;
-
-      CAmount amountdelta = nFeeDelta;
-      if (amountdelta) {
-        mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+    uint64_t num = 0;
+    if (version == MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
+      file >> num;
+    }
+    while (true) {
+      uint32_t nChunk;
+      if (version == MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
+        nChunk = std::min<uint64_t>(num, MEMPOOL_DUMP_CHUNK_SIZE);
+        num -= nChunk;
+      } else {
+        file >> nChunk;
+      }
+      if (nChunk == 0)
+        break;
+
+      std::vector<CTransactionRef> vtx;
+      std::vector<int64_t> vAcceptTime;
+      vtx.reserve(std::min(nChunk, MEMPOOL_DUMP_CHUNK_SIZE));
+      vAcceptTime.reserve(std::min(nChunk, MEMPOOL_DUMP_CHUNK_SIZE));
+      while (nChunk--) {
+        CTransactionRef tx;
+        int64_t nTime;
+        int64_t nFeeDelta;
+        file >> tx;
+        file >> nTime;
+        file >> nFeeDelta;
+
+        CAmount amountdelta = nFeeDelta;
+        if (amountdelta) {
+          mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        }
+        if (nTime + nExpiryTimeout > nNow) {
+          vtx.push_back(tx);
+          vAcceptTime.push_back(nTime);
+        } else {
+          ++expired;
+        }
       }
-      CValidationState state;
-      if (nTime + nExpiryTimeout > nNow) {
-        LOCK(cs_main);
-        AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr,
-                                   nTime, nullptr, false, 0);
-        if (state.IsValid()) {
+
+      int64_t nTimeBatch = GetTimeMicros();
+      std::vector<MempoolAcceptResult> vResults =
+          AcceptToMemoryPoolBatchWithTime(chainparams, mempool, vtx,
+                                          vAcceptTime, false, 0);
+      nTimeAccept += GetTimeMicros() - nTimeBatch;
+      for (size_t i = 0; i < vtx.size(); i++) {
+        if (vResults[i].fAccepted) {
           ++count;
+        } else if (mempool.exists(vtx[i]->GetHash())) {
+          ++already_there;
         } else {
-          if (mempool.exists(tx->GetHash())) {
-            ++already_there;
-          } else {
-            ++failed;
-          }
+          ++failed;
         }
-      } else {
-        ++expired;
       }
       if (ShutdownRequested())
         return false;
@@ -4676,8 +5183,9 @@ bool LoadMempool(void) {
   }
 
   LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, "
-            "%i expired, %i already there\n",
-            count, failed, expired, already_there);
+            "%i expired, %i already there (%.2fs, %.2fs accepting)\n",
+            count, failed, expired, already_there,
+            (GetTimeMicros() - nTimeStart) * MICRO, nTimeAccept * MICRO);
   return true;
 }
 
@@ -4708,13 +5216,19 @@ bool DumpMempool(void) {
     uint64_t version = MEMPOOL_DUMP_VERSION;
     file << version;
 
-    file << (uint64_t)vinfo.size();
-    for (const auto &i : vinfo) {
-      file << *(i.tx);
-      file << (int64_t)i.nTime;
-      file << (int64_t)i.nFeeDelta;
-      mapDeltas.erase(i.tx->GetHash());
+    for (size_t nPos = 0; nPos < vinfo.size();) {
+      uint32_t nChunk = std::min<size_t>(vinfo.size() - nPos,
+                                         MEMPOOL_DUMP_CHUNK_SIZE);
+      file << nChunk;
+      for (; nChunk > 0; nChunk--, nPos++) {
+        const TxMempoolInfo &i = vinfo[nPos];
+        file << *(i.tx);
+        file << (int64_t)i.nTime;
+        file << (int64_t)i.nFeeDelta;
+        mapDeltas.erase(i.tx->GetHash());
+      }
     }
+    file << (uint32_t)0;
 
     file << mapDeltas;
     FileCommit(file.Get());
@@ -12,6 +12,7 @@
 
 #include <amount.h>
 #include <coins.h>
+#include <consensus/validation.h>
 #include <fs.h>
 #include <protocol.h>
 
@@ -77,12 +78,17 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000;
 
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000;
 
+static const unsigned int BLOCK_DISK_HEADER_SIZE =
+    CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+
 static const int SKIP_BLOCKHEADER_POW = 5472830;
 
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 
+static const unsigned int MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS = 32;
+
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 2048;
 
 static const unsigned int BLOCK_STALLING_TIMEOUT = 4;
@@ -95,6 +101,8 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
 
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 
+static const unsigned int MAX_PRECHECKED_BLOCKS = 64;
+
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
@@ -133,6 +141,10 @@ static const bool DEFAULT_ENABLE_REPLACEMENT = false;
 
 static const bool DEFAULT_FEEFILTER = true;
 
+/** Default for -hiverelay, announcing hive blocks to high bandwidth peers once
+ * their header and hive proof check out */
+static const bool DEFAULT_HIVE_FAST_RELAY = true;
+
 /** Default for -introspectionhardening, controls stale fork detection and deep
  * reorg gating */
 static const bool DEFAULT_ENABLE_INTROSPECTION_HARDENING = true;
@@ -171,6 +183,7 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+extern bool fHiveFastRelay;
 extern size_t nCoinCacheUsage;
 
 extern CFeeRate minRelayTxFee;
@@ -217,7 +230,9 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader> &block,
                             CValidationState &state,
                             const CChainParams &chainparams,
                             const CBlockIndex **ppindex = nullptr,
-                            CBlockHeader *first_invalid = nullptr);
+                            CBlockHeader *first_invalid = nullptr,
+                            const std::vector<uint256> *pvHashYespower =
+                                nullptr);
 
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 
@@ -238,6 +253,16 @@ void UnloadBlockIndex();
 
 void ThreadScriptCheck();
 
+void ThreadHeaderHash();
+
+/** Verify tx's input scripts on the script check threads. Only reports whether
+ * all of them passed; use CheckInputs for the reject reason. Requires cs_main.
+ */
+bool CheckInputScriptsParallel(const CTransaction &tx,
+                               const CCoinsViewCache &inputs,
+                               unsigned int flags, bool cacheSigStore,
+                               PrecomputedTransactionData &txdata);
+
 bool IsInitialBlockDownload();
 
 bool GetTransaction(const uint256 &hash, CTransactionRef &tx,
@@ -270,6 +295,28 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state,
                         std::list<CTransactionRef> *plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+struct MempoolAcceptResult {
+  CValidationState state;
+  bool fAccepted;
+  bool fMissingInputs;
+
+  MempoolAcceptResult() : fAccepted(false), fMissingInputs(false) {}
+};
+
+/** Transactions AcceptToMemoryPoolBatch handles per cs_main acquisition. */
+static const size_t MAX_MEMPOOL_BATCH_SIZE = 250;
+
+/** Accept a batch of transactions, taking cs_main once per
+ * MAX_MEMPOOL_BATCH_SIZE of them; callers should not hold it. The script
+ * checks of each chunk are first run in parallel on the script check threads
+ * to warm the signature cache, then each transaction goes through the
+ * regular mempool acceptance in order, so later transactions may spend
+ * earlier ones. */
+std::vector<MempoolAcceptResult>
+AcceptToMemoryPoolBatch(CTxMemPool &pool,
+                        const std::vector<CTransactionRef> &vtx,
+                        bool bypass_limits, const CAmount nAbsurdFee);
+
 std::string FormatStateMessage(const CValidationState &state);
 
 ThresholdState VersionBitsTipState(const Consensus::Params &params,
@@ -333,11 +380,45 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Consensus::Params &consensusParams);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Consensus::Params &consensusParams);
+bool ReadRawBlockFromDisk(std::vector<unsigned char> &block,
+                          const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageStartChars &messageStart);
 
 bool CheckBlock(const CBlock &block, CValidationState &state,
                 const Consensus::Params &consensusParams, bool fCheckPOW = true,
                 bool fCheckMerkleRoot = true);
 
+bool CheckBlockBody(const CBlock &block, CValidationState &state,
+                    bool fCheckMerkleRoot = true);
+
+/** Check the hive proof of block on top of pindexTip, which the caller reads
+ * from chainActive under cs_main. */
+bool CheckBlockHiveProof(const CBlock &block, CValidationState &state,
+                         const Consensus::Params &consensusParams,
+                         const CBlockIndex *pindexTip);
+
+/** Whether hive-mined block may be announced ahead of validation: it extends
+ * pindexTip, its hive proof holds there and its merkle root matches. */
+bool CanRelayHiveBlockEarly(const CBlock &block, const CBlockIndex *pindexTip,
+                            bool fInitialDownload,
+                            const Consensus::Params &consensusParams);
+
+/** Check the proof of work of a header at nHeight against its own nBits,
+ * using phashYespower if already computed. */
+bool CheckHeaderProofOfWork(const CBlockHeader &block, int nHeight,
+                            const Consensus::Params &consensusParams,
+                            const uint256 *phashYespower = nullptr);
+
+/** Compute the yespower hashes of headers starting at nFirstHeight whose
+ * proof of work is checked, on the header hash threads. vHashYespower is left
+ * empty if there are none, and null for the other headers. */
+void HashHeadersYespower(const std::vector<CBlockHeader> &headers,
+                         int nFirstHeight,
+                         const Consensus::Params &consensusParams,
+                         std::vector<uint256> &vHashYespower);
+
+void CachePrecheckedBlock(const std::shared_ptr<const CBlock> &pblock);
+
 bool TestBlockValidity(CValidationState &state, const CChainParams &chainparams,
                        const CBlock &block, CBlockIndex *pindexPrev,
                        bool fCheckPOW = true, bool fCheckMerkleRoot = true);